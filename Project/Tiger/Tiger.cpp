@@ -1,15 +1,27 @@
 #include <iostream>
 #include <fstream>
+#include <cstdlib>
 #include "src/driver.h"
 #include "src/Semantic.h"
 #include "src/PrintIRTree.h"
+#include "src/Canon.h"
+#include "src/IRBinary.h"
+#include "src/Linear.h"
+#include "src/Codegen.h"
+#include "src/RegAlloc.h"
+#include "src/Emit.h"
+#include "src/Elf.h"
+#include "src/Jit.h"
+#include "src/Bytecode.h"
+#include "src/Vm.h"
+#include "src/CSource.h"
 #include "src/cmdline.h"
+#include "src/ThreadPool.h"
 
 using namespace std;
 
 int main(int argc, char *argv[])
 {
-    std::cout << "Tiger Compiler" << std::endl;
     Tiger::Driver driver;
 
     // Make arguments
@@ -19,9 +31,41 @@ int main(int argc, char *argv[])
     cmd.add("trace_parsing", 'p', "trace parsing process");
     cmd.add("trace_scanning", 's', "trace scanning process");
     cmd.add("graph_viz", 'g', "use GraphViz's dot language as output");
+    cmd.add("canon", 'C', "print canonicalized IR trees");
+    cmd.add("linear", 'L', "print the linear three-address form of every function");
+    cmd.add("asm", 'a', "write x86-64 assembly, to link with bin/libtigerrt.a");
+    cmd.add("object", 'x', "write an x86-64 ELF object instead of assembly, to link with bin/libtigerrt.a");
+    cmd.add("run", 'r', "compile into memory and run the program, writing no files");
+    cmd.add("perf_map", 'P', "with --run, write /tmp/perf-<pid>.map for perf, as TIGER_PERF_MAP set does too");
+    cmd.add("c_source", 'e', "write portable C with its runtime, to build with cc -O2");
+    cmd.add("vm", 'v', "compile to bytecode and interpret it, writing no files");
+    cmd.add("bytecode", 'B', "print the bytecode the interpreter runs");
+    cmd.add("linear_select", 'M', "with --asm or --object, select instructions from the linear form instead of tiling");
+    cmd.add("regalloc_stats", 'R', "with --asm or --object, print the spilled temps and eliminated moves of every function");
+    cmd.add<int>("optimize", 'O', "with --asm, --object or --run, optimization level: 0 and 1 allocate registers by linear scan", false, 2);
+    cmd.add<int>("jobs", 'j', "number of threads to compile with", false, 1);
+    cmd.add("binary", 'b', "write the IR in binary form");
+    cmd.add<std::string>("load_ir", 'l', "read the IR from a binary file instead of compiling", false, "");
+    cmd.add<std::string>("dot_dir", 'd', "write each function as a dot file into this directory", false, "");
+    cmd.add<int>("dot_max_nodes", 'n', "with --dot_dir, skip functions of more IR nodes (0: no limit)", false, 0);
+    cmd.add("collapse_seq", 'S', "with --dot_dir, draw SEQs nested in a SEQ as one node");
 
-    // Check arguments
-    cmd.parse_check(argc, argv);
+    // Check arguments. The parser reads -O0 as the flags O and 0, so
+    // spell it out.
+    std::vector<std::string> args(argv, argv + argc);
+    for (auto &arg : args)
+    {
+        if (arg.size() > 2 && arg.compare(0, 2, "-O") == 0)
+        {
+            arg = "--optimize=" + arg.substr(2);
+        }
+    }
+    cmd.parse_check(args);
+    // The program's output is all --run and --vm print
+    if (!cmd.exist("run") && !cmd.exist("vm"))
+    {
+        std::cout << "Tiger Compiler" << std::endl;
+    }
     if (cmd.exist("trace_parsing"))
     {
         driver.trace_parsing = true;
@@ -32,19 +76,103 @@ int main(int argc, char *argv[])
     }
     std::string out_file_name = cmd.get<std::string>("out_file_name");
     std::string compile_file_name = cmd.get<std::string>("compile_file_name");
+    // As in tiger --run prog.tig
+    if (!cmd.exist("compile_file_name") && !cmd.rest().empty())
+    {
+        compile_file_name = cmd.rest()[0];
+    }
+    ThreadPool::setThreadNum(cmd.get<int>("jobs"));
 
-    // Start to compile
-    driver.parse(compile_file_name);
-    auto result = driver.result;
-    if (driver.syntaxError)
+    std::shared_ptr<Frame::FragList> fragList;
+    IRBinary::Reader reader;
+    if (!cmd.get<std::string>("load_ir").empty())
+    {
+        if (!reader.open(cmd.get<std::string>("load_ir")))
+        {
+            exit(1);
+        }
+        fragList = reader.load();
+    }
+    else
+    {
+        // Start to compile
+        driver.parse(compile_file_name);
+        auto result = driver.result;
+        if (driver.syntaxError)
+        {
+            std::cerr << "Tiger compiler exit with syntax error." << std::endl;
+            exit(1);
+        }
+        fragList = Semantic::transProg(result);
+    }
+    if (cmd.exist("canon") || cmd.exist("linear") || cmd.exist("asm") || cmd.exist("object") ||
+        cmd.exist("run") || cmd.exist("vm") || cmd.exist("bytecode") || cmd.exist("c_source"))
     {
-        std::cerr << "Tiger compiler exit with syntax error." << std::endl;
-        exit(1);
+        Canon::canonicalize(fragList);
     }
-    auto fragList = Semantic::transProg(result);
-    ofstream fo(out_file_name, ios::out);
     PrintIRTree printer(fragList);
-    if(cmd.exist("graph_viz"))
+    if (!cmd.get<std::string>("dot_dir").empty())
+    {
+        printer.makeDotFiles(cmd.get<std::string>("dot_dir"), cmd.get<int>("dot_max_nodes"),
+                             cmd.exist("collapse_seq"));
+        return 0;
+    }
+    if (cmd.exist("run"))
+    {
+        auto allocation = cmd.get<int>("optimize") < 2 ? Codegen::LINEAR_SCAN : Codegen::COLORING;
+        auto functions = Codegen::generate(fragList, Codegen::TILE, allocation);
+        // Nothing runs that did not compile cleanly
+        if (Tiger::Error::any())
+        {
+            return 1;
+        }
+        return Jit::run(*fragList, *functions, cmd.exist("perf_map") || std::getenv("TIGER_PERF_MAP"));
+    }
+    if (cmd.exist("vm"))
+    {
+        auto program = Bytecode::compile(*fragList, *Linear::lower(fragList));
+        if (Tiger::Error::any())
+        {
+            return 1;
+        }
+        return Vm::run(*program);
+    }
+    ofstream fo(out_file_name, ios::out | ios::binary);
+    if (cmd.exist("binary"))
+    {
+        IRBinary::write(fragList, fo);
+    }
+    else if (cmd.exist("linear"))
+    {
+        Linear::print(*Linear::lower(fragList), fo);
+    }
+    else if (cmd.exist("c_source"))
+    {
+        CSource::writeProgram(*fragList, *Linear::lower(fragList), fo);
+    }
+    else if (cmd.exist("bytecode"))
+    {
+        Bytecode::print(*Bytecode::compile(*fragList, *Linear::lower(fragList)), fo);
+    }
+    else if (cmd.exist("asm") || cmd.exist("object"))
+    {
+        auto selection = cmd.exist("linear_select") ? Codegen::LINEAR : Codegen::TILE;
+        auto allocation = cmd.get<int>("optimize") < 2 ? Codegen::LINEAR_SCAN : Codegen::COLORING;
+        auto functions = Codegen::generate(fragList, selection, allocation);
+        if (cmd.exist("object"))
+        {
+            Elf::writeObject(*fragList, *functions, fo);
+        }
+        else
+        {
+            Emit::writeAssembly(*fragList, *functions, fo);
+        }
+        if (cmd.exist("regalloc_stats"))
+        {
+            RegAlloc::printStats(*functions, std::cout);
+        }
+    }
+    else if(cmd.exist("graph_viz"))
     {
         printer.makeDotFile(fo);
     }
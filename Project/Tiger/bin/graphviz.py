@@ -37,6 +37,10 @@ def print_graphs(file_path):
 
 if __name__ == '__main__':
     filename = sys.argv[1]
-    path = filename.split('.')[0]
-    split_files(filename)
-    print_graphs(path)
+    if os.path.isdir(filename):
+        # Written by tiger --dot_dir, already one graph per file
+        print_graphs(filename)
+    else:
+        path = filename.split('.')[0]
+        split_files(filename)
+        print_graphs(path)
@@ -0,0 +1,1112 @@
+//
+// Garbage collected heap of the runtime
+//
+
+#include "gc.h"
+#include "runtime.h"
+#include <algorithm>
+#include <chrono>
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+#ifdef __GLIBC__
+// Where the stack of the main thread began, which the dynamic linker keeps
+extern "C" void *__libc_stack_end;
+#endif
+
+int64_t *tiger_cardTable = nullptr;
+uint64_t *tiger_callerFrame = nullptr;
+
+namespace Gc
+{
+    char *next = nullptr;
+    char *limit = nullptr;
+    uint8_t *objectMap = nullptr;
+    char *heapBase = nullptr;
+    char *heapEnd = nullptr;
+
+    namespace
+    {
+        // The heap is one reservation the system backs as it is written: the
+        // nursery, then the old generation, which grows up from its base
+        const size_t MAX_HEAP = (size_t) 16 << 30;
+        const size_t MIN_HEAP = (size_t) 1 << 30;
+        const size_t NURSERY_SIZE = (size_t) 4 << 20;
+        const size_t MIN_NURSERY_SIZE = (size_t) 64 << 10;
+        // Old generation bytes past which a major collection runs, at least
+        const size_t MIN_MAJOR = (size_t) 64 << 20;
+        // A card is the unit the write barrier marks
+        const int CARD_SHIFT = TIGER_CARD_SHIFT;
+        const size_t CARD_SIZE = (size_t) 1 << CARD_SHIFT;
+        // Where the old generation keeps a forwarding address while it
+        // compacts, in words from the heap's base
+        const int FORWARD_SHIFT = 32;
+        // Smallest space between pinned old objects worth promoting into
+        const size_t MIN_HOLE = (size_t) 4 << 10;
+        // Slices that alone keep a string get copies of their parts when
+        // they hold less than this share of its characters, 1 / SLICED
+        const int64_t SLICED = 4;
+        // Where in tiger_callerFrame each of Frame::CALLEE_SAVES is, and the
+        // frame pointer and return address
+        const int SAVED_REGISTERS[] = {5, 3, 2, 1, 0};
+        const int SAVED_REGISTER_COUNT = 5;
+        const int SAVED_FRAME = 4;
+        const int SAVED_RETURN = 6;
+
+        struct Range
+        {
+            char *begin;
+            char *end;
+        };
+
+        size_t nurserySize;
+        char *oldBase;
+        char *oldTop;
+        // Memory from here up has not been written since the system gave it
+        char *oldClean;
+        // Bytes of the old generation objects take
+        size_t oldUsed = 0;
+        size_t majorLimit = MIN_MAJOR;
+        // The spaces compaction left below the pinned old objects, which
+        // promotion fills before it bumps oldTop
+        std::vector<Range> holes;
+        size_t hole = 0;
+        // What this minor collection promoted, for its scan
+        std::vector<Range> fresh;
+        // Records allocated in the old generation. The code stores their
+        // fields without the barrier, after calls that may collect, so the
+        // collections scan them while the stack still points at them.
+        std::vector<uint64_t *> unfinished;
+        int64_t *cards;
+        // Per card, in words from heapBase, the start of the object the
+        // card begins in
+        uint32_t *starts;
+
+        // The nursery is free but for the objects the last collection
+        // pinned; next and limit bump through gaps[gap]
+        std::vector<Range> gaps;
+        size_t gap;
+        char *windowBegin;
+        std::vector<Range> pinned;
+        // Bytes young objects may take in the old generation before the
+        // next collection, when the last one left the nursery mostly pinned
+        // and collecting again would free no more
+        size_t spill = 0;
+
+        const char *stackTop;
+        const int64_t *rootsBegin = nullptr;
+        const int64_t *rootsEnd = nullptr;
+        const int32_t *stackMaps = nullptr;
+        // Words of the stack holding pointers to objects, which move with
+        // them, sorted
+        std::vector<uint64_t *> exact;
+        std::vector<uint64_t *> grey;
+        // The slices of old strings the marking found, whose strings wait
+        // until everything else is marked
+        std::vector<uint64_t *> slices;
+
+        // A slice that gets a copy of its part, where it will be after the
+        // major collection
+        struct SliceCopy
+        {
+            uint64_t *slice;
+            std::string chars;
+        };
+
+        bool statistics = false;
+        std::vector<double> pauses;
+        size_t majors = 0;
+        size_t allocated = 0;
+        size_t promoted = 0;
+        std::chrono::steady_clock::time_point started;
+
+        void fail(const char *message)
+        {
+            std::fflush(stdout);
+            std::fputs(message, stderr);
+            std::fputc('\n', stderr);
+            std::exit(1);
+        }
+
+        inline uint64_t *header(uint64_t value)
+        {
+            return reinterpret_cast<uint64_t *>(value) - 2;
+        }
+
+        inline size_t sizeOf(const uint64_t *header)
+        {
+            if ((header[0] & KIND_MASK) == RECORD)
+            {
+                return (size_t) ((header[0] >> SIZE_SHIFT) & SIZE_MASK) * sizeof(uint64_t);
+            }
+            return (size_t) header[1];
+        }
+
+        inline bool inNursery(uint64_t value)
+        {
+            return value - (uint64_t) heapBase < nurserySize;
+        }
+
+        inline bool inOld(uint64_t value)
+        {
+            return value - (uint64_t) oldBase < (uint64_t) (oldTop - oldBase);
+        }
+
+        inline size_t cardOf(const void *address)
+        {
+            return (size_t) (static_cast<const char *>(address) - heapBase) >> CARD_SHIFT;
+        }
+
+        void writeFiller(char *at, size_t bytes)
+        {
+            auto header = reinterpret_cast<uint64_t *>(at);
+            header[0] = FILLER;
+            header[1] = bytes;
+        }
+
+        // A filler the nursery's object map knows of
+        void writeYoungFiller(char *at, size_t bytes)
+        {
+            writeFiller(at, bytes);
+            objectMap[(uintptr_t) at >> GRANULE_SHIFT] = 1;
+        }
+
+        // Keeps starts right for the cards that begin in [at, at + bytes)
+        void recordStarts(char *at, size_t bytes)
+        {
+            size_t first = ((size_t) (at - heapBase) + CARD_SIZE - 1) >> CARD_SHIFT;
+            size_t last = ((size_t) (at - heapBase) + bytes - 1) >> CARD_SHIFT;
+            auto start = (uint32_t) ((size_t) (at - heapBase) / sizeof(uint64_t));
+            for (size_t card = first; card <= last; card++)
+            {
+                starts[card] = start;
+            }
+        }
+
+        // The object of the old generation address falls in
+        uint64_t *objectAt(uint64_t address)
+        {
+            auto object = heapBase + (size_t) starts[cardOf(reinterpret_cast<char *>(address))] * sizeof(uint64_t);
+            while ((uint64_t) object + sizeOf(reinterpret_cast<uint64_t *>(object)) <= address)
+            {
+                object += sizeOf(reinterpret_cast<uint64_t *>(object));
+            }
+            return reinterpret_cast<uint64_t *>(object);
+        }
+
+        // Calls visit on every pointer field of the object that lies in
+        // [from, to)
+        template<typename Visit>
+        inline void forEachPointer(uint64_t *header, const char *from, const char *to, Visit visit)
+        {
+            auto fields = reinterpret_cast<uint64_t *>(header + 2);
+            size_t count = sizeOf(header) / sizeof(uint64_t) - 2;
+            switch (header[0] & KIND_MASK)
+            {
+                case RECORD:
+                {
+                    auto layout = reinterpret_cast<const TigerString *>(header[1]);
+                    if (layout == nullptr)
+                    {
+                        return;
+                    }
+                    count = std::min(count, (size_t) layout->length);
+                    for (size_t i = 0; i < count; i++)
+                    {
+                        auto field = reinterpret_cast<char *>(fields + i);
+                        if (layout->chars[i] == '1' && field >= from && field < to)
+                        {
+                            visit(fields + i);
+                        }
+                    }
+                    return;
+                }
+                case ARRAY:
+                {
+                    if (!(header[0] & POINTERS))
+                    {
+                        return;
+                    }
+                    auto begin = std::max(fields, reinterpret_cast<uint64_t *>(const_cast<char *>(from)));
+                    auto end = std::min(fields + count, reinterpret_cast<uint64_t *>(const_cast<char *>(to)));
+                    for (auto field = begin; field < end; field++)
+                    {
+                        visit(field);
+                    }
+                    return;
+                }
+                default:
+                    return;
+            }
+        }
+
+        template<typename Visit>
+        inline void forEachPointer(uint64_t *header, Visit visit)
+        {
+            forEachPointer(header, reinterpret_cast<const char *>(header),
+                           reinterpret_cast<const char *>(header) + sizeOf(header), visit);
+        }
+
+        // Closes the hole promotion fills, so that the rest of it starts
+        // its cards again
+        void closeHole()
+        {
+            if (hole < holes.size() && holes[hole].begin < holes[hole].end)
+            {
+                recordStarts(holes[hole].begin, (size_t) (holes[hole].end - holes[hole].begin));
+            }
+        }
+
+        // Room in the old generation, in a hole when one fits an object
+        // that is not large
+        char *reserveOld(size_t bytes)
+        {
+            char *at;
+            for (; bytes < LARGE_SIZE && hole < holes.size(); closeHole(), hole++)
+            {
+                auto &free = holes[hole];
+                if ((size_t) (free.end - free.begin) >= bytes)
+                {
+                    break;
+                }
+            }
+            if (bytes < LARGE_SIZE && hole < holes.size())
+            {
+                auto &free = holes[hole];
+                at = free.begin;
+                free.begin += bytes;
+                // The cards past here keep their start in the hole, which
+                // the objects lead to
+                if (free.begin < free.end)
+                {
+                    writeFiller(free.begin, (size_t) (free.end - free.begin));
+                }
+            }
+            else
+            {
+                if ((size_t) (heapEnd - oldTop) < bytes)
+                {
+                    fail("Out of memory");
+                }
+                at = oldTop;
+                oldTop += bytes;
+                oldClean = std::max(oldClean, oldTop);
+            }
+            recordStarts(at, bytes);
+            oldUsed += bytes;
+            if (!fresh.empty() && fresh.back().end == at)
+            {
+                fresh.back().end += bytes;
+            }
+            else
+            {
+                fresh.push_back({at, at + bytes});
+            }
+            return at;
+        }
+
+        // Points field at where its young object went, copying the object
+        // to the old generation unless something else did or it is pinned
+        inline void evacuate(uint64_t *field)
+        {
+            if (!inNursery(*field))
+            {
+                return;
+            }
+            auto object = header(*field);
+            if (object[0] & FORWARDED)
+            {
+                *field = object[1];
+                return;
+            }
+            if (object[0] & PINNED)
+            {
+                return;
+            }
+            size_t bytes = sizeOf(object);
+            auto copy = reserveOld(bytes);
+            std::memcpy(copy, object, bytes);
+            promoted += bytes;
+            object[0] |= FORWARDED;
+            object[1] = (uint64_t) (copy + HEADER_SIZE);
+            *field = object[1];
+        }
+
+        // Pins the young object address falls in. The nursery begins with
+        // an object, so the search of the map back ends.
+        inline void pin(uint64_t address)
+        {
+            auto granule = address >> GRANULE_SHIFT;
+            while (!objectMap[granule])
+            {
+                granule--;
+            }
+            auto object = reinterpret_cast<char *>(granule << GRANULE_SHIFT);
+            auto fields = reinterpret_cast<uint64_t *>(object);
+            if ((fields[0] & KIND_MASK) != FILLER && !(fields[0] & PINNED))
+            {
+                fields[0] |= PINNED;
+                pinned.push_back({object, object + sizeOf(fields)});
+            }
+        }
+
+        // Pins what the words of [begin, end) point at in the nursery and
+        // keeps those pointing into the old generation
+        void scanRange(const void *begin, const void *end, std::vector<uint64_t> &roots)
+        {
+            auto word = reinterpret_cast<const uint64_t *>(((uintptr_t) begin + 7) & ~(uintptr_t) 7);
+            auto span = (uint64_t) (oldTop - oldBase);
+            for (; word + 1 <= end; word++)
+            {
+                if (inNursery(*word))
+                {
+                    pin(*word);
+                }
+                else if (*word - (uint64_t) oldBase < span)
+                {
+                    roots.push_back(*word);
+                }
+            }
+        }
+
+        // Whether value points at an object, as a pointer root of compiled
+        // code does unless it is nil or a literal
+        bool isObject(uint64_t value)
+        {
+            if (value % ALIGNMENT != 0)
+            {
+                return false;
+            }
+            if (inNursery(value))
+            {
+                return value - (uint64_t) heapBase >= HEADER_SIZE &&
+                       objectMap[(value - HEADER_SIZE) >> GRANULE_SHIFT] &&
+                       (header(value)[0] & KIND_MASK) != FILLER;
+            }
+            return inOld(value) && value - (uint64_t) oldBase >= HEADER_SIZE &&
+                   objectAt(value - HEADER_SIZE) == header(value) && (header(value)[0] & KIND_MASK) != FILLER;
+        }
+
+        // The map of the call of compiled code that returns to address, or
+        // null
+        const int32_t *findMap(uint64_t address)
+        {
+            if (!stackMaps)
+            {
+                return nullptr;
+            }
+            auto offset = (int64_t) (address - (uint64_t) stackMaps);
+            if (offset != (int32_t) offset)
+            {
+                return nullptr;
+            }
+            auto calls = stackMaps + 1;
+            int32_t low = 0;
+            int32_t high = stackMaps[0];
+            while (low < high)
+            {
+                auto middle = low + (high - low) / 2;
+                if (calls[2 * middle] < offset)
+                {
+                    low = middle + 1;
+                }
+                else
+                {
+                    high = middle;
+                }
+            }
+            if (low == stackMaps[0] || calls[2 * low] != offset)
+            {
+                return nullptr;
+            }
+            return reinterpret_cast<const int32_t *>(reinterpret_cast<const char *>(stackMaps) + calls[2 * low + 1]);
+        }
+
+        void frameRoot(uint64_t *word, bool pointer, std::vector<uint64_t> &roots)
+        {
+            if (pointer && isObject(*word))
+            {
+                exact.push_back(word);
+            }
+            else
+            {
+                scanRange(word, word + 1, roots);
+            }
+        }
+
+        // Takes the roots map lists in frame, with where the registers of
+        // the frame's function are, then moves those to where the function
+        // saved its caller's
+        void scanFrame(char *frame, const int32_t *map, uint64_t **where, std::vector<uint64_t> &roots)
+        {
+            auto pointerRegisters = (uint32_t) map[0] & 0xff;
+            auto otherRegisters = ((uint32_t) map[0] >> 8) & 0xff;
+            for (int i = 0; i < SAVED_REGISTER_COUNT; i++)
+            {
+                if ((pointerRegisters | otherRegisters) & (1u << i))
+                {
+                    frameRoot(where[i], (pointerRegisters >> i) & 1, roots);
+                }
+            }
+            auto slots = map + 4;
+            for (uint32_t i = 0; i < (uint32_t) map[1]; i++)
+            {
+                frameRoot(reinterpret_cast<uint64_t *>(frame + (slots[i] & ~1)), !(slots[i] & 1), roots);
+            }
+            for (int i = 0; i < SAVED_REGISTER_COUNT; i++)
+            {
+                auto code = ((uint32_t) map[3] >> (4 * i)) & 0xf;
+                if (code == 0)
+                {
+                    break;
+                }
+                where[code - 1] = reinterpret_cast<uint64_t *>(frame + map[2] - (int32_t) sizeof(uint64_t) * i);
+            }
+        }
+
+        // Scans the stack, from this frame up, and the roots an interpreter
+        // set, leaving the pinned objects, the old roots and the exact roots
+        // sorted. The frames of compiled code under an entry point that
+        // allocates give their roots by their maps; the runtime's frames
+        // below them and those of whoever called the program are scanned
+        // whole. The caller has put the callee saved registers on the stack.
+        __attribute__((noinline)) void findRoots(std::vector<uint64_t> &roots)
+        {
+            std::jmp_buf registers;
+            setjmp(registers);
+            pinned.clear();
+            exact.clear();
+            auto saved = tiger_callerFrame;
+            auto map = saved ? findMap(saved[SAVED_RETURN]) : nullptr;
+            if (!map)
+            {
+                scanRange(&registers, stackTop, roots);
+            }
+            else
+            {
+                scanRange(&registers, saved, roots);
+                uint64_t *where[SAVED_REGISTER_COUNT];
+                for (int i = 0; i < SAVED_REGISTER_COUNT; i++)
+                {
+                    where[i] = saved + SAVED_REGISTERS[i];
+                }
+                // Every frame of compiled code begins with the caller's frame
+                // pointer and the return address. The program's caller holds
+                // nothing of the heap in the registers the last one saved.
+                auto frame = reinterpret_cast<uint64_t *>(saved[SAVED_FRAME]);
+                for (;;)
+                {
+                    scanFrame(reinterpret_cast<char *>(frame), map, where, roots);
+                    map = findMap(frame[1]);
+                    if (!map)
+                    {
+                        break;
+                    }
+                    frame = reinterpret_cast<uint64_t *>(frame[0]);
+                }
+                scanRange(frame + 2, stackTop, roots);
+                std::sort(exact.begin(), exact.end());
+                exact.erase(std::unique(exact.begin(), exact.end()), exact.end());
+            }
+            if (rootsBegin)
+            {
+                scanRange(rootsBegin, rootsEnd, roots);
+            }
+            std::sort(pinned.begin(), pinned.end(), [](const Range &left, const Range &right)
+            {
+                return left.begin < right.begin;
+            });
+            std::sort(roots.begin(), roots.end());
+            roots.erase(std::unique(roots.begin(), roots.end()), roots.end());
+        }
+
+        // Closes the part of the nursery the allocator did not get to
+        void seal()
+        {
+            if (next < limit)
+            {
+                writeYoungFiller(next, (size_t) (limit - next));
+            }
+            allocated += (size_t) (next - windowBegin);
+            windowBegin = next;
+        }
+
+        // Copies what the pinned objects and the marked cards reach out of
+        // the nursery, then what the copies reach
+        void minor(const std::vector<uint64_t> &roots)
+        {
+            fresh.clear();
+            auto top = oldTop;
+            for (auto &object : pinned)
+            {
+                forEachPointer(reinterpret_cast<uint64_t *>(object.begin), evacuate);
+            }
+            // The old objects the exact roots hold on to
+            std::vector<uint64_t> held;
+            for (auto root : exact)
+            {
+                evacuate(root);
+                if (inOld(*root))
+                {
+                    held.push_back(*root);
+                }
+            }
+            std::sort(held.begin(), held.end());
+            size_t kept = 0;
+            for (auto object : unfinished)
+            {
+                forEachPointer(object, [](uint64_t *field)
+                {
+                    evacuate(field);
+                    if (inNursery(*field))
+                    {
+                        cards[cardOf(field)] = 1;
+                    }
+                });
+                auto root = std::lower_bound(roots.begin(), roots.end(), (uint64_t) object);
+                if ((root != roots.end() && *root < (uint64_t) object + sizeOf(object)) ||
+                    std::binary_search(held.begin(), held.end(), (uint64_t) object + HEADER_SIZE))
+                {
+                    unfinished[kept++] = object;
+                }
+            }
+            unfinished.resize(kept);
+            size_t last = (size_t) (top - heapBase + CARD_SIZE - 1) >> CARD_SHIFT;
+            for (size_t card = cardOf(oldBase); card < last; card++)
+            {
+                if (!cards[card])
+                {
+                    continue;
+                }
+                cards[card] = 0;
+                auto from = heapBase + (card << CARD_SHIFT);
+                auto to = std::min(from + CARD_SIZE, top);
+                bool young = false;
+                for (auto object = heapBase + (size_t) starts[card] * sizeof(uint64_t); object < to;)
+                {
+                    auto fields = reinterpret_cast<uint64_t *>(object);
+                    forEachPointer(fields, from, to, [&young](uint64_t *field)
+                    {
+                        evacuate(field);
+                        young |= inNursery(*field);
+                    });
+                    object += sizeOf(fields);
+                }
+                // Still pointing at a pinned object
+                cards[card] = young;
+            }
+            // The copies, which grow as they are scanned
+            for (size_t range = 0; range < fresh.size(); range++)
+            {
+                for (auto object = fresh[range].begin; object < fresh[range].end;)
+                {
+                    auto fields = reinterpret_cast<uint64_t *>(object);
+                    forEachPointer(fields, [](uint64_t *field)
+                    {
+                        evacuate(field);
+                        if (inNursery(*field))
+                        {
+                            cards[cardOf(field)] = 1;
+                        }
+                    });
+                    object += sizeOf(fields);
+                }
+            }
+        }
+
+        inline void mark(uint64_t *field)
+        {
+            if (inOld(*field))
+            {
+                auto object = header(*field);
+                if (!(object[0] & MARKED))
+                {
+                    object[0] |= MARKED;
+                    grey.push_back(object);
+                }
+            }
+        }
+
+        // Marks what the fields of object point at, but for the string of a
+        // slice, which is left to markSlices
+        inline void markFields(uint64_t *object)
+        {
+            if ((object[0] & KIND_MASK) == RECORD && (object[0] & SLICE))
+            {
+                if (inOld(object[3]))
+                {
+                    slices.push_back(object);
+                }
+                return;
+            }
+            forEachPointer(object, mark);
+        }
+
+        // Once the rest is marked, marks the strings of the slices but those
+        // nothing else keeps that the slices hold little of. Their slices
+        // point nowhere until they get copies of their parts, which copies
+        // lists.
+        void markSlices(std::vector<SliceCopy> &copies)
+        {
+            std::sort(slices.begin(), slices.end(), [](const uint64_t *left, const uint64_t *right)
+            {
+                return left[3] < right[3];
+            });
+            for (size_t i = 0; i < slices.size();)
+            {
+                auto string = header(slices[i][3]);
+                size_t end = i;
+                int64_t used = 0;
+                for (; end < slices.size() && slices[end][3] == slices[i][3]; end++)
+                {
+                    used += (int64_t) slices[end][2];
+                }
+                auto length = (int64_t) string[2];
+                if ((string[0] & MARKED) || (string[0] & KIND_MASK) != STRING || used * SLICED >= length)
+                {
+                    string[0] |= MARKED;
+                    i = end;
+                    continue;
+                }
+                for (; i < end; i++)
+                {
+                    auto slice = slices[i];
+                    auto chars = reinterpret_cast<const char *>(string + 3) + slice[4];
+                    copies.push_back({slice, std::string(chars, (size_t) slice[2])});
+                    slice[3] = 0;
+                    slice[4] = 0;
+                }
+            }
+            slices.clear();
+        }
+
+        // Gives the slices their copies, on top of the old generation
+        void copySlices(std::vector<SliceCopy> &copies)
+        {
+            for (auto &copy : copies)
+            {
+                size_t bytes = (HEADER_SIZE + sizeof(int64_t) + copy.chars.size() + 1 + ALIGNMENT - 1) &
+                               ~(ALIGNMENT - 1);
+                if ((size_t) (heapEnd - oldTop) < bytes)
+                {
+                    fail("Out of memory");
+                }
+                auto string = reinterpret_cast<uint64_t *>(oldTop);
+                string[0] = STRING;
+                string[1] = bytes;
+                string[2] = copy.chars.size();
+                std::memcpy(string + 3, copy.chars.data(), copy.chars.size());
+                recordStarts(oldTop, bytes);
+                oldTop += bytes;
+                oldUsed += bytes;
+                copy.slice[3] = (uint64_t) (string + 2);
+            }
+            oldClean = std::max(oldClean, oldTop);
+        }
+
+        inline void relocate(uint64_t *field)
+        {
+            if (inOld(*field))
+            {
+                *field = (uint64_t) heapBase + (header(*field)[0] >> FORWARD_SHIFT) * sizeof(uint64_t) + HEADER_SIZE;
+            }
+        }
+
+        // Marks what the roots and the pinned young objects reach in the
+        // old generation, then slides the live objects down over the dead
+        // ones, leaving those the stack points into but for the exact roots
+        // where they are
+        void major(const std::vector<uint64_t> &roots)
+        {
+            closeHole();
+            for (auto root : roots)
+            {
+                auto object = objectAt(root);
+                if ((object[0] & KIND_MASK) == FILLER)
+                {
+                    continue;
+                }
+                if (!(object[0] & MARKED))
+                {
+                    object[0] |= MARKED;
+                    grey.push_back(object);
+                }
+                object[0] |= PINNED;
+            }
+            for (auto root : exact)
+            {
+                mark(root);
+            }
+            for (auto &object : pinned)
+            {
+                markFields(reinterpret_cast<uint64_t *>(object.begin));
+            }
+            while (!grey.empty())
+            {
+                auto object = grey.back();
+                grey.pop_back();
+                markFields(object);
+            }
+            // The strings have no pointers to follow
+            std::vector<SliceCopy> copies;
+            markSlices(copies);
+
+            // Where each live object goes
+            auto free = oldBase;
+            for (auto object = oldBase; object < oldTop;)
+            {
+                auto fields = reinterpret_cast<uint64_t *>(object);
+                size_t bytes = sizeOf(fields);
+                if (fields[0] & MARKED)
+                {
+                    auto to = fields[0] & PINNED ? object : free;
+                    fields[0] = (fields[0] & 0xffffffff) |
+                                (uint64_t) (to - heapBase) / sizeof(uint64_t) << FORWARD_SHIFT;
+                    free = to + bytes;
+                }
+                object += bytes;
+            }
+            for (auto &copy : copies)
+            {
+                if (inOld((uint64_t) copy.slice))
+                {
+                    copy.slice = reinterpret_cast<uint64_t *>(heapBase + (copy.slice[0] >> FORWARD_SHIFT) *
+                                                                         sizeof(uint64_t));
+                }
+            }
+            for (auto object = oldBase; object < oldTop;)
+            {
+                auto fields = reinterpret_cast<uint64_t *>(object);
+                if (fields[0] & MARKED)
+                {
+                    forEachPointer(fields, relocate);
+                }
+                object += sizeOf(fields);
+            }
+            for (auto &object : pinned)
+            {
+                forEachPointer(reinterpret_cast<uint64_t *>(object.begin), relocate);
+            }
+            for (auto root : exact)
+            {
+                relocate(root);
+            }
+            size_t kept = 0;
+            for (auto object : unfinished)
+            {
+                if (object[0] & MARKED)
+                {
+                    unfinished[kept++] = reinterpret_cast<uint64_t *>(heapBase + (object[0] >> FORWARD_SHIFT) *
+                                                                                 sizeof(uint64_t));
+                }
+            }
+            unfinished.resize(kept);
+
+            // Move, with fillers before the pinned objects, and mark the cards
+            // again for the pointers to pinned young objects
+            auto end = oldTop;
+            holes.clear();
+            hole = 0;
+            oldUsed = 0;
+            std::memset(cards + cardOf(oldBase), 0,
+                        (cardOf(end - 1) + 1 - cardOf(oldBase)) * sizeof(int64_t));
+            free = oldBase;
+            for (auto object = oldBase; object < end;)
+            {
+                auto fields = reinterpret_cast<uint64_t *>(object);
+                size_t bytes = sizeOf(fields);
+                auto following = object + bytes;
+                if (fields[0] & MARKED)
+                {
+                    auto to = heapBase + (fields[0] >> FORWARD_SHIFT) * sizeof(uint64_t);
+                    if (to > free)
+                    {
+                        writeFiller(free, (size_t) (to - free));
+                        recordStarts(free, (size_t) (to - free));
+                        if ((size_t) (to - free) >= MIN_HOLE)
+                        {
+                            holes.push_back({free, to});
+                        }
+                    }
+                    if (to != object)
+                    {
+                        std::memmove(to, object, bytes);
+                    }
+                    auto moved = reinterpret_cast<uint64_t *>(to);
+                    moved[0] &= 0xffffffff & ~(MARKED | PINNED);
+                    recordStarts(to, bytes);
+                    forEachPointer(moved, [](uint64_t *field)
+                    {
+                        if (inNursery(*field))
+                        {
+                            cards[cardOf(field)] = 1;
+                        }
+                    });
+                    free = to + bytes;
+                    oldUsed += bytes;
+                }
+                object = following;
+            }
+            oldTop = free;
+            copySlices(copies);
+
+            // The generation grows back to its limit before the next major
+            // collection, so only what lies past that goes back to the system
+            majorLimit = std::max(MIN_MAJOR, 2 * oldUsed);
+            auto page = (size_t) sysconf(_SC_PAGESIZE);
+            auto boundary = reinterpret_cast<char *>(((uintptr_t) free + majorLimit + page - 1) & ~(page - 1));
+            if (boundary < oldClean)
+            {
+                madvise(boundary, (size_t) (oldClean - boundary), MADV_DONTNEED);
+                oldClean = boundary;
+            }
+            majors++;
+        }
+
+        // Frees the nursery but for the pinned objects
+        void resetNursery()
+        {
+            gaps.clear();
+            auto at = heapBase;
+            for (auto &object : pinned)
+            {
+                reinterpret_cast<uint64_t *>(object.begin)[0] &= ~PINNED;
+                if (object.begin > at)
+                {
+                    gaps.push_back({at, object.begin});
+                }
+                at = object.end;
+            }
+            if (at < heapBase + nurserySize)
+            {
+                gaps.push_back({at, heapBase + nurserySize});
+            }
+            size_t freed = 0;
+            for (auto &free : gaps)
+            {
+                std::memset(objectMap + ((uintptr_t) free.begin >> GRANULE_SHIFT), 0,
+                            (size_t) (free.end - free.begin) >> GRANULE_SHIFT);
+                writeYoungFiller(free.begin, (size_t) (free.end - free.begin));
+                freed += (size_t) (free.end - free.begin);
+            }
+            spill = freed < nurserySize / 4 ? nurserySize : 0;
+            gap = (size_t) -1;
+            next = limit = windowBegin = nullptr;
+        }
+
+        // Runs a minor collection, and a major one after it when asked or
+        // when the old generation has outgrown its limit
+        __attribute__((noinline)) void collect(bool full)
+        {
+            auto start = std::chrono::steady_clock::now();
+            seal();
+            std::vector<uint64_t> roots;
+            findRoots(roots);
+            minor(roots);
+            if (full || oldUsed > majorLimit ||
+                (size_t) (heapEnd - oldTop) < nurserySize)
+            {
+                major(roots);
+            }
+            resetNursery();
+            std::chrono::duration<double, std::micro> pause = std::chrono::steady_clock::now() - start;
+            pauses.push_back(pause.count());
+        }
+
+        // Collects with the callee saved registers of every caller on the
+        // stack, where findRoots sees them
+        void collectWithRegisters(bool full)
+        {
+#ifdef __GNUC__
+            __builtin_unwind_init();
+#endif
+            collect(full);
+        }
+
+        // Moves next and limit to the first gap after the current one with
+        // room for bytes
+        bool nextGap(size_t bytes)
+        {
+            seal();
+            for (gap++; gap < gaps.size(); gap++)
+            {
+                if ((size_t) (gaps[gap].end - gaps[gap].begin) >= bytes)
+                {
+                    next = windowBegin = gaps[gap].begin;
+                    limit = gaps[gap].end;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        uint64_t *place(size_t bytes, uint64_t word, uint64_t extra)
+        {
+            auto header = reinterpret_cast<uint64_t *>(next);
+            next += bytes;
+            header[0] = word;
+            header[1] = extra;
+            objectMap[(uintptr_t) header >> GRANULE_SHIFT] = 1;
+            if ((word & KIND_MASK) == RECORD)
+            {
+                std::memset(header + 2, 0, bytes - HEADER_SIZE);
+            }
+            return header;
+        }
+
+        uint64_t *allocateOld(size_t bytes, uint64_t word, uint64_t extra)
+        {
+            if (oldUsed + bytes > majorLimit || (size_t) (heapEnd - oldTop) < bytes)
+            {
+                collectWithRegisters(true);
+            }
+            auto clean = oldClean;
+            auto header = reinterpret_cast<uint64_t *>(reserveOld(bytes));
+            fresh.clear();
+            auto end = reinterpret_cast<char *>(header) + bytes;
+            if (reinterpret_cast<char *>(header) < clean)
+            {
+                std::memset(header, 0, (size_t) (std::min(end, clean) - reinterpret_cast<char *>(header)));
+            }
+            header[0] = word;
+            header[1] = extra;
+            allocated += bytes;
+            // The fields of an array are stored without the barrier a young
+            // object needs none of, but before anything collects
+            if ((word & KIND_MASK) == RECORD && extra)
+            {
+                unfinished.push_back(header);
+            }
+            else if (word & POINTERS)
+            {
+                std::fill(cards + cardOf(header), cards + cardOf(end - 1) + 1, 1);
+            }
+            return header;
+        }
+
+        double percentile(const std::vector<double> &sorted, double fraction)
+        {
+            return sorted[std::min(sorted.size() - 1, (size_t) (fraction * (double) sorted.size()))];
+        }
+
+        void report()
+        {
+            seal();
+            std::chrono::duration<double, std::milli> run = std::chrono::steady_clock::now() - started;
+            double total = 0;
+            for (auto pause : pauses)
+            {
+                total += pause;
+            }
+            std::fprintf(stderr, "gc: %zu collections, %zu major; %.1f MiB allocated, %.1f MiB promoted, "
+                                 "%.1f MiB old at exit\n", pauses.size(), majors, allocated / 1048576.0,
+                         promoted / 1048576.0, oldUsed / 1048576.0);
+            if (pauses.empty())
+            {
+                return;
+            }
+            auto sorted = pauses;
+            std::sort(sorted.begin(), sorted.end());
+            std::fprintf(stderr, "gc: pause p50 %.0f us, p90 %.0f us, p99 %.0f us, max %.0f us; "
+                                 "%.1f ms of %.1f ms run\n", percentile(sorted, 0.5), percentile(sorted, 0.9),
+                         percentile(sorted, 0.99), sorted.back(), total / 1000, run.count());
+        }
+
+        char *reserve(size_t bytes)
+        {
+            auto memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                               -1, 0);
+            return memory == MAP_FAILED ? nullptr : static_cast<char *>(memory);
+        }
+    }
+
+    void init()
+    {
+#ifdef __GLIBC__
+        stackTop = static_cast<const char *>(__libc_stack_end);
+#else
+        // The program's frames are below those of whoever sets the runtime up
+        stackTop = static_cast<const char *>(__builtin_frame_address(0)) + 4096;
+#endif
+        started = std::chrono::steady_clock::now();
+        nurserySize = NURSERY_SIZE;
+        if (auto kilobytes = std::getenv("TIGER_NURSERY"))
+        {
+            auto bytes = (size_t) std::atoll(kilobytes) << 10;
+            nurserySize = std::max(MIN_NURSERY_SIZE, bytes & ~(CARD_SIZE - 1));
+        }
+        // What the system lets us reserve, a nursery and the cards at least
+        size_t size = MAX_HEAP;
+        for (; size >= MIN_HEAP; size /= 2)
+        {
+            heapBase = reserve(size);
+            if (heapBase)
+            {
+                break;
+            }
+        }
+        size_t cardCount = size >> CARD_SHIFT;
+        size_t granules = nurserySize >> GRANULE_SHIFT;
+        auto tables = heapBase ? reserve(cardCount * (sizeof(int64_t) + sizeof(uint32_t)) + granules) : nullptr;
+        if (!tables || size <= 2 * nurserySize)
+        {
+            fail("Cannot reserve memory for the heap");
+        }
+        heapEnd = heapBase + size;
+        oldBase = oldTop = oldClean = heapBase + nurserySize;
+        cards = reinterpret_cast<int64_t *>(tables);
+        starts = reinterpret_cast<uint32_t *>(tables + cardCount * sizeof(int64_t));
+        objectMap = reinterpret_cast<uint8_t *>(tables + cardCount * (sizeof(int64_t) + sizeof(uint32_t))) -
+                    ((uintptr_t) heapBase >> GRANULE_SHIFT);
+        // Biased, so an address shifted right is its card's index
+        tiger_cardTable = reinterpret_cast<int64_t *>((uintptr_t) cards -
+                                                      ((uintptr_t) heapBase >> CARD_SHIFT) * sizeof(int64_t));
+        pinned.clear();
+        resetNursery();
+        auto setting = std::getenv("TIGER_GC_STATS");
+        statistics = setting && *setting && std::strcmp(setting, "0") != 0;
+        if (statistics)
+        {
+            std::atexit(report);
+        }
+    }
+
+    uint64_t *allocateSlow(size_t bytes, uint64_t word, uint64_t extra)
+    {
+        if (bytes < LARGE_SIZE)
+        {
+            if (nextGap(bytes))
+            {
+                return place(bytes, word, extra);
+            }
+            if (spill >= bytes)
+            {
+                spill -= bytes;
+                return allocateOld(bytes, word, extra);
+            }
+            collectWithRegisters(false);
+            if (nextGap(bytes))
+            {
+                return place(bytes, word, extra);
+            }
+        }
+        return allocateOld(bytes, word, extra);
+    }
+
+    void setRoots(const int64_t *begin, const int64_t *end)
+    {
+        rootsBegin = begin;
+        rootsEnd = end;
+    }
+
+    void setStackMaps(const int32_t *table)
+    {
+        stackMaps = table;
+    }
+}
@@ -0,0 +1,127 @@
+//
+// Garbage collected heap of the runtime
+//
+
+#ifndef RUNTIME_GC_H
+#define RUNTIME_GC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// While an entry point that allocates runs, where it saved the registers of
+// the compiled code that called it: r15, r14, r13, r12, rbp and rbx, then
+// the return address. Null otherwise.
+extern "C" uint64_t *tiger_callerFrame;
+
+// Every object is two header words and then the payload a Tiger value
+// points to. The first word holds the kind and the collector's flags, the
+// second the layout of a record, a string pointing at its pointer fields,
+// or the size in bytes of anything else. Objects are allocated in a
+// nursery, copied to the old generation when a minor collection finds them
+// alive, and slid down there by the mark-compact major collections. The
+// frames of compiled code are walked with the compiler's stack maps, and
+// the pointers they list are updated when their objects move. Any other
+// word of the stack that looks like a pointer into the heap pins its
+// object, which the nursery finds through a byte a granule marking where
+// objects begin.
+namespace Gc
+{
+    enum Kind
+    {
+        RECORD, ARRAY, STRING, FILLER
+    };
+
+    const uint64_t KIND_MASK = 3;
+    const uint64_t MARKED = 4;
+    const uint64_t PINNED = 8;
+    // A young object copied out, the second word is where to
+    const uint64_t FORWARDED = 16;
+    // An array whose elements are pointers
+    const uint64_t POINTERS = 32;
+    // A record the runtime makes of part of a string: the length, the
+    // string, its one pointer field, and where in it the part begins. A
+    // major collection gives slices copies of their parts instead of the
+    // string when nothing else keeps it and they hold little of it.
+    const uint64_t SLICE = 64;
+    // Size in words of a record, header included
+    const int SIZE_SHIFT = 8;
+    const uint64_t SIZE_MASK = 0xffffff;
+
+    const size_t HEADER_SIZE = 2 * sizeof(uint64_t);
+    const size_t ALIGNMENT = 16;
+    const int GRANULE_SHIFT = 4;
+    // Objects from here on go to the old generation straight away
+    const size_t LARGE_SIZE = (size_t) 64 << 10;
+
+    // The free part of the nursery the fast path bumps through. Compiled
+    // code bumps it too, under the C names, as Gc::allocate does.
+    extern char *next __asm__("tiger_heapNext");
+    extern char *limit __asm__("tiger_heapLimit");
+    // Biased like the cards, nonzero at the granules of the nursery an
+    // object begins at
+    extern uint8_t *objectMap __asm__("tiger_objectMap");
+    // The reservation the heap takes
+    extern char *heapBase;
+    extern char *heapEnd;
+
+    // Reserves the heap and finds the stack
+    void init();
+
+    __attribute__((noinline)) uint64_t *allocateSlow(size_t bytes, uint64_t word, uint64_t extra);
+
+    // Payload of at least payload bytes, zeroed for a record, whose fields
+    // are stored after calls that may collect. flags is the kind and, for an
+    // array, POINTERS. layout is a record's. Large objects come zeroed too.
+    inline int64_t *allocate(size_t payload, uint64_t flags, uint64_t layout)
+    {
+        size_t bytes = (HEADER_SIZE + payload + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+        bool record = (flags & KIND_MASK) == RECORD;
+        uint64_t word = record ? flags | (uint64_t) (bytes / sizeof(uint64_t)) << SIZE_SHIFT : flags;
+        uint64_t extra = record ? layout : (uint64_t) bytes;
+        uint64_t *header;
+        if (bytes >= LARGE_SIZE || (size_t) (limit - next) < bytes)
+        {
+            header = allocateSlow(bytes, word, extra);
+        }
+        else
+        {
+            header = reinterpret_cast<uint64_t *>(next);
+            next += bytes;
+            header[0] = word;
+            header[1] = extra;
+            objectMap[(uintptr_t) header >> GRANULE_SHIFT] = 1;
+            if (record)
+            {
+                std::memset(header + 2, 0, payload);
+            }
+        }
+        return reinterpret_cast<int64_t *>(header + 2);
+    }
+
+    // Whether value points at a record of the heap, not at an array or a
+    // string, nor outside the heap, like a literal
+    inline bool isRecord(const void *value)
+    {
+        return (uintptr_t) value - (uintptr_t) heapBase < (uintptr_t) (heapEnd - heapBase) &&
+               (static_cast<const uint64_t *>(value)[-2] & KIND_MASK) == RECORD;
+    }
+
+    // Whether the record value points at is a slice
+    inline bool isSlice(const void *value)
+    {
+        return (static_cast<const uint64_t *>(value)[-2] & SLICE) != 0;
+    }
+
+    // Words in [begin, end) may point into the heap too
+    void setRoots(const int64_t *begin, const int64_t *end);
+
+    // The compiler's table of what the frames of compiled code hold at each
+    // call, null to scan them conservatively
+    void setStackMaps(const int32_t *table);
+
+    // Largest record payload a header can describe
+    const size_t MAX_RECORD = SIZE_MASK * sizeof(uint64_t) - HEADER_SIZE - ALIGNMENT;
+}
+
+#endif //RUNTIME_GC_H
@@ -0,0 +1,262 @@
+//
+// String kernels of the runtime
+//
+
+#include "kernels.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace Kernels
+{
+    namespace
+    {
+        int differ(const char *left, const char *right, size_t at)
+        {
+            return (unsigned char) left[at] - (unsigned char) right[at];
+        }
+
+        uint64_t load64(const char *at)
+        {
+            uint64_t word;
+            std::memcpy(&word, at, sizeof(word));
+            return word;
+        }
+
+        // Eight bytes at a time, the first byte of a word the most
+        // significant when words are compared
+        int compareScalar(const char *left, const char *right, size_t n)
+        {
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8)
+            {
+                auto a = load64(left + i);
+                auto b = load64(right + i);
+                if (a != b)
+                {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+                    a = __builtin_bswap64(a);
+                    b = __builtin_bswap64(b);
+#endif
+                    return a < b ? -1 : 1;
+                }
+            }
+            for (; i < n; i++)
+            {
+                if (left[i] != right[i])
+                {
+                    return differ(left, right, i);
+                }
+            }
+            return 0;
+        }
+
+        void copyScalar(char *to, const char *from, size_t n)
+        {
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8)
+            {
+                auto word = load64(from + i);
+                std::memcpy(to + i, &word, sizeof(word));
+            }
+            for (; i < n; i++)
+            {
+                to[i] = from[i];
+            }
+        }
+
+        bool always()
+        {
+            return true;
+        }
+
+#if defined(__x86_64__)
+        // Bit i set where byte i of the 16 at left and right differs
+        inline unsigned mismatch16(const char *left, const char *right)
+        {
+            auto a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(left));
+            auto b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(right));
+            return ~(unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) & 0xffff;
+        }
+
+        // Blocks of 16 bytes, the last one overlapping the one before it
+        int compareSse2(const char *left, const char *right, size_t n)
+        {
+            if (n < 16)
+            {
+                return compareScalar(left, right, n);
+            }
+            size_t i = 0;
+            for (; i + 16 <= n; i += 16)
+            {
+                if (auto mask = mismatch16(left + i, right + i))
+                {
+                    return differ(left, right, i + __builtin_ctz(mask));
+                }
+            }
+            if (i < n)
+            {
+                i = n - 16;
+                if (auto mask = mismatch16(left + i, right + i))
+                {
+                    return differ(left, right, i + __builtin_ctz(mask));
+                }
+            }
+            return 0;
+        }
+
+        void copySse2(char *to, const char *from, size_t n)
+        {
+            if (n < 16)
+            {
+                copyScalar(to, from, n);
+                return;
+            }
+            auto last = _mm_loadu_si128(reinterpret_cast<const __m128i *>(from + n - 16));
+            for (size_t i = 0; i + 16 <= n; i += 16)
+            {
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(to + i),
+                                 _mm_loadu_si128(reinterpret_cast<const __m128i *>(from + i)));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(to + n - 16), last);
+        }
+
+        __attribute__((target("avx2"))) inline unsigned mismatch32(const char *left, const char *right)
+        {
+            auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(left));
+            auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(right));
+            return ~(unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+        }
+
+        // Blocks of 32 bytes, two at a time while they last
+        __attribute__((target("avx2"))) int compareAvx2(const char *left, const char *right, size_t n)
+        {
+            if (n < 32)
+            {
+                return compareSse2(left, right, n);
+            }
+            size_t i = 0;
+            for (; i + 64 <= n; i += 64)
+            {
+                auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(left + i));
+                auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(right + i));
+                auto c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(left + i + 32));
+                auto d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(right + i + 32));
+                auto equal = _mm256_and_si256(_mm256_cmpeq_epi8(a, b), _mm256_cmpeq_epi8(c, d));
+                if ((unsigned) _mm256_movemask_epi8(equal) != 0xffffffffu)
+                {
+                    break;
+                }
+            }
+            for (; i + 32 <= n; i += 32)
+            {
+                if (auto mask = mismatch32(left + i, right + i))
+                {
+                    return differ(left, right, i + __builtin_ctz(mask));
+                }
+            }
+            if (i < n)
+            {
+                i = n - 32;
+                if (auto mask = mismatch32(left + i, right + i))
+                {
+                    return differ(left, right, i + __builtin_ctz(mask));
+                }
+            }
+            return 0;
+        }
+
+        __attribute__((target("avx2"))) void copyAvx2(char *to, const char *from, size_t n)
+        {
+            if (n < 32)
+            {
+                copySse2(to, from, n);
+                return;
+            }
+            auto last = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(from + n - 32));
+            size_t i = 0;
+            for (; i + 64 <= n; i += 64)
+            {
+                auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(from + i));
+                auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(from + i + 32));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(to + i), a);
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(to + i + 32), b);
+            }
+            if (i + 32 <= n)
+            {
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(to + i),
+                                    _mm256_loadu_si256(reinterpret_cast<const __m256i *>(from + i)));
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(to + n - 32), last);
+        }
+
+        bool hasAvx2()
+        {
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+        }
+#endif
+
+        struct KernelSet
+        {
+            const char *name;
+            int (*compare)(const char *, const char *, size_t);
+            void (*copy)(char *, const char *, size_t);
+            bool (*supported)();
+        };
+
+        // Best first
+        const KernelSet sets[] = {
+#if defined(__x86_64__)
+                {"avx2", compareAvx2, copyAvx2, hasAvx2},
+                // Every x86-64 processor has SSE2
+                {"sse2", compareSse2, copySse2, always},
+#endif
+                {"scalar", compareScalar, copyScalar, always}
+        };
+
+        const KernelSet *inUse = &sets[sizeof(sets) / sizeof(sets[0]) - 1];
+    }
+
+    int (*compare)(const char *left, const char *right, size_t n) = compareScalar;
+    void (*copy)(char *to, const char *from, size_t n) = copyScalar;
+
+    void init()
+    {
+        auto name = std::getenv("TIGER_KERNELS");
+        if (name != nullptr && use(name))
+        {
+            return;
+        }
+        for (auto &set : sets)
+        {
+            if (use(set.name))
+            {
+                return;
+            }
+        }
+    }
+
+    bool use(const char *name)
+    {
+        for (auto &set : sets)
+        {
+            if (std::strcmp(set.name, name) == 0 && set.supported())
+            {
+                compare = set.compare;
+                copy = set.copy;
+                inUse = &set;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const char *current()
+    {
+        return inUse->name;
+    }
+}
@@ -0,0 +1,32 @@
+//
+// String kernels of the runtime
+//
+
+#ifndef RUNTIME_KERNELS_H
+#define RUNTIME_KERNELS_H
+
+#include <cstddef>
+
+// What the string entry points spend their time in, for the characters of
+// length prefixed strings: comparing and copying blocks. Each comes in
+// AVX2, SSE2 and plain C++, and init picks the best the processor has.
+namespace Kernels
+{
+    // Like memcmp
+    extern int (*compare)(const char *left, const char *right, size_t n);
+    // Like memcpy
+    extern void (*copy)(char *to, const char *from, size_t n);
+
+    // Picks the kernels by what CPUID reports, or by TIGER_KERNELS,
+    // "avx2", "sse2" or "scalar", when it names ones the processor runs
+    void init();
+
+    // Switches to the kernels of that name. False, and nothing changes,
+    // when there are none or the processor cannot run them.
+    bool use(const char *name);
+
+    // Name of the kernels in use
+    const char *current();
+}
+
+#endif //RUNTIME_KERNELS_H
@@ -0,0 +1,14 @@
+//
+// Entry of a linked Tiger program
+//
+
+#include "runtime.h"
+
+extern "C" int64_t tigermain(int64_t staticLink);
+// Written by the compiler after the code
+extern "C" const int32_t tiger_stackMaps[];
+
+int main()
+{
+    return tiger_run(tigermain, tiger_stackMaps);
+}
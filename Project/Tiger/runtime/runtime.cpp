@@ -0,0 +1,583 @@
+//
+// Runtime library of compiled Tiger programs
+//
+
+#include "runtime.h"
+#include "gc.h"
+#include "kernels.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    struct Char
+    {
+        int64_t length;
+        char chars[8];
+    };
+
+    // Strings of one character, for chr and getchar
+    Char chars[256];
+    const Char empty = {0, {0}};
+
+    // So the size of an array in bytes, header included, stays far from
+    // overflowing
+    const int64_t MAX_ARRAY = (int64_t) 1 << 40;
+
+    const size_t OUTPUT_BUFFER_SIZE = (size_t) 1 << 16;
+    char outputBuffer[OUTPUT_BUFFER_SIZE];
+
+    void makeChars()
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            chars[i].length = 1;
+            chars[i].chars[0] = (char) i;
+        }
+    }
+
+    const TigerString *asString(const Char &c)
+    {
+        return reinterpret_cast<const TigerString *>(&c);
+    }
+
+    void fail(const char *message, int64_t value)
+    {
+        std::fflush(stdout);
+        std::fprintf(stderr, message, (long long) value);
+        std::fputc('\n', stderr);
+        std::exit(1);
+    }
+
+    TigerString *allocString(int64_t length)
+    {
+        auto s = reinterpret_cast<TigerString *>(Gc::allocate(sizeof(int64_t) + (size_t) length + 1, Gc::STRING, 0));
+        s->length = length;
+        return s;
+    }
+
+    // A concatenation not copied yet, the string left and then right. It is
+    // a record of the heap, which tells it from a flat string, and has the
+    // length where one has it. Flattening keeps the copy in left, with right
+    // null.
+    struct Rope
+    {
+        int64_t length;
+        const TigerString *left;
+        const TigerString *right;
+        int64_t depth;
+    };
+
+    // A substring not copied: a record with the flag Gc::SLICE, the
+    // characters of string from first on
+    struct Slice
+    {
+        int64_t length;
+        const TigerString *string;
+        int64_t first;
+    };
+
+    // The layouts the collector reads them by
+    const Char ropeLayout = {4, {'0', '1', '1', '0'}};
+    const Char sliceLayout = {3, {'0', '1', '0'}};
+
+    // Concatenations of no more characters than this are copied
+    const int64_t SHORT_STRING = 64;
+    // Deeper ropes are flattened, which the rebalancing of concat leaves
+    // for pathological cases
+    const int64_t MAX_DEPTH = 64;
+    // Substrings of fewer characters are copied, which takes about the
+    // room a slice does
+    const int64_t MIN_SLICE = 32;
+
+    // The rope s is, or null for a flat string or a slice
+    inline Rope *ropeOf(const TigerString *s)
+    {
+        return Gc::isRecord(s) && !Gc::isSlice(s) ? reinterpret_cast<Rope *>(const_cast<TigerString *>(s)) : nullptr;
+    }
+
+    // The flat string the characters of s are in, and where in it they
+    // begin, or null for a rope not flattened yet
+    inline const TigerString *bufferOf(const TigerString *s, int64_t &first)
+    {
+        first = 0;
+        if (!Gc::isRecord(s))
+        {
+            return s;
+        }
+        if (Gc::isSlice(s))
+        {
+            auto slice = reinterpret_cast<const Slice *>(s);
+            first = slice->first;
+            return slice->string;
+        }
+        auto rope = reinterpret_cast<const Rope *>(s);
+        return rope->right == nullptr ? rope->left : nullptr;
+    }
+
+    // The characters of s in one piece without copying, or null
+    inline const char *charsOf(const TigerString *s)
+    {
+        int64_t first;
+        auto buffer = bufferOf(s, first);
+        return buffer == nullptr ? nullptr : buffer->chars + first;
+    }
+
+    inline int64_t depthOf(const TigerString *s)
+    {
+        auto rope = ropeOf(s);
+        return rope == nullptr ? 0 : rope->depth;
+    }
+
+    // Calls visit on the characters and length of each piece of s in
+    // order. Nothing it does may allocate.
+    template<typename Visit>
+    void forEachPiece(const TigerString *s, Visit visit)
+    {
+        const TigerString *pending[MAX_DEPTH + 2];
+        int count = 0;
+        pending[count++] = s;
+        while (count > 0)
+        {
+            auto next = pending[--count];
+            if (auto chars = charsOf(next))
+            {
+                visit(chars, next->length);
+                continue;
+            }
+            auto rope = ropeOf(next);
+            pending[count++] = rope->right;
+            pending[count++] = rope->left;
+        }
+    }
+
+    // The characters of s in one piece, which a rope keeps, so it is only
+    // copied once. The pieces are read after the allocation, which may
+    // move them.
+    const char *flatten(const TigerString *s)
+    {
+        if (auto chars = charsOf(s))
+        {
+            return chars;
+        }
+        auto rope = ropeOf(s);
+        auto result = allocString(s->length);
+        int64_t at = 0;
+        forEachPiece(s, [result, &at](const char *chars, int64_t length)
+        {
+            Kernels::copy(result->chars + at, chars, (size_t) length);
+            at += length;
+        });
+        rope->left = result;
+        rope->right = nullptr;
+        rope->depth = 0;
+        // The rope may be older than its copy
+        tiger_markCard(reinterpret_cast<const int64_t *>(&rope->left));
+        return result->chars;
+    }
+
+    const TigerString *makeRope(const TigerString *left, const TigerString *right)
+    {
+        auto rope = reinterpret_cast<Rope *>(Gc::allocate(sizeof(Rope), Gc::RECORD, (uint64_t) &ropeLayout));
+        rope->length = left->length + right->length;
+        rope->left = left;
+        rope->right = right;
+        rope->depth = std::max(depthOf(left), depthOf(right)) + 1;
+        return reinterpret_cast<const TigerString *>(rope);
+    }
+
+    const TigerString *makeSlice(const TigerString *string, int64_t first, int64_t length)
+    {
+        auto slice = reinterpret_cast<Slice *>(Gc::allocate(sizeof(Slice), Gc::RECORD | Gc::SLICE,
+                                                            (uint64_t) &sliceLayout));
+        slice->length = length;
+        slice->string = string;
+        slice->first = first;
+        return reinterpret_cast<const TigerString *>(slice);
+    }
+
+    // A rope of left and then right. When one is more than a level deeper
+    // than the other, and its piece next to the other is no deeper than
+    // the other, that piece is joined to the other first, like a carry of
+    // a binary counter: appending or prepending again and again keeps the
+    // depth about the logarithm of the pieces, for a node or two an append.
+    const TigerString *join(const TigerString *left, const TigerString *right)
+    {
+        for (;;)
+        {
+            auto leftDepth = depthOf(left);
+            auto rightDepth = depthOf(right);
+            if (leftDepth > rightDepth + 1 && depthOf(ropeOf(left)->right) <= rightDepth)
+            {
+                auto rope = ropeOf(left);
+                right = makeRope(rope->right, right);
+                left = rope->left;
+            }
+            else if (rightDepth > leftDepth + 1 && depthOf(ropeOf(right)->left) <= leftDepth)
+            {
+                auto rope = ropeOf(right);
+                left = makeRope(left, rope->left);
+                right = rope->right;
+            }
+            else
+            {
+                break;
+            }
+        }
+        auto result = makeRope(left, right);
+        if (depthOf(result) > MAX_DEPTH)
+        {
+            flatten(result);
+        }
+        return result;
+    }
+
+    // The characters of left and then of right, copied
+    const TigerString *concatChars(const char *left, int64_t leftLength, const char *right, int64_t rightLength)
+    {
+        auto result = allocString(leftLength + rightLength);
+        Kernels::copy(result->chars, left, (size_t) leftLength);
+        Kernels::copy(result->chars + leftLength, right, (size_t) rightLength);
+        return result;
+    }
+
+    // Stores value into the count words at words, two words a store
+    void fill(int64_t *words, int64_t count, int64_t value)
+    {
+        int64_t i = 0;
+#ifdef __SSE2__
+        auto pair = _mm_set1_epi64x(value);
+        for (; i + 8 <= count; i += 8)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(words + i), pair);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(words + i + 2), pair);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(words + i + 4), pair);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(words + i + 6), pair);
+        }
+        for (; i + 2 <= count; i += 2)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(words + i), pair);
+        }
+#endif
+        for (; i < count; i++)
+        {
+            words[i] = value;
+        }
+    }
+}
+
+// The entry points that allocate save the callee saved registers of the
+// compiled code that calls them, which the collector finds through
+// tiger_callerFrame and may change when it moves what they point at, and
+// clear them so the runtime's frames hold no copies. They run the body of
+// the same name.
+#if defined(__x86_64__) && defined(__ELF__)
+#define TIGER_TRAMPOLINE(name) \
+    asm(".text\n" \
+        ".globl " #name "\n" \
+        ".type " #name ", @function\n" \
+        #name ":\n" \
+        "\tpushq %rbx\n" \
+        "\tpushq %rbp\n" \
+        "\tpushq %r12\n" \
+        "\tpushq %r13\n" \
+        "\tpushq %r14\n" \
+        "\tpushq %r15\n" \
+        "\tsubq $8, %rsp\n" \
+        "\tleaq 8(%rsp), %rax\n" \
+        "\tmovq %rax, tiger_callerFrame(%rip)\n" \
+        "\txorl %ebx, %ebx\n" \
+        "\txorl %r12d, %r12d\n" \
+        "\txorl %r13d, %r13d\n" \
+        "\txorl %r14d, %r14d\n" \
+        "\txorl %r15d, %r15d\n" \
+        "\tcall " #name "Body@PLT\n" \
+        "\tmovq $0, tiger_callerFrame(%rip)\n" \
+        "\taddq $8, %rsp\n" \
+        "\tpopq %r15\n" \
+        "\tpopq %r14\n" \
+        "\tpopq %r13\n" \
+        "\tpopq %r12\n" \
+        "\tpopq %rbp\n" \
+        "\tpopq %rbx\n" \
+        "\tret\n" \
+        ".size " #name ", .-" #name "\n");
+
+TIGER_TRAMPOLINE(tiger_initArray)
+TIGER_TRAMPOLINE(tiger_initRecord)
+TIGER_TRAMPOLINE(tiger_strcmp)
+TIGER_TRAMPOLINE(tiger_substring)
+TIGER_TRAMPOLINE(tiger_concat)
+#endif
+
+extern "C"
+{
+    int64_t *tiger_initArrayBody(int64_t size, int64_t init, int64_t pointers)
+    {
+        if (size < 0)
+        {
+            fail("Array of negative size %lld", size);
+        }
+        if (size > MAX_ARRAY)
+        {
+            fail("Array of %lld elements is too large", size);
+        }
+        auto bytes = (size_t) (size > 0 ? size : 1) * sizeof(int64_t);
+        auto array = Gc::allocate(bytes, pointers ? Gc::ARRAY | Gc::POINTERS : (uint64_t) Gc::ARRAY, 0);
+        // Large arrays are zeroed already. The words that pad the payload
+        // are filled too, as the collector reads them with the elements.
+        if (init != 0 || bytes + Gc::HEADER_SIZE < Gc::LARGE_SIZE)
+        {
+            fill(array, (int64_t) ((bytes / sizeof(int64_t) + 1) & ~(size_t) 1), init);
+        }
+        return array;
+    }
+
+    void *tiger_initRecordBody(int64_t size, const TigerString *layout)
+    {
+        if (size > (int64_t) Gc::MAX_RECORD)
+        {
+            fail("Record of %lld bytes is too large", size);
+        }
+        return Gc::allocate((size_t) (size > 0 ? size : 1), Gc::RECORD, (uint64_t) layout);
+    }
+
+    void tiger_markCard(const int64_t *address)
+    {
+        tiger_cardTable[(uintptr_t) address >> TIGER_CARD_SHIFT] = 1;
+    }
+
+    int64_t tiger_strcmpBody(const TigerString *left, const TigerString *right)
+    {
+        if (left == right)
+        {
+            return 0;
+        }
+        auto leftChars = flatten(left);
+        auto rightChars = flatten(right);
+        int64_t length = left->length < right->length ? left->length : right->length;
+        int result = Kernels::compare(leftChars, rightChars, (size_t) length);
+        if (result != 0)
+        {
+            return result;
+        }
+        return left->length < right->length ? -1 : left->length > right->length ? 1 : 0;
+    }
+
+    void tiger_print(const TigerString *s)
+    {
+        // A rope is written a piece at a time, with no copy
+        forEachPiece(s, [](const char *chars, int64_t length)
+        {
+            // Programs run on one thread, so stdout needs no lock
+#ifdef __GLIBC__
+            fwrite_unlocked(chars, 1, (size_t) length, stdout);
+#else
+            std::fwrite(chars, 1, (size_t) length, stdout);
+#endif
+        });
+    }
+
+    void tiger_flush()
+    {
+        std::fflush(stdout);
+    }
+
+    const TigerString *tiger_getchar()
+    {
+        int c = std::getchar();
+        return c == EOF ? asString(empty) : asString(chars[c]);
+    }
+
+    int64_t tiger_ord(const TigerString *s)
+    {
+        if (s->length == 0)
+        {
+            return -1;
+        }
+        // The first piece of a rope holds its first character
+        while (charsOf(s) == nullptr)
+        {
+            s = ropeOf(s)->left;
+        }
+        return (unsigned char) charsOf(s)[0];
+    }
+
+    const TigerString *tiger_chr(int64_t i)
+    {
+        if (i < 0 || i > 255)
+        {
+            fail("chr(%lld) out of range", i);
+        }
+        return asString(chars[i]);
+    }
+
+    int64_t tiger_size(const TigerString *s)
+    {
+        return s->length;
+    }
+
+    const TigerString *tiger_substringBody(const TigerString *s, int64_t first, int64_t n)
+    {
+        if (first < 0 || n < 0 || first + n > s->length)
+        {
+            fail("substring out of range at %lld", first);
+        }
+        // Strings never change, so they can be shared
+        if (n == s->length)
+        {
+            return s;
+        }
+        auto from = flatten(s) + first;
+        if (n <= 1)
+        {
+            return n == 0 ? asString(empty) : asString(chars[(unsigned char) *from]);
+        }
+        if (n < MIN_SLICE)
+        {
+            auto result = allocString(n);
+            Kernels::copy(result->chars, from, (size_t) n);
+            return result;
+        }
+        // A slice of a slice is one of the same string
+        int64_t offset;
+        auto buffer = bufferOf(s, offset);
+        return makeSlice(buffer, offset + first, n);
+    }
+
+    const TigerString *tiger_concatBody(const TigerString *left, const TigerString *right)
+    {
+        if (left->length == 0)
+        {
+            return right;
+        }
+        if (right->length == 0)
+        {
+            return left;
+        }
+        auto leftChars = charsOf(left);
+        auto rightChars = charsOf(right);
+        if (leftChars != nullptr && rightChars != nullptr && left->length + right->length <= SHORT_STRING)
+        {
+            return concatChars(leftChars, left->length, rightChars, right->length);
+        }
+        // A short string goes into the short piece at that end of a rope,
+        // so appending a character at a time makes pieces, not nodes
+        auto leftRope = ropeOf(left);
+        auto rightRope = ropeOf(right);
+        if (rightChars != nullptr && leftRope != nullptr && leftRope->right != nullptr)
+        {
+            auto last = leftRope->right;
+            auto lastChars = charsOf(last);
+            if (lastChars != nullptr && last->length + right->length <= SHORT_STRING)
+            {
+                auto piece = concatChars(lastChars, last->length, rightChars, right->length);
+                return join(leftRope->left, piece);
+            }
+        }
+        if (leftChars != nullptr && rightRope != nullptr && rightRope->right != nullptr)
+        {
+            auto first = rightRope->left;
+            auto firstChars = charsOf(first);
+            if (firstChars != nullptr && left->length + first->length <= SHORT_STRING)
+            {
+                auto piece = concatChars(leftChars, left->length, firstChars, first->length);
+                return join(piece, rightRope->right);
+            }
+        }
+        return join(left, right);
+    }
+
+#if !defined(__x86_64__) || !defined(__ELF__)
+    // Without the trampolines the collector scans the stack conservatively
+    int64_t *tiger_initArray(int64_t size, int64_t init, int64_t pointers)
+    {
+        return tiger_initArrayBody(size, init, pointers);
+    }
+
+    void *tiger_initRecord(int64_t size, const TigerString *layout)
+    {
+        return tiger_initRecordBody(size, layout);
+    }
+
+    int64_t tiger_strcmp(const TigerString *left, const TigerString *right)
+    {
+        return tiger_strcmpBody(left, right);
+    }
+
+    const TigerString *tiger_substring(const TigerString *s, int64_t first, int64_t n)
+    {
+        return tiger_substringBody(s, first, n);
+    }
+
+    const TigerString *tiger_concat(const TigerString *left, const TigerString *right)
+    {
+        return tiger_concatBody(left, right);
+    }
+#endif
+
+    int64_t tiger_not(int64_t i)
+    {
+        return i == 0;
+    }
+
+    void tiger_exit(int64_t code)
+    {
+        std::fflush(stdout);
+        std::exit((int) code);
+    }
+}
+
+const TigerEntryPoint tiger_entryPoints[] = {
+        {"tiger_initArray", reinterpret_cast<void *>(tiger_initArray)},
+        {"tiger_initRecord", reinterpret_cast<void *>(tiger_initRecord)},
+        {"tiger_strcmp", reinterpret_cast<void *>(tiger_strcmp)},
+        {"tiger_print", reinterpret_cast<void *>(tiger_print)},
+        {"tiger_flush", reinterpret_cast<void *>(tiger_flush)},
+        {"tiger_getchar", reinterpret_cast<void *>(tiger_getchar)},
+        {"tiger_ord", reinterpret_cast<void *>(tiger_ord)},
+        {"tiger_chr", reinterpret_cast<void *>(tiger_chr)},
+        {"tiger_size", reinterpret_cast<void *>(tiger_size)},
+        {"tiger_substring", reinterpret_cast<void *>(tiger_substring)},
+        {"tiger_concat", reinterpret_cast<void *>(tiger_concat)},
+        {"tiger_not", reinterpret_cast<void *>(tiger_not)},
+        {"tiger_exit", reinterpret_cast<void *>(tiger_exit)},
+        {"tiger_markCard", reinterpret_cast<void *>(tiger_markCard)},
+        {"tiger_cardTable", reinterpret_cast<void *>(&tiger_cardTable)},
+        {"tiger_heapNext", reinterpret_cast<void *>(&Gc::next)},
+        {"tiger_heapLimit", reinterpret_cast<void *>(&Gc::limit)},
+        {"tiger_objectMap", reinterpret_cast<void *>(&Gc::objectMap)},
+        {nullptr, nullptr}
+};
+
+void tiger_init()
+{
+    makeChars();
+    Kernels::init();
+    Gc::init();
+    // Fewer writes for programs that print a character at a time
+    if (!isatty(STDOUT_FILENO))
+    {
+        std::setvbuf(stdout, outputBuffer, _IOFBF, OUTPUT_BUFFER_SIZE);
+    }
+}
+
+void tiger_setRoots(const int64_t *begin, const int64_t *end)
+{
+    Gc::setRoots(begin, end);
+}
+
+int tiger_run(int64_t (*main)(int64_t), const int32_t *stackMaps)
+{
+    tiger_init();
+    Gc::setStackMaps(stackMaps);
+    main(0);
+    std::fflush(stdout);
+    return 0;
+}
@@ -0,0 +1,77 @@
+//
+// Runtime library of compiled Tiger programs
+//
+
+#ifndef RUNTIME_RUNTIME_H
+#define RUNTIME_RUNTIME_H
+
+#include <cstdint>
+
+// A string is its length followed by its characters, which is also how
+// the compiler lays out string literals. Long concatenations are ropes
+// and long substrings slices, which begin with the length too but leave
+// the characters to the strings they join or are taken from, so only the
+// runtime reads the characters of a string.
+struct TigerString
+{
+    int64_t length;
+    char chars[1];
+};
+
+// An address shifted right by this is the index of its card
+const int TIGER_CARD_SHIFT = 9;
+
+// What compiled programs call, under the names Frame::makeRuntimeLabel
+// gives them. The heap is garbage collected: initArray is told whether the
+// elements are pointers, and initRecord which fields are, by a string with
+// a '1' for each pointer field and a '0' for each int, or null for none.
+extern "C"
+{
+    int64_t *tiger_initArray(int64_t size, int64_t init, int64_t pointers);
+    void *tiger_initRecord(int64_t size, const TigerString *layout);
+    int64_t tiger_strcmp(const TigerString *left, const TigerString *right);
+    void tiger_print(const TigerString *s);
+    void tiger_flush();
+    const TigerString *tiger_getchar();
+    int64_t tiger_ord(const TigerString *s);
+    const TigerString *tiger_chr(int64_t i);
+    int64_t tiger_size(const TigerString *s);
+    const TigerString *tiger_substring(const TigerString *s, int64_t first, int64_t n);
+    const TigerString *tiger_concat(const TigerString *left, const TigerString *right);
+    int64_t tiger_not(int64_t i);
+    void tiger_exit(int64_t code);
+
+    // The write barrier: code that stores a pointer at address marks its
+    // card, tiger_cardTable[address >> TIGER_CARD_SHIFT], as the native
+    // code does inline, so the next minor collection looks at the card
+    void tiger_markCard(const int64_t *address);
+    extern int64_t *tiger_cardTable;
+}
+
+// What code that does not go through the linker, like the compiler's
+// --run, needs to call the runtime
+struct TigerEntryPoint
+{
+    const char *name;
+    void *address;
+};
+
+// Every function and variable compiled code may refer to, ending with a
+// null name
+extern const TigerEntryPoint tiger_entryPoints[];
+
+// Sets the runtime up, before anything else is called
+void tiger_init();
+
+// Words of [begin, end) are roots of the collector from then on, like those
+// of the native stack, for an interpreter that keeps Tiger values in a
+// stack of its own
+void tiger_setRoots(const int64_t *begin, const int64_t *end);
+
+// Calls tiger_init, runs main with a null static link and flushes the
+// output. Returns the exit status, unless the program calls exit.
+// stackMaps is the table the compiler wrote with the code, or null, which
+// leaves the collector to scan the stack conservatively.
+int tiger_run(int64_t (*main)(int64_t), const int32_t *stackMaps);
+
+#endif //RUNTIME_RUNTIME_H
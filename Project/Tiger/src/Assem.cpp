@@ -0,0 +1,171 @@
+//
+// x86-64 instructions over temps
+//
+
+#include "Assem.h"
+
+namespace Assem
+{
+    Instr makeInstr(Opcode opcode, Form form)
+    {
+        Instr instr;
+        instr.opcode = (uint8_t) opcode;
+        instr.form = (uint8_t) form;
+        instr.cond = 0;
+        instr.argCount = 0;
+        instr.kind = Temporary::UNKNOWN;
+        instr.dst = NONE;
+        instr.src = NONE;
+        instr.imm = 0;
+        instr.target = NONE;
+        instr.mem = makeMem(NONE, 0);
+        return instr;
+    }
+
+    Mem makeMem(int32_t base, int32_t disp)
+    {
+        Mem mem;
+        mem.base = base;
+        mem.index = NONE;
+        mem.scale = 1;
+        mem.disp = disp;
+        mem.label = NONE;
+        return mem;
+    }
+
+    bool isMove(const Instr &instr)
+    {
+        return instr.opcode == MOV && instr.form == RR;
+    }
+
+    IR::ComparisonOp negate(IR::ComparisonOp cond)
+    {
+        switch (cond)
+        {
+            case IR::EQ:
+                return IR::NE;
+            case IR::NE:
+                return IR::EQ;
+            case IR::LT:
+                return IR::GE;
+            case IR::GE:
+                return IR::LT;
+            case IR::GT:
+                return IR::LE;
+            case IR::LE:
+            default:
+                return IR::GT;
+        }
+    }
+
+    IR::ComparisonOp commute(IR::ComparisonOp cond)
+    {
+        switch (cond)
+        {
+            case IR::LT:
+                return IR::GT;
+            case IR::GT:
+                return IR::LT;
+            case IR::LE:
+                return IR::GE;
+            case IR::GE:
+                return IR::LE;
+            default:
+                return cond;
+        }
+    }
+
+    namespace
+    {
+        // Opcodes that read and write their destination register
+        bool readsDst(uint8_t opcode)
+        {
+            return opcode == ADD || opcode == SUB || opcode == IMUL || opcode == SHR || opcode == CMP;
+        }
+
+        bool writesDst(uint8_t opcode)
+        {
+            return opcode != CMP;
+        }
+
+        void addMem(const Mem &mem, std::vector<int32_t> &uses)
+        {
+            if (mem.base != NONE)
+            {
+                uses.push_back(mem.base);
+            }
+            if (mem.index != NONE)
+            {
+                uses.push_back(mem.index);
+            }
+        }
+    }
+
+    void getUses(const Instr &instr, std::vector<int32_t> &uses)
+    {
+        switch (instr.form)
+        {
+            case R:
+            case RR:
+            case MR:
+            case RRI:
+                uses.push_back(instr.src);
+                break;
+            default:
+                break;
+        }
+        if ((instr.form == RR || instr.form == RI || instr.form == RM) && readsDst(instr.opcode))
+        {
+            uses.push_back(instr.dst);
+        }
+        if (instr.form == RM || instr.form == MR || instr.form == MI)
+        {
+            addMem(instr.mem, uses);
+        }
+        switch (instr.opcode)
+        {
+            case CQO:
+                uses.push_back(Frame::RAX);
+                break;
+            case IDIV:
+                uses.push_back(Frame::RAX);
+                uses.push_back(Frame::RDX);
+                break;
+            case CALL:
+                for (int i = 0; i < instr.argCount; i++)
+                {
+                    uses.push_back(Frame::ARG_REGISTERS[i]);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    void getDefs(const Instr &instr, std::vector<int32_t> &defs)
+    {
+        if ((instr.form == RR || instr.form == RI || instr.form == RM || instr.form == RRI) &&
+            writesDst(instr.opcode))
+        {
+            defs.push_back(instr.dst);
+        }
+        switch (instr.opcode)
+        {
+            case CQO:
+                defs.push_back(Frame::RDX);
+                break;
+            case IDIV:
+                defs.push_back(Frame::RAX);
+                defs.push_back(Frame::RDX);
+                break;
+            case CALL:
+                for (auto reg : Frame::CALLER_SAVES)
+                {
+                    defs.push_back(reg);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
@@ -0,0 +1,152 @@
+//
+// x86-64 instructions over temps
+//
+
+#ifndef SRC_ASSEM_H
+#define SRC_ASSEM_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Frame.h"
+
+// Instructions are records, not text, so the register allocator can read
+// their uses and defs and rewrite their operands. A temp below
+// Frame::REGISTER_COUNT is that machine register, the others are virtual.
+namespace Assem
+{
+    // Stands for a missing temp, block or label
+    const int32_t NONE = -1;
+
+    enum Opcode
+    {
+        MOV, LEA, ADD, SUB, IMUL, CQO, IDIV, SHR, CMP, JMP, JCC, CALL,
+        MOVB        // a byte store, MI only
+    };
+
+    // Operands, destination first
+    //   NO_OPERANDS  cqo
+    //   R            src                  idiv, call *src, jmp *src
+    //   RR           dst, src
+    //   RI           dst, imm             shr by imm
+    //   RM           dst, mem             loads, lea
+    //   MR           mem, src             stores
+    //   MI           mem, imm
+    //   RRI          dst, src, imm        imul
+    //   L            target               jmp, jcc, call
+    enum Form
+    {
+        NO_OPERANDS, R, RR, RI, RM, MR, MI, RRI, L
+    };
+
+    // base + index * scale + disp, or labels[label] + disp relative to the
+    // instruction pointer when label is set
+    struct Mem
+    {
+        int32_t base;
+        int32_t index;
+        int32_t scale;
+        int32_t disp;
+        int32_t label;
+    };
+
+    struct Instr
+    {
+        uint8_t opcode;     // Opcode
+        uint8_t form;       // Form
+        uint8_t cond;       // IR::ComparisonOp of a JCC, signed
+        uint8_t argCount;   // arguments a CALL passes in registers
+        // Temporary::Kind of what the instruction writes to dst, from its
+        // temp, which the stack maps need once registers replace the temps
+        uint8_t kind;
+        int32_t dst;
+        int32_t src;
+        int32_t imm;
+        // Block of a JMP or JCC, label of a CALL
+        int32_t target;
+        Mem mem;
+    };
+
+    // Instructions [begin, end) of a function. A block without a jump at
+    // its end falls through to the next one.
+    struct Block
+    {
+        int32_t label;      // index into labels, NONE for an unlabelled start
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    // Where the collector finds the heap pointers of a frame while one of
+    // its calls is out: words at offsets from the frame pointer and callee
+    // saved registers, bit i for Frame::CALLEE_SAVES[i]. A pointer root
+    // holds the start of an object or a value outside the heap, so the
+    // collector may move the object and update the root. Any other root may
+    // point anywhere into an object, which then stays where it is.
+    struct StackMap
+    {
+        uint32_t call;      // index of the CALL in instrs
+        uint8_t pointerRegisters;
+        uint8_t otherRegisters;
+        std::vector<int32_t> pointerSlots;
+        std::vector<int32_t> otherSlots;
+    };
+
+    // The return value is live when the last block ends, and the frame,
+    // with the callee saved registers the body writes, is made around the
+    // body when it is emitted.
+    struct Function
+    {
+        std::string name;
+        std::vector<Instr> instrs;
+        std::vector<Block> blocks;
+        std::vector<std::string> labels;
+        int32_t tempCount;
+        // Words below the frame pointer taken by the Frame's locals, then by
+        // the allocator's spill slots
+        int32_t frameWords;
+        int32_t spillWords;
+        // Words at the stack pointer for arguments after the sixth
+        int32_t outgoingWords;
+        // What the register allocator did: temps it put on the stack, and
+        // moves it removed because both sides got the same register
+        int32_t spilledTemps;
+        int32_t eliminatedMoves;
+        // Temporary::Kind of the temps the selector took from the IR, and
+        // of the variables in the frame by their offset from the frame
+        // pointer
+        std::vector<uint8_t> tempKinds;
+        std::vector<std::pair<int32_t, uint8_t>> frameKinds;
+        // One for every CALL, in order, once the registers are allocated
+        std::vector<StackMap> stackMaps;
+    };
+
+    using FunctionList = std::vector<std::shared_ptr<Function>>;
+
+    Instr makeInstr(Opcode opcode, Form form);
+
+    Mem makeMem(int32_t base, int32_t disp);
+
+    inline bool isRegister(int32_t temp)
+    {
+        return temp >= 0 && temp < Frame::REGISTER_COUNT;
+    }
+
+    // A register to register MOV
+    bool isMove(const Instr &instr);
+
+    // The condition that holds when cond does not
+    IR::ComparisonOp negate(IR::ComparisonOp cond);
+
+    // The condition that holds with the operands swapped
+    IR::ComparisonOp commute(IR::ComparisonOp cond);
+
+    // Append the temps instr reads and writes, including the registers it
+    // uses implicitly. A temp can be listed twice.
+    void getUses(const Instr &instr, std::vector<int32_t> &uses);
+
+    void getDefs(const Instr &instr, std::vector<int32_t> &defs);
+}
+
+#endif //SRC_ASSEM_H
@@ -0,0 +1,403 @@
+//
+// Allocation inline in the nursery
+//
+
+#include "Bump.h"
+#include <algorithm>
+
+namespace Bump
+{
+    namespace
+    {
+        // The runtime's allocators and the variables of its nursery, and
+        // the headers it writes, as runtime/gc.h lays them out
+        const char *const INIT_RECORD_NAME = "tiger_initRecord";
+        const char *const INIT_ARRAY_NAME = "tiger_initArray";
+        const char *const HEAP_NEXT_NAME = "tiger_heapNext";
+        const char *const HEAP_LIMIT_NAME = "tiger_heapLimit";
+        const char *const OBJECT_MAP_NAME = "tiger_objectMap";
+        const int32_t ARRAY = 1;
+        const int32_t POINTERS = 32;
+        const int SIZE_SHIFT = 8;
+        const int32_t HEADER_SIZE = 16;
+        const int GRANULE_SHIFT = 4;
+        const int32_t LARGE_SIZE = 64 << 10;
+        // Longer arrays are left to the runtime, which fills them faster
+        const int32_t MAX_ARRAY = 32;
+
+        class Expander
+        {
+            Assem::Function &function;
+            std::vector<Assem::Instr> instrs;
+            std::vector<Assem::Block> blocks;
+            // Whether each jump of instrs already goes to a new block
+            std::vector<bool> renumbered;
+            // Where the block being built starts
+            int32_t label;
+            uint32_t begin;
+
+            int32_t newTemp(Temporary::Kind kind)
+            {
+                function.tempKinds.push_back((uint8_t) kind);
+                return function.tempCount++;
+            }
+
+            int32_t symbol(const char *name)
+            {
+                auto found = std::find(function.labels.begin(), function.labels.end(), name);
+                if (found != function.labels.end())
+                {
+                    return (int32_t) (found - function.labels.begin());
+                }
+                function.labels.push_back(name);
+                return (int32_t) function.labels.size() - 1;
+            }
+
+            void emit(const Assem::Instr &instr)
+            {
+                instrs.push_back(instr);
+                renumbered.push_back(false);
+            }
+
+            void closeBlock()
+            {
+                blocks.push_back({label, begin, (uint32_t) instrs.size()});
+                label = Assem::NONE;
+                begin = (uint32_t) instrs.size();
+            }
+
+            // Ends the block with a jump to the new block target
+            void jump(Assem::Opcode opcode, IR::ComparisonOp cond, int32_t target)
+            {
+                auto instr = Assem::makeInstr(opcode, Assem::L);
+                instr.cond = (uint8_t) cond;
+                instr.target = target;
+                emit(instr);
+                renumbered.back() = true;
+                closeBlock();
+            }
+
+            void move(int32_t dst, int32_t src)
+            {
+                auto instr = Assem::makeInstr(Assem::MOV, Assem::RR);
+                instr.dst = dst;
+                instr.src = src;
+                emit(instr);
+            }
+
+            void lea(int32_t dst, const Assem::Mem &mem)
+            {
+                auto instr = Assem::makeInstr(Assem::LEA, Assem::RM);
+                instr.dst = dst;
+                instr.mem = mem;
+                emit(instr);
+            }
+
+            void store(const Assem::Mem &mem, int32_t src)
+            {
+                auto instr = Assem::makeInstr(Assem::MOV, Assem::MR);
+                instr.mem = mem;
+                instr.src = src;
+                emit(instr);
+            }
+
+            Assem::Mem global(const char *name)
+            {
+                auto mem = Assem::makeMem(Assem::NONE, 0);
+                mem.label = symbol(name);
+                return mem;
+            }
+
+            // Whether the last write to temp before instruction at of block
+            // puts a constant there, following moves
+            bool constant(const Assem::Block &block, uint32_t at, int32_t temp, int32_t &value) const
+            {
+                std::vector<int32_t> defs;
+                for (uint32_t i = at; i-- > block.begin;)
+                {
+                    auto &instr = function.instrs[i];
+                    defs.clear();
+                    Assem::getDefs(instr, defs);
+                    if (std::find(defs.begin(), defs.end(), temp) == defs.end())
+                    {
+                        continue;
+                    }
+                    if (instr.opcode == Assem::MOV && instr.form == Assem::RI)
+                    {
+                        value = instr.imm;
+                        return true;
+                    }
+                    if (Assem::isMove(instr))
+                    {
+                        temp = instr.src;
+                        continue;
+                    }
+                    return false;
+                }
+                return false;
+            }
+
+            // Takes the object from the nursery's free part, bytes of it
+            // at header, and goes to target if they fit as cond says
+            void bump(int32_t header, int32_t end, const Assem::Mem &bytes, IR::ComparisonOp cond, int32_t target)
+            {
+                auto load = Assem::makeInstr(Assem::MOV, Assem::RM);
+                load.dst = header;
+                load.mem = global(HEAP_NEXT_NAME);
+                emit(load);
+                auto sum = bytes;
+                if (sum.base == Assem::NONE)
+                {
+                    sum.base = header;
+                }
+                else
+                {
+                    sum.index = header;
+                }
+                lea(end, sum);
+                auto compare = Assem::makeInstr(Assem::CMP, Assem::RM);
+                compare.dst = end;
+                compare.mem = global(HEAP_LIMIT_NAME);
+                emit(compare);
+                jump(Assem::JCC, cond, target);
+            }
+
+            // Writes the header of the object bumped off at header, and
+            // marks where it begins
+            void initialize(int32_t header, int32_t end, int32_t word, int32_t extra)
+            {
+                store(global(HEAP_NEXT_NAME), end);
+                auto kind = Assem::makeInstr(Assem::MOV, Assem::MI);
+                kind.mem = Assem::makeMem(header, 0);
+                kind.imm = word;
+                emit(kind);
+                store(Assem::makeMem(header, Frame::WORD_SIZE), extra);
+                auto map = newTemp(Temporary::SCALAR);
+                auto load = Assem::makeInstr(Assem::MOV, Assem::RM);
+                load.dst = map;
+                load.mem = global(OBJECT_MAP_NAME);
+                emit(load);
+                auto granule = newTemp(Temporary::SCALAR);
+                move(granule, header);
+                auto shift = Assem::makeInstr(Assem::SHR, Assem::RI);
+                shift.dst = granule;
+                shift.imm = GRANULE_SHIFT;
+                emit(shift);
+                auto mark = Assem::makeInstr(Assem::MOVB, Assem::MI);
+                mark.mem = Assem::makeMem(map, 0);
+                mark.mem.index = granule;
+                mark.imm = 1;
+                emit(mark);
+            }
+
+            // The call, with its arguments back in their registers, then
+            // the move of its result, and on to the block after if there is
+            // one
+            void slowPath(const Assem::Instr &call, const Assem::Instr &result, const std::vector<int32_t> &args,
+                          int32_t after)
+            {
+                for (size_t i = 0; i < args.size(); i++)
+                {
+                    move(Frame::ARG_REGISTERS[i], args[i]);
+                }
+                emit(call);
+                emit(result);
+                if (after != Assem::NONE)
+                {
+                    jump(Assem::JMP, IR::EQ, after);
+                }
+                else
+                {
+                    closeBlock();
+                }
+            }
+
+            std::vector<int32_t> saveArgs(const Assem::Instr &call)
+            {
+                std::vector<int32_t> args;
+                for (int i = 0; i < call.argCount; i++)
+                {
+                    args.push_back(newTemp(Temporary::UNKNOWN));
+                    move(args.back(), Frame::ARG_REGISTERS[i]);
+                }
+                return args;
+            }
+
+            // A record of size bytes, laid out as the second argument says:
+            // the block so far bumps it, then the fast path, the call, and
+            // the rest
+            void record(const Assem::Instr &call, const Assem::Instr &result, int32_t size)
+            {
+                int32_t bytes = (HEADER_SIZE + std::max(size, 1) + 15) & ~15;
+                auto args = saveArgs(call);
+                auto slow = (int32_t) blocks.size() + 2;
+                auto header = newTemp(Temporary::UNKNOWN);
+                auto end = newTemp(Temporary::UNKNOWN);
+                bump(header, end, Assem::makeMem(Assem::NONE, bytes), IR::GT, slow);
+                initialize(header, end, bytes / Frame::WORD_SIZE << SIZE_SHIFT, args[1]);
+                lea(result.dst, Assem::makeMem(header, HEADER_SIZE));
+                jump(Assem::JMP, IR::EQ, slow + 1);
+                slowPath(call, result, args, Assem::NONE);
+            }
+
+            // An array of the first argument's elements, each the second,
+            // pointers if the third is nonzero, of length elements if that
+            // is known: the block so far and, for any length, the next two
+            // check the length and bump it, then the call, the fast path,
+            // the loop that fills the elements and the word that may pad
+            // them, and the rest
+            void array(const Assem::Instr &call, const Assem::Instr &result, int32_t pointers, int32_t length)
+            {
+                auto args = saveArgs(call);
+                auto bytes = newTemp(Temporary::SCALAR);
+                auto slow = (int32_t) blocks.size() + 1;
+                if (length == Assem::NONE)
+                {
+                    slow += 2;
+                    auto compare = Assem::makeInstr(Assem::CMP, Assem::RI);
+                    compare.dst = args[0];
+                    compare.imm = 1;
+                    emit(compare);
+                    jump(Assem::JCC, IR::LT, slow);
+                    compare.imm = MAX_ARRAY;
+                    emit(compare);
+                    jump(Assem::JCC, IR::GT, slow);
+
+                    // Two elements a granule, with the header's
+                    lea(bytes, Assem::makeMem(args[0], 3));
+                    auto shift = Assem::makeInstr(Assem::SHR, Assem::RI);
+                    shift.dst = bytes;
+                    shift.imm = 1;
+                    emit(shift);
+                    auto scale = Assem::makeInstr(Assem::IMUL, Assem::RI);
+                    scale.dst = bytes;
+                    scale.imm = 1 << GRANULE_SHIFT;
+                    emit(scale);
+                }
+                else
+                {
+                    auto load = Assem::makeInstr(Assem::MOV, Assem::RI);
+                    load.dst = bytes;
+                    load.imm = (length + 3) / 2 << GRANULE_SHIFT;
+                    emit(load);
+                }
+                auto header = newTemp(Temporary::UNKNOWN);
+                auto end = newTemp(Temporary::UNKNOWN);
+                bump(header, end, Assem::makeMem(bytes, 0), IR::LE, slow + 1);
+                slowPath(call, result, args, slow + 3);
+                initialize(header, end, pointers != 0 ? ARRAY | POINTERS : ARRAY, bytes);
+                lea(result.dst, Assem::makeMem(header, HEADER_SIZE));
+                auto at = newTemp(Temporary::UNKNOWN);
+                lea(at, Assem::makeMem(header, HEADER_SIZE));
+                closeBlock();
+
+                auto loop = (int32_t) blocks.size();
+                store(Assem::makeMem(at, 0), args[1]);
+                store(Assem::makeMem(at, Frame::WORD_SIZE), args[1]);
+                auto add = Assem::makeInstr(Assem::ADD, Assem::RI);
+                add.dst = at;
+                add.imm = 2 * Frame::WORD_SIZE;
+                emit(add);
+                auto done = Assem::makeInstr(Assem::CMP, Assem::RR);
+                done.dst = at;
+                done.src = end;
+                emit(done);
+                jump(Assem::JCC, IR::LT, loop);
+            }
+
+            // Expands the call at i of block if it allocates and its result
+            // goes straight to a temp
+            bool expand(const Assem::Block &block, uint32_t i)
+            {
+                auto &call = function.instrs[i];
+                if (call.opcode != Assem::CALL || call.form != Assem::L || i + 1 >= block.end)
+                {
+                    return false;
+                }
+                auto &result = function.instrs[i + 1];
+                if (!Assem::isMove(result) || result.src != Frame::RAX || Assem::isRegister(result.dst))
+                {
+                    return false;
+                }
+                auto &name = function.labels[call.target];
+                int32_t value;
+                int32_t length;
+                if (name == INIT_RECORD_NAME && call.argCount == 2 &&
+                    constant(block, i, Frame::ARG_REGISTERS[0], value) && value >= 0 &&
+                    value < LARGE_SIZE - 2 * HEADER_SIZE)
+                {
+                    record(call, result, value);
+                    return true;
+                }
+                if (name == INIT_ARRAY_NAME && call.argCount == 3 && constant(block, i, Frame::ARG_REGISTERS[2], value))
+                {
+                    if (!constant(block, i, Frame::ARG_REGISTERS[0], length))
+                    {
+                        length = Assem::NONE;
+                    }
+                    else if (length < 1 || length > MAX_ARRAY)
+                    {
+                        return false;
+                    }
+                    array(call, result, value, length);
+                    return true;
+                }
+                return false;
+            }
+
+        public:
+            explicit Expander(Assem::Function &function)
+                    : function(function), label(Assem::NONE), begin(0)
+            {}
+
+            void run()
+            {
+                if (std::find(function.labels.begin(), function.labels.end(), INIT_RECORD_NAME) ==
+                    function.labels.end() &&
+                    std::find(function.labels.begin(), function.labels.end(), INIT_ARRAY_NAME) ==
+                    function.labels.end())
+                {
+                    return;
+                }
+                instrs.reserve(function.instrs.size());
+                // The new number of each block
+                std::vector<int32_t> first;
+                for (auto &block : function.blocks)
+                {
+                    first.push_back((int32_t) blocks.size());
+                    label = block.label;
+                    begin = (uint32_t) instrs.size();
+                    for (uint32_t i = block.begin; i < block.end; i++)
+                    {
+                        if (expand(block, i))
+                        {
+                            // The move of the result went with the call
+                            i++;
+                        }
+                        else
+                        {
+                            emit(function.instrs[i]);
+                        }
+                    }
+                    closeBlock();
+                }
+                for (size_t i = 0; i < instrs.size(); i++)
+                {
+                    auto &instr = instrs[i];
+                    if ((instr.opcode == Assem::JMP || instr.opcode == Assem::JCC) && instr.form == Assem::L &&
+                        !renumbered[i])
+                    {
+                        instr.target = first[instr.target];
+                    }
+                }
+                function.instrs = std::move(instrs);
+                function.blocks = std::move(blocks);
+            }
+        };
+    }
+
+    void expand(Assem::Function &function)
+    {
+        Expander(function).run();
+    }
+}
@@ -0,0 +1,23 @@
+//
+// Allocation inline in the nursery
+//
+
+#ifndef SRC_BUMP_H
+#define SRC_BUMP_H
+
+#include "Assem.h"
+
+// A call to initRecord of a constant size, or to initArray, becomes the
+// runtime's fast path: the object is bumped off the free part of the
+// nursery and its header written in place, and the call is left for when
+// the nursery is full, or an array is empty or long. The record's fields
+// are stored after it with no call in between, which Translate sees to,
+// so its payload is not zeroed.
+namespace Bump
+{
+    // Before the stack maps are prepared, on the temps the selector left.
+    // Splits the blocks of the allocations and renumbers the others.
+    void expand(Assem::Function &function);
+}
+
+#endif //SRC_BUMP_H
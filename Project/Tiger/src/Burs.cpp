@@ -0,0 +1,1029 @@
+//
+// Instruction selection by tree tiling
+//
+
+#include "Burs.h"
+#include "Error.h"
+#include <algorithm>
+#include <climits>
+#include <unordered_map>
+
+namespace Burs
+{
+    namespace
+    {
+        using Assem::makeInstr;
+
+        // Destination of a call whose value is not used
+        const int32_t DISCARD = -2;
+
+        enum Nonterminal : uint8_t
+        {
+            REG,            // value in a temp
+            IMM,            // constant
+            SCALE,          // constant an index can be scaled by
+            INDEX,          // index * scale
+            BASE_DISP,      // base + disp
+            INDEX_DISP,     // index * scale + disp
+            BASE_INDEX,     // base + index * scale
+            ADDR,           // any address
+            MEMORY,         // word at an address
+            NONTERMINAL_COUNT
+        };
+
+        // Missing child of a tile
+        const Nonterminal NO = NONTERMINAL_COUNT;
+
+        // Node a tile covers. A CHAIN tile covers no node of its own and
+        // turns its left nonterminal into its lhs.
+        enum Match : uint8_t
+        {
+            M_TEMP, M_CONST, M_NAME, M_CALL, M_MEM, M_PLUS, M_MINUS, M_MUL, M_DIV, M_CHAIN
+        };
+
+        // What reducing a tile emits
+        enum Action : uint8_t
+        {
+            TEMP_OPERAND, CONST_OPERAND, LOAD_LABEL, CALL_RESULT, MEMORY_OPERAND, LOAD_IMM, LOAD, LEA,
+            ARITHMETIC, DIVIDE, ADDRESS
+        };
+
+        struct Tile
+        {
+            Nonterminal lhs;
+            Match match;
+            Nonterminal left;
+            Nonterminal right;
+            int cost;
+            Action action;
+        };
+
+        // Costs count instructions, with a multiply as 3 and a division as
+        // 20. Of tiles of equal cost, the first one is taken.
+        const Tile TILES[] = {
+                {REG,        M_TEMP,  NO,         NO,         0,  TEMP_OPERAND},
+                {IMM,        M_CONST, NO,         NO,         0,  CONST_OPERAND},
+                {SCALE,      M_CONST, NO,         NO,         0,  CONST_OPERAND},
+                {REG,        M_NAME,  NO,         NO,         1,  LOAD_LABEL},
+                {REG,        M_CALL,  NO,         NO,         1,  CALL_RESULT},
+                {MEMORY,     M_MEM,   ADDR,       NO,         0,  MEMORY_OPERAND},
+
+                {REG,        M_PLUS,  REG,        REG,        1,  ARITHMETIC},
+                {REG,        M_PLUS,  REG,        IMM,        1,  ARITHMETIC},
+                {REG,        M_PLUS,  IMM,        REG,        1,  ARITHMETIC},
+                {REG,        M_PLUS,  REG,        MEMORY,     1,  ARITHMETIC},
+                {REG,        M_PLUS,  MEMORY,     REG,        1,  ARITHMETIC},
+                {REG,        M_MINUS, REG,        REG,        1,  ARITHMETIC},
+                {REG,        M_MINUS, REG,        IMM,        1,  ARITHMETIC},
+                {REG,        M_MINUS, REG,        MEMORY,     1,  ARITHMETIC},
+                {REG,        M_MUL,   REG,        REG,        3,  ARITHMETIC},
+                {REG,        M_MUL,   REG,        IMM,        3,  ARITHMETIC},
+                {REG,        M_MUL,   IMM,        REG,        3,  ARITHMETIC},
+                {REG,        M_MUL,   REG,        MEMORY,     3,  ARITHMETIC},
+                {REG,        M_MUL,   MEMORY,     REG,        3,  ARITHMETIC},
+                {REG,        M_DIV,   REG,        REG,        20, DIVIDE},
+                {REG,        M_DIV,   REG,        IMM,        21, DIVIDE},
+
+                {INDEX,      M_MUL,   REG,        SCALE,      0,  ADDRESS},
+                {INDEX,      M_MUL,   SCALE,      REG,        0,  ADDRESS},
+                {BASE_DISP,  M_PLUS,  REG,        IMM,        0,  ADDRESS},
+                {BASE_DISP,  M_PLUS,  IMM,        REG,        0,  ADDRESS},
+                {BASE_DISP,  M_MINUS, REG,        IMM,        0,  ADDRESS},
+                {INDEX_DISP, M_PLUS,  INDEX,      IMM,        0,  ADDRESS},
+                {INDEX_DISP, M_PLUS,  IMM,        INDEX,      0,  ADDRESS},
+                {INDEX_DISP, M_MINUS, INDEX,      IMM,        0,  ADDRESS},
+                {BASE_INDEX, M_PLUS,  REG,        INDEX,      0,  ADDRESS},
+                {BASE_INDEX, M_PLUS,  INDEX,      REG,        0,  ADDRESS},
+                {BASE_INDEX, M_PLUS,  REG,        REG,        0,  ADDRESS},
+                {ADDR,       M_PLUS,  BASE_INDEX, IMM,        0,  ADDRESS},
+                {ADDR,       M_PLUS,  IMM,        BASE_INDEX, 0,  ADDRESS},
+                {ADDR,       M_MINUS, BASE_INDEX, IMM,        0,  ADDRESS},
+                {ADDR,       M_PLUS,  REG,        INDEX_DISP, 0,  ADDRESS},
+                {ADDR,       M_PLUS,  INDEX_DISP, REG,        0,  ADDRESS},
+                {ADDR,       M_PLUS,  BASE_DISP,  INDEX,      0,  ADDRESS},
+                {ADDR,       M_PLUS,  INDEX,      BASE_DISP,  0,  ADDRESS},
+                {ADDR,       M_PLUS,  BASE_DISP,  REG,        0,  ADDRESS},
+                {ADDR,       M_PLUS,  REG,        BASE_DISP,  0,  ADDRESS},
+
+                {ADDR,       M_CHAIN, REG,        NO,         0,  ADDRESS},
+                {ADDR,       M_CHAIN, INDEX,      NO,         0,  ADDRESS},
+                {ADDR,       M_CHAIN, BASE_DISP,  NO,         0,  ADDRESS},
+                {ADDR,       M_CHAIN, INDEX_DISP, NO,         0,  ADDRESS},
+                {ADDR,       M_CHAIN, BASE_INDEX, NO,         0,  ADDRESS},
+                {REG,        M_CHAIN, IMM,        NO,         1,  LOAD_IMM},
+                {REG,        M_CHAIN, MEMORY,     NO,         1,  LOAD},
+                {REG,        M_CHAIN, ADDR,       NO,         1,  LEA},
+        };
+        const size_t TILE_COUNT = sizeof(TILES) / sizeof(TILES[0]);
+
+        const int INFINITE = INT_MAX / 4;
+        const int16_t NO_TILE = -1;
+
+        // Cheapest cost and tile of every nonterminal at a node
+        struct State
+        {
+            int cost[NONTERMINAL_COUNT];
+            int16_t tile[NONTERMINAL_COUNT];
+        };
+
+        // A reduced nonterminal: reg for REG, imm for IMM and SCALE, mem for
+        // the addresses and MEMORY
+        struct Operand
+        {
+            int32_t reg;
+            int32_t imm;
+            Assem::Mem mem;
+        };
+
+        Operand makeOperand(int32_t reg)
+        {
+            Operand operand;
+            operand.reg = reg;
+            operand.imm = 0;
+            operand.mem = Assem::makeMem(Assem::NONE, 0);
+            return operand;
+        }
+
+        bool isConst(const IR::Exp *exp)
+        {
+            return exp->getExpType() == IR::CONST;
+        }
+
+        int32_t constOf(const IR::Exp *exp)
+        {
+            return static_cast<const IR::Const *>(exp)->getConstt();
+        }
+
+        // An index can only be scaled by these
+        bool isScale(int32_t value)
+        {
+            return value == 1 || value == 2 || value == 4 || value == 8;
+        }
+
+        Match matchOf(const IR::Exp *exp)
+        {
+            switch (exp->getExpType())
+            {
+                case IR::TEMP:
+                    return M_TEMP;
+                case IR::CONST:
+                    return M_CONST;
+                case IR::NAME:
+                    return M_NAME;
+                case IR::CALL:
+                    return M_CALL;
+                case IR::MEM:
+                    return M_MEM;
+                case IR::BINOP:
+                {
+                    const Match ops[] = {M_PLUS, M_MINUS, M_MUL, M_DIV};
+                    return ops[static_cast<const IR::Binop *>(exp)->getOp()];
+                }
+                default:
+                    // No tile covers it
+                    return M_CHAIN;
+            }
+        }
+
+        // Labels and reduces the statements of one function. Trees are
+        // walked with explicit stacks, so deep ones cost no native stack.
+        class Selector
+        {
+            Assem::Function &function;
+            std::unordered_map<int, int32_t> temps;
+            std::unordered_map<std::string, int32_t> labelIndex;
+            // Block that starts at each label, NONE for labels of other code
+            std::vector<int32_t> labelBlock;
+            std::unordered_map<const IR::Exp *, State> states;
+            // Set while instructions go into the last block
+            bool open;
+            // Block placed after the one being selected
+            int32_t next;
+
+            struct Work
+            {
+                const IR::Exp *exp;
+                Nonterminal goal;
+                int32_t dst;
+                bool done;
+            };
+            std::vector<Work> work;
+            std::vector<std::pair<const IR::Exp *, bool>> pending;
+            std::vector<Operand> values;
+
+            int32_t newTemp()
+            {
+                return function.tempCount++;
+            }
+
+            int32_t temp(const std::shared_ptr<Temporary::Temp> &temp)
+            {
+                int num = temp->getNum();
+                if (num >= 0 && num < Frame::REGISTER_COUNT)
+                {
+                    return num;
+                }
+                auto found = temps.find(num);
+                if (found != temps.end())
+                {
+                    return found->second;
+                }
+                int32_t index = newTemp();
+                temps.emplace(num, index);
+                function.tempKinds.resize((size_t) function.tempCount, Temporary::UNKNOWN);
+                function.tempKinds[index] = (uint8_t) temp->getKind();
+                return index;
+            }
+
+            int32_t label(const std::shared_ptr<Temporary::Label> &label)
+            {
+                return symbol(label->getLabelName());
+            }
+
+            int32_t symbol(const std::string &name)
+            {
+                auto found = labelIndex.find(name);
+                if (found != labelIndex.end())
+                {
+                    return found->second;
+                }
+                auto index = (int32_t) function.labels.size();
+                function.labels.push_back(name);
+                labelBlock.push_back(Assem::NONE);
+                labelIndex.emplace(name, index);
+                return index;
+            }
+
+            int32_t target(int32_t dst)
+            {
+                return dst >= 0 ? dst : newTemp();
+            }
+
+            const State &state(const IR::Exp *exp) const
+            {
+                return states.find(exp)->second;
+            }
+
+            // A call argument is passed as an immediate when that is cheaper
+            Nonterminal argGoal(const IR::Exp *arg) const
+            {
+                auto &argState = state(arg);
+                return argState.cost[IMM] <= argState.cost[REG] ? IMM : REG;
+            }
+
+            // Labelling
+
+            static void getChildren(const IR::Exp *exp, std::vector<const IR::Exp *> &children)
+            {
+                switch (exp->getExpType())
+                {
+                    case IR::BINOP:
+                    {
+                        auto binop = static_cast<const IR::Binop *>(exp);
+                        children.push_back(binop->getLeft().get());
+                        children.push_back(binop->getRight().get());
+                        break;
+                    }
+                    case IR::MEM:
+                        children.push_back(static_cast<const IR::Mem *>(exp)->getExp().get());
+                        break;
+                    case IR::CALL:
+                    {
+                        auto call = static_cast<const IR::Call *>(exp);
+                        children.push_back(call->getFun().get());
+                        for (auto &arg : *call->getArgs())
+                        {
+                            children.push_back(arg.get());
+                        }
+                        break;
+                    }
+                    default:
+                        break;
+                }
+            }
+
+            int childrenCost(const IR::Exp *exp, const Tile &tile) const
+            {
+                long cost = 0;
+                switch (exp->getExpType())
+                {
+                    case IR::BINOP:
+                    {
+                        auto binop = static_cast<const IR::Binop *>(exp);
+                        cost = (long) state(binop->getLeft().get()).cost[tile.left] +
+                               state(binop->getRight().get()).cost[tile.right];
+                        break;
+                    }
+                    case IR::MEM:
+                        cost = state(static_cast<const IR::Mem *>(exp)->getExp().get()).cost[tile.left];
+                        break;
+                    case IR::CALL:
+                    {
+                        auto call = static_cast<const IR::Call *>(exp);
+                        if (call->getFun()->getExpType() != IR::NAME)
+                        {
+                            cost = state(call->getFun().get()).cost[REG];
+                        }
+                        for (auto &arg : *call->getArgs())
+                        {
+                            cost += state(arg.get()).cost[argGoal(arg.get())];
+                        }
+                        break;
+                    }
+                    default:
+                        break;
+                }
+                return (int) std::min(cost, (long) INFINITE);
+            }
+
+            void labelNode(const IR::Exp *exp)
+            {
+                State result;
+                std::fill(std::begin(result.cost), std::end(result.cost), INFINITE);
+                std::fill(std::begin(result.tile), std::end(result.tile), NO_TILE);
+                auto match = matchOf(exp);
+                if (match == M_CHAIN)
+                {
+                    Tiger::Error error("Expression is not canonical in " + function.name);
+                }
+                for (size_t t = 0; t < TILE_COUNT && match != M_CHAIN; t++)
+                {
+                    auto &tile = TILES[t];
+                    if (tile.match != match)
+                    {
+                        continue;
+                    }
+                    if (tile.lhs == SCALE && !isScale(constOf(exp)))
+                    {
+                        continue;
+                    }
+                    int cost = std::min(tile.cost + childrenCost(exp, tile), INFINITE);
+                    if (cost < result.cost[tile.lhs])
+                    {
+                        result.cost[tile.lhs] = cost;
+                        result.tile[tile.lhs] = (int16_t) t;
+                    }
+                }
+                // Chain tiles, until none makes a nonterminal cheaper
+                for (bool changed = true; changed;)
+                {
+                    changed = false;
+                    for (size_t t = 0; t < TILE_COUNT; t++)
+                    {
+                        auto &tile = TILES[t];
+                        if (tile.match != M_CHAIN || result.cost[tile.left] == INFINITE)
+                        {
+                            continue;
+                        }
+                        int cost = tile.cost + result.cost[tile.left];
+                        if (cost < result.cost[tile.lhs])
+                        {
+                            result.cost[tile.lhs] = cost;
+                            result.tile[tile.lhs] = (int16_t) t;
+                            changed = true;
+                        }
+                    }
+                }
+                states[exp] = result;
+            }
+
+            void label(const IR::Exp *root)
+            {
+                std::vector<const IR::Exp *> children;
+                pending.assign(1, {root, false});
+                while (!pending.empty())
+                {
+                    auto item = pending.back();
+                    pending.pop_back();
+                    if (item.second)
+                    {
+                        labelNode(item.first);
+                        continue;
+                    }
+                    if (states.find(item.first) != states.end())
+                    {
+                        continue;
+                    }
+                    pending.push_back({item.first, true});
+                    children.clear();
+                    getChildren(item.first, children);
+                    for (auto child = children.rbegin(); child != children.rend(); child++)
+                    {
+                        pending.push_back({*child, false});
+                    }
+                }
+            }
+
+            // Reduction
+
+            void emit(const Assem::Instr &instr)
+            {
+                if (!open)
+                {
+                    startBlock(Assem::NONE);
+                }
+                function.instrs.push_back(instr);
+            }
+
+            void move(int32_t dst, int32_t src)
+            {
+                if (dst != src)
+                {
+                    auto instr = makeInstr(Assem::MOV, Assem::RR);
+                    instr.dst = dst;
+                    instr.src = src;
+                    emit(instr);
+                }
+            }
+
+            // op operand, dst, where operand is of kind
+            void operate(Assem::Opcode opcode, int32_t dst, const Operand &operand, Nonterminal kind)
+            {
+                auto instr = makeInstr(opcode, kind == IMM ? Assem::RI : kind == MEMORY ? Assem::RM : Assem::RR);
+                instr.dst = dst;
+                instr.src = kind == REG ? operand.reg : Assem::NONE;
+                instr.imm = operand.imm;
+                instr.mem = operand.mem;
+                emit(instr);
+            }
+
+            static bool reads(const Operand &operand, Nonterminal kind, int32_t temp)
+            {
+                return (kind == REG && operand.reg == temp) ||
+                       (kind == MEMORY && (operand.mem.base == temp || operand.mem.index == temp));
+            }
+
+            int32_t arithmetic(IR::ArithmeticOp op, const Tile &tile, Operand a, Operand b, int32_t dst)
+            {
+                Nonterminal aKind = tile.left;
+                Nonterminal bKind = tile.right;
+                if (aKind != REG)
+                {
+                    // Only PLUS and MUL, which commute, have one on the left
+                    std::swap(a, b);
+                    std::swap(aKind, bKind);
+                }
+                int32_t result = target(dst);
+                if (bKind == IMM && op == IR::MUL)
+                {
+                    auto multiply = makeInstr(Assem::IMUL, Assem::RRI);
+                    multiply.dst = result;
+                    multiply.src = a.reg;
+                    multiply.imm = b.imm;
+                    emit(multiply);
+                    return result;
+                }
+                // Three operand additions go through lea
+                if (result != a.reg && op != IR::MUL && (bKind == IMM || (bKind == REG && op == IR::PLUS)) &&
+                    !reads(b, bKind, result))
+                {
+                    auto lea = makeInstr(Assem::LEA, Assem::RM);
+                    lea.dst = result;
+                    lea.mem = Assem::makeMem(a.reg, bKind != IMM ? 0 : op == IR::PLUS ? b.imm : -b.imm);
+                    if (bKind == REG)
+                    {
+                        lea.mem.index = b.reg;
+                    }
+                    emit(lea);
+                    return result;
+                }
+                Assem::Opcode opcode = op == IR::PLUS ? Assem::ADD : op == IR::MINUS ? Assem::SUB : Assem::IMUL;
+                if (result != a.reg && reads(b, bKind, result))
+                {
+                    if (bKind == REG && op != IR::MINUS)
+                    {
+                        // Commutes, and b is already in place
+                        operate(opcode, result, a, REG);
+                        return result;
+                    }
+                    int32_t value = newTemp();
+                    move(value, a.reg);
+                    operate(opcode, value, b, bKind);
+                    move(result, value);
+                    return result;
+                }
+                move(result, a.reg);
+                operate(opcode, result, b, bKind);
+                return result;
+            }
+
+            int32_t divide(const Tile &tile, const Operand &a, const Operand &b, int32_t dst)
+            {
+                move(Frame::RAX, a.reg);
+                emit(makeInstr(Assem::CQO, Assem::NO_OPERANDS));
+                auto division = makeInstr(Assem::IDIV, Assem::R);
+                // The divisor cannot be an immediate, nor be in a register
+                // the division overwrites
+                division.src = tile.right == IMM ? Assem::NONE : b.reg;
+                if (tile.right == IMM || Assem::isRegister(division.src))
+                {
+                    int32_t divisor = newTemp();
+                    if (tile.right == IMM)
+                    {
+                        auto load = makeInstr(Assem::MOV, Assem::RI);
+                        load.dst = divisor;
+                        load.imm = b.imm;
+                        emit(load);
+                    }
+                    else
+                    {
+                        move(divisor, division.src);
+                    }
+                    division.src = divisor;
+                }
+                emit(division);
+                int32_t result = target(dst);
+                move(result, Frame::RAX);
+                return result;
+            }
+
+            // Puts the parts of an address tile together
+            static Operand address(const Tile &tile, const Operand *parts)
+            {
+                auto result = makeOperand(Assem::NONE);
+                const Nonterminal kinds[] = {tile.left, tile.right};
+                for (int i = 0; i < 2 && kinds[i] != NO; i++)
+                {
+                    auto &part = parts[i];
+                    auto &mem = result.mem;
+                    switch (kinds[i])
+                    {
+                        case REG:
+                            if (tile.match == M_MUL || mem.base != Assem::NONE)
+                            {
+                                mem.index = part.reg;
+                            }
+                            else
+                            {
+                                mem.base = part.reg;
+                            }
+                            break;
+                        case SCALE:
+                            mem.scale = part.imm;
+                            break;
+                        case IMM:
+                            mem.disp += tile.match == M_MINUS ? -part.imm : part.imm;
+                            break;
+                        default:
+                            // The base of reg + (base + disp) becomes the index
+                            if (part.mem.base != Assem::NONE && mem.base != Assem::NONE)
+                            {
+                                mem.index = part.mem.base;
+                                mem.scale = 1;
+                            }
+                            else if (part.mem.base != Assem::NONE)
+                            {
+                                mem.base = part.mem.base;
+                            }
+                            if (part.mem.index != Assem::NONE)
+                            {
+                                mem.index = part.mem.index;
+                                mem.scale = part.mem.scale;
+                            }
+                            mem.disp += part.mem.disp;
+                            break;
+                    }
+                }
+                return result;
+            }
+
+            // The write barrier a call to Frame::MARK_CARD_NAME stands for,
+            // inline: the card of the address is set in the runtime's table
+            void markCard(int32_t address)
+            {
+                auto table = newTemp();
+                auto load = makeInstr(Assem::MOV, Assem::RM);
+                load.dst = table;
+                load.mem.label = symbol(Frame::CARD_TABLE_NAME);
+                emit(load);
+                auto card = newTemp();
+                move(card, address);
+                auto shift = makeInstr(Assem::SHR, Assem::RI);
+                shift.dst = card;
+                shift.imm = Frame::CARD_SHIFT;
+                emit(shift);
+                auto store = makeInstr(Assem::MOV, Assem::MI);
+                store.mem = Assem::makeMem(table, 0);
+                store.mem.index = card;
+                store.mem.scale = Frame::WORD_SIZE;
+                store.imm = 1;
+                emit(store);
+            }
+
+            int32_t call(const IR::Call *call, const Operand *parts, int32_t dst)
+            {
+                auto &args = *call->getArgs();
+                bool direct = call->getFun()->getExpType() == IR::NAME;
+                if (direct && dst == DISCARD && args.size() == 1 && argGoal(args.front().get()) != IMM &&
+                    static_cast<const IR::Name *>(call->getFun().get())->getLabel()->getLabelName() ==
+                    Frame::MARK_CARD_NAME)
+                {
+                    markCard(parts[0].reg);
+                    return Assem::NONE;
+                }
+                int32_t i = 0;
+                for (auto &arg : args)
+                {
+                    auto &part = parts[(direct ? 0 : 1) + i];
+                    bool immediate = argGoal(arg.get()) == IMM;
+                    if (i < Frame::MAX_REG)
+                    {
+                        if (immediate)
+                        {
+                            auto load = makeInstr(Assem::MOV, Assem::RI);
+                            load.dst = Frame::ARG_REGISTERS[i];
+                            load.imm = part.imm;
+                            emit(load);
+                        }
+                        else
+                        {
+                            move(Frame::ARG_REGISTERS[i], part.reg);
+                        }
+                    }
+                    else
+                    {
+                        auto store = makeInstr(Assem::MOV, immediate ? Assem::MI : Assem::MR);
+                        store.src = immediate ? Assem::NONE : part.reg;
+                        store.imm = part.imm;
+                        store.mem = Assem::makeMem(Frame::RSP, (i - Frame::MAX_REG) * Frame::WORD_SIZE);
+                        emit(store);
+                    }
+                    i++;
+                }
+                function.outgoingWords = std::max(function.outgoingWords, i - Frame::MAX_REG);
+                auto instr = makeInstr(Assem::CALL, direct ? Assem::L : Assem::R);
+                instr.target = direct ? label(static_cast<const IR::Name *>(call->getFun().get())->getLabel())
+                                      : Assem::NONE;
+                instr.src = direct ? Assem::NONE : parts[0].reg;
+                instr.argCount = (uint8_t) std::min(i, (int32_t) Frame::MAX_REG);
+                emit(instr);
+                if (dst == DISCARD)
+                {
+                    return Assem::NONE;
+                }
+                int32_t result = target(dst);
+                move(result, Frame::RAX);
+                return result;
+            }
+
+            void pushChildren(const IR::Exp *exp, const Tile &tile)
+            {
+                switch (exp->getExpType())
+                {
+                    case IR::BINOP:
+                    {
+                        auto binop = static_cast<const IR::Binop *>(exp);
+                        work.push_back({binop->getRight().get(), tile.right, Assem::NONE, false});
+                        work.push_back({binop->getLeft().get(), tile.left, Assem::NONE, false});
+                        break;
+                    }
+                    case IR::MEM:
+                        work.push_back({static_cast<const IR::Mem *>(exp)->getExp().get(), tile.left, Assem::NONE,
+                                        false});
+                        break;
+                    case IR::CALL:
+                    {
+                        auto call = static_cast<const IR::Call *>(exp);
+                        auto &args = *call->getArgs();
+                        for (auto arg = args.rbegin(); arg != args.rend(); arg++)
+                        {
+                            work.push_back({arg->get(), argGoal(arg->get()), Assem::NONE, false});
+                        }
+                        if (call->getFun()->getExpType() != IR::NAME)
+                        {
+                            work.push_back({call->getFun().get(), REG, Assem::NONE, false});
+                        }
+                        break;
+                    }
+                    default:
+                        break;
+                }
+            }
+
+            // Number of operands the children of exp leave for tile
+            static size_t partCount(const IR::Exp *exp, const Tile &tile)
+            {
+                if (tile.match == M_CALL)
+                {
+                    auto call = static_cast<const IR::Call *>(exp);
+                    return call->getArgs()->size() + (call->getFun()->getExpType() != IR::NAME ? 1 : 0);
+                }
+                return (tile.left != NO ? 1 : 0) + (tile.right != NO ? 1 : 0);
+            }
+
+            Operand apply(const Work &item, const Tile &tile)
+            {
+                size_t count = partCount(item.exp, tile);
+                std::vector<Operand> parts(values.end() - count, values.end());
+                values.resize(values.size() - count);
+                auto result = makeOperand(Assem::NONE);
+                switch (tile.action)
+                {
+                    case TEMP_OPERAND:
+                        result.reg = temp(static_cast<const IR::Temp *>(item.exp)->getTemp());
+                        if (item.dst >= 0 && item.dst != result.reg)
+                        {
+                            move(item.dst, result.reg);
+                            result.reg = item.dst;
+                        }
+                        break;
+                    case CONST_OPERAND:
+                        result.imm = constOf(item.exp);
+                        break;
+                    case LOAD_LABEL:
+                    {
+                        auto lea = makeInstr(Assem::LEA, Assem::RM);
+                        lea.dst = result.reg = target(item.dst);
+                        lea.mem.label = label(static_cast<const IR::Name *>(item.exp)->getLabel());
+                        emit(lea);
+                        break;
+                    }
+                    case CALL_RESULT:
+                        result.reg = call(static_cast<const IR::Call *>(item.exp), parts.data(), item.dst);
+                        break;
+                    case MEMORY_OPERAND:
+                        result = parts[0];
+                        break;
+                    case LOAD_IMM:
+                    {
+                        auto load = makeInstr(Assem::MOV, Assem::RI);
+                        load.dst = result.reg = target(item.dst);
+                        load.imm = parts[0].imm;
+                        emit(load);
+                        break;
+                    }
+                    case LOAD:
+                    case LEA:
+                    {
+                        auto load = makeInstr(tile.action == LOAD ? Assem::MOV : Assem::LEA, Assem::RM);
+                        load.dst = result.reg = target(item.dst);
+                        load.mem = parts[0].mem;
+                        emit(load);
+                        break;
+                    }
+                    case ARITHMETIC:
+                        result.reg = arithmetic(static_cast<const IR::Binop *>(item.exp)->getOp(), tile, parts[0],
+                                                parts[1], item.dst);
+                        break;
+                    case DIVIDE:
+                        result.reg = divide(tile, parts[0], parts[1], item.dst);
+                        break;
+                    case ADDRESS:
+                    default:
+                        result = address(tile, parts.data());
+                        break;
+                }
+                return result;
+            }
+
+            // Emits root, which label has seen, as goal. A REG goes into dst
+            // when that is a temp.
+            Operand reduce(const IR::Exp *root, Nonterminal goal, int32_t dst)
+            {
+                work.assign(1, {root, goal, dst, false});
+                values.clear();
+                while (!work.empty())
+                {
+                    auto item = work.back();
+                    work.pop_back();
+                    int16_t index = state(item.exp).tile[item.goal];
+                    if (index == NO_TILE)
+                    {
+                        // Reported while labelling
+                        values.push_back(makeOperand(target(item.dst)));
+                        continue;
+                    }
+                    auto &tile = TILES[index];
+                    if (item.done)
+                    {
+                        values.push_back(apply(item, tile));
+                        continue;
+                    }
+                    work.push_back({item.exp, item.goal, item.dst, true});
+                    if (tile.match == M_CHAIN)
+                    {
+                        work.push_back({item.exp, tile.left, Assem::NONE, false});
+                    }
+                    else
+                    {
+                        pushChildren(item.exp, tile);
+                    }
+                }
+                return values.back();
+            }
+
+            // Statements
+
+            void startBlock(int32_t label)
+            {
+                closeBlock();
+                auto begin = (uint32_t) function.instrs.size();
+                function.blocks.push_back({label, begin, begin});
+                next = (int32_t) function.blocks.size();
+                open = true;
+            }
+
+            void closeBlock()
+            {
+                if (open)
+                {
+                    function.blocks.back().end = (uint32_t) function.instrs.size();
+                    open = false;
+                }
+            }
+
+            // Numbers the blocks the way the statements will start them, so
+            // jumps can name blocks that come later
+            void findBlocks(const IR::StmList &stmList)
+            {
+                int32_t blocks = 0;
+                bool started = false;
+                for (auto &s : stmList)
+                {
+                    switch (s->getStmType())
+                    {
+                        case IR::LABEL:
+                            labelBlock[label(std::static_pointer_cast<IR::Label>(s)->getLabel())] = blocks++;
+                            started = true;
+                            break;
+                        case IR::JUMP:
+                        case IR::CJUMP:
+                            blocks += started ? 0 : 1;
+                            started = false;
+                            break;
+                        default:
+                            blocks += started ? 0 : 1;
+                            started = true;
+                            break;
+                    }
+                }
+            }
+
+            void jump(int32_t label)
+            {
+                int32_t block = labelBlock[label];
+                if (block == Assem::NONE)
+                {
+                    Tiger::Error error("Jump to label " + function.labels[label] + " outside of " + function.name);
+                    return;
+                }
+                if (block != next)
+                {
+                    auto jmp = makeInstr(Assem::JMP, Assem::L);
+                    jmp.target = block;
+                    emit(jmp);
+                }
+            }
+
+            void cjump(const IR::CJump *cjump)
+            {
+                auto left = cjump->getLeft().get();
+                auto right = cjump->getRight().get();
+                auto op = cjump->getOp();
+                label(left);
+                label(right);
+                if (isConst(left) && !isConst(right))
+                {
+                    std::swap(left, right);
+                    op = Assem::commute(op);
+                }
+                // Compare with an immediate or a memory operand when it saves
+                // loading it
+                auto &rightState = state(right);
+                Nonterminal kind = rightState.cost[IMM] <= rightState.cost[REG] ? IMM :
+                                   rightState.cost[MEMORY] <= rightState.cost[REG] ? MEMORY : REG;
+                int32_t a = reduce(left, REG, Assem::NONE).reg;
+                auto b = reduce(right, kind, Assem::NONE);
+                auto compare = makeInstr(Assem::CMP, kind == IMM ? Assem::RI : kind == MEMORY ? Assem::RM : Assem::RR);
+                compare.dst = a;
+                compare.src = kind == REG ? b.reg : Assem::NONE;
+                compare.imm = b.imm;
+                compare.mem = b.mem;
+                emit(compare);
+
+                int32_t labelTrue = label(cjump->getLabelTrue());
+                int32_t labelFalse = label(cjump->getLabelFalse());
+                auto branch = makeInstr(Assem::JCC, Assem::L);
+                if (labelBlock[labelTrue] == next)
+                {
+                    branch.cond = (uint8_t) Assem::negate(op);
+                    branch.target = labelBlock[labelFalse];
+                    emit(branch);
+                    return;
+                }
+                branch.cond = (uint8_t) op;
+                branch.target = labelBlock[labelTrue];
+                emit(branch);
+                jump(labelFalse);
+            }
+
+            void move(const IR::Move *move)
+            {
+                auto dst = move->getDst().get();
+                auto src = move->getSrc().get();
+                if (dst->getExpType() == IR::TEMP)
+                {
+                    label(src);
+                    reduce(src, REG, temp(static_cast<const IR::Temp *>(dst)->getTemp()));
+                }
+                else if (dst->getExpType() == IR::MEM)
+                {
+                    label(dst);
+                    label(src);
+                    auto mem = reduce(dst, MEMORY, Assem::NONE).mem;
+                    auto &srcState = state(src);
+                    bool immediate = srcState.cost[IMM] <= srcState.cost[REG];
+                    auto value = reduce(src, immediate ? IMM : REG, Assem::NONE);
+                    auto store = makeInstr(Assem::MOV, immediate ? Assem::MI : Assem::MR);
+                    store.src = immediate ? Assem::NONE : value.reg;
+                    store.imm = value.imm;
+                    store.mem = mem;
+                    emit(store);
+                }
+                else
+                {
+                    Tiger::Error error("MOVE to an expression that is not TEMP or MEM in " + function.name);
+                }
+            }
+
+            void stm(const IR::Stm *stm)
+            {
+                states.clear();
+                switch (stm->getStmType())
+                {
+                    case IR::LABEL:
+                        startBlock(label(static_cast<const IR::Label *>(stm)->getLabel()));
+                        break;
+                    case IR::JUMP:
+                    {
+                        auto exp = static_cast<const IR::Jump *>(stm)->getExp().get();
+                        if (exp->getExpType() == IR::NAME)
+                        {
+                            jump(label(static_cast<const IR::Name *>(exp)->getLabel()));
+                        }
+                        else
+                        {
+                            label(exp);
+                            auto jmp = makeInstr(Assem::JMP, Assem::R);
+                            jmp.src = reduce(exp, REG, Assem::NONE).reg;
+                            emit(jmp);
+                        }
+                        closeBlock();
+                        break;
+                    }
+                    case IR::CJUMP:
+                        cjump(static_cast<const IR::CJump *>(stm));
+                        closeBlock();
+                        break;
+                    case IR::MOVE:
+                        move(static_cast<const IR::Move *>(stm));
+                        break;
+                    case IR::EXP:
+                        label(static_cast<const IR::Exp *>(stm));
+                        reduce(static_cast<const IR::Exp *>(stm), REG, DISCARD);
+                        break;
+                    case IR::SEQ:
+                    default:
+                        Tiger::Error error("Statement is not canonical");
+                        break;
+                }
+            }
+
+        public:
+            Selector(Assem::Function &function) : function(function), open(false), next(0)
+            {}
+
+            void run(const IR::StmList &stmList)
+            {
+                findBlocks(stmList);
+                for (auto &s : stmList)
+                {
+                    stm(s.get());
+                }
+                closeBlock();
+            }
+        };
+    }
+
+    std::shared_ptr<Assem::Function> select(std::shared_ptr<Frame::ProcFrag> procFrag, int32_t frameWords)
+    {
+        auto result = std::make_shared<Assem::Function>();
+        if (procFrag->getFrame() != nullptr)
+        {
+            result->name = procFrag->getFrame()->getName()->getLabelName();
+        }
+        result->tempCount = Frame::REGISTER_COUNT;
+        result->frameWords = frameWords;
+        result->spillWords = 0;
+        result->outgoingWords = 0;
+        result->spilledTemps = 0;
+        result->eliminatedMoves = 0;
+        if (procFrag->getStmList() == nullptr)
+        {
+            Tiger::Error error("Function " + result->name + " is not canonicalized");
+            return result;
+        }
+        Selector(*result).run(*procFrag->getStmList());
+        return result;
+    }
+}
@@ -0,0 +1,25 @@
+//
+// Instruction selection by tree tiling
+//
+
+#ifndef SRC_BURS_H
+#define SRC_BURS_H
+
+#include <memory>
+#include "Assem.h"
+#include "Frame.h"
+
+// Each expression of a canonical statement is labelled bottom up with the
+// cheapest way to compute every nonterminal at every node, from a table of
+// tiles that match one operator each. The tree is then reduced top down
+// from the nonterminal its statement needs. Subscript and field addresses,
+// base + index * 8 + disp, fold into x86-64 addressing modes this way.
+namespace Burs
+{
+    // Selects instructions for the canonical statements of procFrag, whose
+    // Frame has frameWords words of locals. Machine registers keep their
+    // temp number, the other temps are numbered after them.
+    std::shared_ptr<Assem::Function> select(std::shared_ptr<Frame::ProcFrag> procFrag, int32_t frameWords);
+}
+
+#endif //SRC_BURS_H
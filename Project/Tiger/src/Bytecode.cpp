@@ -0,0 +1,376 @@
+//
+// Register bytecode for the interpreter
+//
+
+#include "Bytecode.h"
+#include "Error.h"
+#include "OutBuffer.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+namespace Bytecode
+{
+    namespace
+    {
+        const char *const nativeNames[NATIVE_COUNT] = {
+                "initArray", "initRecord", "strcmp", "print", "flush", "getchar", "ord", "chr", "size",
+                "substring", "concat", "not", "exit", "markCard"
+        };
+
+        const char *const opcodeNames[OPCODE_COUNT] = {
+                "move", "loadi", "loadk",
+                "add", "sub", "mul", "div",
+                "addi", "subi", "muli", "divi",
+                "load", "store", "loadf", "storef",
+                "jump",
+                "jeq", "jne", "jlt", "jgt", "jle", "jge",
+                "jeqi", "jnei", "jlti", "jgti", "jlei", "jgei",
+                "call", "native", "ret"
+        };
+
+        // Operand words after the opcode, but for CALL and NATIVE, which
+        // add their arguments
+        const int32_t operandCounts[OPCODE_COUNT] = {
+                2, 2, 2,
+                3, 3, 3, 3,
+                3, 3, 3, 3,
+                3, 3, 2, 2,
+                1,
+                3, 3, 3, 3, 3, 3,
+                3, 3, 3, 3, 3, 3,
+                3, 3, 0
+        };
+
+        // Where calls and string addresses go, by label name
+        struct Symbols
+        {
+            std::unordered_map<std::string, int32_t> functions;
+            std::unordered_map<std::string, int32_t> natives;
+            std::unordered_map<std::string, int32_t> strings;
+        };
+
+        class Compiler
+        {
+            const Linear::Function &function;
+            const Symbols &symbols;
+            Function &result;
+            // Word of each block, and the words that hold a block to patch
+            std::vector<int32_t> blockAt;
+            std::vector<std::pair<size_t, int32_t>> patches;
+            // Block placed after the one being compiled
+            int32_t next;
+
+            void emit(int32_t word)
+            {
+                result.code.push_back(word);
+            }
+
+            void emit(Opcode opcode, std::initializer_list<int32_t> operands)
+            {
+                emit(opcode);
+                for (auto operand : operands)
+                {
+                    emit(operand);
+                }
+            }
+
+            void target(int32_t block)
+            {
+                patches.push_back({result.code.size(), block});
+                emit(0);
+            }
+
+            void jump(int32_t block)
+            {
+                if (block != next)
+                {
+                    emit(JUMP);
+                    target(block);
+                }
+            }
+
+            void error(const std::string &message)
+            {
+                Tiger::Error error(message + " in " + function.name + ", which the interpreter cannot run");
+            }
+
+            void binop(const Linear::Instr &instr)
+            {
+                auto op = (IR::ArithmeticOp) instr.op;
+                emit((Opcode) ((instr.useImm ? ADDI : ADD) + op), {instr.dst, instr.a, instr.useImm ? instr.imm : instr.b});
+            }
+
+            void cjump(const Linear::Instr &instr)
+            {
+                auto op = (IR::ComparisonOp) instr.op;
+                int32_t taken = instr.first;
+                int32_t fallen = instr.second;
+                if (taken == next)
+                {
+                    op = negate(op);
+                    std::swap(taken, fallen);
+                }
+                emit((Opcode) ((instr.useImm ? JEQI : JEQ) + op));
+                emit(instr.a);
+                emit(instr.useImm ? instr.imm : instr.b);
+                target(taken);
+                jump(fallen);
+            }
+
+            static IR::ComparisonOp negate(IR::ComparisonOp op)
+            {
+                switch (op)
+                {
+                    case IR::EQ:
+                        return IR::NE;
+                    case IR::NE:
+                        return IR::EQ;
+                    case IR::LT:
+                        return IR::GE;
+                    case IR::GT:
+                        return IR::LE;
+                    case IR::LE:
+                        return IR::GT;
+                    case IR::GE:
+                    default:
+                        return IR::LT;
+                }
+            }
+
+            void call(const Linear::Instr &instr)
+            {
+                if (instr.imm == Linear::NONE)
+                {
+                    error("Call through a register");
+                    return;
+                }
+                auto &name = function.labels[instr.imm];
+                auto found = symbols.functions.find(name);
+                if (found != symbols.functions.end())
+                {
+                    emit(CALL, {instr.dst, found->second, instr.second});
+                }
+                else
+                {
+                    auto native = symbols.natives.find(name);
+                    if (native == symbols.natives.end())
+                    {
+                        error("Call to unknown function " + name);
+                        return;
+                    }
+                    emit(NATIVE, {instr.dst, native->second, instr.second});
+                }
+                for (int32_t i = 0; i < instr.second; i++)
+                {
+                    emit(function.args[instr.first + i]);
+                }
+            }
+
+            void instr(const Linear::Instr &instr)
+            {
+                switch (instr.opcode)
+                {
+                    case Linear::MOVE:
+                        emit(MOVE, {instr.dst, instr.a});
+                        break;
+                    case Linear::LOADI:
+                        emit(LOADI, {instr.dst, instr.imm});
+                        break;
+                    case Linear::LOADA:
+                    {
+                        auto found = symbols.strings.find(function.labels[instr.imm]);
+                        if (found == symbols.strings.end())
+                        {
+                            error("Address of " + function.labels[instr.imm]);
+                            break;
+                        }
+                        emit(LOADK, {instr.dst, found->second});
+                        break;
+                    }
+                    case Linear::BINOP:
+                        binop(instr);
+                        break;
+                    case Linear::LOAD:
+                        if (instr.a == result.fp)
+                        {
+                            emit(LOADF, {instr.dst, instr.imm});
+                        }
+                        else
+                        {
+                            emit(LOAD, {instr.dst, instr.a, instr.imm});
+                        }
+                        break;
+                    case Linear::STORE:
+                        if (instr.a == result.fp)
+                        {
+                            emit(STOREF, {instr.imm, instr.b});
+                        }
+                        else
+                        {
+                            emit(STORE, {instr.a, instr.imm, instr.b});
+                        }
+                        break;
+                    case Linear::CALL:
+                        call(instr);
+                        break;
+                    case Linear::JUMP:
+                        if (instr.first == Linear::NONE)
+                        {
+                            error("Jump through a register");
+                            break;
+                        }
+                        jump(instr.first);
+                        break;
+                    case Linear::CJUMP:
+                    default:
+                        cjump(instr);
+                        break;
+                }
+            }
+
+        public:
+            Compiler(const Linear::Function &function, const Symbols &symbols, Function &result)
+                    : function(function), symbols(symbols), result(result), next(0)
+            {}
+
+            void run()
+            {
+                result.name = function.name;
+                result.registerCount = function.getTempCount();
+                result.fp = Linear::NONE;
+                result.rv = Linear::NONE;
+                std::fill(std::begin(result.args), std::end(result.args), Linear::NONE);
+                for (int32_t t = 0; t < function.getTempCount(); t++)
+                {
+                    int num = function.tempNums[t];
+                    if (num == Frame::RBP)
+                    {
+                        result.fp = t;
+                    }
+                    else if (num == Frame::RAX)
+                    {
+                        result.rv = t;
+                    }
+                    for (int i = 0; i < Frame::MAX_REG; i++)
+                    {
+                        if (num == Frame::ARG_REGISTERS[i])
+                        {
+                            result.args[i] = t;
+                        }
+                    }
+                }
+                for (size_t b = 0; b < function.blocks.size(); b++)
+                {
+                    auto &block = function.blocks[b];
+                    next = (int32_t) b + 1;
+                    blockAt.push_back((int32_t) result.code.size());
+                    for (uint32_t i = block.begin; i < block.end; i++)
+                    {
+                        instr(function.instrs[i]);
+                    }
+                }
+                // Jumps past the last block return
+                blockAt.push_back((int32_t) result.code.size());
+                emit(RET);
+                for (auto &patch : patches)
+                {
+                    result.code[patch.first] = blockAt[patch.second];
+                }
+            }
+        };
+    }
+
+    std::shared_ptr<Program> compile(const Frame::FragList &fragList, const Linear::FunctionList &functions)
+    {
+        auto program = std::make_shared<Program>();
+        Symbols symbols;
+        std::vector<int32_t> frameWords;
+        program->main = NONE;
+        for (auto &frag : fragList)
+        {
+            if (frag->getKind() == Frame::STRING_FRAG)
+            {
+                auto &string = static_cast<const Frame::StringFrag &>(*frag);
+                auto str = string.getStr();
+                std::vector<int64_t> words(1 + (str.size() + 8) / 8, 0);
+                words[0] = (int64_t) str.size();
+                std::memcpy(&words[1], str.data(), str.size());
+                symbols.strings.emplace(string.getLabel()->getLabelName(), (int32_t) program->strings.size());
+                program->strings.push_back(std::move(words));
+            }
+            else
+            {
+                auto frame = static_cast<const Frame::ProcFrag &>(*frag).getFrame();
+                frameWords.push_back(frame ? frame->getLocal_count() : 0);
+            }
+        }
+        for (size_t i = 0; i < functions.size(); i++)
+        {
+            symbols.functions.emplace(functions[i]->name, (int32_t) i);
+            if (functions[i]->name == Frame::MAIN_NAME)
+            {
+                program->main = (int32_t) i;
+            }
+        }
+        for (int32_t i = 0; i < NATIVE_COUNT; i++)
+        {
+            symbols.natives.emplace(Frame::makeRuntimeLabel(nativeNames[i])->getLabelName(), i);
+        }
+
+        program->functions.resize(functions.size());
+        parallelFor(functions.size(), [&functions, &symbols, &program, &frameWords](size_t i)
+        {
+            program->functions[i].frameWords = frameWords[i];
+            Compiler(*functions[i], symbols, program->functions[i]).run();
+        });
+        if (program->main == NONE)
+        {
+            Tiger::Error error(std::string("No function ") + Frame::MAIN_NAME + " to run");
+        }
+        return program;
+    }
+
+    void print(const Program &program, std::ostream &outFile)
+    {
+        OutBuffer buffer(OutBuffer::FLUSH_CAPACITY);
+        for (auto &function : program.functions)
+        {
+            buffer << "function " << function.name << " (" << function.registerCount << " registers, "
+                   << function.frameWords << " frame words)\n";
+            auto &code = function.code;
+            for (size_t pc = 0; pc < code.size();)
+            {
+                auto opcode = code[pc];
+                buffer << "    " << (int) pc << ": " << opcodeNames[opcode];
+                int32_t count = operandCounts[opcode];
+                if (opcode == CALL || opcode == NATIVE)
+                {
+                    count += code[pc + 3];
+                }
+                for (int32_t i = 1; i <= count; i++)
+                {
+                    buffer << (i == 1 ? " " : ", ");
+                    if (i == 2 && opcode == CALL)
+                    {
+                        buffer << program.functions[code[pc + i]].name;
+                    }
+                    else if (i == 2 && opcode == NATIVE)
+                    {
+                        buffer << nativeNames[code[pc + i]];
+                    }
+                    else
+                    {
+                        buffer << code[pc + i];
+                    }
+                }
+                buffer << '\n';
+                pc += 1 + count;
+            }
+            buffer << '\n';
+            buffer.writeIfFull(outFile);
+        }
+        buffer.writeTo(outFile);
+    }
+}
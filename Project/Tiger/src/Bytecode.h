@@ -0,0 +1,93 @@
+//
+// Register bytecode for the interpreter
+//
+
+#ifndef SRC_BYTECODE_H
+#define SRC_BYTECODE_H
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Frame.h"
+#include "Linear.h"
+
+// A function is a stream of 32-bit words: an opcode and its operands.
+// Register operands index the frame's registers, which are the temps of
+// the Linear function, and jumps name the word they go to.
+namespace Bytecode
+{
+    const int32_t NONE = -1;
+
+    //   MOVE          d a
+    //   LOADI         d imm
+    //   LOADK         d constant           address of a string
+    //   ADD .. DIV    d a b
+    //   ADDI .. DIVI  d a imm
+    //   LOAD          d a off              d = M[a + off]
+    //   STORE         a off b              M[a + off] = b
+    //   LOADF         d off                d = M[fp + off]
+    //   STOREF        off b                M[fp + off] = b
+    //   JUMP          target
+    //   JEQ .. JGE    a b target           in IR::ComparisonOp order
+    //   JEQI .. JGEI  a imm target
+    //   CALL          d function argc args...
+    //   NATIVE        d native argc args...
+    //   RET                                returns the register of RAX
+    // CALL and NATIVE drop the result when d is NONE. LOAD and STORE are
+    // the MEM(BINOP(PLUS, TEMP, CONST)) of the tree in one instruction, and
+    // LOADF and STOREF the same with the frame pointer, the most common
+    // temp there.
+    enum Opcode
+    {
+        MOVE, LOADI, LOADK,
+        ADD, SUB, MUL, DIV,
+        ADDI, SUBI, MULI, DIVI,
+        LOAD, STORE, LOADF, STOREF,
+        JUMP,
+        JEQ, JNE, JLT, JGT, JLE, JGE,
+        JEQI, JNEI, JLTI, JGTI, JLEI, JGEI,
+        CALL, NATIVE, RET,
+        OPCODE_COUNT
+    };
+
+    // Runtime functions the interpreter calls natively
+    enum Native
+    {
+        INIT_ARRAY, INIT_RECORD, STRCMP, PRINT, FLUSH, GETCHAR, ORD, CHR, SIZE, SUBSTRING, CONCAT, NOT, EXIT,
+        MARK_CARD, NATIVE_COUNT
+    };
+
+    struct Function
+    {
+        std::string name;
+        std::vector<int32_t> code;
+        int32_t registerCount;
+        // Words of locals below the frame pointer
+        int32_t frameWords;
+        // Registers that stand for the frame pointer, the return value and
+        // the argument registers, NONE where the function has none
+        int32_t fp;
+        int32_t rv;
+        int32_t args[Frame::MAX_REG];
+    };
+
+    struct Program
+    {
+        std::vector<Function> functions;
+        // Function of the main fragment
+        int32_t main;
+        // Each string literal as the runtime lays it out, a length word
+        // followed by the characters
+        std::vector<std::vector<int64_t>> strings;
+    };
+
+    // Compiles the lowered ProcFrags of fragList, in the order of
+    // Linear::lower, and its StringFrags
+    std::shared_ptr<Program> compile(const Frame::FragList &fragList, const Linear::FunctionList &functions);
+
+    void print(const Program &program, std::ostream &outFile);
+}
+
+#endif //SRC_BYTECODE_H
@@ -0,0 +1,556 @@
+//
+// Portable C output
+//
+
+#include "CSource.h"
+#include "Error.h"
+#include "OutBuffer.h"
+#include <algorithm>
+#include <unordered_map>
+
+namespace CSource
+{
+    namespace
+    {
+        // The runtime, as functions of int64_t the calls reach directly.
+        // It behaves like runtime/runtime.cpp.
+        const char *const RUNTIME = R"(#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+    int64_t length;
+    char chars[];
+} TigerString;
+
+typedef struct
+{
+    int64_t length;
+    char chars[8];
+} TigerChar;
+
+#define TIGER_M(a) (*(int64_t *) (intptr_t) (a))
+#define TIGER_ADD(a, b) ((int64_t) ((uint64_t) (a) + (uint64_t) (b)))
+#define TIGER_SUB(a, b) ((int64_t) ((uint64_t) (a) - (uint64_t) (b)))
+#define TIGER_MUL(a, b) ((int64_t) ((uint64_t) (a) * (uint64_t) (b)))
+#define TIGER_DIV(a, b) ((a) / (b))
+
+static TigerChar tiger_chars[256];
+static const TigerChar tiger_empty = {0, {0}};
+
+static void tiger_fail(const char *message, int64_t value)
+{
+    fflush(stdout);
+    fprintf(stderr, message, (long long) value);
+    fputc('\n', stderr);
+    exit(1);
+}
+
+static inline int64_t tiger_initArray(int64_t size, int64_t init, int64_t pointers)
+{
+    int64_t *array;
+    int64_t i;
+    if (size < 0)
+    {
+        tiger_fail("Array of negative size %lld", size);
+    }
+    (void) pointers;
+    array = (int64_t *) malloc((size_t) (size > 0 ? size : 1) * sizeof(int64_t));
+    for (i = 0; i < size; i++)
+    {
+        array[i] = init;
+    }
+    return (int64_t) (intptr_t) array;
+}
+
+static inline int64_t tiger_initRecord(int64_t size, int64_t layout)
+{
+    (void) layout;
+    return (int64_t) (intptr_t) calloc(1, (size_t) (size > 0 ? size : 1));
+}
+
+static inline int64_t tiger_strcmp(int64_t left, int64_t right)
+{
+    const TigerString *l = (const TigerString *) (intptr_t) left;
+    const TigerString *r = (const TigerString *) (intptr_t) right;
+    int64_t length = l->length < r->length ? l->length : r->length;
+    int result = memcmp(l->chars, r->chars, (size_t) length);
+    if (result != 0)
+    {
+        return result;
+    }
+    return l->length < r->length ? -1 : l->length > r->length ? 1 : 0;
+}
+
+static inline int64_t tiger_print(int64_t s)
+{
+    const TigerString *string = (const TigerString *) (intptr_t) s;
+    fwrite(string->chars, 1, (size_t) string->length, stdout);
+    return 0;
+}
+
+static inline int64_t tiger_flush(void)
+{
+    fflush(stdout);
+    return 0;
+}
+
+static inline int64_t tiger_getchar(void)
+{
+    int c = getchar();
+    return (int64_t) (intptr_t) (c == EOF ? &tiger_empty : &tiger_chars[c]);
+}
+
+static inline int64_t tiger_ord(int64_t s)
+{
+    const TigerString *string = (const TigerString *) (intptr_t) s;
+    return string->length == 0 ? -1 : (unsigned char) string->chars[0];
+}
+
+static inline int64_t tiger_chr(int64_t i)
+{
+    if (i < 0 || i > 255)
+    {
+        tiger_fail("chr(%lld) out of range", i);
+    }
+    return (int64_t) (intptr_t) &tiger_chars[i];
+}
+
+static inline int64_t tiger_size(int64_t s)
+{
+    return ((const TigerString *) (intptr_t) s)->length;
+}
+
+static inline int64_t tiger_substring(int64_t s, int64_t first, int64_t n)
+{
+    const TigerString *string = (const TigerString *) (intptr_t) s;
+    TigerString *result;
+    if (first < 0 || n < 0 || first + n > string->length)
+    {
+        tiger_fail("substring out of range at %lld", first);
+    }
+    if (n == 1)
+    {
+        return (int64_t) (intptr_t) &tiger_chars[(unsigned char) string->chars[first]];
+    }
+    result = (TigerString *) malloc(sizeof(int64_t) + (size_t) n + 1);
+    result->length = n;
+    memcpy(result->chars, string->chars + first, (size_t) n);
+    return (int64_t) (intptr_t) result;
+}
+
+static inline int64_t tiger_concat(int64_t left, int64_t right)
+{
+    const TigerString *l = (const TigerString *) (intptr_t) left;
+    const TigerString *r = (const TigerString *) (intptr_t) right;
+    TigerString *result;
+    if (l->length == 0)
+    {
+        return right;
+    }
+    if (r->length == 0)
+    {
+        return left;
+    }
+    result = (TigerString *) malloc(sizeof(int64_t) + (size_t) (l->length + r->length) + 1);
+    result->length = l->length + r->length;
+    memcpy(result->chars, l->chars, (size_t) l->length);
+    memcpy(result->chars + l->length, r->chars, (size_t) r->length);
+    return (int64_t) (intptr_t) result;
+}
+
+static inline int64_t tiger_not(int64_t i)
+{
+    return i == 0;
+}
+
+/* Nothing is collected, so stores need no barrier */
+static inline int64_t tiger_markCard(int64_t address)
+{
+    (void) address;
+    return 0;
+}
+
+static inline int64_t tiger_exit(int64_t code)
+{
+    fflush(stdout);
+    exit((int) code);
+}
+
+static void tiger_init(void)
+{
+    int i;
+    for (i = 0; i < 256; i++)
+    {
+        tiger_chars[i].length = 1;
+        tiger_chars[i].chars[0] = (char) i;
+    }
+}
+
+)";
+
+        const char *const runtimeNames[] = {
+                "initArray", "initRecord", "strcmp", "print", "flush", "getchar", "ord", "chr", "size",
+                "substring", "concat", "not", "exit", "markCard"
+        };
+
+        const char *const binopNames[] = {"TIGER_ADD", "TIGER_SUB", "TIGER_MUL", "TIGER_DIV"};
+        // In IR::ComparisonOp order
+        const char *const relopNames[] = {"==", "!=", "<", ">", "<=", ">="};
+
+        // What a call may name, and how many arguments each function takes
+        struct Symbols
+        {
+            std::unordered_map<std::string, int32_t> arity;
+            std::unordered_map<std::string, bool> runtime;
+        };
+
+        void writeOffset(int32_t imm, OutBuffer &outFile)
+        {
+            if (imm < 0)
+            {
+                outFile << " - " << std::to_string(-(int64_t) imm);
+            }
+            else if (imm > 0)
+            {
+                outFile << " + " << imm;
+            }
+        }
+
+        class FunctionWriter
+        {
+            const Linear::Function &function;
+            const Symbols &symbols;
+            int32_t frameWords;
+            OutBuffer &outFile;
+            // Block placed after the one being written
+            int32_t next;
+
+            void error(const std::string &message)
+            {
+                Tiger::Error error(message + " in " + function.name + ", which has no C form");
+            }
+
+            void temp(int32_t temp)
+            {
+                outFile << 't' << temp;
+            }
+
+            void operand(const Linear::Instr &instr)
+            {
+                if (instr.useImm)
+                {
+                    outFile << instr.imm;
+                }
+                else
+                {
+                    temp(instr.b);
+                }
+            }
+
+            void jump(int32_t block)
+            {
+                if (block != next)
+                {
+                    outFile << "    goto B" << block << ";\n";
+                }
+            }
+
+            void call(const Linear::Instr &instr)
+            {
+                if (instr.imm == Linear::NONE)
+                {
+                    error("Call through a register");
+                    return;
+                }
+                auto &name = function.labels[instr.imm];
+                if (!symbols.arity.count(name) && !symbols.runtime.count(name))
+                {
+                    error("Call to unknown function " + name);
+                    return;
+                }
+                outFile << "    ";
+                if (instr.dst != Linear::NONE)
+                {
+                    temp(instr.dst);
+                    outFile << " = ";
+                }
+                outFile << name << '(';
+                for (int32_t i = 0; i < instr.second; i++)
+                {
+                    if (i > 0)
+                    {
+                        outFile << ", ";
+                    }
+                    temp(function.args[instr.first + i]);
+                }
+                outFile << ");\n";
+            }
+
+            void instr(const Linear::Instr &instr)
+            {
+                switch (instr.opcode)
+                {
+                    case Linear::MOVE:
+                        outFile << "    ";
+                        temp(instr.dst);
+                        outFile << " = ";
+                        temp(instr.a);
+                        outFile << ";\n";
+                        break;
+                    case Linear::LOADI:
+                        outFile << "    ";
+                        temp(instr.dst);
+                        outFile << " = " << instr.imm << ";\n";
+                        break;
+                    case Linear::LOADA:
+                        outFile << "    ";
+                        temp(instr.dst);
+                        outFile << " = (int64_t) (intptr_t) &" << function.labels[instr.imm] << ";\n";
+                        break;
+                    case Linear::BINOP:
+                        outFile << "    ";
+                        temp(instr.dst);
+                        outFile << " = " << binopNames[instr.op] << '(';
+                        temp(instr.a);
+                        outFile << ", ";
+                        operand(instr);
+                        outFile << ");\n";
+                        break;
+                    case Linear::LOAD:
+                        outFile << "    ";
+                        temp(instr.dst);
+                        outFile << " = TIGER_M(";
+                        temp(instr.a);
+                        writeOffset(instr.imm, outFile);
+                        outFile << ");\n";
+                        break;
+                    case Linear::STORE:
+                        outFile << "    TIGER_M(";
+                        temp(instr.a);
+                        writeOffset(instr.imm, outFile);
+                        outFile << ") = ";
+                        temp(instr.b);
+                        outFile << ";\n";
+                        break;
+                    case Linear::CALL:
+                        call(instr);
+                        break;
+                    case Linear::JUMP:
+                        if (instr.first == Linear::NONE)
+                        {
+                            error("Jump through a register");
+                            break;
+                        }
+                        jump(instr.first);
+                        break;
+                    case Linear::CJUMP:
+                    default:
+                        outFile << "    if (";
+                        temp(instr.a);
+                        outFile << ' ' << relopNames[instr.op] << ' ';
+                        operand(instr);
+                        outFile << ") goto B" << instr.first << ";\n";
+                        jump(instr.second);
+                        break;
+                }
+            }
+
+        public:
+            FunctionWriter(const Linear::Function &function, const Symbols &symbols, int32_t frameWords,
+                           OutBuffer &outFile)
+                    : function(function), symbols(symbols), frameWords(frameWords), outFile(outFile), next(0)
+            {}
+
+            static void prototype(const std::string &name, int32_t arity, OutBuffer &outFile)
+            {
+                outFile << "static int64_t " << name << '(';
+                for (int32_t i = 0; i < arity; i++)
+                {
+                    outFile << (i > 0 ? ", " : "") << "int64_t a" << i;
+                }
+                outFile << (arity == 0 ? "void)" : ")");
+            }
+
+            void run()
+            {
+                int32_t arity = symbols.arity.at(function.name);
+                int32_t extra = std::max(arity - Frame::MAX_REG, 0);
+                prototype(function.name, arity, outFile);
+                outFile << "\n{\n";
+                int32_t fp = Linear::NONE;
+                int32_t rv = Linear::NONE;
+                for (int32_t t = 0; t < function.getTempCount(); t++)
+                {
+                    outFile << (t % 16 == 0 ? (t == 0 ? "    int64_t " : ",\n        ") : ", ");
+                    temp(t);
+                    if (function.tempNums[t] == Frame::RAX)
+                    {
+                        // What a procedure returns, which nobody reads
+                        outFile << " = 0";
+                        rv = t;
+                    }
+                    else if (function.tempNums[t] == Frame::RBP)
+                    {
+                        fp = t;
+                    }
+                }
+                if (function.getTempCount() > 0)
+                {
+                    outFile << ";\n";
+                }
+                // Arguments past the sixth sit above two words of link, as
+                // in the native frame
+                if (fp != Linear::NONE)
+                {
+                    outFile << "    int64_t frame[" << frameWords + 2 + extra << "];\n    ";
+                    temp(fp);
+                    outFile << " = (int64_t) (intptr_t) (frame + " << frameWords << ");\n";
+                }
+                for (int32_t t = 0; t < function.getTempCount(); t++)
+                {
+                    for (int32_t i = 0; i < std::min(arity, (int32_t) Frame::MAX_REG); i++)
+                    {
+                        if (function.tempNums[t] == Frame::ARG_REGISTERS[i])
+                        {
+                            outFile << "    ";
+                            temp(t);
+                            outFile << " = a" << i << ";\n";
+                        }
+                    }
+                }
+                if (fp != Linear::NONE)
+                {
+                    for (int32_t i = 0; i < extra; i++)
+                    {
+                        outFile << "    frame[" << frameWords + 2 + i << "] = a" << Frame::MAX_REG + i << ";\n";
+                    }
+                }
+                for (size_t b = 0; b < function.blocks.size(); b++)
+                {
+                    auto &block = function.blocks[b];
+                    next = (int32_t) b + 1;
+                    outFile << "B" << (int) b << ":;\n";
+                    for (uint32_t i = block.begin; i < block.end; i++)
+                    {
+                        instr(function.instrs[i]);
+                    }
+                }
+                // Jumps past the last block return
+                outFile << "B" << (int) function.blocks.size() << ":\n    return ";
+                if (rv != Linear::NONE)
+                {
+                    temp(rv);
+                }
+                else
+                {
+                    outFile << '0';
+                }
+                outFile << ";\n}\n\n";
+            }
+        };
+
+        void writeString(const Frame::StringFrag &frag, OutBuffer &outFile)
+        {
+            auto str = frag.getStr();
+            outFile << "static const struct\n{\n    int64_t length;\n    char chars[" << (int) str.size() + 1
+                    << "];\n} " << frag.getLabel()->getLabelName() << " = {" << (int) str.size() << ", \"";
+            for (unsigned char c : str)
+            {
+                // Octal escapes keep trigraphs and hex digits after them
+                // from changing the string
+                if (c == '"' || c == '\\')
+                {
+                    outFile << '\\' << (char) c;
+                }
+                else if (c >= 0x20 && c < 0x7f && c != '?')
+                {
+                    outFile << (char) c;
+                }
+                else
+                {
+                    outFile << '\\' << (char) ('0' + (c >> 6)) << (char) ('0' + ((c >> 3) & 7))
+                            << (char) ('0' + (c & 7));
+                }
+            }
+            outFile << "\"};\n";
+        }
+    }
+
+    void writeProgram(const Frame::FragList &fragList, const Linear::FunctionList &functions,
+                      std::ostream &outFile)
+    {
+        Symbols symbols;
+        for (auto name : runtimeNames)
+        {
+            symbols.runtime.emplace(Frame::makeRuntimeLabel(name)->getLabelName(), true);
+        }
+        // Functions loaded without their frames take as many arguments as
+        // their calls pass
+        std::vector<int32_t> frameWords;
+        auto function = functions.begin();
+        for (auto &frag : fragList)
+        {
+            if (frag->getKind() != Frame::PROC_FRAG)
+            {
+                continue;
+            }
+            auto frame = std::static_pointer_cast<Frame::ProcFrag>(frag)->getFrame();
+            frameWords.push_back(frame ? frame->getLocal_count() : 0);
+            symbols.arity[(*function)->name] = frame ? (int32_t) frame->getFormals()->size() : 0;
+            ++function;
+        }
+        for (auto &caller : functions)
+        {
+            for (auto &instr : caller->instrs)
+            {
+                if (instr.opcode == Linear::CALL && instr.imm != Linear::NONE)
+                {
+                    auto found = symbols.arity.find(caller->labels[instr.imm]);
+                    if (found != symbols.arity.end())
+                    {
+                        found->second = std::max(found->second, instr.second);
+                    }
+                }
+            }
+        }
+        auto main = symbols.arity.find(Frame::MAIN_NAME);
+        if (main == symbols.arity.end())
+        {
+            Tiger::Error error(std::string("No function ") + Frame::MAIN_NAME + " to call from main");
+            return;
+        }
+        main->second = std::max(main->second, 1);
+
+        OutBuffer buffer(OutBuffer::FLUSH_CAPACITY);
+        buffer << RUNTIME;
+        for (auto &frag : fragList)
+        {
+            if (frag->getKind() == Frame::STRING_FRAG)
+            {
+                writeString(*std::static_pointer_cast<Frame::StringFrag>(frag), buffer);
+            }
+        }
+        buffer << '\n';
+        for (auto &function : functions)
+        {
+            FunctionWriter::prototype(function->name, symbols.arity[function->name], buffer);
+            buffer << ";\n";
+        }
+        buffer << '\n';
+        for (size_t i = 0; i < functions.size(); i++)
+        {
+            FunctionWriter(*functions[i], symbols, frameWords[i], buffer).run();
+            buffer.writeIfFull(outFile);
+        }
+        buffer << "int main(void)\n{\n    tiger_init();\n    " << Frame::MAIN_NAME << "(0";
+        for (int32_t i = 1; i < main->second; i++)
+        {
+            buffer << ", 0";
+        }
+        buffer << ");\n    fflush(stdout);\n    return 0;\n}\n";
+        buffer.writeTo(outFile);
+    }
+}
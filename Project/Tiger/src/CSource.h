@@ -0,0 +1,24 @@
+//
+// Portable C output
+//
+
+#ifndef SRC_CSOURCE_H
+#define SRC_CSOURCE_H
+
+#include <ostream>
+#include "Frame.h"
+#include "Linear.h"
+
+namespace CSource
+{
+    // Writes the lowered ProcFrags of fragList, in the order of
+    // Linear::lower, as one C function each, with a local per temp and the
+    // frame as a local array whose address is the static link the callees
+    // get. StringFrags become static arrays laid out like the runtime's
+    // strings. The file carries the runtime and a main, so cc -O2 alone
+    // makes an executable of it.
+    void writeProgram(const Frame::FragList &fragList, const Linear::FunctionList &functions,
+                      std::ostream &outFile);
+}
+
+#endif //SRC_CSOURCE_H
@@ -0,0 +1,555 @@
+//
+// Canonical trees: linearize, basic blocks and traces
+//
+
+#include "Canon.h"
+#include "ThreadPool.h"
+#include <map>
+#include <set>
+#include <vector>
+
+namespace Canon
+{
+    Block::Block(const std::shared_ptr<StmListList> &stmLists, const std::shared_ptr<Temporary::Label> &label)
+            : stmLists(stmLists), label(label)
+    {}
+
+    const std::shared_ptr<StmListList> Block::getStmLists() const
+    {
+        return stmLists;
+    }
+
+    const std::shared_ptr<Temporary::Label> Block::getLabel() const
+    {
+        return label;
+    }
+
+    namespace
+    {
+        using ExpVector = std::vector<std::shared_ptr<IR::Exp>>;
+
+        bool isNop(const std::shared_ptr<IR::Stm> &stm)
+        {
+            return stm->getStmType() == IR::EXP &&
+                   std::static_pointer_cast<IR::Exp>(stm)->getExpType() == IR::CONST;
+        }
+
+        std::shared_ptr<IR::Stm> nop()
+        {
+            return IR::makeExp(IR::makeConst(0));
+        }
+
+        // A conservative guess whether exp can be evaluated after statements
+        // that are not all nops
+        bool commute(const std::shared_ptr<IR::Exp> &exp)
+        {
+            return exp->getExpType() == IR::NAME || exp->getExpType() == IR::CONST;
+        }
+
+        ExpVector callKids(const std::shared_ptr<IR::Call> &call)
+        {
+            ExpVector kids;
+            kids.push_back(call->getFun());
+            for (auto &arg : *call->getArgs())
+            {
+                kids.push_back(arg);
+            }
+            return kids;
+        }
+
+        std::shared_ptr<IR::Exp> remakeCall(const ExpVector &kids)
+        {
+            auto args = std::make_shared<IR::ExpList>(++kids.begin(), kids.end());
+            return IR::makeCall(kids.front(), args);
+        }
+
+        // Linearizes one statement tree. The walk keeps its own stacks, so
+        // trees of any depth can be canonicalized, and it appends to the
+        // result list in execution order instead of building SEQs that would
+        // have to be flattened again.
+        class Linearizer
+        {
+            // A node whose kids are pulled out one after the other, as
+            // reorder in Appel's book does
+            struct Node
+            {
+                enum Build
+                {
+                    BINOP, MEM, CALL, JUMP, CJUMP, MOVE_TEMP, MOVE_CALL, MOVE_MEM, EXP, EXP_CALL
+                } build;
+                std::shared_ptr<IR::Stm> stm;
+                ExpVector kids;
+                // Where the statements of kid i + 1 begin, a MOVE saving kid
+                // i to a temp goes there
+                std::vector<IR::StmList::iterator> marks;
+                // Statements emitted before each kid, and after the last one
+                std::vector<size_t> emitted;
+                size_t next;
+                // Kid of the parent node that receives an expression,
+                // parent < 0 for a statement
+                int parent;
+                size_t kid;
+            };
+
+            struct Work
+            {
+                enum Kind
+                {
+                    STM, EXP, NODE
+                } kind;
+                std::shared_ptr<IR::Stm> stm;
+                // EXP: kid of which node it is, NODE: the node
+                int node;
+                size_t kid;
+            };
+
+            IR::StmList &out;
+            std::vector<Node> nodes;
+            std::vector<Work> work;
+            size_t emitted;
+            std::shared_ptr<IR::Stm> lastNop;
+
+            void emit(const std::shared_ptr<IR::Stm> &stm)
+            {
+                if (isNop(stm))
+                {
+                    lastNop = stm;
+                    return;
+                }
+                out.push_back(stm);
+                emitted++;
+            }
+
+            void push(Node::Build build, const std::shared_ptr<IR::Stm> &stm, ExpVector kids,
+                      int parent = -1, size_t kid = 0)
+            {
+                nodes.push_back({build, stm, std::move(kids), {}, {}, 0, parent, kid});
+                work.push_back({Work::NODE, nullptr, (int) nodes.size() - 1, 0});
+            }
+
+            // Queues stms to run in order
+            void pushStms(const IR::StmVector &stms)
+            {
+                for (auto stm = stms.rbegin(); stm != stms.rend(); stm++)
+                {
+                    work.push_back({Work::STM, *stm, -1, 0});
+                }
+            }
+
+            void doStm(const std::shared_ptr<IR::Stm> &stm);
+
+            void doExp(const std::shared_ptr<IR::Exp> &exp, int node, size_t kid);
+
+            void doNode(int index);
+
+            void finish(Node &node);
+
+        public:
+            explicit Linearizer(IR::StmList &out) : out(out), emitted(0)
+            {}
+
+            void run(const std::shared_ptr<IR::Stm> &stm)
+            {
+                work.push_back({Work::STM, stm, -1, 0});
+                while (!work.empty())
+                {
+                    Work item = std::move(work.back());
+                    work.pop_back();
+                    switch (item.kind)
+                    {
+                        case Work::STM:
+                            doStm(item.stm);
+                            break;
+                        case Work::EXP:
+                            doExp(std::static_pointer_cast<IR::Exp>(item.stm), item.node, item.kid);
+                            break;
+                        case Work::NODE:
+                            doNode(item.node);
+                            break;
+                    }
+                }
+                if (out.empty())
+                {
+                    out.push_back(lastNop != nullptr ? lastNop : nop());
+                }
+            }
+        };
+
+        void Linearizer::doStm(const std::shared_ptr<IR::Stm> &stm)
+        {
+            switch (stm->getStmType())
+            {
+                case IR::SEQ:
+                {
+                    pushStms(std::static_pointer_cast<IR::Seq>(stm)->getStms());
+                    break;
+                }
+                case IR::JUMP:
+                    push(Node::JUMP, stm, {std::static_pointer_cast<IR::Jump>(stm)->getExp()});
+                    break;
+                case IR::CJUMP:
+                {
+                    auto cjump = std::static_pointer_cast<IR::CJump>(stm);
+                    push(Node::CJUMP, stm, {cjump->getLeft(), cjump->getRight()});
+                    break;
+                }
+                case IR::MOVE:
+                {
+                    auto move = std::static_pointer_cast<IR::Move>(stm);
+                    auto dst = move->getDst();
+                    auto src = move->getSrc();
+                    if (dst->getExpType() == IR::TEMP && src->getExpType() == IR::CALL)
+                    {
+                        push(Node::MOVE_CALL, stm, callKids(std::static_pointer_cast<IR::Call>(src)));
+                    }
+                    else if (dst->getExpType() == IR::TEMP)
+                    {
+                        push(Node::MOVE_TEMP, stm, {src});
+                    }
+                    else if (dst->getExpType() == IR::MEM)
+                    {
+                        push(Node::MOVE_MEM, stm, {std::static_pointer_cast<IR::Mem>(dst)->getExp(), src});
+                    }
+                    else if (dst->getExpType() == IR::ESEQ)
+                    {
+                        auto eseq = std::static_pointer_cast<IR::Eseq>(dst);
+                        work.push_back({Work::STM, IR::makeMove(eseq->getExp(), src), -1, 0});
+                        pushStms(eseq->getStms());
+                    }
+                    else
+                    {
+                        emit(stm);
+                    }
+                    break;
+                }
+                case IR::EXP:
+                {
+                    auto exp = std::static_pointer_cast<IR::Exp>(stm);
+                    if (exp->getExpType() == IR::CALL)
+                    {
+                        push(Node::EXP_CALL, stm, callKids(std::static_pointer_cast<IR::Call>(exp)));
+                    }
+                    else
+                    {
+                        push(Node::EXP, stm, {exp});
+                    }
+                    break;
+                }
+                default:
+                    emit(stm);
+            }
+        }
+
+        void Linearizer::doExp(const std::shared_ptr<IR::Exp> &exp, int node, size_t kid)
+        {
+            switch (exp->getExpType())
+            {
+                case IR::BINOP:
+                {
+                    auto binop = std::static_pointer_cast<IR::Binop>(exp);
+                    push(Node::BINOP, exp, {binop->getLeft(), binop->getRight()}, node, kid);
+                    break;
+                }
+                case IR::MEM:
+                    push(Node::MEM, exp, {std::static_pointer_cast<IR::Mem>(exp)->getExp()}, node, kid);
+                    break;
+                case IR::ESEQ:
+                {
+                    auto eseq = std::static_pointer_cast<IR::Eseq>(exp);
+                    work.push_back({Work::EXP, eseq->getExp(), node, kid});
+                    pushStms(eseq->getStms());
+                    break;
+                }
+                case IR::CALL:
+                    push(Node::CALL, exp, callKids(std::static_pointer_cast<IR::Call>(exp)), node, kid);
+                    break;
+                default:
+                    nodes[node].kids[kid] = exp;
+            }
+        }
+
+        void Linearizer::doNode(int index)
+        {
+            Node &node = nodes[index];
+            if (node.next == node.kids.size())
+            {
+                node.emitted.push_back(emitted);
+                finish(node);
+                nodes.pop_back();
+                return;
+            }
+            size_t i = node.next++;
+            if (i > 0)
+            {
+                node.marks.push_back(out.insert(out.end(), nullptr));
+            }
+            node.emitted.push_back(emitted);
+            auto &exp = node.kids[i];
+            if (exp->getExpType() == IR::CALL)
+            {
+                auto t = Temporary::makeTemp();
+                exp = IR::makeEseq(IR::makeMove(IR::makeTemp(t), exp), IR::makeTemp(t));
+            }
+            work.push_back({Work::NODE, nullptr, index, 0});
+            work.push_back({Work::EXP, exp, index, i});
+        }
+
+        void Linearizer::finish(Node &node)
+        {
+            // Temps for kids that a later statement might change, made from
+            // the last kid back as the recursive reorder does
+            bool restIsNop = true;
+            for (size_t i = node.kids.size(); i-- > 0;)
+            {
+                auto &exp = node.kids[i];
+                if (restIsNop || commute(exp))
+                {
+                    restIsNop = restIsNop && node.emitted[i + 1] == node.emitted[i];
+                    continue;
+                }
+                auto t = Temporary::makeTemp();
+                *node.marks[i] = IR::makeMove(IR::makeTemp(t), exp);
+                emitted++;
+                exp = IR::makeTemp(t);
+                restIsNop = false;
+            }
+            for (auto &mark : node.marks)
+            {
+                if (*mark == nullptr)
+                {
+                    out.erase(mark);
+                }
+            }
+
+            auto &kids = node.kids;
+            std::shared_ptr<IR::Exp> exp;
+            switch (node.build)
+            {
+                case Node::BINOP:
+                    exp = IR::makeBinop(std::static_pointer_cast<IR::Binop>(node.stm)->getOp(), kids[0], kids[1]);
+                    break;
+                case Node::MEM:
+                    exp = IR::makeMem(kids[0]);
+                    break;
+                case Node::CALL:
+                    exp = remakeCall(kids);
+                    break;
+                case Node::JUMP:
+                    emit(IR::makeJump(kids[0], std::static_pointer_cast<IR::Jump>(node.stm)->getLabels()));
+                    break;
+                case Node::CJUMP:
+                {
+                    auto cjump = std::static_pointer_cast<IR::CJump>(node.stm);
+                    emit(IR::makeCJump(cjump->getOp(), kids[0], kids[1], cjump->getLabelTrue(),
+                                       cjump->getLabelFalse()));
+                    break;
+                }
+                case Node::MOVE_TEMP:
+                    emit(IR::makeMove(std::static_pointer_cast<IR::Move>(node.stm)->getDst(), kids[0]));
+                    break;
+                case Node::MOVE_CALL:
+                    emit(IR::makeMove(std::static_pointer_cast<IR::Move>(node.stm)->getDst(), remakeCall(kids)));
+                    break;
+                case Node::MOVE_MEM:
+                    emit(IR::makeMove(IR::makeMem(kids[0]), kids[1]));
+                    break;
+                case Node::EXP:
+                    emit(IR::makeExp(kids[0]));
+                    break;
+                case Node::EXP_CALL:
+                    emit(IR::makeExp(remakeCall(kids)));
+                    break;
+            }
+            if (exp != nullptr)
+            {
+                nodes[node.parent].kids[node.kid] = exp;
+            }
+        }
+
+        bool endsBlock(const std::shared_ptr<IR::Stm> &stm)
+        {
+            return stm->getStmType() == IR::JUMP || stm->getStmType() == IR::CJUMP;
+        }
+
+        std::shared_ptr<Temporary::Label> blockLabel(const std::shared_ptr<IR::StmList> &block)
+        {
+            return std::static_pointer_cast<IR::Label>(block->front())->getLabel();
+        }
+
+        std::shared_ptr<IR::Stm> jumpTo(const std::shared_ptr<Temporary::Label> &label)
+        {
+            auto labels = std::make_shared<IR::LabelList>();
+            labels->push_back(label);
+            return IR::makeJump(IR::makeName(label), labels);
+        }
+
+        IR::ComparisonOp notRel(IR::ComparisonOp op)
+        {
+            switch (op)
+            {
+                case IR::EQ:
+                    return IR::NE;
+                case IR::NE:
+                    return IR::EQ;
+                case IR::LT:
+                    return IR::GE;
+                case IR::GE:
+                    return IR::LT;
+                case IR::GT:
+                    return IR::LE;
+                case IR::LE:
+                    return IR::GT;
+            }
+            return op;
+        }
+    }
+
+    std::shared_ptr<IR::StmList> linearize(std::shared_ptr<IR::Stm> stm)
+    {
+        auto stmList = std::make_shared<IR::StmList>();
+        Linearizer(*stmList).run(stm);
+        return stmList;
+    }
+
+    std::shared_ptr<Block> basicBlocks(std::shared_ptr<IR::StmList> stmList)
+    {
+        auto done = Temporary::makeLabel();
+        auto stmLists = std::make_shared<StmListList>();
+        std::shared_ptr<IR::StmList> current;
+        for (auto &stm : *stmList)
+        {
+            if (current == nullptr)
+            {
+                current = std::make_shared<IR::StmList>();
+                if (stm->getStmType() != IR::LABEL)
+                {
+                    current->push_back(IR::makeLabel(Temporary::makeLabel()));
+                }
+            }
+            else if (stm->getStmType() == IR::LABEL)
+            {
+                // Fall into the next block through an explicit jump
+                current->push_back(jumpTo(std::static_pointer_cast<IR::Label>(stm)->getLabel()));
+                stmLists->push_back(current);
+                current = std::make_shared<IR::StmList>();
+            }
+            current->push_back(stm);
+            if (endsBlock(stm))
+            {
+                stmLists->push_back(current);
+                current = nullptr;
+            }
+        }
+        if (current != nullptr)
+        {
+            current->push_back(jumpTo(done));
+            stmLists->push_back(current);
+        }
+        return std::make_shared<Block>(stmLists, done);
+    }
+
+    std::shared_ptr<IR::StmList> traceSchedule(std::shared_ptr<Block> block)
+    {
+        auto stmLists = block->getStmLists();
+        std::map<Temporary::Label *, std::shared_ptr<IR::StmList>> table;
+        for (auto &stmList : *stmLists)
+        {
+            table.insert(std::make_pair(blockLabel(stmList).get(), stmList));
+        }
+        // Blocks are found by label, and only while they are not placed yet
+        std::set<IR::StmList *> placed;
+        auto take = [&table, &placed](const std::shared_ptr<Temporary::Label> &label)
+        {
+            std::shared_ptr<IR::StmList> found;
+            auto entry = table.find(label.get());
+            if (entry != table.end() && placed.count(entry->second.get()) == 0)
+            {
+                found = entry->second;
+            }
+            return found;
+        };
+
+        auto result = std::make_shared<IR::StmList>();
+        for (auto &head : *stmLists)
+        {
+            auto current = placed.count(head.get()) == 0 ? head : nullptr;
+            while (current != nullptr)
+            {
+                placed.insert(current.get());
+                auto last = current->back();
+                current->pop_back();
+                result->splice(result->end(), *current);
+                std::shared_ptr<IR::StmList> next;
+                if (last->getStmType() == IR::JUMP)
+                {
+                    auto jump = std::static_pointer_cast<IR::Jump>(last);
+                    if (jump->getLabels()->size() == 1)
+                    {
+                        next = take(jump->getLabels()->front());
+                    }
+                    if (next == nullptr)
+                    {
+                        result->push_back(last);
+                    }
+                }
+                else
+                {
+                    auto cjump = std::static_pointer_cast<IR::CJump>(last);
+                    auto falseBlock = take(cjump->getLabelFalse());
+                    auto trueBlock = take(cjump->getLabelTrue());
+                    if (falseBlock != nullptr)
+                    {
+                        result->push_back(last);
+                        next = falseBlock;
+                    }
+                    else if (trueBlock != nullptr)
+                    {
+                        result->push_back(IR::makeCJump(notRel(cjump->getOp()), cjump->getLeft(),
+                                                        cjump->getRight(), cjump->getLabelFalse(),
+                                                        cjump->getLabelTrue()));
+                        next = trueBlock;
+                    }
+                    else
+                    {
+                        auto f = Temporary::makeLabel();
+                        result->push_back(IR::makeCJump(cjump->getOp(), cjump->getLeft(), cjump->getRight(),
+                                                        cjump->getLabelTrue(), f));
+                        result->push_back(IR::makeLabel(f));
+                        result->push_back(jumpTo(cjump->getLabelFalse()));
+                    }
+                }
+                current = next;
+            }
+        }
+        result->push_back(IR::makeLabel(block->getLabel()));
+        return result;
+    }
+
+    void canonicalize(std::shared_ptr<Frame::FragList> fragList)
+    {
+        std::vector<std::shared_ptr<Frame::ProcFrag>> procFrags;
+        for (auto &frag : *fragList)
+        {
+            if (frag->getKind() == Frame::PROC_FRAG)
+            {
+                procFrags.push_back(std::static_pointer_cast<Frame::ProcFrag>(frag));
+            }
+        }
+        std::vector<std::unique_ptr<Temporary::NameScope>> names;
+        for (size_t i = 0; i < procFrags.size(); i++)
+        {
+            names.emplace_back(new Temporary::NameScope());
+        }
+        parallelFor(procFrags.size(), [&procFrags, &names](size_t i)
+        {
+            Temporary::NameScope::Activation activation(names[i].get());
+            auto procFrag = procFrags[i];
+            auto stmList = traceSchedule(basicBlocks(linearize(procFrag->getBody())));
+            procFrag->setStmList(stmList);
+        });
+        for (auto &scope : names)
+        {
+            scope->commit();
+        }
+    }
+}
@@ -0,0 +1,48 @@
+//
+// Canonical trees: linearize, basic blocks and traces
+//
+
+#ifndef SRC_CANON_H
+#define SRC_CANON_H
+
+#include <memory>
+#include <list>
+#include "IR.h"
+#include "Frame.h"
+#include "Temporary.h"
+
+namespace Canon
+{
+    using StmListList = std::list<std::shared_ptr<IR::StmList>>;
+
+    class Block
+    {
+        std::shared_ptr<StmListList> stmLists;
+        std::shared_ptr<Temporary::Label> label;
+    public:
+        Block(const std::shared_ptr<StmListList> &stmLists, const std::shared_ptr<Temporary::Label> &label);
+
+        const std::shared_ptr<StmListList> getStmLists() const;
+
+        // The label every block jumps to when the procedure is done
+        const std::shared_ptr<Temporary::Label> getLabel() const;
+    };
+
+    // Removes SEQ and ESEQ, and leaves every CALL as the direct child of an
+    // EXP or of a MOVE(TEMP, ...), giving a list of statements
+    std::shared_ptr<IR::StmList> linearize(std::shared_ptr<IR::Stm> stm);
+
+    // Splits a linearized list into blocks that start with a LABEL, end with
+    // a JUMP or CJUMP and contain no other LABEL, JUMP or CJUMP
+    std::shared_ptr<Block> basicBlocks(std::shared_ptr<IR::StmList> stmList);
+
+    // Orders the blocks so every CJUMP is followed by its false label and
+    // JUMPs to the next statement are dropped
+    std::shared_ptr<IR::StmList> traceSchedule(std::shared_ptr<Block> block);
+
+    // Canonicalizes the body of every ProcFrag, one task per fragment.
+    // New temps and labels are numbered in fragment order.
+    void canonicalize(std::shared_ptr<Frame::FragList> fragList);
+}
+
+#endif //SRC_CANON_H
@@ -0,0 +1,378 @@
+//
+// Instruction selection for x86-64
+//
+
+#include "Codegen.h"
+#include "Bump.h"
+#include "Burs.h"
+#include "RegAlloc.h"
+#include "LinearScan.h"
+#include "StackMaps.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace Codegen
+{
+    namespace
+    {
+        using Assem::makeInstr;
+
+        class Selector
+        {
+            const Linear::Function &function;
+            Assem::Function &result;
+            // Block placed after the one being selected
+            int32_t next;
+            // Label of the card table, once a write barrier needs it
+            int32_t cardTable;
+
+            int32_t temp(int32_t index) const
+            {
+                int num = function.tempNums[index];
+                if (num >= 0 && num < Frame::REGISTER_COUNT)
+                {
+                    return num;
+                }
+                return Frame::REGISTER_COUNT + index;
+            }
+
+            int32_t newTemp()
+            {
+                return result.tempCount++;
+            }
+
+            void emit(const Assem::Instr &instr)
+            {
+                result.instrs.push_back(instr);
+            }
+
+            void move(int32_t dst, int32_t src)
+            {
+                if (dst != src)
+                {
+                    auto instr = makeInstr(Assem::MOV, Assem::RR);
+                    instr.dst = dst;
+                    instr.src = src;
+                    emit(instr);
+                }
+            }
+
+            void arithmetic(Assem::Opcode opcode, int32_t dst, const Linear::Instr &instr)
+            {
+                auto op = makeInstr(opcode, instr.useImm ? Assem::RI : Assem::RR);
+                op.dst = dst;
+                op.src = instr.useImm ? Assem::NONE : temp(instr.b);
+                op.imm = instr.imm;
+                emit(op);
+            }
+
+            void binop(const Linear::Instr &instr)
+            {
+                int32_t dst = temp(instr.dst);
+                int32_t a = temp(instr.a);
+                auto op = (IR::ArithmeticOp) instr.op;
+                if (op == IR::DIV)
+                {
+                    move(Frame::RAX, a);
+                    emit(makeInstr(Assem::CQO, Assem::NO_OPERANDS));
+                    auto divide = makeInstr(Assem::IDIV, Assem::R);
+                    // The divisor cannot be an immediate, nor be in a register
+                    // the division overwrites
+                    divide.src = instr.useImm ? Assem::NONE : temp(instr.b);
+                    if (instr.useImm || Assem::isRegister(divide.src))
+                    {
+                        int32_t divisor = newTemp();
+                        if (instr.useImm)
+                        {
+                            auto load = makeInstr(Assem::MOV, Assem::RI);
+                            load.dst = divisor;
+                            load.imm = instr.imm;
+                            emit(load);
+                        }
+                        else
+                        {
+                            move(divisor, divide.src);
+                        }
+                        divide.src = divisor;
+                    }
+                    emit(divide);
+                    move(dst, Frame::RAX);
+                    return;
+                }
+                if (instr.useImm)
+                {
+                    if (op == IR::MUL)
+                    {
+                        auto multiply = makeInstr(Assem::IMUL, Assem::RRI);
+                        multiply.dst = dst;
+                        multiply.src = a;
+                        multiply.imm = instr.imm;
+                        emit(multiply);
+                    }
+                    else if (dst != a)
+                    {
+                        auto lea = makeInstr(Assem::LEA, Assem::RM);
+                        lea.dst = dst;
+                        lea.mem = Assem::makeMem(a, op == IR::PLUS ? instr.imm : -instr.imm);
+                        emit(lea);
+                    }
+                    else
+                    {
+                        arithmetic(op == IR::PLUS ? Assem::ADD : Assem::SUB, dst, instr);
+                    }
+                    return;
+                }
+                Assem::Opcode opcode = op == IR::PLUS ? Assem::ADD : op == IR::MINUS ? Assem::SUB : Assem::IMUL;
+                int32_t b = temp(instr.b);
+                if (dst == b && dst != a)
+                {
+                    if (op != IR::MINUS)
+                    {
+                        // Commutes, and b is already in place
+                        auto operation = makeInstr(opcode, Assem::RR);
+                        operation.dst = dst;
+                        operation.src = a;
+                        emit(operation);
+                        return;
+                    }
+                    int32_t difference = newTemp();
+                    move(difference, a);
+                    arithmetic(opcode, difference, instr);
+                    move(dst, difference);
+                    return;
+                }
+                move(dst, a);
+                arithmetic(opcode, dst, instr);
+            }
+
+            // The write barrier a call to Frame::MARK_CARD_NAME stands for,
+            // inline: the card of the address is set in the runtime's table
+            void markCard(int32_t address)
+            {
+                if (cardTable == Assem::NONE)
+                {
+                    cardTable = (int32_t) result.labels.size();
+                    result.labels.push_back(Frame::CARD_TABLE_NAME);
+                }
+                auto table = newTemp();
+                auto load = makeInstr(Assem::MOV, Assem::RM);
+                load.dst = table;
+                load.mem.label = cardTable;
+                emit(load);
+                auto card = newTemp();
+                move(card, address);
+                auto shift = makeInstr(Assem::SHR, Assem::RI);
+                shift.dst = card;
+                shift.imm = Frame::CARD_SHIFT;
+                emit(shift);
+                auto store = makeInstr(Assem::MOV, Assem::MI);
+                store.mem = Assem::makeMem(table, 0);
+                store.mem.index = card;
+                store.mem.scale = Frame::WORD_SIZE;
+                store.imm = 1;
+                emit(store);
+            }
+
+            void call(const Linear::Instr &instr)
+            {
+                if (instr.imm != Linear::NONE && instr.dst == Linear::NONE && instr.second == 1 &&
+                    function.labels[instr.imm] == Frame::MARK_CARD_NAME)
+                {
+                    markCard(temp(function.args[instr.first]));
+                    return;
+                }
+                for (int32_t i = 0; i < instr.second; i++)
+                {
+                    int32_t arg = temp(function.args[instr.first + i]);
+                    if (i < Frame::MAX_REG)
+                    {
+                        move(Frame::ARG_REGISTERS[i], arg);
+                    }
+                    else
+                    {
+                        auto store = makeInstr(Assem::MOV, Assem::MR);
+                        store.src = arg;
+                        store.mem = Assem::makeMem(Frame::RSP, (i - Frame::MAX_REG) * Frame::WORD_SIZE);
+                        emit(store);
+                    }
+                }
+                result.outgoingWords = std::max(result.outgoingWords, instr.second - Frame::MAX_REG);
+                auto call = makeInstr(Assem::CALL, instr.imm != Linear::NONE ? Assem::L : Assem::R);
+                call.target = instr.imm;
+                call.src = instr.imm != Linear::NONE ? Assem::NONE : temp(instr.a);
+                call.argCount = (uint8_t) std::min(instr.second, (int32_t) Frame::MAX_REG);
+                emit(call);
+                if (instr.dst != Linear::NONE)
+                {
+                    move(temp(instr.dst), Frame::RAX);
+                }
+            }
+
+            void jump(int32_t block)
+            {
+                if (block != next)
+                {
+                    auto jmp = makeInstr(Assem::JMP, Assem::L);
+                    jmp.target = block;
+                    emit(jmp);
+                }
+            }
+
+            void cjump(const Linear::Instr &instr)
+            {
+                auto compare = makeInstr(Assem::CMP, instr.useImm ? Assem::RI : Assem::RR);
+                compare.dst = temp(instr.a);
+                compare.src = instr.useImm ? Assem::NONE : temp(instr.b);
+                compare.imm = instr.imm;
+                emit(compare);
+                auto branch = makeInstr(Assem::JCC, Assem::L);
+                if (instr.first == next)
+                {
+                    branch.cond = (uint8_t) Assem::negate((IR::ComparisonOp) instr.op);
+                    branch.target = instr.second;
+                    emit(branch);
+                    return;
+                }
+                branch.cond = instr.op;
+                branch.target = instr.first;
+                emit(branch);
+                jump(instr.second);
+            }
+
+            void instr(const Linear::Instr &instr)
+            {
+                switch (instr.opcode)
+                {
+                    case Linear::MOVE:
+                        move(temp(instr.dst), temp(instr.a));
+                        break;
+                    case Linear::LOADI:
+                    {
+                        auto load = makeInstr(Assem::MOV, Assem::RI);
+                        load.dst = temp(instr.dst);
+                        load.imm = instr.imm;
+                        emit(load);
+                        break;
+                    }
+                    case Linear::LOADA:
+                    {
+                        auto lea = makeInstr(Assem::LEA, Assem::RM);
+                        lea.dst = temp(instr.dst);
+                        lea.mem.label = instr.imm;
+                        emit(lea);
+                        break;
+                    }
+                    case Linear::BINOP:
+                        binop(instr);
+                        break;
+                    case Linear::LOAD:
+                    {
+                        auto load = makeInstr(Assem::MOV, Assem::RM);
+                        load.dst = temp(instr.dst);
+                        load.mem = Assem::makeMem(temp(instr.a), instr.imm);
+                        emit(load);
+                        break;
+                    }
+                    case Linear::STORE:
+                    {
+                        auto store = makeInstr(Assem::MOV, Assem::MR);
+                        store.src = temp(instr.b);
+                        store.mem = Assem::makeMem(temp(instr.a), instr.imm);
+                        emit(store);
+                        break;
+                    }
+                    case Linear::CALL:
+                        call(instr);
+                        break;
+                    case Linear::JUMP:
+                        if (instr.first != Linear::NONE)
+                        {
+                            jump(instr.first);
+                        }
+                        else
+                        {
+                            auto jmp = makeInstr(Assem::JMP, Assem::R);
+                            jmp.src = temp(instr.a);
+                            emit(jmp);
+                        }
+                        break;
+                    case Linear::CJUMP:
+                    default:
+                        cjump(instr);
+                        break;
+                }
+            }
+
+        public:
+            Selector(const Linear::Function &function, Assem::Function &result)
+                    : function(function), result(result), next(0), cardTable(Assem::NONE)
+            {}
+
+            void run()
+            {
+                for (size_t b = 0; b < function.blocks.size(); b++)
+                {
+                    auto &block = function.blocks[b];
+                    next = (int32_t) b + 1;
+                    auto begin = (uint32_t) result.instrs.size();
+                    for (uint32_t i = block.begin; i < block.end; i++)
+                    {
+                        instr(function.instrs[i]);
+                    }
+                    result.blocks.push_back({block.label, begin, (uint32_t) result.instrs.size()});
+                }
+            }
+        };
+    }
+
+    std::shared_ptr<Assem::Function> select(const Linear::Function &function, int32_t frameWords)
+    {
+        auto result = std::make_shared<Assem::Function>();
+        result->name = function.name;
+        result->labels = function.labels;
+        result->tempCount = Frame::REGISTER_COUNT + function.getTempCount();
+        result->tempKinds.assign(Frame::REGISTER_COUNT, Temporary::UNKNOWN);
+        result->tempKinds.insert(result->tempKinds.end(), function.tempKinds.begin(), function.tempKinds.end());
+        result->frameWords = frameWords;
+        result->spillWords = 0;
+        result->outgoingWords = 0;
+        result->spilledTemps = 0;
+        result->eliminatedMoves = 0;
+        Selector(function, *result).run();
+        return result;
+    }
+
+    std::shared_ptr<Assem::FunctionList> generate(std::shared_ptr<Frame::FragList> fragList, Selection selection,
+                                                  Allocation allocation)
+    {
+        std::vector<std::shared_ptr<Frame::ProcFrag>> procFrags;
+        for (auto &frag : *fragList)
+        {
+            if (frag->getKind() == Frame::PROC_FRAG)
+            {
+                procFrags.push_back(std::static_pointer_cast<Frame::ProcFrag>(frag));
+            }
+        }
+        auto functions = std::make_shared<Assem::FunctionList>(procFrags.size());
+        parallelFor(procFrags.size(), [&procFrags, &functions, selection, allocation](size_t i)
+        {
+            auto frame = procFrags[i]->getFrame();
+            int32_t frameWords = frame ? frame->getLocal_count() : 0;
+            auto function = selection == TILE ? Burs::select(procFrags[i], frameWords)
+                                              : select(*Linear::lower(procFrags[i]), frameWords);
+            Bump::expand(*function);
+            StackMaps::prepare(*function, frame.get());
+            if (allocation == LINEAR_SCAN)
+            {
+                LinearScan::allocate(*function);
+            }
+            else
+            {
+                RegAlloc::color(*function);
+            }
+            StackMaps::build(*function);
+            (*functions)[i] = function;
+        });
+        return functions;
+    }
+}
@@ -0,0 +1,38 @@
+//
+// Instruction selection for x86-64
+//
+
+#ifndef SRC_CODEGEN_H
+#define SRC_CODEGEN_H
+
+#include <memory>
+#include "Assem.h"
+#include "Frame.h"
+#include "Linear.h"
+
+namespace Codegen
+{
+    // Selects instructions for a function lowered from a ProcFrag with
+    // frameWords words of locals. Temps of the Linear function keep their
+    // index past the machine registers.
+    std::shared_ptr<Assem::Function> select(const Linear::Function &function, int32_t frameWords);
+
+    enum Selection
+    {
+        TILE,       // tile the canonical trees, see Burs
+        LINEAR      // one instruction or so per instruction of the linear form
+    };
+
+    enum Allocation
+    {
+        COLORING,       // RegAlloc::color
+        LINEAR_SCAN     // LinearScan::allocate, for fast builds
+    };
+
+    // Selects and allocates every ProcFrag, one task per fragment, in
+    // fragment order. Canon::canonicalize must have run.
+    std::shared_ptr<Assem::FunctionList> generate(std::shared_ptr<Frame::FragList> fragList,
+                                                  Selection selection = TILE, Allocation allocation = COLORING);
+}
+
+#endif //SRC_CODEGEN_H
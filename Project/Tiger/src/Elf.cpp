@@ -0,0 +1,163 @@
+//
+// ELF64 relocatable object output
+//
+
+#include "Elf.h"
+#include "Encode.h"
+#include <cstring>
+#include <elf.h>
+
+namespace Elf
+{
+    namespace
+    {
+        // Sections in header order, after the null one
+        enum SectionIndex
+        {
+            TEXT_SECTION = 1, RODATA_SECTION, RELA_SECTION, SYMTAB_SECTION, STRTAB_SECTION, SHSTRTAB_SECTION,
+            NOTE_SECTION, SECTION_COUNT
+        };
+
+        const char *const sectionNames[] = {
+                "", ".text", ".rodata", ".rela.text", ".symtab", ".strtab", ".shstrtab", ".note.GNU-stack"
+        };
+
+        template<typename T>
+        void append(std::string &out, const T &value)
+        {
+            out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+        }
+
+        void align(std::string &out, size_t alignment)
+        {
+            out.resize((out.size() + alignment - 1) / alignment * alignment, '\0');
+        }
+
+        // Index of name in a string table, adding it to the end
+        uint32_t addName(std::string &table, const std::string &name)
+        {
+            auto index = (uint32_t) table.size();
+            table.append(name);
+            table.push_back('\0');
+            return index;
+        }
+    }
+
+    void writeObject(const Frame::FragList &fragList, const Assem::FunctionList &functions, std::ostream &outFile)
+    {
+        auto object = Encode::encode(fragList, functions);
+
+        // The symbol table lists the local symbols before the global ones
+        std::string strtab(1, '\0');
+        std::string symtab;
+        append(symtab, Elf64_Sym{});
+        std::vector<uint32_t> symbolIndex(object.symbols.size());
+        uint32_t count = 1;
+        uint32_t firstGlobal = 0;
+        for (bool global : {false, true})
+        {
+            if (global)
+            {
+                firstGlobal = count;
+            }
+            for (size_t i = 0; i < object.symbols.size(); i++)
+            {
+                auto &symbol = object.symbols[i];
+                if (symbol.global != global)
+                {
+                    continue;
+                }
+                Elf64_Sym sym = {};
+                sym.st_name = addName(strtab, symbol.name);
+                sym.st_info = (unsigned char) ELF64_ST_INFO(global ? STB_GLOBAL : STB_LOCAL,
+                                                            symbol.function ? STT_FUNC :
+                                                            symbol.section == Encode::RODATA ? STT_OBJECT
+                                                                                             : STT_NOTYPE);
+                sym.st_shndx = (Elf64_Section) (symbol.section == Encode::TEXT ? TEXT_SECTION :
+                                                symbol.section == Encode::RODATA ? RODATA_SECTION : SHN_UNDEF);
+                sym.st_value = symbol.offset;
+                sym.st_size = symbol.size;
+                append(symtab, sym);
+                symbolIndex[i] = count++;
+            }
+        }
+
+        std::string rela;
+        for (auto &relocation : object.relocations)
+        {
+            Elf64_Rela entry = {};
+            entry.r_offset = relocation.offset;
+            entry.r_info = ELF64_R_INFO(symbolIndex[relocation.symbol],
+                                        relocation.call ? R_X86_64_PLT32 : R_X86_64_PC32);
+            entry.r_addend = relocation.addend;
+            append(rela, entry);
+        }
+
+        std::string shstrtab(1, '\0');
+        Elf64_Shdr headers[SECTION_COUNT] = {};
+        for (int i = 1; i < SECTION_COUNT; i++)
+        {
+            headers[i].sh_name = addName(shstrtab, sectionNames[i]);
+            headers[i].sh_addralign = 1;
+        }
+
+        std::string out(sizeof(Elf64_Ehdr), '\0');
+        auto section = [&out, &headers](int index, const char *data, size_t size, size_t alignment)
+        {
+            align(out, alignment);
+            headers[index].sh_offset = out.size();
+            headers[index].sh_size = size;
+            headers[index].sh_addralign = alignment;
+            if (size > 0)
+            {
+                out.append(data, size);
+            }
+        };
+        section(TEXT_SECTION, reinterpret_cast<const char *>(object.text.data()), object.text.size(), 16);
+        headers[TEXT_SECTION].sh_type = SHT_PROGBITS;
+        headers[TEXT_SECTION].sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+        section(RODATA_SECTION, reinterpret_cast<const char *>(object.rodata.data()), object.rodata.size(), 8);
+        headers[RODATA_SECTION].sh_type = SHT_PROGBITS;
+        headers[RODATA_SECTION].sh_flags = SHF_ALLOC;
+        section(RELA_SECTION, rela.data(), rela.size(), 8);
+        headers[RELA_SECTION].sh_type = SHT_RELA;
+        headers[RELA_SECTION].sh_flags = SHF_INFO_LINK;
+        headers[RELA_SECTION].sh_link = SYMTAB_SECTION;
+        headers[RELA_SECTION].sh_info = TEXT_SECTION;
+        headers[RELA_SECTION].sh_entsize = sizeof(Elf64_Rela);
+        section(SYMTAB_SECTION, symtab.data(), symtab.size(), 8);
+        headers[SYMTAB_SECTION].sh_type = SHT_SYMTAB;
+        headers[SYMTAB_SECTION].sh_link = STRTAB_SECTION;
+        headers[SYMTAB_SECTION].sh_info = firstGlobal;
+        headers[SYMTAB_SECTION].sh_entsize = sizeof(Elf64_Sym);
+        section(STRTAB_SECTION, strtab.data(), strtab.size(), 1);
+        headers[STRTAB_SECTION].sh_type = SHT_STRTAB;
+        section(SHSTRTAB_SECTION, shstrtab.data(), shstrtab.size(), 1);
+        headers[SHSTRTAB_SECTION].sh_type = SHT_STRTAB;
+        // Empty, so the stack need not be executable
+        section(NOTE_SECTION, nullptr, 0, 1);
+        headers[NOTE_SECTION].sh_type = SHT_PROGBITS;
+
+        align(out, 8);
+        Elf64_Ehdr header = {};
+        std::memcpy(header.e_ident, ELFMAG, SELFMAG);
+        header.e_ident[EI_CLASS] = ELFCLASS64;
+        header.e_ident[EI_DATA] = ELFDATA2LSB;
+        header.e_ident[EI_VERSION] = EV_CURRENT;
+        header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+        header.e_type = ET_REL;
+        header.e_machine = EM_X86_64;
+        header.e_version = EV_CURRENT;
+        header.e_shoff = out.size();
+        header.e_ehsize = sizeof(Elf64_Ehdr);
+        header.e_shentsize = sizeof(Elf64_Shdr);
+        header.e_shnum = SECTION_COUNT;
+        header.e_shstrndx = SHSTRTAB_SECTION;
+        std::memcpy(&out[0], &header, sizeof(header));
+        for (auto &sectionHeader : headers)
+        {
+            append(out, sectionHeader);
+        }
+        outFile.write(out.data(), (std::streamsize) out.size());
+    }
+}
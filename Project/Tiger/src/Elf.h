@@ -0,0 +1,22 @@
+//
+// ELF64 relocatable object output
+//
+
+#ifndef SRC_ELF_H
+#define SRC_ELF_H
+
+#include <ostream>
+#include "Assem.h"
+#include "Frame.h"
+
+namespace Elf
+{
+    // Writes what Encode::encode makes of the functions and StringFrags as
+    // an x86-64 object with .text, .rodata and the relocations for the
+    // strings and the runtime calls. It links with the system linker
+    // against the runtime library, like the output of writeAssembly
+    // after as.
+    void writeObject(const Frame::FragList &fragList, const Assem::FunctionList &functions, std::ostream &outFile);
+}
+
+#endif //SRC_ELF_H
@@ -0,0 +1,317 @@
+//
+// GNU assembler output
+//
+
+#include "Emit.h"
+#include "OutBuffer.h"
+#include "StackMaps.h"
+#include <algorithm>
+
+namespace Emit
+{
+    namespace
+    {
+        const char *const opcodeNames[] = {
+                "movq", "leaq", "addq", "subq", "imulq", "cqto", "idivq", "shrq", "cmpq", "jmp", "j", "call",
+                "movb"
+        };
+        // Signed conditions, in IR::ComparisonOp order
+        const char *const conditionNames[] = {"e", "ne", "l", "g", "le", "ge"};
+
+        // Label after the calls, whose return addresses the stack map
+        // table lists
+        const char *const RETURN_PREFIX = ".Lret";
+
+        class FunctionWriter
+        {
+            const Assem::Function &function;
+            OutBuffer &outFile;
+            // Number of the next call's return label, counted over the file
+            int32_t &returns;
+
+            void temp(int32_t temp)
+            {
+                outFile << '%';
+                if (Assem::isRegister(temp))
+                {
+                    outFile << Frame::getRegisterName(temp);
+                }
+                else
+                {
+                    // Left by an allocator that did not finish
+                    outFile << 't' << temp;
+                }
+            }
+
+            void immediate(int32_t imm)
+            {
+                outFile << '$' << imm;
+            }
+
+            void mem(const Assem::Mem &mem)
+            {
+                if (mem.label != Assem::NONE)
+                {
+                    outFile << function.labels[mem.label];
+                    if (mem.disp != 0)
+                    {
+                        outFile << (mem.disp > 0 ? "+" : "") << mem.disp;
+                    }
+                    outFile << "(%rip)";
+                    return;
+                }
+                if (mem.disp != 0 || mem.base == Assem::NONE)
+                {
+                    outFile << mem.disp;
+                }
+                outFile << '(';
+                if (mem.base != Assem::NONE)
+                {
+                    temp(mem.base);
+                }
+                if (mem.index != Assem::NONE)
+                {
+                    outFile << ", ";
+                    temp(mem.index);
+                    outFile << ", " << mem.scale;
+                }
+                outFile << ')';
+            }
+
+            void block(int32_t index)
+            {
+                auto &target = function.blocks[index];
+                if (target.label != Assem::NONE)
+                {
+                    outFile << function.labels[target.label];
+                }
+                else
+                {
+                    outFile << ".L" << function.name << '_' << index;
+                }
+            }
+
+            void instr(const Assem::Instr &instr)
+            {
+                outFile << '\t' << opcodeNames[instr.opcode];
+                if (instr.opcode == Assem::JCC)
+                {
+                    outFile << conditionNames[instr.cond];
+                }
+                if (instr.form != Assem::NO_OPERANDS)
+                {
+                    outFile << '\t';
+                }
+                switch (instr.form)
+                {
+                    case Assem::R:
+                        if (instr.opcode == Assem::CALL || instr.opcode == Assem::JMP)
+                        {
+                            outFile << '*';
+                        }
+                        temp(instr.src);
+                        break;
+                    case Assem::RR:
+                        temp(instr.src);
+                        outFile << ", ";
+                        temp(instr.dst);
+                        break;
+                    case Assem::RI:
+                        immediate(instr.imm);
+                        outFile << ", ";
+                        temp(instr.dst);
+                        break;
+                    case Assem::RM:
+                        mem(instr.mem);
+                        outFile << ", ";
+                        temp(instr.dst);
+                        break;
+                    case Assem::MR:
+                        temp(instr.src);
+                        outFile << ", ";
+                        mem(instr.mem);
+                        break;
+                    case Assem::MI:
+                        immediate(instr.imm);
+                        outFile << ", ";
+                        mem(instr.mem);
+                        break;
+                    case Assem::RRI:
+                        immediate(instr.imm);
+                        outFile << ", ";
+                        temp(instr.src);
+                        outFile << ", ";
+                        temp(instr.dst);
+                        break;
+                    case Assem::L:
+                        if (instr.opcode == Assem::CALL)
+                        {
+                            outFile << function.labels[instr.target];
+                        }
+                        else
+                        {
+                            block(instr.target);
+                        }
+                        break;
+                    default:
+                        break;
+                }
+                outFile << '\n';
+            }
+
+        public:
+            FunctionWriter(const Assem::Function &function, OutBuffer &outFile, int32_t &returns)
+                    : function(function), outFile(outFile), returns(returns)
+            {}
+
+            void run()
+            {
+                auto frame = layout(function);
+
+                outFile << "\t.text\n";
+                if (function.name == Frame::MAIN_NAME)
+                {
+                    outFile << "\t.globl\t" << function.name << '\n';
+                }
+                outFile << "\t.type\t" << function.name << ", @function\n";
+                outFile << function.name << ":\n";
+                outFile << "\tpushq\t%rbp\n";
+                outFile << "\tmovq\t%rsp, %rbp\n";
+                if (frame.frameBytes > 0)
+                {
+                    outFile << "\tsubq\t$" << frame.frameBytes << ", %rsp\n";
+                }
+                for (size_t i = 0; i < frame.saved.size(); i++)
+                {
+                    outFile << "\tmovq\t%" << Frame::getRegisterName(frame.saved[i]) << ", "
+                            << frame.saveSlots[i] << "(%rbp)\n";
+                }
+                size_t map = 0;
+                for (size_t b = 0; b < function.blocks.size(); b++)
+                {
+                    auto &current = function.blocks[b];
+                    block((int32_t) b);
+                    outFile << ":\n";
+                    for (uint32_t i = current.begin; i < current.end; i++)
+                    {
+                        instr(function.instrs[i]);
+                        if (map < function.stackMaps.size() && function.stackMaps[map].call == i)
+                        {
+                            outFile << RETURN_PREFIX << returns++ << ":\n";
+                            map++;
+                        }
+                    }
+                }
+                for (size_t i = 0; i < frame.saved.size(); i++)
+                {
+                    outFile << "\tmovq\t" << frame.saveSlots[i] << "(%rbp), %"
+                            << Frame::getRegisterName(frame.saved[i]) << '\n';
+                }
+                outFile << "\tleave\n";
+                outFile << "\tret\n";
+                outFile << "\t.size\t" << function.name << ", .-" << function.name << "\n\n";
+            }
+        };
+
+        void writeStackMaps(const Assem::FunctionList &functions, OutBuffer &outFile)
+        {
+            auto table = StackMaps::makeTable(functions);
+            outFile << "\t.p2align\t2\n";
+            outFile << "\t.globl\t" << StackMaps::TABLE_NAME << '\n';
+            outFile << StackMaps::TABLE_NAME << ":\n";
+            outFile << "\t.long\t" << (int32_t) table.mapOffsets.size() << '\n';
+            for (size_t i = 0; i < table.mapOffsets.size(); i++)
+            {
+                outFile << "\t.long\t" << RETURN_PREFIX << (int32_t) i << '-' << StackMaps::TABLE_NAME << ", "
+                        << (int32_t) table.mapOffsets[i] << '\n';
+            }
+            for (auto word : table.maps)
+            {
+                outFile << "\t.long\t" << word << '\n';
+            }
+        }
+
+        void writeString(const Frame::StringFrag &frag, OutBuffer &outFile)
+        {
+            auto str = frag.getStr();
+            outFile << "\t.p2align\t3\n";
+            outFile << frag.getLabel()->getLabelName() << ":\n";
+            outFile << "\t.quad\t" << (int) str.size() << '\n';
+            outFile << "\t.ascii\t\"";
+            for (unsigned char c : str)
+            {
+                if (c == '"' || c == '\\')
+                {
+                    outFile << '\\' << (char) c;
+                }
+                else if (c >= 0x20 && c < 0x7f)
+                {
+                    outFile << (char) c;
+                }
+                else
+                {
+                    outFile << '\\' << (char) ('0' + (c >> 6)) << (char) ('0' + ((c >> 3) & 7))
+                            << (char) ('0' + (c & 7));
+                }
+            }
+            outFile << "\"\n";
+        }
+    }
+
+    FrameLayout layout(const Assem::Function &function)
+    {
+        FrameLayout frame;
+        std::vector<int32_t> defs;
+        for (auto &instr : function.instrs)
+        {
+            defs.clear();
+            Assem::getDefs(instr, defs);
+            for (auto def : defs)
+            {
+                if (std::find(std::begin(Frame::CALLEE_SAVES), std::end(Frame::CALLEE_SAVES), def) !=
+                    std::end(Frame::CALLEE_SAVES) &&
+                    std::find(frame.saved.begin(), frame.saved.end(), def) == frame.saved.end())
+                {
+                    frame.saved.push_back(def);
+                }
+            }
+        }
+        // Below the spill slots
+        for (size_t i = 0; i < frame.saved.size(); i++)
+        {
+            frame.saveSlots.push_back(
+                    -Frame::WORD_SIZE * (function.frameWords + function.spillWords + (int32_t) i + 1));
+        }
+        int32_t words = function.frameWords + function.spillWords + (int32_t) frame.saved.size() +
+                        function.outgoingWords;
+        // The stack pointer stays 16 byte aligned at calls
+        words += words % 2;
+        frame.frameBytes = words * Frame::WORD_SIZE;
+        return frame;
+    }
+
+    void writeAssembly(const Frame::FragList &fragList, const Assem::FunctionList &functions,
+                       std::ostream &outFile)
+    {
+        OutBuffer buffer(OutBuffer::FLUSH_CAPACITY);
+        int32_t returns = 0;
+        for (auto &function : functions)
+        {
+            FunctionWriter(*function, buffer, returns).run();
+            buffer.writeIfFull(outFile);
+        }
+        // Still in the text, where the return addresses are
+        writeStackMaps(functions, buffer);
+        buffer << "\t.section\t.rodata\n";
+        for (auto &frag : fragList)
+        {
+            if (frag->getKind() == Frame::STRING_FRAG)
+            {
+                writeString(*std::static_pointer_cast<Frame::StringFrag>(frag), buffer);
+                buffer.writeIfFull(outFile);
+            }
+        }
+        buffer << "\t.section\t.note.GNU-stack,\"\",@progbits\n";
+        buffer.writeTo(outFile);
+    }
+}
@@ -0,0 +1,34 @@
+//
+// GNU assembler output
+//
+
+#ifndef SRC_EMIT_H
+#define SRC_EMIT_H
+
+#include <ostream>
+#include <vector>
+#include "Assem.h"
+#include "Frame.h"
+
+namespace Emit
+{
+    // What the prologue makes of a function's frame: the callee saved
+    // registers the body writes, their slots relative to the frame
+    // pointer, and the bytes the stack pointer goes down by
+    struct FrameLayout
+    {
+        std::vector<int32_t> saved;
+        std::vector<int32_t> saveSlots;
+        int32_t frameBytes;
+    };
+
+    FrameLayout layout(const Assem::Function &function);
+
+    // Writes the allocated functions with their prologues and epilogues,
+    // and the StringFrags of fragList as length-prefixed data. The output
+    // assembles with as and links against the runtime library.
+    void writeAssembly(const Frame::FragList &fragList, const Assem::FunctionList &functions,
+                       std::ostream &outFile);
+}
+
+#endif //SRC_EMIT_H
@@ -0,0 +1,609 @@
+//
+// x86-64 machine code
+//
+
+#include "Encode.h"
+#include "Emit.h"
+#include "Error.h"
+#include "StackMaps.h"
+#include "ThreadPool.h"
+#include <unordered_map>
+
+namespace Encode
+{
+    namespace
+    {
+        // Low nibble of the condition code of each JCC, in
+        // IR::ComparisonOp order
+        const uint8_t conditionCodes[] = {0x4, 0x5, 0xc, 0xf, 0xe, 0xd};
+
+        // Opcodes of an ALU instruction: register into r/m, r/m into
+        // register, the /digit of its immediate forms and its short form
+        // with RAX
+        struct Arithmetic
+        {
+            uint8_t store;
+            uint8_t load;
+            uint8_t digit;
+            uint8_t accumulator;
+        };
+
+        const Arithmetic ADD_CODES = {0x01, 0x03, 0, 0x05};
+        const Arithmetic SUB_CODES = {0x29, 0x2b, 5, 0x2d};
+        const Arithmetic CMP_CODES = {0x39, 0x3b, 7, 0x3d};
+
+        bool isByte(int32_t value)
+        {
+            return value >= -128 && value <= 127;
+        }
+
+        // A field to fill in once every function has its place
+        struct Fixup
+        {
+            uint32_t offset;
+            const std::string *symbol;
+            int32_t addend;
+            bool call;
+        };
+
+        struct Code
+        {
+            std::vector<uint8_t> bytes;
+            std::vector<Fixup> fixups;
+            // Where the calls return to, in the order of their stack maps
+            std::vector<uint32_t> returns;
+        };
+
+        // Encodes the instructions first without their jumps, then picks
+        // the form of every jump and puts them in
+        class FunctionEncoder
+        {
+            const Assem::Function &function;
+            std::vector<uint8_t> code;
+            std::vector<Fixup> fixups;
+            std::vector<uint32_t> returns;
+
+            struct Jump
+            {
+                // Where it goes in code
+                uint32_t at;
+                int32_t block;
+                // Condition code, NONE for a JMP
+                int32_t cond;
+                bool isShort;
+            };
+            std::vector<Jump> jumps;
+            // Offset of each block in code, and the jumps before it
+            std::vector<uint32_t> blockAt;
+            std::vector<uint32_t> jumpsBefore;
+
+            void byte(uint8_t value)
+            {
+                code.push_back(value);
+            }
+
+            void int32(int32_t value)
+            {
+                for (int i = 0; i < 4; i++)
+                {
+                    code.push_back((uint8_t) ((uint32_t) value >> (8 * i)));
+                }
+            }
+
+            void immediate(int32_t value, bool isShort)
+            {
+                if (isShort)
+                {
+                    byte((uint8_t) value);
+                }
+                else
+                {
+                    int32(value);
+                }
+            }
+
+            // REX prefix for 64-bit operands, with the high bits of the
+            // registers in ModRM.reg, SIB.index and ModRM.rm or SIB.base
+            void rex(int32_t reg, int32_t index, int32_t base, bool wide = true)
+            {
+                uint8_t prefix = (uint8_t) ((wide ? 0x48 : 0x40) | (reg > 7 ? 4 : 0) | (index > 7 ? 2 : 0) |
+                                            (base > 7 ? 1 : 0));
+                if (prefix != 0x40)
+                {
+                    byte(prefix);
+                }
+            }
+
+            void opcode(uint8_t first, uint8_t second)
+            {
+                byte(first);
+                if (second != 0)
+                {
+                    byte(second);
+                }
+            }
+
+            // opcode reg, rm with both in registers. A reg below 8 may be
+            // an opcode's /digit.
+            void registers(uint8_t first, uint8_t second, int32_t reg, int32_t rm, bool wide = true)
+            {
+                rex(reg, Assem::NONE, rm, wide);
+                opcode(first, second);
+                byte((uint8_t) (0xc0 | (reg & 7) << 3 | (rm & 7)));
+            }
+
+            // opcode reg, mem. trailing is the size of the immediate after
+            // the operand, which a RIP relative address must reach past.
+            void memory(uint8_t first, uint8_t second, int32_t reg, const Assem::Mem &mem, int32_t trailing,
+                        bool wide = true)
+            {
+                rex(reg, mem.index, mem.base, wide);
+                opcode(first, second);
+                uint8_t regBits = (uint8_t) ((reg & 7) << 3);
+                if (mem.label != Assem::NONE)
+                {
+                    byte((uint8_t) (regBits | 5));
+                    fixups.push_back({(uint32_t) code.size(), &function.labels[mem.label], mem.disp - 4 - trailing,
+                                      false});
+                    int32(0);
+                    return;
+                }
+                uint8_t scale = (uint8_t) (mem.scale == 8 ? 3 : mem.scale == 4 ? 2 : mem.scale == 2 ? 1 : 0);
+                uint8_t index = (uint8_t) (mem.index == Assem::NONE ? 4 : mem.index & 7);
+                if (mem.base == Assem::NONE)
+                {
+                    // disp32 with no base
+                    byte((uint8_t) (regBits | 4));
+                    byte((uint8_t) (scale << 6 | index << 3 | 5));
+                    int32(mem.disp);
+                    return;
+                }
+                uint8_t base = (uint8_t) (mem.base & 7);
+                // RBP and R13 have no form without a displacement
+                uint8_t mod = (uint8_t) (mem.disp == 0 && base != 5 ? 0 : isByte(mem.disp) ? 1 : 2);
+                // RSP and R12 need a SIB byte
+                if (mem.index == Assem::NONE && base != 4)
+                {
+                    byte((uint8_t) (mod << 6 | regBits | base));
+                }
+                else
+                {
+                    byte((uint8_t) (mod << 6 | regBits | 4));
+                    byte((uint8_t) (scale << 6 | index << 3 | base));
+                }
+                if (mod == 1)
+                {
+                    byte((uint8_t) mem.disp);
+                }
+                else if (mod == 2)
+                {
+                    int32(mem.disp);
+                }
+            }
+
+            void arithmetic(const Arithmetic &codes, const Assem::Instr &instr)
+            {
+                switch (instr.form)
+                {
+                    case Assem::RR:
+                        registers(codes.store, 0, instr.src, instr.dst);
+                        break;
+                    case Assem::RI:
+                        if (isByte(instr.imm))
+                        {
+                            registers(0x83, 0, codes.digit, instr.dst);
+                            byte((uint8_t) instr.imm);
+                        }
+                        else if (instr.dst == Frame::RAX)
+                        {
+                            rex(Assem::NONE, Assem::NONE, Assem::NONE);
+                            byte(codes.accumulator);
+                            int32(instr.imm);
+                        }
+                        else
+                        {
+                            registers(0x81, 0, codes.digit, instr.dst);
+                            int32(instr.imm);
+                        }
+                        break;
+                    case Assem::RM:
+                        memory(codes.load, 0, instr.dst, instr.mem, 0);
+                        break;
+                    case Assem::MR:
+                        memory(codes.store, 0, instr.src, instr.mem, 0);
+                        break;
+                    case Assem::MI:
+                        memory(isByte(instr.imm) ? 0x83 : 0x81, 0, codes.digit, instr.mem, isByte(instr.imm) ? 1 : 4);
+                        immediate(instr.imm, isByte(instr.imm));
+                        break;
+                    default:
+                        invalid(instr);
+                }
+            }
+
+            void invalid(const Assem::Instr &instr)
+            {
+                Tiger::Error error("Cannot encode instruction " + std::to_string(instr.opcode) + " of form " +
+                                   std::to_string(instr.form) + " in " + function.name);
+            }
+
+            void instr(const Assem::Instr &instr)
+            {
+                switch (instr.opcode)
+                {
+                    case Assem::MOV:
+                        switch (instr.form)
+                        {
+                            case Assem::RR:
+                                registers(0x89, 0, instr.src, instr.dst);
+                                break;
+                            case Assem::RI:
+                                registers(0xc7, 0, 0, instr.dst);
+                                int32(instr.imm);
+                                break;
+                            case Assem::RM:
+                                memory(0x8b, 0, instr.dst, instr.mem, 0);
+                                break;
+                            case Assem::MR:
+                                memory(0x89, 0, instr.src, instr.mem, 0);
+                                break;
+                            case Assem::MI:
+                                memory(0xc7, 0, 0, instr.mem, 4);
+                                int32(instr.imm);
+                                break;
+                            default:
+                                invalid(instr);
+                        }
+                        break;
+                    case Assem::LEA:
+                        if (instr.form != Assem::RM)
+                        {
+                            invalid(instr);
+                            break;
+                        }
+                        memory(0x8d, 0, instr.dst, instr.mem, 0);
+                        break;
+                    case Assem::ADD:
+                        arithmetic(ADD_CODES, instr);
+                        break;
+                    case Assem::SUB:
+                        arithmetic(SUB_CODES, instr);
+                        break;
+                    case Assem::CMP:
+                        arithmetic(CMP_CODES, instr);
+                        break;
+                    case Assem::IMUL:
+                        switch (instr.form)
+                        {
+                            case Assem::RR:
+                                registers(0x0f, 0xaf, instr.dst, instr.src);
+                                break;
+                            case Assem::RM:
+                                memory(0x0f, 0xaf, instr.dst, instr.mem, 0);
+                                break;
+                            case Assem::RI:
+                            case Assem::RRI:
+                            {
+                                int32_t src = instr.form == Assem::RI ? instr.dst : instr.src;
+                                registers(isByte(instr.imm) ? 0x6b : 0x69, 0, instr.dst, src);
+                                immediate(instr.imm, isByte(instr.imm));
+                                break;
+                            }
+                            default:
+                                invalid(instr);
+                        }
+                        break;
+                    case Assem::SHR:
+                        if (instr.form != Assem::RI)
+                        {
+                            invalid(instr);
+                            break;
+                        }
+                        registers(0xc1, 0, 5, instr.dst);
+                        byte((uint8_t) instr.imm);
+                        break;
+                    case Assem::CQO:
+                        rex(Assem::NONE, Assem::NONE, Assem::NONE);
+                        byte(0x99);
+                        break;
+                    case Assem::IDIV:
+                        if (instr.form != Assem::R)
+                        {
+                            invalid(instr);
+                            break;
+                        }
+                        registers(0xf7, 0, 7, instr.src);
+                        break;
+                    case Assem::JMP:
+                    case Assem::JCC:
+                        if (instr.form == Assem::L)
+                        {
+                            jumps.push_back({(uint32_t) code.size(), instr.target,
+                                             instr.opcode == Assem::JCC ? conditionCodes[instr.cond] : Assem::NONE,
+                                             true});
+                        }
+                        else if (instr.form == Assem::R && instr.opcode == Assem::JMP)
+                        {
+                            registers(0xff, 0, 4, instr.src, false);
+                        }
+                        else
+                        {
+                            invalid(instr);
+                        }
+                        break;
+                    case Assem::CALL:
+                        if (instr.form == Assem::L)
+                        {
+                            byte(0xe8);
+                            fixups.push_back({(uint32_t) code.size(), &function.labels[instr.target], -4, true});
+                            int32(0);
+                        }
+                        else if (instr.form == Assem::R)
+                        {
+                            registers(0xff, 0, 2, instr.src, false);
+                        }
+                        else
+                        {
+                            invalid(instr);
+                        }
+                        break;
+                    case Assem::MOVB:
+                        if (instr.form != Assem::MI)
+                        {
+                            invalid(instr);
+                            break;
+                        }
+                        memory(0xc6, 0, 0, instr.mem, 1, false);
+                        byte((uint8_t) instr.imm);
+                        break;
+                    default:
+                        invalid(instr);
+                }
+            }
+
+            // Makes jumps long until every short one reaches its block.
+            // Jumps only grow, so this ends.
+            std::vector<uint32_t> relax()
+            {
+                // Bytes the jumps before each one take
+                std::vector<uint32_t> shift(jumps.size() + 1, 0);
+                for (bool changed = true; changed;)
+                {
+                    changed = false;
+                    for (size_t j = 0; j < jumps.size(); j++)
+                    {
+                        shift[j + 1] = shift[j] + size(jumps[j]);
+                    }
+                    for (size_t j = 0; j < jumps.size(); j++)
+                    {
+                        auto &jump = jumps[j];
+                        if (!jump.isShort)
+                        {
+                            continue;
+                        }
+                        int64_t from = jump.at + shift[j + 1];
+                        int64_t to = blockAt[jump.block] + shift[jumpsBefore[jump.block]];
+                        if (!isByte((int32_t) (to - from)))
+                        {
+                            jump.isShort = false;
+                            changed = true;
+                        }
+                    }
+                }
+                return shift;
+            }
+
+            static uint32_t size(const Jump &jump)
+            {
+                return jump.isShort ? 2 : jump.cond == Assem::NONE ? 5 : 6;
+            }
+
+        public:
+            explicit FunctionEncoder(const Assem::Function &function)
+                    : function(function)
+            {}
+
+            Code run()
+            {
+                auto frame = Emit::layout(function);
+                // pushq %rbp; movq %rsp, %rbp
+                byte(0x55);
+                registers(0x89, 0, Frame::RSP, Frame::RBP);
+                if (frame.frameBytes > 0)
+                {
+                    bool isShort = isByte(frame.frameBytes);
+                    registers(isShort ? 0x83 : 0x81, 0, 5, Frame::RSP);
+                    immediate(frame.frameBytes, isShort);
+                }
+                for (size_t i = 0; i < frame.saved.size(); i++)
+                {
+                    memory(0x89, 0, frame.saved[i], Assem::makeMem(Frame::RBP, frame.saveSlots[i]), 0);
+                }
+                size_t map = 0;
+                for (auto &block : function.blocks)
+                {
+                    blockAt.push_back((uint32_t) code.size());
+                    jumpsBefore.push_back((uint32_t) jumps.size());
+                    for (uint32_t i = block.begin; i < block.end; i++)
+                    {
+                        instr(function.instrs[i]);
+                        if (map < function.stackMaps.size() && function.stackMaps[map].call == i)
+                        {
+                            returns.push_back((uint32_t) code.size());
+                            map++;
+                        }
+                    }
+                }
+                for (size_t i = 0; i < frame.saved.size(); i++)
+                {
+                    memory(0x8b, 0, frame.saved[i], Assem::makeMem(Frame::RBP, frame.saveSlots[i]), 0);
+                }
+                // leave; ret
+                byte(0xc9);
+                byte(0xc3);
+
+                auto shift = relax();
+                Code result;
+                result.bytes.reserve(code.size() + shift.back());
+                uint32_t copied = 0;
+                for (size_t j = 0; j < jumps.size(); j++)
+                {
+                    auto &jump = jumps[j];
+                    result.bytes.insert(result.bytes.end(), code.begin() + copied, code.begin() + jump.at);
+                    copied = jump.at;
+                    int32_t to = (int32_t) (blockAt[jump.block] + shift[jumpsBefore[jump.block]]);
+                    int32_t disp = to - (int32_t) (jump.at + shift[j + 1]);
+                    if (jump.isShort)
+                    {
+                        result.bytes.push_back(jump.cond == Assem::NONE ? 0xeb : (uint8_t) (0x70 | jump.cond));
+                        result.bytes.push_back((uint8_t) disp);
+                        continue;
+                    }
+                    if (jump.cond == Assem::NONE)
+                    {
+                        result.bytes.push_back(0xe9);
+                    }
+                    else
+                    {
+                        result.bytes.push_back(0x0f);
+                        result.bytes.push_back((uint8_t) (0x80 | jump.cond));
+                    }
+                    for (int i = 0; i < 4; i++)
+                    {
+                        result.bytes.push_back((uint8_t) ((uint32_t) disp >> (8 * i)));
+                    }
+                }
+                result.bytes.insert(result.bytes.end(), code.begin() + copied, code.end());
+                // A field lies within an instruction, so after every jump
+                // at or before its offset
+                size_t j = 0;
+                for (auto &fixup : fixups)
+                {
+                    while (j < jumps.size() && jumps[j].at <= fixup.offset)
+                    {
+                        j++;
+                    }
+                    fixup.offset += shift[j];
+                }
+                result.fixups = std::move(fixups);
+                // A jump where a call returns to comes after it
+                j = 0;
+                for (auto &at : returns)
+                {
+                    while (j < jumps.size() && jumps[j].at < at)
+                    {
+                        j++;
+                    }
+                    at += shift[j];
+                }
+                result.returns = std::move(returns);
+                return result;
+            }
+        };
+
+        void putInt32(std::vector<uint8_t> &bytes, int32_t value)
+        {
+            for (int i = 0; i < 4; i++)
+            {
+                bytes.push_back((uint8_t) ((uint32_t) value >> (8 * i)));
+            }
+        }
+
+        void putInt64(std::vector<uint8_t> &bytes, int64_t value)
+        {
+            for (int i = 0; i < 8; i++)
+            {
+                bytes.push_back((uint8_t) ((uint64_t) value >> (8 * i)));
+            }
+        }
+    }
+
+    Object encode(const Frame::FragList &fragList, const Assem::FunctionList &functions)
+    {
+        Object object;
+        std::unordered_map<std::string, int32_t> symbolIndex;
+        for (auto &frag : fragList)
+        {
+            if (frag->getKind() != Frame::STRING_FRAG)
+            {
+                continue;
+            }
+            auto &string = static_cast<const Frame::StringFrag &>(*frag);
+            auto str = string.getStr();
+            object.rodata.resize((object.rodata.size() + 7) & ~(size_t) 7, 0);
+            symbolIndex.emplace(string.getLabel()->getLabelName(), (int32_t) object.symbols.size());
+            object.symbols.push_back({string.getLabel()->getLabelName(), RODATA, false, false,
+                                      (uint32_t) object.rodata.size(), (uint32_t) (8 + str.size())});
+            putInt64(object.rodata, (int64_t) str.size());
+            object.rodata.insert(object.rodata.end(), str.begin(), str.end());
+        }
+
+        std::vector<Code> codes(functions.size());
+        parallelFor(functions.size(), [&functions, &codes](size_t i)
+        {
+            codes[i] = FunctionEncoder(*functions[i]).run();
+        });
+        std::vector<std::pair<uint32_t, size_t>> fixupsAt;
+        std::vector<uint32_t> returns;
+        for (size_t i = 0; i < functions.size(); i++)
+        {
+            auto &name = functions[i]->name;
+            auto offset = (uint32_t) object.text.size();
+            symbolIndex[name] = (int32_t) object.symbols.size();
+            object.symbols.push_back({name, TEXT, name == Frame::MAIN_NAME, true, offset,
+                                      (uint32_t) codes[i].bytes.size()});
+            object.text.insert(object.text.end(), codes[i].bytes.begin(), codes[i].bytes.end());
+            codes[i].bytes = std::vector<uint8_t>();
+            for (auto at : codes[i].returns)
+            {
+                returns.push_back(offset + at);
+            }
+            fixupsAt.push_back({offset, i});
+        }
+
+        // The stack map table, after the code its return addresses are in
+        auto table = StackMaps::makeTable(functions);
+        object.text.resize((object.text.size() + 3) & ~(size_t) 3, 0);
+        auto tableAt = (uint32_t) object.text.size();
+        object.symbols.push_back({StackMaps::TABLE_NAME, TEXT, true, false, tableAt,
+                                  StackMaps::headerSize(table) + (uint32_t) (sizeof(int32_t) * table.maps.size())});
+        putInt32(object.text, (int32_t) returns.size());
+        for (size_t i = 0; i < returns.size(); i++)
+        {
+            putInt32(object.text, (int32_t) (returns[i] - tableAt));
+            putInt32(object.text, (int32_t) table.mapOffsets[i]);
+        }
+        for (auto word : table.maps)
+        {
+            putInt32(object.text, word);
+        }
+
+        for (auto &at : fixupsAt)
+        {
+            for (auto &fixup : codes[at.second].fixups)
+            {
+                uint32_t offset = at.first + fixup.offset;
+                auto found = symbolIndex.find(*fixup.symbol);
+                if (found == symbolIndex.end())
+                {
+                    found = symbolIndex.emplace(*fixup.symbol, (int32_t) object.symbols.size()).first;
+                    object.symbols.push_back({*fixup.symbol, UNDEFINED, true, false, 0, 0});
+                }
+                auto &symbol = object.symbols[found->second];
+                // Code that calls or addresses a local function needs no
+                // relocation, the rest waits for the linker
+                if (symbol.section == TEXT && !symbol.global)
+                {
+                    auto value = (uint32_t) ((int64_t) symbol.offset + fixup.addend - offset);
+                    for (int i = 0; i < 4; i++)
+                    {
+                        object.text[offset + i] = (uint8_t) (value >> (8 * i));
+                    }
+                    continue;
+                }
+                object.relocations.push_back({offset, found->second, fixup.addend, fixup.call});
+            }
+        }
+        return object;
+    }
+}
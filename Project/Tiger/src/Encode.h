@@ -0,0 +1,61 @@
+//
+// x86-64 machine code
+//
+
+#ifndef SRC_ENCODE_H
+#define SRC_ENCODE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Assem.h"
+#include "Frame.h"
+
+namespace Encode
+{
+    enum Section
+    {
+        UNDEFINED,  // defined by the runtime library
+        TEXT,
+        RODATA
+    };
+
+    struct Symbol
+    {
+        std::string name;
+        uint8_t section;    // Section
+        bool global;
+        bool function;
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    // A 32-bit field of the text that must hold symbol + addend minus the
+    // field's own address
+    struct Relocation
+    {
+        uint32_t offset;
+        int32_t symbol;
+        int32_t addend;
+        // The field of a CALL, which the linker may send through the PLT
+        bool call;
+    };
+
+    struct Object
+    {
+        std::vector<uint8_t> text;
+        std::vector<uint8_t> rodata;
+        std::vector<Symbol> symbols;
+        std::vector<Relocation> relocations;
+    };
+
+    // Encodes the allocated functions with their prologues and epilogues,
+    // the same instructions Emit::writeAssembly writes, one task per
+    // function, and the StringFrags of fragList as length-prefixed data.
+    // Jumps get the short form where their block is near. Calls between the
+    // functions are resolved, references to strings and calls to the
+    // runtime become relocations.
+    Object encode(const Frame::FragList &fragList, const Assem::FunctionList &functions);
+}
+
+#endif //SRC_ENCODE_H
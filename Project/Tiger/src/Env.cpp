@@ -139,6 +139,11 @@ namespace Env
     {}
 
     TypeEnv::TypeEnv()
+            : base(nullptr), baseSize(0)
+    {}
+
+    TypeEnv::TypeEnv(const TypeEnv *base)
+            : base(base), baseSize(base->bindList.size())
     {}
 
     void TypeEnv::setDefaultEnv()
@@ -165,6 +170,17 @@ namespace Env
                 return (*r_iter);
             }
         }
+        for (const TypeEnv *env = this; env->base != nullptr; env = env->base)
+        {
+            auto &list = env->base->bindList;
+            for (auto r_iter = list.crbegin() + (list.size() - env->baseSize); r_iter != list.crend(); r_iter++)
+            {
+                if ((*r_iter)->name == name)
+                {
+                    return (*r_iter);
+                }
+            }
+        }
         throw EntryNotFound("Var Entry with name " + name + " not found");
     }
 
@@ -187,58 +203,64 @@ namespace Env
     }
 
     VarEnv::VarEnv()
+            : base(nullptr), baseSize(0)
+    {}
+
+    VarEnv::VarEnv(const VarEnv *base)
+            : base(base), baseSize(base->bindList.size())
     {}
 
     void VarEnv::setDefaultEnv()
     {
+        // Library functions are defined at no level and live in the runtime
         // print
-        FuncEntry print(Translate::getGlobalLevel(),
-                        Temporary::makeLabel(),
+        FuncEntry print(nullptr,
+                        Frame::makeRuntimeLabel("print"),
                         "print", Type::STRING, Type::VOID);
         enterFunc(print);
         // flush
-        FuncEntry flush(Translate::getGlobalLevel(),
-                        Temporary::makeLabel(),
+        FuncEntry flush(nullptr,
+                        Frame::makeRuntimeLabel("flush"),
                         "flush", Type::VOID);
         enterFunc(flush);
         // getchar
-        FuncEntry getchar(Translate::getGlobalLevel(),
-                          Temporary::makeLabel(),
+        FuncEntry getchar(nullptr,
+                          Frame::makeRuntimeLabel("getchar"),
                           "getchar", Type::STRING);
         enterFunc(getchar);
         // ord
-        FuncEntry ord(Translate::getGlobalLevel(),
-                      Temporary::makeLabel(),
+        FuncEntry ord(nullptr,
+                      Frame::makeRuntimeLabel("ord"),
                       "ord", Type::STRING, Type::INT);
         enterFunc(ord);
         // chr
-        FuncEntry chr(Translate::getGlobalLevel(),
-                      Temporary::makeLabel(),
+        FuncEntry chr(nullptr,
+                      Frame::makeRuntimeLabel("chr"),
                       "chr", Type::INT, Type::STRING);
         enterFunc(chr);
         // size
-        FuncEntry size(Translate::getGlobalLevel(),
-                       Temporary::makeLabel(),
+        FuncEntry size(nullptr,
+                       Frame::makeRuntimeLabel("size"),
                        "size", Type::STRING, Type::INT);
         enterFunc(size);
         // substring
-        FuncEntry substring(Translate::getGlobalLevel(),
-                            Temporary::makeLabel(),
+        FuncEntry substring(nullptr,
+                            Frame::makeRuntimeLabel("substring"),
                             "substring", {Type::STRING, Type::INT, Type::INT}, Type::STRING);
         enterFunc(substring);
         // concat
-        FuncEntry concat(Translate::getGlobalLevel(),
-                         Temporary::makeLabel(),
+        FuncEntry concat(nullptr,
+                         Frame::makeRuntimeLabel("concat"),
                          "concat", {Type::STRING, Type::STRING}, Type::STRING);
         enterFunc(concat);
         // not
-        FuncEntry notFunc(Translate::getGlobalLevel(),
-                          Temporary::makeLabel(),
+        FuncEntry notFunc(nullptr,
+                          Frame::makeRuntimeLabel("not"),
                           "not", Type::INT, Type::INT);
         enterFunc(notFunc);
         // exit
-        FuncEntry exit(Translate::getGlobalLevel(),
-                       Temporary::makeLabel(),
+        FuncEntry exit(nullptr,
+                       Frame::makeRuntimeLabel("exit"),
                        "exit", Type::INT, Type::VOID);
         enterFunc(exit);
     }
@@ -257,6 +279,17 @@ namespace Env
                 return (*r_iter);
             }
         }
+        for (const VarEnv *env = this; env->base != nullptr; env = env->base)
+        {
+            auto &list = env->base->bindList;
+            for (auto r_iter = list.crbegin() + (list.size() - env->baseSize); r_iter != list.crend(); r_iter++)
+            {
+                if ((*r_iter)->name == entryName)
+                {
+                    return (*r_iter);
+                }
+            }
+        }
         throw EntryNotFound("Entry with name " + entryName + " not found");
     }
 
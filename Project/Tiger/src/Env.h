@@ -164,12 +164,19 @@ namespace Env
 
     class TypeEnv : public Env
     { // same as "tenv"
+        // Read-only view of the enclosing environment, see TypeEnv(const TypeEnv *)
+        const TypeEnv *base;
+        size_t baseSize;
     public:
         std::vector<std::shared_ptr<TypeEntry>> bindList;
         std::vector<unsigned int> scope;
 
         TypeEnv();
 
+        // A persistent view of base as it is now. Lookups fall through to base,
+        // new bindings stay local, and base must not change while the view lives.
+        explicit TypeEnv(const TypeEnv *base);
+
         void setDefaultEnv() override;
 
         void enter(std::shared_ptr<TypeEntry> entry);
@@ -193,12 +200,19 @@ namespace Env
 
     class VarEnv : public Env
     {
+        // Read-only view of the enclosing environment, see VarEnv(const VarEnv *)
+        const VarEnv *base;
+        size_t baseSize;
     public:
         std::vector<std::shared_ptr<Entry>> bindList;
         std::vector<unsigned int> scope;
 
         VarEnv();
 
+        // A persistent view of base as it is now. Lookups fall through to base,
+        // new bindings stay local, and base must not change while the view lives.
+        explicit VarEnv(const VarEnv *base);
+
         void setDefaultEnv();
 
         void enter(std::shared_ptr<Entry> entry);
@@ -3,9 +3,14 @@
 //
 
 #include "Error.h"
+#include <atomic>
 
 namespace Tiger
 {
+    namespace
+    {
+        std::atomic<bool> reported(false);
+    }
 
     Error::Error() : hasError(false)
     {
@@ -15,6 +20,7 @@ namespace Tiger
     Error::Error(const location &loc, const std::string &message)
             : loc(loc), message(message), hasError(true)
     {
+        reported = true;
         print();
     }
 
@@ -27,12 +33,65 @@ namespace Tiger
 
     void Error::print()
     {
-        std::cerr << "Error at " << loc << " : " << message << std::endl;
+        ErrorBuffer::stream() << "Error at " << loc << " : " << message << std::endl;
     }
 
     Error::Error(const std::string &message)
             : message(message)
     {
-        std::cerr << "Error: " << message << std::endl;
+        reported = true;
+        ErrorBuffer::stream() << "Error: " << message << std::endl;
+    }
+
+    bool Error::any()
+    {
+        return reported;
+    }
+
+    namespace
+    {
+        thread_local ErrorBuffer *activeBuffer = nullptr;
+    }
+
+    ErrorBuffer::ErrorBuffer() : parent(activeBuffer)
+    {
+    }
+
+    void ErrorBuffer::commit()
+    {
+        auto text = buffer.str();
+        if (parent != nullptr)
+        {
+            parent->buffer << text;
+        }
+        else
+        {
+            std::cerr << text;
+        }
+        buffer.str(std::string());
+    }
+
+    std::ostream &ErrorBuffer::stream()
+    {
+        if (activeBuffer != nullptr)
+        {
+            return activeBuffer->buffer;
+        }
+        return std::cerr;
+    }
+
+    ErrorBuffer *ErrorBuffer::current()
+    {
+        return activeBuffer;
+    }
+
+    ErrorBuffer::Activation::Activation(ErrorBuffer *buffer) : saved(activeBuffer)
+    {
+        activeBuffer = buffer;
+    }
+
+    ErrorBuffer::Activation::~Activation()
+    {
+        activeBuffer = saved;
     }
 }
\ No newline at end of file
@@ -7,6 +7,7 @@
 
 #include <string>
 #include <iostream>
+#include <sstream>
 #include "location.hh"
 
 namespace Tiger {
@@ -25,6 +26,37 @@ class Error {
     void set(const location &loc, const std::string &message);
 
     void print();
+
+    // Whether an error with a message has been reported
+    static bool any();
+};
+
+// Holds back diagnostics reported on the current thread while it is active,
+// so concurrent work can replay them in source order.
+class ErrorBuffer {
+    ErrorBuffer *parent;
+    std::ostringstream buffer;
+
+   public:
+    // The buffer active on the constructing thread becomes the parent
+    ErrorBuffer();
+
+    // Hand the held diagnostics to the parent buffer, or to std::cerr
+    void commit();
+
+    // Where diagnostics should go on the current thread
+    static std::ostream &stream();
+
+    static ErrorBuffer *current();
+
+    class Activation {
+        ErrorBuffer *saved;
+
+       public:
+        Activation(ErrorBuffer *buffer);
+
+        ~Activation();
+    };
 };
 }
 
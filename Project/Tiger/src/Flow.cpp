@@ -0,0 +1,440 @@
+//
+// Control flow and liveness over selected instructions
+//
+
+#include "Flow.h"
+#include <algorithm>
+#include <iterator>
+
+namespace Flow
+{
+    namespace
+    {
+        // Blocks reachable from the first one, in reverse postorder
+        std::vector<int32_t> reversePostorder(const Graph &graph)
+        {
+            auto count = graph.succs.size();
+            std::vector<int32_t> order;
+            if (count == 0)
+            {
+                return order;
+            }
+            std::vector<char> seen(count, 0);
+            // Block and the index of the next successor to visit
+            std::vector<std::pair<int32_t, size_t>> stack;
+            stack.push_back({0, 0});
+            seen[0] = 1;
+            while (!stack.empty())
+            {
+                auto &top = stack.back();
+                auto &succs = graph.succs[top.first];
+                if (top.second < succs.size())
+                {
+                    int32_t succ = succs[top.second++];
+                    if (!seen[succ])
+                    {
+                        seen[succ] = 1;
+                        stack.push_back({succ, 0});
+                    }
+                    continue;
+                }
+                order.push_back(top.first);
+                stack.pop_back();
+            }
+            std::reverse(order.begin(), order.end());
+            return order;
+        }
+
+        // Immediate dominators by the iteration of Cooper, Harvey and
+        // Kennedy. Unreachable blocks get NONE.
+        std::vector<int32_t> dominators(const Graph &graph, const std::vector<int32_t> &order)
+        {
+            std::vector<int32_t> idom(graph.succs.size(), Assem::NONE);
+            std::vector<int32_t> position(graph.succs.size(), Assem::NONE);
+            for (size_t i = 0; i < order.size(); i++)
+            {
+                position[order[i]] = (int32_t) i;
+            }
+            if (order.empty())
+            {
+                return idom;
+            }
+            idom[order[0]] = order[0];
+            for (bool changed = true; changed;)
+            {
+                changed = false;
+                for (size_t i = 1; i < order.size(); i++)
+                {
+                    int32_t block = order[i];
+                    int32_t dom = Assem::NONE;
+                    for (auto pred : graph.preds[block])
+                    {
+                        if (idom[pred] == Assem::NONE)
+                        {
+                            continue;
+                        }
+                        if (dom == Assem::NONE)
+                        {
+                            dom = pred;
+                            continue;
+                        }
+                        int32_t other = pred;
+                        while (dom != other)
+                        {
+                            while (position[dom] > position[other])
+                            {
+                                dom = idom[dom];
+                            }
+                            while (position[other] > position[dom])
+                            {
+                                other = idom[other];
+                            }
+                        }
+                    }
+                    if (idom[block] != dom)
+                    {
+                        idom[block] = dom;
+                        changed = true;
+                    }
+                }
+            }
+            return idom;
+        }
+
+        bool dominates(const std::vector<int32_t> &idom, int32_t dom, int32_t block)
+        {
+            while (true)
+            {
+                if (block == dom)
+                {
+                    return true;
+                }
+                if (idom[block] == block || idom[block] == Assem::NONE)
+                {
+                    return false;
+                }
+                block = idom[block];
+            }
+        }
+
+        // Each loop header adds one to the depth of the blocks of its loop,
+        // the blocks that reach a back edge to it without passing it
+        void findLoops(Graph &graph)
+        {
+            auto count = graph.succs.size();
+            graph.loopDepth.assign(count, 0);
+            auto order = reversePostorder(graph);
+            auto idom = dominators(graph, order);
+            std::vector<int32_t> mark(count, Assem::NONE);
+            std::vector<int32_t> work;
+            for (auto header : order)
+            {
+                for (auto pred : graph.preds[header])
+                {
+                    if (idom[pred] == Assem::NONE || !dominates(idom, header, pred))
+                    {
+                        continue;
+                    }
+                    if (mark[header] != header)
+                    {
+                        mark[header] = header;
+                        graph.loopDepth[header]++;
+                    }
+                    work.push_back(pred);
+                    while (!work.empty())
+                    {
+                        int32_t block = work.back();
+                        work.pop_back();
+                        if (mark[block] == header)
+                        {
+                            continue;
+                        }
+                        mark[block] = header;
+                        graph.loopDepth[block]++;
+                        for (auto p : graph.preds[block])
+                        {
+                            work.push_back(p);
+                        }
+                    }
+                }
+            }
+        }
+
+        void addUnique(std::vector<int32_t> &list, int32_t value)
+        {
+            if (std::find(list.begin(), list.end(), value) == list.end())
+            {
+                list.push_back(value);
+            }
+        }
+
+        // Functions whose live sets take up to this many words in all are
+        // solved with dense bitsets, larger ones with sorted lists
+        const size_t BITSET_LIMIT = (size_t) 1 << 22;
+
+        // Blocks after their successors, except along back edges: reachable
+        // blocks in postorder, then the others from the last
+        std::vector<int32_t> backwardOrder(const Graph &graph)
+        {
+            auto order = reversePostorder(graph);
+            std::reverse(order.begin(), order.end());
+            std::vector<char> seen(graph.succs.size(), 0);
+            for (auto block : order)
+            {
+                seen[block] = 1;
+            }
+            for (size_t b = graph.succs.size(); b-- > 0;)
+            {
+                if (!seen[b])
+                {
+                    order.push_back((int32_t) b);
+                }
+            }
+            return order;
+        }
+
+        // Runs update, which recomputes a block's live sets and tells
+        // whether its live-in set grew, on every block in order, then in
+        // further passes only on the predecessors of blocks that grew
+        template<typename Update>
+        void solve(const Graph &graph, const std::vector<int32_t> &order, LivenessStats &stats, Update update)
+        {
+            std::vector<char> queued(graph.succs.size(), 1);
+            for (bool pending = true; pending;)
+            {
+                pending = false;
+                stats.passes++;
+                for (auto block : order)
+                {
+                    if (!queued[block])
+                    {
+                        continue;
+                    }
+                    queued[block] = 0;
+                    stats.visits++;
+                    if (!update(block))
+                    {
+                        continue;
+                    }
+                    for (auto pred : graph.preds[block])
+                    {
+                        if (!queued[pred])
+                        {
+                            queued[pred] = 1;
+                            pending = true;
+                        }
+                    }
+                }
+            }
+        }
+
+        void setBit(uint64_t *bits, int32_t index)
+        {
+            bits[index / 64] |= (uint64_t) 1 << (index % 64);
+        }
+
+        // The word loops have no dependence between words, so the compiler
+        // can vectorize them
+        void unite(uint64_t *dst, const uint64_t *src, size_t words)
+        {
+            for (size_t w = 0; w < words; w++)
+            {
+                dst[w] |= src[w];
+            }
+        }
+
+        // in = gen | (out & ~kill), telling whether in changed
+        bool transfer(uint64_t *in, const uint64_t *out, const uint64_t *gen, const uint64_t *kill, size_t words)
+        {
+            uint64_t changed = 0;
+            for (size_t w = 0; w < words; w++)
+            {
+                uint64_t next = gen[w] | (out[w] & ~kill[w]);
+                changed |= next ^ in[w];
+                in[w] = next;
+            }
+            return changed != 0;
+        }
+    }
+
+    Graph makeGraph(const Assem::Function &function)
+    {
+        Graph graph;
+        auto count = function.blocks.size();
+        graph.succs.resize(count);
+        graph.preds.resize(count);
+        for (size_t b = 0; b < count; b++)
+        {
+            auto &block = function.blocks[b];
+            bool fallsThrough = true;
+            if (block.end > block.begin)
+            {
+                auto &last = function.instrs[block.end - 1];
+                if (last.opcode == Assem::JMP || last.opcode == Assem::JCC)
+                {
+                    if (last.form == Assem::L)
+                    {
+                        addUnique(graph.succs[b], last.target);
+                    }
+                    fallsThrough = last.opcode == Assem::JCC;
+                }
+            }
+            if (fallsThrough && b + 1 < count)
+            {
+                addUnique(graph.succs[b], (int32_t) b + 1);
+            }
+            for (auto succ : graph.succs[b])
+            {
+                graph.preds[succ].push_back((int32_t) b);
+            }
+        }
+        findLoops(graph);
+        return graph;
+    }
+
+    std::vector<std::vector<int32_t>> liveOut(const Assem::Function &function, const Graph &graph,
+                                              LivenessStats *stats)
+    {
+        auto count = function.blocks.size();
+        // Temps each block reads before writing them, and the ones it writes
+        std::vector<std::vector<int32_t>> gen(count), kill(count);
+        std::vector<int32_t> uses, defs;
+        // Last block that read or wrote each temp
+        std::vector<int32_t> read((size_t) function.tempCount, Assem::NONE);
+        std::vector<int32_t> written((size_t) function.tempCount, Assem::NONE);
+        // Only temps some block reads before writing them are live across
+        // blocks, and get a bit
+        std::vector<int32_t> bit((size_t) function.tempCount, Assem::NONE);
+        bit[Frame::RAX] = 0;
+        for (size_t b = 0; b < count; b++)
+        {
+            auto &block = function.blocks[b];
+            for (auto i = block.begin; i < block.end; i++)
+            {
+                auto &instr = function.instrs[i];
+                uses.clear();
+                defs.clear();
+                Assem::getUses(instr, uses);
+                Assem::getDefs(instr, defs);
+                for (auto use : uses)
+                {
+                    if (written[use] != (int32_t) b && read[use] != (int32_t) b)
+                    {
+                        read[use] = (int32_t) b;
+                        gen[b].push_back(use);
+                        bit[use] = 0;
+                    }
+                }
+                for (auto def : defs)
+                {
+                    if (written[def] != (int32_t) b)
+                    {
+                        written[def] = (int32_t) b;
+                        kill[b].push_back(def);
+                    }
+                }
+            }
+        }
+        std::vector<int32_t> globals;
+        for (int32_t temp = 0; temp < function.tempCount; temp++)
+        {
+            if (bit[temp] != Assem::NONE)
+            {
+                bit[temp] = (int32_t) globals.size();
+                globals.push_back(temp);
+            }
+        }
+
+        auto order = backwardOrder(graph);
+        std::vector<std::vector<int32_t>> out(count);
+        size_t words = (globals.size() + 63) / 64;
+        LivenessStats result = {0, 0, (int32_t) globals.size(), words * count <= BITSET_LIMIT};
+        if (result.dense)
+        {
+            // Row b of each holds the bits of block b
+            std::vector<uint64_t> genBits(words * count, 0), killBits(words * count, 0);
+            std::vector<uint64_t> inBits(words * count, 0), outBits(words * count, 0);
+            for (size_t b = 0; b < count; b++)
+            {
+                for (auto temp : gen[b])
+                {
+                    setBit(&genBits[b * words], bit[temp]);
+                }
+                for (auto temp : kill[b])
+                {
+                    if (bit[temp] != Assem::NONE)
+                    {
+                        setBit(&killBits[b * words], bit[temp]);
+                    }
+                }
+            }
+            solve(graph, order, result, [&](int32_t b)
+            {
+                auto row = b * words;
+                auto blockOut = &outBits[row];
+                std::fill(blockOut, blockOut + words, 0);
+                if (graph.succs[b].empty())
+                {
+                    setBit(blockOut, bit[Frame::RAX]);
+                }
+                for (auto succ : graph.succs[b])
+                {
+                    unite(blockOut, &inBits[succ * words], words);
+                }
+                return transfer(&inBits[row], blockOut, &genBits[row], &killBits[row], words);
+            });
+            for (size_t b = 0; b < count; b++)
+            {
+                for (size_t w = 0; w < words; w++)
+                {
+                    for (auto bits = outBits[b * words + w]; bits != 0; bits &= bits - 1)
+                    {
+                        out[b].push_back(globals[w * 64 + __builtin_ctzll(bits)]);
+                    }
+                }
+            }
+        }
+        else
+        {
+            for (size_t b = 0; b < count; b++)
+            {
+                std::sort(gen[b].begin(), gen[b].end());
+                std::sort(kill[b].begin(), kill[b].end());
+            }
+            std::vector<std::vector<int32_t>> in(count);
+            std::vector<int32_t> merged, next;
+            solve(graph, order, result, [&](int32_t b)
+            {
+                merged.clear();
+                if (graph.succs[b].empty())
+                {
+                    merged.push_back(Frame::RAX);
+                }
+                for (auto succ : graph.succs[b])
+                {
+                    next.clear();
+                    std::set_union(merged.begin(), merged.end(), in[succ].begin(), in[succ].end(),
+                                   std::back_inserter(next));
+                    merged.swap(next);
+                }
+                out[b] = merged;
+                next.clear();
+                std::set_difference(merged.begin(), merged.end(), kill[b].begin(), kill[b].end(),
+                                    std::back_inserter(next));
+                merged.clear();
+                std::set_union(next.begin(), next.end(), gen[b].begin(), gen[b].end(), std::back_inserter(merged));
+                if (merged.size() == in[b].size())
+                {
+                    return false;
+                }
+                in[b].swap(merged);
+                return true;
+            });
+        }
+        if (stats)
+        {
+            *stats = result;
+        }
+        return out;
+    }
+}
@@ -0,0 +1,48 @@
+//
+// Control flow and liveness over selected instructions
+//
+
+#ifndef SRC_FLOW_H
+#define SRC_FLOW_H
+
+#include <cstdint>
+#include <vector>
+#include "Assem.h"
+
+namespace Flow
+{
+    // Edges between the blocks of an Assem::Function. A block goes to the
+    // target of its last JMP or JCC, and falls through to the next block
+    // unless it ends with a JMP.
+    struct Graph
+    {
+        std::vector<std::vector<int32_t>> succs;
+        std::vector<std::vector<int32_t>> preds;
+        // Number of natural loops each block is in
+        std::vector<int32_t> loopDepth;
+    };
+
+    Graph makeGraph(const Assem::Function &function);
+
+    // How liveOut reached its fixpoint
+    struct LivenessStats
+    {
+        // Passes over the blocks, and blocks recomputed in them
+        int32_t passes;
+        int32_t visits;
+        // Temps live across some block boundary
+        int32_t globals;
+        // Whether the live sets were bitsets rather than sorted lists
+        bool dense;
+    };
+
+    // Temps live when each block ends, sorted. The return value is live
+    // when the function ends. Only temps that some block reads before
+    // writing them can be live there, and those get a bit in dense live-in
+    // and live-out sets, which a worklist updates in postorder until
+    // nothing changes.
+    std::vector<std::vector<int32_t>> liveOut(const Assem::Function &function, const Graph &graph,
+                                              LivenessStats *stats = nullptr);
+}
+
+#endif //SRC_FLOW_H
@@ -3,6 +3,7 @@
 //
 
 #include "Frame.h"
+#include <vector>
 
 
 namespace Frame
@@ -33,6 +34,16 @@ namespace Frame
         local_count += 1;
     }
 
+    const std::map<int, Temporary::Kind> &Frame::getSlotKinds() const
+    {
+        return slotKinds;
+    }
+
+    void Frame::setSlotKind(int offset, Temporary::Kind kind)
+    {
+        slotKinds[offset] = kind;
+    }
+
     Access::Access(AccessType accessType)
             : accessType(accessType)
     {}
@@ -70,27 +81,54 @@ namespace Frame
         return std::make_shared<AccessFrame>(offset);
     }
 
+    Temporary::Kind kindOf(bool pointer)
+    {
+        return pointer ? Temporary::POINTER : Temporary::SCALAR;
+    }
+
     std::shared_ptr<Access> MakeFAccessReg(std::shared_ptr<Temporary::Temp> reg)
     {
         return std::make_shared<AccessReg>(reg);
     }
 
 
-    std::shared_ptr<AccessList> MakeFormalAccessList(std::shared_ptr<BoolList> formals)
+    // The first MAX_REG formals arrive in registers. An escaping one gets a
+    // home below the frame pointer, counted in homes; the others were pushed
+    // by the caller above the return address. Where pointers tells what a
+    // formal holds, its word or temp gets that kind in kinds.
+    std::shared_ptr<AccessList> MakeFormalAccessList(std::shared_ptr<BoolList> formals,
+                                                     std::shared_ptr<BoolList> pointers, int &homes,
+                                                     std::map<int, Temporary::Kind> &kinds)
     {
         std::list<bool>::iterator iter = formals->begin();
         std::shared_ptr<AccessList> accessList = std::make_shared<AccessList>();
+        bool known = pointers && pointers->size() == formals->size();
+        auto pointer = known ? pointers->begin() : std::list<bool>::iterator();
 
+        homes = 0;
         for (int i = 0; iter != formals->end(); i++, iter++)
         {
+            auto kind = known ? kindOf(*pointer++) : Temporary::UNKNOWN;
             std::shared_ptr<Access> access;
-            if (i < MAX_REG && !formals->front())
+            int offset = 0;
+            if (i >= MAX_REG)
             {
-                access = MakeFAccessReg(Temporary::makeTemp());
+                offset = (i - MAX_REG + 2) * WORD_SIZE;
+                access = MakeFAccessFrame(offset);
+            }
+            else if (*iter)
+            {
+                homes += 1;
+                offset = -1 * WORD_SIZE * homes;
+                access = MakeFAccessFrame(offset);
             }
             else
             {
-                access = MakeFAccessFrame(i * WORD_SIZE);
+                access = MakeFAccessReg(Temporary::makeTemp(kind));
+            }
+            if (offset != 0 && known)
+            {
+                kinds[offset] = kind;
             }
             accessList->push_back(access);
         }
@@ -98,19 +136,30 @@ namespace Frame
         return accessList;
     }
 
-    std::shared_ptr<Frame> makeFrame(std::shared_ptr<Temporary::Label> name, std::shared_ptr<BoolList> formals)
+    std::shared_ptr<Frame> makeFrame(std::shared_ptr<Temporary::Label> name, std::shared_ptr<BoolList> formals,
+                                     std::shared_ptr<BoolList> pointers)
     {
-        return std::make_shared<Frame>(name, MakeFormalAccessList(formals), 0);
+        int homes;
+        std::map<int, Temporary::Kind> kinds;
+        auto accessList = MakeFormalAccessList(formals, pointers, homes, kinds);
+        auto frame = std::make_shared<Frame>(name, accessList, homes);
+        for (auto &kind : kinds)
+        {
+            frame->setSlotKind(kind.first, kind.second);
+        }
+        return frame;
     }
 
-    std::shared_ptr<Access> allocLocalVariable(std::shared_ptr<Frame> f, bool escape)
+    std::shared_ptr<Access> allocLocalVariable(std::shared_ptr<Frame> f, bool escape, bool pointer)
     {
         f->increaseLocalCount();
         if (escape)
         {
-            return MakeFAccessFrame(-1 * WORD_SIZE * f->getLocal_count());
+            int offset = -1 * WORD_SIZE * f->getLocal_count();
+            f->setSlotKind(offset, kindOf(pointer));
+            return MakeFAccessFrame(offset);
         }
-        return MakeFAccessReg(Temporary::makeTemp());
+        return MakeFAccessReg(Temporary::makeTemp(kindOf(pointer)));
     }
 
     /* IR */
@@ -136,15 +185,41 @@ namespace Frame
         return tail;
     }
 
-    static std::shared_ptr<Temporary::Temp> fp = nullptr;
+    std::shared_ptr<Temporary::Temp> getRegister(Register reg)
+    {
+        static const std::vector<std::shared_ptr<Temporary::Temp>> registers = []()
+        {
+            std::vector<std::shared_ptr<Temporary::Temp>> temps;
+            for (int i = 0; i < REGISTER_COUNT; i++)
+            {
+                temps.push_back(std::make_shared<Temporary::Temp>(i));
+            }
+            if (Temporary::Temp::tempNum < REGISTER_COUNT)
+            {
+                Temporary::Temp::tempNum = REGISTER_COUNT;
+            }
+            return temps;
+        }();
+        return registers[reg];
+    }
+
+    const char *getRegisterName(int reg)
+    {
+        static const char *const names[REGISTER_COUNT] = {
+                "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+                "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"
+        };
+        return names[reg];
+    }
 
     std::shared_ptr<Temporary::Temp> getFP()
     {
-        if (fp == nullptr)
-        {
-            fp = Temporary::makeTemp();
-        }
-        return fp;
+        return getRegister(RBP);
+    }
+
+    std::shared_ptr<Temporary::Temp> getRV()
+    {
+        return getRegister(RAX);
     }
 
     std::shared_ptr<IR::Exp> getVariable(std::shared_ptr<Access> access, std::shared_ptr<IR::Exp> framePtr)
@@ -167,9 +242,29 @@ namespace Frame
         }
     }
 
+    std::shared_ptr<Temporary::Label> makeRuntimeLabel(const std::string &name)
+    {
+        // The prefix keeps names like exit and getchar clear of libc
+        return std::make_shared<Temporary::Label>("tiger_" + name);
+    }
+
     std::shared_ptr<IR::Exp> makeExternalCall(std::string str, std::shared_ptr<IR::ExpList> args)
     {
-        return IR::makeCall(IR::makeName(Temporary::makeLabel(str)), args);
+        return IR::makeCall(IR::makeName(makeRuntimeLabel(str)), args);
+    }
+
+    std::shared_ptr<IR::Stm> procEntryExit1(std::shared_ptr<Frame> frame, std::shared_ptr<IR::Stm> body)
+    {
+        IR::StmVector stms;
+        int i = 0;
+        for (auto formal = frame->getFormals()->begin();
+             formal != frame->getFormals()->end() && i < MAX_REG; formal++, i++)
+        {
+            stms.push_back(IR::makeMove(getVariable(*formal, IR::makeTemp(getFP())),
+                                        IR::makeTemp(getRegister(ARG_REGISTERS[i]))));
+        }
+        stms.push_back(body);
+        return IR::makeSeq(std::move(stms));
     }
 
 
@@ -212,5 +307,15 @@ namespace Frame
         return frame;
     }
 
+    const std::shared_ptr<IR::StmList> ProcFrag::getStmList() const
+    {
+        return stmList;
+    }
+
+    void ProcFrag::setStmList(const std::shared_ptr<IR::StmList> &stmList)
+    {
+        ProcFrag::stmList = stmList;
+    }
+
 
 }
@@ -7,6 +7,7 @@
 
 #include <memory>
 #include <list>
+#include <map>
 #include <string>
 #include "Temporary.h"
 #include "IR.h"
@@ -24,6 +25,10 @@ namespace Frame
         std::shared_ptr<Temporary::Label> name;
         std::shared_ptr<AccessList> formals;
         int local_count;
+        // What the words of the frame that hold variables hold, by their
+        // offset from the frame pointer. A word not listed may hold
+        // anything.
+        std::map<int, Temporary::Kind> slotKinds;
     public:
         Frame(const std::shared_ptr<Temporary::Label> &name, const std::shared_ptr<AccessList> &formals,
               int local_count);
@@ -35,6 +40,10 @@ namespace Frame
         int getLocal_count() const;
 
         void increaseLocalCount();
+
+        const std::map<int, Temporary::Kind> &getSlotKinds() const;
+
+        void setSlotKind(int offset, Temporary::Kind kind);
     };
 
 
@@ -75,9 +84,13 @@ namespace Frame
     };
 
 
-    std::shared_ptr<Frame> makeFrame(std::shared_ptr<Temporary::Label> name, std::shared_ptr<BoolList> formals);
+    // pointers, when given, tells for each formal whether it holds a pointer
+    std::shared_ptr<Frame> makeFrame(std::shared_ptr<Temporary::Label> name, std::shared_ptr<BoolList> formals,
+                                     std::shared_ptr<BoolList> pointers = nullptr);
 
-    std::shared_ptr<Access> allocLocalVariable(std::shared_ptr<Frame> f, bool escape);
+    // A variable that holds a pointer, as records, arrays and strings do,
+    // or an int, which the collector's stack maps tell apart
+    std::shared_ptr<Access> allocLocalVariable(std::shared_ptr<Frame> f, bool escape, bool pointer);
 
     /* IR */
     enum FragType
@@ -112,12 +125,18 @@ namespace Frame
     {
         std::shared_ptr<IR::Stm> body;
         std::shared_ptr<Frame> frame;
+        // Canonical statements of body, empty until Canon::canonicalize ran
+        std::shared_ptr<IR::StmList> stmList;
     public:
         ProcFrag(const std::shared_ptr<IR::Stm> &body, const std::shared_ptr<Frame> &frame);
 
         const std::shared_ptr<IR::Stm> getBody() const;
 
         const std::shared_ptr<Frame> getFrame() const;
+
+        const std::shared_ptr<IR::StmList> getStmList() const;
+
+        void setStmList(const std::shared_ptr<IR::StmList> &stmList);
     };
 
     using FragList = std::list<std::shared_ptr<Frag>>;
@@ -125,8 +144,32 @@ namespace Frame
 
     namespace
     {
-        const int WORD_SIZE = 4;
+        const int WORD_SIZE = 8;
+        // Arguments after the first MAX_REG are passed on the stack
         const int MAX_REG = 6;
+        // Label of the main program, which the runtime calls
+        const char *const MAIN_NAME = "tigermain";
+        // The write barrier, a call the native code does inline: address
+        // shifted right by CARD_SHIFT indexes the runtime's CARD_TABLE, as
+        // runtime.h lays out
+        const char *const MARK_CARD_NAME = "tiger_markCard";
+        const char *const CARD_TABLE_NAME = "tiger_cardTable";
+        const int CARD_SHIFT = 9;
+    }
+
+    // x86-64 general purpose registers, in encoding order. The temp of a
+    // register has its number, every other temp a larger one.
+    enum Register
+    {
+        RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15, REGISTER_COUNT
+    };
+
+    namespace
+    {
+        // System V calling convention
+        const Register ARG_REGISTERS[MAX_REG] = {RDI, RSI, RDX, RCX, R8, R9};
+        const Register CALLER_SAVES[] = {RAX, RCX, RDX, RSI, RDI, R8, R9, R10, R11};
+        const Register CALLEE_SAVES[] = {RBX, R12, R13, R14, R15};
     }
 
     std::shared_ptr<Frag> makeStringFrag(std::shared_ptr<Temporary::Label> label, const std::string &str);
@@ -135,12 +178,26 @@ namespace Frame
 
     std::shared_ptr<FragList> makeFragList(std::shared_ptr<Frag> head, std::shared_ptr<FragList> tail);
 
+    std::shared_ptr<Temporary::Temp> getRegister(Register reg);
+
+    // AT&T name of a register, without the %
+    const char *getRegisterName(int reg);
+
     std::shared_ptr<Temporary::Temp> getFP();
 
+    // Register that holds the result of a call
+    std::shared_ptr<Temporary::Temp> getRV();
+
     std::shared_ptr<IR::Exp> getVariable(std::shared_ptr<Access> access, std::shared_ptr<IR::Exp> framePtr);
 
+    // Symbol of the runtime function for a library call like initArray
+    std::shared_ptr<Temporary::Label> makeRuntimeLabel(const std::string &name);
+
     std::shared_ptr<IR::Exp> makeExternalCall(std::string str, std::shared_ptr<IR::ExpList> args);
 
+    // Puts the arguments passed in registers where the body expects them
+    std::shared_ptr<IR::Stm> procEntryExit1(std::shared_ptr<Frame> frame, std::shared_ptr<IR::Stm> body);
+
 }
 
 
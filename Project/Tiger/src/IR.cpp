@@ -1,4 +1,5 @@
 #include "IR.h"
+#include <vector>
 
 //
 // Created by Chege on 2017/6/1.
@@ -15,6 +16,36 @@ namespace IR
         return stmType;
     }
 
+    namespace
+    {
+        // Nodes waiting to be freed by the release running on this thread
+        thread_local std::vector<std::shared_ptr<Stm>> *graveyard = nullptr;
+    }
+
+    void Stm::release(std::shared_ptr<Stm> child)
+    {
+        if (child == nullptr || child.use_count() > 1)
+        {
+            return;
+        }
+        if (graveyard != nullptr)
+        {
+            graveyard->push_back(std::move(child));
+            return;
+        }
+        std::vector<std::shared_ptr<Stm>> pending;
+        graveyard = &pending;
+        pending.push_back(std::move(child));
+        while (!pending.empty())
+        {
+            auto next = std::move(pending.back());
+            pending.pop_back();
+            // The destructor queues the children of next in pending
+            next.reset();
+        }
+        graveyard = nullptr;
+    }
+
     Exp::Exp(ExpType expType)
             : Stm(EXP), expType(expType)
     {
@@ -25,19 +56,22 @@ namespace IR
         return expType;
     }
 
-    Seq::Seq(const std::shared_ptr<Stm> &left, const std::shared_ptr<Stm> &right)
-            : Stm(SEQ), left(left), right(right)
+    Seq::Seq(StmVector stms)
+            : Stm(SEQ), stms(std::move(stms))
     {
     }
 
-    const std::shared_ptr<Stm> Seq::getLeft() const
+    Seq::~Seq()
     {
-        return left;
+        for (auto &stm : stms)
+        {
+            release(std::move(stm));
+        }
     }
 
-    const std::shared_ptr<Stm> Seq::getRight() const
+    const StmVector &Seq::getStms() const
     {
-        return right;
+        return stms;
     }
 
     Label::Label(const std::shared_ptr<Temporary::Label> &label)
@@ -55,6 +89,11 @@ namespace IR
     {
     }
 
+    Jump::~Jump()
+    {
+        release(std::move(exp));
+    }
+
     const std::shared_ptr<Exp> Jump::getExp() const
     {
         return exp;
@@ -73,6 +112,12 @@ namespace IR
     {
     }
 
+    CJump::~CJump()
+    {
+        release(std::move(left));
+        release(std::move(right));
+    }
+
     ComparisonOp CJump::getOp() const
     {
         return op;
@@ -113,6 +158,12 @@ namespace IR
     {
     }
 
+    Move::~Move()
+    {
+        release(std::move(dst));
+        release(std::move(src));
+    }
+
     const std::shared_ptr<Exp> Move::getDst() const
     {
         return dst;
@@ -128,6 +179,12 @@ namespace IR
     {
     }
 
+    Binop::~Binop()
+    {
+        release(std::move(left));
+        release(std::move(right));
+    }
+
     ArithmeticOp Binop::getOp() const
     {
         return op;
@@ -147,6 +204,11 @@ namespace IR
     {
     }
 
+    Mem::~Mem()
+    {
+        release(std::move(exp));
+    }
+
     const std::shared_ptr<Exp> Mem::getExp() const
     {
         return exp;
@@ -162,14 +224,23 @@ namespace IR
         return temp;
     }
 
-    Eseq::Eseq(const std::shared_ptr<Stm> &stm, const std::shared_ptr<Exp> &exp)
-            : Exp(ESEQ), stm(stm), exp(exp)
+    Eseq::Eseq(StmVector stms, const std::shared_ptr<Exp> &exp)
+            : Exp(ESEQ), stms(std::move(stms)), exp(exp)
+    {
+    }
+
+    Eseq::~Eseq()
     {
+        for (auto &stm : stms)
+        {
+            release(std::move(stm));
+        }
+        release(std::move(exp));
     }
 
-    const std::shared_ptr<Stm> Eseq::getStm() const
+    const StmVector &Eseq::getStms() const
     {
-        return stm;
+        return stms;
     }
 
     const std::shared_ptr<Exp> Eseq::getExp() const
@@ -202,6 +273,18 @@ namespace IR
 
     }
 
+    Call::~Call()
+    {
+        release(std::move(fun));
+        if (args != nullptr && args.use_count() == 1)
+        {
+            for (auto &arg : *args)
+            {
+                release(std::move(arg));
+            }
+        }
+    }
+
     const std::shared_ptr<Exp> Call::getFun() const
     {
         return fun;
@@ -225,7 +308,12 @@ namespace IR
 
     std::shared_ptr<Stm> makeSeq(std::shared_ptr<Stm> left, std::shared_ptr<Stm> right)
     {
-        return std::make_shared<Seq>(left, right);
+        return std::make_shared<Seq>(StmVector{left, right});
+    }
+
+    std::shared_ptr<Stm> makeSeq(StmVector stms)
+    {
+        return std::make_shared<Seq>(std::move(stms));
     }
 
     std::shared_ptr<Stm> makeLabel(std::shared_ptr<Temporary::Label> label)
@@ -274,7 +362,12 @@ namespace IR
 
     std::shared_ptr<Exp> makeEseq(std::shared_ptr<Stm> stm, std::shared_ptr<Exp> exp)
     {
-        return std::make_shared<Eseq>(stm, exp);
+        return std::make_shared<Eseq>(StmVector{stm}, exp);
+    }
+
+    std::shared_ptr<Exp> makeEseq(StmVector stms, std::shared_ptr<Exp> exp)
+    {
+        return std::make_shared<Eseq>(std::move(stms), exp);
     }
 
     std::shared_ptr<Exp> makeName(std::shared_ptr<Temporary::Label> label)
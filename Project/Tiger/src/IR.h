@@ -8,6 +8,7 @@
 #include <memory>
 #include <list>
 #include <string>
+#include <vector>
 #include "Temporary.h"
 
 namespace IR
@@ -20,6 +21,7 @@ namespace IR
     typedef std::list<std::shared_ptr<Stm>> StmList;
     typedef std::list<std::shared_ptr<Exp>> ExpList;
     typedef std::list<std::shared_ptr<Temporary::Label>> LabelList;
+    typedef std::vector<std::shared_ptr<Stm>> StmVector;
 
     enum ArithmeticOp
     {
@@ -46,6 +48,11 @@ namespace IR
         {};
 
         StmType getStmType() const;
+
+    protected:
+        // Destroys child without recursing once per tree level: children
+        // released while a release is running are queued and freed by it
+        static void release(std::shared_ptr<Stm> child);
     };
 
     enum ExpType
@@ -68,15 +75,16 @@ namespace IR
 
     // extend class
 
+    // Runs its statements in order
     class Seq : public Stm
     {
-        std::shared_ptr<Stm> left, right;
+        StmVector stms;
     public:
-        Seq(const std::shared_ptr<Stm> &left, const std::shared_ptr<Stm> &right);
+        Seq(StmVector stms);
 
-        const std::shared_ptr<Stm> getLeft() const;
+        ~Seq();
 
-        const std::shared_ptr<Stm> getRight() const;
+        const StmVector &getStms() const;
     };
 
     class Label : public Stm
@@ -95,6 +103,8 @@ namespace IR
     public:
         Jump(const std::shared_ptr<Exp> &exp, const std::shared_ptr<LabelList> &labels);
 
+        ~Jump();
+
         const std::shared_ptr<Exp> getExp() const;
 
         const std::shared_ptr<LabelList> getLabels() const;
@@ -109,6 +119,8 @@ namespace IR
         CJump(ComparisonOp op, const std::shared_ptr<Exp> &left, const std::shared_ptr<Exp> &right,
               const std::shared_ptr<Temporary::Label> &labelTrue, const std::shared_ptr<Temporary::Label> &labelFalse);
 
+        ~CJump();
+
         ComparisonOp getOp() const;
 
         const std::shared_ptr<Exp> getLeft() const;
@@ -130,6 +142,8 @@ namespace IR
     public:
         Move(const std::shared_ptr<Exp> &dst, const std::shared_ptr<Exp> &src);
 
+        ~Move();
+
         const std::shared_ptr<Exp> getDst() const;
 
         const std::shared_ptr<Exp> getSrc() const;
@@ -142,6 +156,8 @@ namespace IR
     public:
         Binop(ArithmeticOp op, const std::shared_ptr<Exp> &left, const std::shared_ptr<Exp> &right);
 
+        ~Binop();
+
         ArithmeticOp getOp() const;
 
         const std::shared_ptr<Exp> getLeft() const;
@@ -155,6 +171,8 @@ namespace IR
     public:
         Mem(const std::shared_ptr<Exp> &exp);
 
+        ~Mem();
+
         const std::shared_ptr<Exp> getExp() const;
     };
 
@@ -167,14 +185,17 @@ namespace IR
         const std::shared_ptr<Temporary::Temp> getTemp() const;
     };
 
+    // Runs its statements in order, then evaluates exp
     class Eseq : public Exp
     {
-        std::shared_ptr<Stm> stm;
+        StmVector stms;
         std::shared_ptr<Exp> exp;
     public:
-        Eseq(const std::shared_ptr<Stm> &stm, const std::shared_ptr<Exp> &exp);
+        Eseq(StmVector stms, const std::shared_ptr<Exp> &exp);
+
+        ~Eseq();
 
-        const std::shared_ptr<Stm> getStm() const;
+        const StmVector &getStms() const;
 
         const std::shared_ptr<Exp> getExp() const;
     };
@@ -204,6 +225,8 @@ namespace IR
     public:
         Call(const std::shared_ptr<Exp> &fun, const std::shared_ptr<ExpList> &args);
 
+        ~Call();
+
         const std::shared_ptr<Exp> getFun() const;
 
         const std::shared_ptr<ExpList> getArgs() const;
@@ -215,6 +238,8 @@ namespace IR
 
     std::shared_ptr<Stm> makeSeq(std::shared_ptr<Stm> left, std::shared_ptr<Stm> right);
 
+    std::shared_ptr<Stm> makeSeq(StmVector stms);
+
     std::shared_ptr<Stm> makeLabel(std::shared_ptr<Temporary::Label> label);
 
     std::shared_ptr<Stm> makeJump(std::shared_ptr<Exp> exp, std::shared_ptr<LabelList> labels);
@@ -235,6 +260,8 @@ namespace IR
 
     std::shared_ptr<Exp> makeEseq(std::shared_ptr<Stm> stm, std::shared_ptr<Exp> exp);
 
+    std::shared_ptr<Exp> makeEseq(StmVector stms, std::shared_ptr<Exp> exp);
+
     std::shared_ptr<Exp> makeName(std::shared_ptr<Temporary::Label> label);
 
     std::shared_ptr<Exp> makeConst(int constt);
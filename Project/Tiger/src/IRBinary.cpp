@@ -0,0 +1,926 @@
+//
+// Binary form of a fragment list, written by the compiler and read in place
+//
+
+#include "IRBinary.h"
+#include "Error.h"
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace IRBinary
+{
+    namespace
+    {
+        const uint64_t ALIGN = 8;
+
+        uint64_t alignUp(uint64_t offset)
+        {
+            return (offset + ALIGN - 1) & ~(ALIGN - 1);
+        }
+
+        struct FragData
+        {
+            FragEntry entry;
+            std::vector<Formal> formals;
+            std::vector<Node> nodes;
+            std::vector<uint32_t> lists;
+            std::vector<uint32_t> roots;
+            // Subtrees reachable twice, e.g. from the body and the canonical
+            // statements, are stored once
+            std::unordered_map<const IR::Stm *, uint32_t> written;
+        };
+
+        class Writer
+        {
+            std::vector<FragData> frags;
+            std::vector<const std::string *> strings;
+            std::unordered_map<std::string, uint32_t> stringIndex;
+
+            uint32_t intern(const std::string &str)
+            {
+                auto found = stringIndex.find(str);
+                if (found != stringIndex.end())
+                {
+                    return found->second;
+                }
+                auto index = (uint32_t) strings.size();
+                auto inserted = stringIndex.emplace(str, index);
+                strings.push_back(&inserted.first->first);
+                return index;
+            }
+
+            uint32_t intern(const std::shared_ptr<Temporary::Label> &label)
+            {
+                return label ? intern(label->getLabelName()) : NONE;
+            }
+
+            uint32_t addNode(FragData &frag, const IR::Stm *key, Node node)
+            {
+                auto index = (uint32_t) frag.nodes.size();
+                frag.nodes.push_back(node);
+                frag.written.emplace(key, index);
+                return index;
+            }
+
+            static Node makeNode(NodeKind kind, uint8_t op = 0, int32_t value = 0,
+                                 uint32_t left = NONE, uint32_t right = NONE)
+            {
+                Node node;
+                node.kind = (uint8_t) kind;
+                node.op = op;
+                node.reserved = 0;
+                node.value = value;
+                node.left = left;
+                node.right = right;
+                node.listBegin = 0;
+                node.listCount = 0;
+                return node;
+            }
+
+            // Children of a node in the order they are stored
+            static void children(const IR::Stm *stm, std::vector<const IR::Stm *> &kids)
+            {
+                switch (stm->getStmType())
+                {
+                    case IR::SEQ:
+                    {
+                        for (auto &child : static_cast<const IR::Seq *>(stm)->getStms())
+                        {
+                            kids.push_back(child.get());
+                        }
+                        return;
+                    }
+                    case IR::JUMP:
+                        kids.push_back(static_cast<const IR::Jump *>(stm)->getExp().get());
+                        return;
+                    case IR::CJUMP:
+                    {
+                        auto cjump = static_cast<const IR::CJump *>(stm);
+                        kids.push_back(cjump->getLeft().get());
+                        kids.push_back(cjump->getRight().get());
+                        return;
+                    }
+                    case IR::MOVE:
+                    {
+                        auto move = static_cast<const IR::Move *>(stm);
+                        kids.push_back(move->getDst().get());
+                        kids.push_back(move->getSrc().get());
+                        return;
+                    }
+                    case IR::EXP:
+                        break;
+                    default:
+                        return;
+                }
+                auto exp = static_cast<const IR::Exp *>(stm);
+                switch (exp->getExpType())
+                {
+                    case IR::BINOP:
+                    {
+                        auto binop = static_cast<const IR::Binop *>(exp);
+                        kids.push_back(binop->getLeft().get());
+                        kids.push_back(binop->getRight().get());
+                        return;
+                    }
+                    case IR::MEM:
+                        kids.push_back(static_cast<const IR::Mem *>(exp)->getExp().get());
+                        return;
+                    case IR::ESEQ:
+                    {
+                        auto eseq = static_cast<const IR::Eseq *>(exp);
+                        for (auto &child : eseq->getStms())
+                        {
+                            kids.push_back(child.get());
+                        }
+                        kids.push_back(eseq->getExp().get());
+                        return;
+                    }
+                    case IR::CALL:
+                    {
+                        auto call = static_cast<const IR::Call *>(exp);
+                        kids.push_back(call->getFun().get());
+                        for (auto &arg : *call->getArgs())
+                        {
+                            kids.push_back(arg.get());
+                        }
+                        return;
+                    }
+                    default:
+                        return;
+                }
+            }
+
+            // Stores the indices of stms, which are already stored, as the
+            // list of node
+            static void addList(FragData &frag, Node &node, const IR::StmVector &stms)
+            {
+                node.listBegin = (uint32_t) frag.lists.size();
+                for (auto &child : stms)
+                {
+                    frag.lists.push_back(frag.written.at(child.get()));
+                }
+                node.listCount = (uint32_t) stms.size();
+            }
+
+            // Stores stm once all its children are stored
+            uint32_t addParent(FragData &frag, const IR::Stm *stm)
+            {
+                auto index = [&frag](const std::shared_ptr<IR::Stm> &child)
+                {
+                    return frag.written.at(child.get());
+                };
+                switch (stm->getStmType())
+                {
+                    case IR::SEQ:
+                    {
+                        auto node = makeNode(SEQ_NODE);
+                        addList(frag, node, static_cast<const IR::Seq *>(stm)->getStms());
+                        return addNode(frag, stm, node);
+                    }
+                    case IR::LABEL:
+                    {
+                        auto label = static_cast<const IR::Label *>(stm);
+                        return addNode(frag, stm, makeNode(LABEL_NODE, 0, (int32_t) intern(label->getLabel())));
+                    }
+                    case IR::JUMP:
+                    {
+                        auto jump = static_cast<const IR::Jump *>(stm);
+                        auto node = makeNode(JUMP_NODE, 0, 0, index(jump->getExp()));
+                        node.listBegin = (uint32_t) frag.lists.size();
+                        if (jump->getLabels() != nullptr)
+                        {
+                            for (auto &label : *jump->getLabels())
+                            {
+                                frag.lists.push_back(intern(label));
+                            }
+                        }
+                        node.listCount = (uint32_t) frag.lists.size() - node.listBegin;
+                        return addNode(frag, stm, node);
+                    }
+                    case IR::CJUMP:
+                    {
+                        auto cjump = static_cast<const IR::CJump *>(stm);
+                        auto node = makeNode(CJUMP_NODE, (uint8_t) cjump->getOp(), 0, index(cjump->getLeft()),
+                                             index(cjump->getRight()));
+                        node.listBegin = (uint32_t) frag.lists.size();
+                        node.listCount = 2;
+                        frag.lists.push_back(intern(cjump->getLabelTrue()));
+                        frag.lists.push_back(intern(cjump->getLabelFalse()));
+                        return addNode(frag, stm, node);
+                    }
+                    case IR::MOVE:
+                    {
+                        auto move = static_cast<const IR::Move *>(stm);
+                        return addNode(frag, stm, makeNode(MOVE_NODE, 0, 0, index(move->getDst()),
+                                                           index(move->getSrc())));
+                    }
+                    case IR::EXP:
+                    default:
+                        break;
+                }
+                auto exp = static_cast<const IR::Exp *>(stm);
+                switch (exp->getExpType())
+                {
+                    case IR::BINOP:
+                    {
+                        auto binop = static_cast<const IR::Binop *>(exp);
+                        return addNode(frag, stm, makeNode(BINOP_NODE, (uint8_t) binop->getOp(), 0,
+                                                           index(binop->getLeft()), index(binop->getRight())));
+                    }
+                    case IR::MEM:
+                        return addNode(frag, stm, makeNode(MEM_NODE, 0, 0,
+                                                           index(static_cast<const IR::Mem *>(exp)->getExp())));
+                    case IR::TEMP:
+                    {
+                        auto temp = static_cast<const IR::Temp *>(exp);
+                        return addNode(frag, stm, makeNode(TEMP_NODE, 0, temp->getTemp()->getNum()));
+                    }
+                    case IR::ESEQ:
+                    {
+                        auto eseq = static_cast<const IR::Eseq *>(exp);
+                        auto node = makeNode(ESEQ_NODE, 0, 0, NONE, index(eseq->getExp()));
+                        addList(frag, node, eseq->getStms());
+                        return addNode(frag, stm, node);
+                    }
+                    case IR::NAME:
+                    {
+                        auto name = static_cast<const IR::Name *>(exp);
+                        return addNode(frag, stm, makeNode(NAME_NODE, 0, (int32_t) intern(name->getLabel())));
+                    }
+                    case IR::CONST:
+                    {
+                        auto constt = static_cast<const IR::Const *>(exp);
+                        return addNode(frag, stm, makeNode(CONST_NODE, 0, constt->getConstt()));
+                    }
+                    case IR::CALL:
+                    default:
+                    {
+                        auto call = static_cast<const IR::Call *>(exp);
+                        auto node = makeNode(CALL_NODE, 0, 0, index(call->getFun()));
+                        node.listBegin = (uint32_t) frag.lists.size();
+                        for (auto &arg : *call->getArgs())
+                        {
+                            frag.lists.push_back(index(arg));
+                        }
+                        node.listCount = (uint32_t) frag.lists.size() - node.listBegin;
+                        return addNode(frag, stm, node);
+                    }
+                }
+            }
+
+            // Stores the tree of stm in postorder, without recursing so deep
+            // trees fit on the stack
+            uint32_t addStm(FragData &frag, const std::shared_ptr<IR::Stm> &stm)
+            {
+                // A node is pushed again as done once its children are queued
+                std::vector<std::pair<const IR::Stm *, bool>> todo{{stm.get(), false}};
+                std::vector<const IR::Stm *> kids;
+                while (!todo.empty())
+                {
+                    auto node = todo.back().first;
+                    bool done = todo.back().second;
+                    todo.pop_back();
+                    if (frag.written.count(node) != 0)
+                    {
+                        continue;
+                    }
+                    if (done)
+                    {
+                        addParent(frag, node);
+                        continue;
+                    }
+                    todo.push_back({node, true});
+                    kids.clear();
+                    children(node, kids);
+                    for (auto kid = kids.rbegin(); kid != kids.rend(); kid++)
+                    {
+                        todo.push_back({*kid, false});
+                    }
+                }
+                return frag.written.at(stm.get());
+            }
+
+            void addFrag(const std::shared_ptr<Frame::Frag> &frag)
+            {
+                frags.emplace_back();
+                auto &data = frags.back();
+                std::memset(&data.entry, 0, sizeof(FragEntry));
+                data.entry.kind = (uint32_t) frag->getKind();
+                data.entry.label = NONE;
+                data.entry.str = NONE;
+                if (frag->getKind() == Frame::STRING_FRAG)
+                {
+                    auto stringFrag = std::static_pointer_cast<Frame::StringFrag>(frag);
+                    data.entry.label = intern(stringFrag->getLabel());
+                    data.entry.str = intern(stringFrag->getStr());
+                    return;
+                }
+                auto procFrag = std::static_pointer_cast<Frame::ProcFrag>(frag);
+                auto frame = procFrag->getFrame();
+                if (frame != nullptr)
+                {
+                    data.entry.label = intern(frame->getName());
+                    data.entry.localCount = (uint32_t) frame->getLocal_count();
+                    for (auto &access : *frame->getFormals())
+                    {
+                        Formal formal;
+                        formal.accessType = (uint32_t) access->getAccessType();
+                        if (access->getAccessType() == Frame::IN_FRAME)
+                        {
+                            formal.value = std::static_pointer_cast<Frame::AccessFrame>(access)->getOffset();
+                        }
+                        else
+                        {
+                            formal.value = std::static_pointer_cast<Frame::AccessReg>(access)->getReg()->getNum();
+                        }
+                        data.formals.push_back(formal);
+                    }
+                }
+                data.roots.push_back(addStm(data, procFrag->getBody()));
+                if (procFrag->getStmList() != nullptr)
+                {
+                    data.entry.canonical = 1;
+                    for (auto &stm : *procFrag->getStmList())
+                    {
+                        data.roots.push_back(addStm(data, stm));
+                    }
+                }
+                data.written.clear();
+            }
+
+            template<typename T>
+            static uint64_t append(std::string &file, const T *items, size_t count)
+            {
+                file.resize(alignUp(file.size()), '\0');
+                uint64_t offset = file.size();
+                file.append(reinterpret_cast<const char *>(items), count * sizeof(T));
+                return offset;
+            }
+
+        public:
+            void write(std::shared_ptr<Frame::FragList> fragList, std::ostream &out)
+            {
+                for (auto &frag : *fragList)
+                {
+                    addFrag(frag);
+                }
+
+                Header header;
+                std::memset(&header, 0, sizeof(Header));
+                header.magic = MAGIC;
+                header.version = VERSION;
+                header.wordSize = (uint32_t) Frame::WORD_SIZE;
+                header.stringCount = (uint32_t) strings.size();
+                header.fragCount = (uint32_t) frags.size();
+                header.tempNum = (uint32_t) Temporary::Temp::tempNum;
+                header.labelNum = (uint32_t) Temporary::Label::labelNum;
+
+                std::string file(sizeof(Header), '\0');
+                std::vector<StringEntry> entries;
+                uint32_t dataSize = 0;
+                for (auto str : strings)
+                {
+                    entries.push_back({dataSize, (uint32_t) str->size()});
+                    dataSize += (uint32_t) str->size() + 1;
+                }
+                header.stringsOffset = append(file, entries.data(), entries.size());
+                for (auto str : strings)
+                {
+                    file.append(str->c_str(), str->size() + 1);
+                }
+
+                std::vector<FragEntry> fragEntries(frags.size());
+                header.fragsOffset = append(file, fragEntries.data(), fragEntries.size());
+                for (size_t i = 0; i < frags.size(); i++)
+                {
+                    auto &data = frags[i];
+                    auto &entry = fragEntries[i];
+                    entry = data.entry;
+                    entry.formalCount = (uint32_t) data.formals.size();
+                    entry.nodeCount = (uint32_t) data.nodes.size();
+                    entry.listCount = (uint32_t) data.lists.size();
+                    entry.rootCount = (uint32_t) data.roots.size();
+                    entry.formalsOffset = append(file, data.formals.data(), data.formals.size());
+                    entry.nodesOffset = append(file, data.nodes.data(), data.nodes.size());
+                    entry.listsOffset = append(file, data.lists.data(), data.lists.size());
+                    entry.rootsOffset = append(file, data.roots.data(), data.roots.size());
+                }
+                file.resize(alignUp(file.size()), '\0');
+                header.fileSize = file.size();
+
+                std::memcpy(&file[0], &header, sizeof(Header));
+                if (!fragEntries.empty())
+                {
+                    std::memcpy(&file[header.fragsOffset], fragEntries.data(), fragEntries.size() * sizeof(FragEntry));
+                }
+                out.write(file.data(), file.size());
+            }
+        };
+
+        bool isExpKind(uint32_t kind)
+        {
+            return kind >= BINOP_NODE && kind <= CALL_NODE;
+        }
+
+        // What the left and right references of each kind must point to
+        enum ChildRule
+        {
+            NO_CHILD, ANY_CHILD, EXP_CHILD
+        };
+
+        const ChildRule leftRule[] = {
+                NO_CHILD, NO_CHILD, EXP_CHILD, EXP_CHILD, EXP_CHILD,
+                EXP_CHILD, EXP_CHILD, NO_CHILD, NO_CHILD, NO_CHILD, NO_CHILD, EXP_CHILD};
+
+        const ChildRule rightRule[] = {
+                NO_CHILD, NO_CHILD, NO_CHILD, EXP_CHILD, EXP_CHILD,
+                EXP_CHILD, NO_CHILD, NO_CHILD, EXP_CHILD, NO_CHILD, NO_CHILD, NO_CHILD};
+    }
+
+    void write(std::shared_ptr<Frame::FragList> fragList, std::ostream &out)
+    {
+        Writer writer;
+        writer.write(fragList, out);
+    }
+
+    FragView::FragView(const Reader *reader, const FragEntry *entry) : reader(reader), entry(entry)
+    {}
+
+    Frame::FragType FragView::getKind() const
+    {
+        return (Frame::FragType) entry->kind;
+    }
+
+    const FragEntry &FragView::getEntry() const
+    {
+        return *entry;
+    }
+
+    const char *FragView::getLabel() const
+    {
+        return entry->label == NONE ? nullptr : reader->getString(entry->label);
+    }
+
+    const char *FragView::getStr() const
+    {
+        return entry->str == NONE ? nullptr : reader->getString(entry->str);
+    }
+
+    uint32_t FragView::getStrLength() const
+    {
+        return entry->str == NONE ? 0 : reader->getStringLength(entry->str);
+    }
+
+    int FragView::getLocalCount() const
+    {
+        return (int) entry->localCount;
+    }
+
+    bool FragView::isCanonical() const
+    {
+        return entry->canonical != 0;
+    }
+
+    uint32_t FragView::getFormalCount() const
+    {
+        return entry->formalCount;
+    }
+
+    const Formal &FragView::getFormal(uint32_t index) const
+    {
+        return reader->at<Formal>(entry->formalsOffset)[index];
+    }
+
+    uint32_t FragView::getNodeCount() const
+    {
+        return entry->nodeCount;
+    }
+
+    const Node &FragView::getNode(uint32_t index) const
+    {
+        return reader->at<Node>(entry->nodesOffset)[index];
+    }
+
+    uint32_t FragView::getListItem(const Node &node, uint32_t i) const
+    {
+        return reader->at<uint32_t>(entry->listsOffset)[node.listBegin + i];
+    }
+
+    uint32_t FragView::getRootCount() const
+    {
+        return entry->rootCount;
+    }
+
+    uint32_t FragView::getRoot(uint32_t index) const
+    {
+        return reader->at<uint32_t>(entry->rootsOffset)[index];
+    }
+
+    Reader::Reader() : base(nullptr), size(0), mapped(false)
+    {}
+
+    Reader::~Reader()
+    {
+        close();
+    }
+
+    void Reader::close()
+    {
+        if (mapped)
+        {
+            munmap(const_cast<char *>(base), size);
+        }
+        base = nullptr;
+        size = 0;
+        mapped = false;
+    }
+
+    bool Reader::open(const std::string &fileName)
+    {
+        close();
+        int fd = ::open(fileName.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            Tiger::Error error("Cannot open IR file " + fileName);
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size < (off_t) sizeof(Header))
+        {
+            ::close(fd);
+            Tiger::Error error("Not an IR file: " + fileName);
+            return false;
+        }
+        void *data = mmap(nullptr, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED)
+        {
+            Tiger::Error error("Cannot map IR file " + fileName);
+            return false;
+        }
+        base = static_cast<const char *>(data);
+        size = (size_t) info.st_size;
+        mapped = true;
+        if (!validate())
+        {
+            close();
+            Tiger::Error error("Not an IR file: " + fileName);
+            return false;
+        }
+        return true;
+    }
+
+    bool Reader::attach(const void *data, size_t size)
+    {
+        close();
+        base = static_cast<const char *>(data);
+        Reader::size = size;
+        if (reinterpret_cast<uintptr_t>(data) % ALIGN != 0 || size < sizeof(Header) || !validate())
+        {
+            close();
+            Tiger::Error error("Not an IR buffer");
+            return false;
+        }
+        return true;
+    }
+
+    bool Reader::inFile(uint64_t offset, uint64_t count, uint64_t itemSize) const
+    {
+        return offset % ALIGN == 0 && offset <= size && count <= (size - offset) / itemSize;
+    }
+
+    bool Reader::validate()
+    {
+        auto &header = getHeader();
+        if (header.magic != MAGIC || header.version != VERSION || header.fileSize != size)
+        {
+            return false;
+        }
+        if (!inFile(header.stringsOffset, header.stringCount, sizeof(StringEntry)))
+        {
+            return false;
+        }
+        uint64_t dataOffset = header.stringsOffset + (uint64_t) header.stringCount * sizeof(StringEntry);
+        auto entries = at<StringEntry>(header.stringsOffset);
+        for (uint32_t i = 0; i < header.stringCount; i++)
+        {
+            uint64_t end = dataOffset + entries[i].offset + entries[i].length;
+            if (end >= size || base[end] != '\0')
+            {
+                return false;
+            }
+        }
+        if (!inFile(header.fragsOffset, header.fragCount, sizeof(FragEntry)))
+        {
+            return false;
+        }
+        auto frags = at<FragEntry>(header.fragsOffset);
+        for (uint32_t i = 0; i < header.fragCount; i++)
+        {
+            if (!validateFrag(frags[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool Reader::validateFrag(const FragEntry &frag)
+    {
+        uint32_t stringCount = getHeader().stringCount;
+        auto isString = [stringCount](uint32_t index)
+        {
+            return index == NONE || index < stringCount;
+        };
+        if ((frag.kind != Frame::STRING_FRAG && frag.kind != Frame::PROC_FRAG)
+            || !isString(frag.label) || !isString(frag.str))
+        {
+            return false;
+        }
+        if (!inFile(frag.formalsOffset, frag.formalCount, sizeof(Formal))
+            || !inFile(frag.nodesOffset, frag.nodeCount, sizeof(Node))
+            || !inFile(frag.listsOffset, frag.listCount, sizeof(uint32_t))
+            || !inFile(frag.rootsOffset, frag.rootCount, sizeof(uint32_t)))
+        {
+            return false;
+        }
+        if (frag.kind == Frame::PROC_FRAG && frag.rootCount == 0)
+        {
+            return false;
+        }
+        auto nodes = at<Node>(frag.nodesOffset);
+        auto lists = at<uint32_t>(frag.listsOffset);
+        // A reference is valid when it points to an earlier node of the
+        // kind the rule asks for
+        auto follows = [nodes](ChildRule rule, uint32_t child, uint32_t parent)
+        {
+            switch (rule)
+            {
+                case NO_CHILD:
+                    return true;
+                case ANY_CHILD:
+                    return child < parent;
+                case EXP_CHILD:
+                default:
+                    return child < parent && isExpKind(nodes[child].kind);
+            }
+        };
+        for (uint32_t i = 0; i < frag.nodeCount; i++)
+        {
+            auto &node = nodes[i];
+            if (node.kind > CALL_NODE
+                || !follows(leftRule[node.kind], node.left, i)
+                || !follows(rightRule[node.kind], node.right, i)
+                || node.listBegin > frag.listCount
+                || node.listCount > frag.listCount - node.listBegin)
+            {
+                return false;
+            }
+            switch (node.kind)
+            {
+                case LABEL_NODE:
+                case NAME_NODE:
+                    if (!isString((uint32_t) node.value))
+                    {
+                        return false;
+                    }
+                    break;
+                case JUMP_NODE:
+                case CJUMP_NODE:
+                    if (node.kind == CJUMP_NODE && (node.listCount != 2 || node.op > IR::GE))
+                    {
+                        return false;
+                    }
+                    for (uint32_t j = 0; j < node.listCount; j++)
+                    {
+                        if (!isString(lists[node.listBegin + j]))
+                        {
+                            return false;
+                        }
+                    }
+                    break;
+                case BINOP_NODE:
+                    if (node.op > IR::DIV)
+                    {
+                        return false;
+                    }
+                    break;
+                case SEQ_NODE:
+                case ESEQ_NODE:
+                case CALL_NODE:
+                    for (uint32_t j = 0; j < node.listCount; j++)
+                    {
+                        if (!follows(node.kind == CALL_NODE ? EXP_CHILD : ANY_CHILD, lists[node.listBegin + j], i))
+                        {
+                            return false;
+                        }
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        auto roots = at<uint32_t>(frag.rootsOffset);
+        for (uint32_t i = 0; i < frag.rootCount; i++)
+        {
+            if (roots[i] >= frag.nodeCount)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const Header &Reader::getHeader() const
+    {
+        return *at<Header>(0);
+    }
+
+    uint32_t Reader::getStringCount() const
+    {
+        return getHeader().stringCount;
+    }
+
+    const char *Reader::getString(uint32_t index) const
+    {
+        auto &header = getHeader();
+        uint64_t dataOffset = header.stringsOffset + (uint64_t) header.stringCount * sizeof(StringEntry);
+        return base + dataOffset + at<StringEntry>(header.stringsOffset)[index].offset;
+    }
+
+    uint32_t Reader::getStringLength(uint32_t index) const
+    {
+        return at<StringEntry>(getHeader().stringsOffset)[index].length;
+    }
+
+    uint32_t Reader::getFragCount() const
+    {
+        return getHeader().fragCount;
+    }
+
+    FragView Reader::getFrag(uint32_t index) const
+    {
+        return FragView(this, at<FragEntry>(getHeader().fragsOffset) + index);
+    }
+
+    std::shared_ptr<Frame::FragList> Reader::load() const
+    {
+        std::vector<std::shared_ptr<Temporary::Label>> labels(getStringCount());
+        std::unordered_map<int, std::shared_ptr<Temporary::Temp>> temps;
+        auto getLabel = [this, &labels](uint32_t index) -> std::shared_ptr<Temporary::Label>
+        {
+            if (index == NONE)
+            {
+                return nullptr;
+            }
+            if (labels[index] == nullptr)
+            {
+                labels[index] = std::make_shared<Temporary::Label>(std::string(getString(index)));
+            }
+            return labels[index];
+        };
+        auto getTemp = [&temps](int num)
+        {
+            auto &temp = temps[num];
+            if (temp == nullptr)
+            {
+                temp = std::make_shared<Temporary::Temp>(num);
+            }
+            return temp;
+        };
+
+        auto fragList = std::make_shared<Frame::FragList>();
+        for (uint32_t f = 0; f < getFragCount(); f++)
+        {
+            auto view = getFrag(f);
+            if (view.getKind() == Frame::STRING_FRAG)
+            {
+                fragList->push_back(Frame::makeStringFrag(getLabel(view.getEntry().label),
+                                                          std::string(view.getStr(), view.getStrLength())));
+                continue;
+            }
+
+            // Postorder means every child is built before its parent
+            std::vector<std::shared_ptr<IR::Stm>> built(view.getNodeCount());
+            auto exp = [&built](uint32_t index)
+            {
+                return std::static_pointer_cast<IR::Exp>(built[index]);
+            };
+            auto stms = [&built, &view](const Node &node)
+            {
+                IR::StmVector list;
+                list.reserve(node.listCount);
+                for (uint32_t j = 0; j < node.listCount; j++)
+                {
+                    list.push_back(built[view.getListItem(node, j)]);
+                }
+                return list;
+            };
+            for (uint32_t i = 0; i < view.getNodeCount(); i++)
+            {
+                auto &node = view.getNode(i);
+                switch (node.kind)
+                {
+                    case SEQ_NODE:
+                        built[i] = IR::makeSeq(stms(node));
+                        break;
+                    case LABEL_NODE:
+                        built[i] = IR::makeLabel(getLabel((uint32_t) node.value));
+                        break;
+                    case JUMP_NODE:
+                    {
+                        auto targets = std::make_shared<IR::LabelList>();
+                        for (uint32_t j = 0; j < node.listCount; j++)
+                        {
+                            targets->push_back(getLabel(view.getListItem(node, j)));
+                        }
+                        built[i] = IR::makeJump(exp(node.left), targets);
+                        break;
+                    }
+                    case CJUMP_NODE:
+                        built[i] = IR::makeCJump((IR::ComparisonOp) node.op, exp(node.left), exp(node.right),
+                                                 getLabel(view.getListItem(node, 0)),
+                                                 getLabel(view.getListItem(node, 1)));
+                        break;
+                    case MOVE_NODE:
+                        built[i] = IR::makeMove(exp(node.left), exp(node.right));
+                        break;
+                    case BINOP_NODE:
+                        built[i] = IR::makeBinop((IR::ArithmeticOp) node.op, exp(node.left), exp(node.right));
+                        break;
+                    case MEM_NODE:
+                        built[i] = IR::makeMem(exp(node.left));
+                        break;
+                    case TEMP_NODE:
+                        built[i] = IR::makeTemp(getTemp(node.value));
+                        break;
+                    case ESEQ_NODE:
+                        built[i] = IR::makeEseq(stms(node), exp(node.right));
+                        break;
+                    case NAME_NODE:
+                        built[i] = IR::makeName(getLabel((uint32_t) node.value));
+                        break;
+                    case CONST_NODE:
+                        built[i] = IR::makeConst(node.value);
+                        break;
+                    case CALL_NODE:
+                    default:
+                    {
+                        auto args = std::make_shared<IR::ExpList>();
+                        for (uint32_t j = 0; j < node.listCount; j++)
+                        {
+                            args->push_back(exp(view.getListItem(node, j)));
+                        }
+                        built[i] = IR::makeCall(exp(node.left), args);
+                        break;
+                    }
+                }
+            }
+
+            auto formals = std::make_shared<Frame::AccessList>();
+            for (uint32_t j = 0; j < view.getFormalCount(); j++)
+            {
+                auto &formal = view.getFormal(j);
+                if (formal.accessType == Frame::IN_FRAME)
+                {
+                    formals->push_back(std::make_shared<Frame::AccessFrame>(formal.value));
+                }
+                else
+                {
+                    formals->push_back(std::make_shared<Frame::AccessReg>(getTemp(formal.value)));
+                }
+            }
+            auto frame = std::make_shared<Frame::Frame>(getLabel(view.getEntry().label),
+                                                        formals, view.getLocalCount());
+            auto procFrag = std::static_pointer_cast<Frame::ProcFrag>(
+                    Frame::makeProcFrag(built[view.getRoot(0)], frame));
+            if (view.isCanonical())
+            {
+                auto stmList = std::make_shared<IR::StmList>();
+                for (uint32_t j = 1; j < view.getRootCount(); j++)
+                {
+                    stmList->push_back(built[view.getRoot(j)]);
+                }
+                procFrag->setStmList(stmList);
+            }
+            fragList->push_back(procFrag);
+        }
+
+        // New names made after loading must not clash with the stored ones
+        auto &header = getHeader();
+        if (Temporary::Temp::tempNum < (int) header.tempNum)
+        {
+            Temporary::Temp::tempNum = (int) header.tempNum;
+        }
+        if (Temporary::Label::labelNum < (int) header.labelNum)
+        {
+            Temporary::Label::labelNum = (int) header.labelNum;
+        }
+        return fragList;
+    }
+}
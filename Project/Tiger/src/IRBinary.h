@@ -0,0 +1,210 @@
+//
+// Binary form of a fragment list, written by the compiler and read in place
+//
+
+#ifndef SRC_IRBINARY_H
+#define SRC_IRBINARY_H
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include "Frame.h"
+
+// A file is laid out as
+//
+//   Header
+//   StringEntry[stringCount]   offsets into the string data
+//   string data                every string is NUL terminated
+//   FragEntry[fragCount]
+//   per fragment: Formal[], Node[], list words, root indices
+//
+// All sections start on 8 byte boundaries and use host byte order. The
+// nodes of a ProcFrag are stored in postorder, so the children of a node
+// always come before it and references are indices into the same array.
+namespace IRBinary
+{
+    const uint32_t MAGIC = 0x52494754;  // "TGIR"
+    const uint32_t VERSION = 2;
+    // Stands for a missing label or string
+    const uint32_t NONE = 0xffffffff;
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t wordSize;
+        uint32_t stringCount;
+        uint32_t fragCount;
+        // Temp and label counters of the writer, so a reader can keep
+        // making new names without clashing with the stored ones
+        uint32_t tempNum;
+        uint32_t labelNum;
+        uint32_t reserved;
+        uint64_t stringsOffset;
+        uint64_t fragsOffset;
+        uint64_t fileSize;
+    };
+
+    struct StringEntry
+    {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    struct FragEntry
+    {
+        uint32_t kind;          // Frame::FragType
+        uint32_t label;         // STRING_FRAG label, PROC_FRAG frame name
+        uint32_t str;           // STRING_FRAG text
+        uint32_t localCount;
+        uint32_t formalCount;
+        uint32_t nodeCount;
+        uint32_t listCount;
+        // Set when the roots are the canonical statement list
+        uint32_t canonical;
+        uint32_t rootCount;
+        uint32_t reserved;
+        uint64_t formalsOffset;
+        uint64_t nodesOffset;
+        uint64_t listsOffset;
+        uint64_t rootsOffset;
+    };
+
+    struct Formal
+    {
+        uint32_t accessType;    // Frame::AccessType
+        int32_t value;          // frame offset or register temp number
+    };
+
+    enum NodeKind
+    {
+        SEQ_NODE, LABEL_NODE, JUMP_NODE, CJUMP_NODE, MOVE_NODE,
+        BINOP_NODE, MEM_NODE, TEMP_NODE, ESEQ_NODE, NAME_NODE, CONST_NODE, CALL_NODE
+    };
+
+    // An expression used as a statement is stored as the expression itself.
+    //
+    //   SEQ    list = statements
+    //   LABEL  value = label
+    //   JUMP   left = target, list = labels
+    //   CJUMP  op, left, right, list = true label, false label
+    //   MOVE   left = dst, right = src
+    //   BINOP  op, left, right
+    //   MEM    left
+    //   TEMP   value = temp number
+    //   ESEQ   list = statements, right = exp
+    //   NAME   value = label
+    //   CONST  value
+    //   CALL   left = function, list = arguments
+    struct Node
+    {
+        uint8_t kind;
+        uint8_t op;
+        uint16_t reserved;
+        int32_t value;
+        uint32_t left;
+        uint32_t right;
+        uint32_t listBegin;
+        uint32_t listCount;
+    };
+
+    // Serializes fragList, with the canonical statement lists of ProcFrags
+    // that have one
+    void write(std::shared_ptr<Frame::FragList> fragList, std::ostream &out);
+
+    class Reader;
+
+    // One fragment of a file, pointing straight into the mapped bytes
+    class FragView
+    {
+        const Reader *reader;
+        const FragEntry *entry;
+    public:
+        FragView(const Reader *reader, const FragEntry *entry);
+
+        const FragEntry &getEntry() const;
+
+        Frame::FragType getKind() const;
+
+        const char *getLabel() const;
+
+        const char *getStr() const;
+
+        uint32_t getStrLength() const;
+
+        int getLocalCount() const;
+
+        bool isCanonical() const;
+
+        uint32_t getFormalCount() const;
+
+        const Formal &getFormal(uint32_t index) const;
+
+        uint32_t getNodeCount() const;
+
+        const Node &getNode(uint32_t index) const;
+
+        // Entry i of a node's list
+        uint32_t getListItem(const Node &node, uint32_t i) const;
+
+        uint32_t getRootCount() const;
+
+        // Index of a root node, the body or a canonical statement
+        uint32_t getRoot(uint32_t index) const;
+    };
+
+    class Reader
+    {
+        const char *base;
+        size_t size;
+        bool mapped;
+
+        bool validate();
+
+        bool validateFrag(const FragEntry &frag);
+
+        bool inFile(uint64_t offset, uint64_t count, uint64_t itemSize) const;
+
+    public:
+        Reader();
+
+        ~Reader();
+
+        Reader(const Reader &) = delete;
+
+        Reader &operator=(const Reader &) = delete;
+
+        // Maps the file and checks its structure, reporting an error and
+        // returning false when it is not a valid IR file
+        bool open(const std::string &fileName);
+
+        // Reads bytes that are already in memory and outlive the reader
+        bool attach(const void *data, size_t size);
+
+        void close();
+
+        const Header &getHeader() const;
+
+        uint32_t getStringCount() const;
+
+        const char *getString(uint32_t index) const;
+
+        uint32_t getStringLength(uint32_t index) const;
+
+        uint32_t getFragCount() const;
+
+        FragView getFrag(uint32_t index) const;
+
+        template<typename T>
+        const T *at(uint64_t offset) const
+        {
+            return reinterpret_cast<const T *>(base + offset);
+        }
+
+        // Rebuilds the fragment list as IR trees
+        std::shared_ptr<Frame::FragList> load() const;
+    };
+}
+
+#endif //SRC_IRBINARY_H
@@ -0,0 +1,183 @@
+//
+// Running compiled code in the compiler's own process
+//
+
+#include "Jit.h"
+#include "Encode.h"
+#include "Error.h"
+#include "StackMaps.h"
+#include "../runtime/runtime.h"
+#include <cstdio>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace Jit
+{
+    namespace
+    {
+        // jmp *0(%rip) and the address it reads, so code can call a
+        // runtime function further away than a rel32 reaches
+        const uint8_t STUB[] = {0xff, 0x25, 0, 0, 0, 0};
+        const size_t STUB_SIZE = 16;
+        // How far below the runtime the code is asked to go
+        const uintptr_t NEAR_DISTANCE = (uintptr_t) 1 << 30;
+
+        size_t pageAlign(size_t size)
+        {
+            auto page = (size_t) sysconf(_SC_PAGESIZE);
+            return (size + page - 1) / page * page;
+        }
+
+        void writePerfMap(const Encode::Object &object, const std::vector<uint8_t *> &addresses,
+                          const std::vector<bool> &data)
+        {
+            auto name = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+            auto file = std::fopen(name.c_str(), "w");
+            if (!file)
+            {
+                return;
+            }
+            for (size_t i = 0; i < object.symbols.size(); i++)
+            {
+                auto &symbol = object.symbols[i];
+                if (symbol.function)
+                {
+                    std::fprintf(file, "%lx %x %s\n", (unsigned long) addresses[i], symbol.size, symbol.name.c_str());
+                }
+                else if (symbol.section == Encode::UNDEFINED && !data[i])
+                {
+                    std::fprintf(file, "%lx %zx %s@stub\n", (unsigned long) addresses[i], STUB_SIZE,
+                                 symbol.name.c_str());
+                }
+            }
+            std::fclose(file);
+        }
+    }
+
+    int run(const Frame::FragList &fragList, const Assem::FunctionList &functions, bool perfMap)
+    {
+        auto object = Encode::encode(fragList, functions);
+        std::unordered_map<std::string, void *> runtime;
+        for (auto entry = tiger_entryPoints; entry->name; entry++)
+        {
+            runtime.emplace(entry->name, entry->address);
+        }
+
+        // The runtime's variables, like the card table, are addressed
+        // rather than called
+        std::vector<bool> data(object.symbols.size(), false);
+        for (auto &relocation : object.relocations)
+        {
+            if (!relocation.call && object.symbols[relocation.symbol].section == Encode::UNDEFINED)
+            {
+                data[relocation.symbol] = true;
+            }
+        }
+
+        // The text with the stubs after it, then the strings on pages of
+        // their own
+        size_t stubsAt = (object.text.size() + STUB_SIZE - 1) / STUB_SIZE * STUB_SIZE;
+        size_t stubCount = 0;
+        for (size_t i = 0; i < object.symbols.size(); i++)
+        {
+            stubCount += object.symbols[i].section == Encode::UNDEFINED && !data[i];
+        }
+        size_t codeSize = pageAlign(stubsAt + stubCount * STUB_SIZE);
+        size_t size = codeSize + pageAlign(object.rodata.size());
+        // Near the runtime, below it unless it sits low, so a rel32 reaches
+        // its variables
+        auto runtimeAt = reinterpret_cast<uintptr_t>(tiger_entryPoints);
+        auto near = (runtimeAt > NEAR_DISTANCE + size ? runtimeAt - NEAR_DISTANCE - size : runtimeAt + NEAR_DISTANCE) &
+                    ~(uintptr_t) 0xfff;
+        auto memory = mmap(reinterpret_cast<void *>(near), size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                           -1, 0);
+        if (memory == MAP_FAILED)
+        {
+            Tiger::Error error("Cannot map memory to run the program in");
+            return 1;
+        }
+        auto base = static_cast<uint8_t *>(memory);
+        std::memcpy(base, object.text.data(), object.text.size());
+        if (!object.rodata.empty())
+        {
+            std::memcpy(base + codeSize, object.rodata.data(), object.rodata.size());
+        }
+
+        std::vector<uint8_t *> addresses;
+        auto stub = base + stubsAt;
+        for (size_t i = 0; i < object.symbols.size(); i++)
+        {
+            auto &symbol = object.symbols[i];
+            if (symbol.section == Encode::TEXT)
+            {
+                addresses.push_back(base + symbol.offset);
+                continue;
+            }
+            if (symbol.section == Encode::RODATA)
+            {
+                addresses.push_back(base + codeSize + symbol.offset);
+                continue;
+            }
+            auto found = runtime.find(symbol.name);
+            if (found == runtime.end())
+            {
+                Tiger::Error error("Undefined symbol " + symbol.name);
+                munmap(memory, size);
+                return 1;
+            }
+            if (data[i])
+            {
+                addresses.push_back(static_cast<uint8_t *>(found->second));
+                continue;
+            }
+            std::memcpy(stub, STUB, sizeof(STUB));
+            std::memcpy(stub + sizeof(STUB), &found->second, sizeof(found->second));
+            addresses.push_back(stub);
+            stub += STUB_SIZE;
+        }
+        for (auto &relocation : object.relocations)
+        {
+            auto field = base + relocation.offset;
+            auto value = (int64_t) (addresses[relocation.symbol] + relocation.addend - field);
+            if (value != (int32_t) value)
+            {
+                Tiger::Error error("Relocation out of range for " + object.symbols[relocation.symbol].name);
+                munmap(memory, size);
+                return 1;
+            }
+            auto value32 = (int32_t) value;
+            std::memcpy(field, &value32, sizeof(value32));
+        }
+        if (mprotect(base, codeSize, PROT_READ | PROT_EXEC) != 0 ||
+            (size > codeSize && mprotect(base + codeSize, size - codeSize, PROT_READ) != 0))
+        {
+            Tiger::Error error("Cannot make the memory the program runs in executable");
+            munmap(memory, size);
+            return 1;
+        }
+        if (perfMap)
+        {
+            writePerfMap(object, addresses, data);
+        }
+
+        const int32_t *stackMaps = nullptr;
+        for (size_t i = 0; i < object.symbols.size(); i++)
+        {
+            if (object.symbols[i].name == StackMaps::TABLE_NAME && object.symbols[i].section == Encode::TEXT)
+            {
+                stackMaps = reinterpret_cast<const int32_t *>(addresses[i]);
+            }
+        }
+        for (size_t i = 0; i < object.symbols.size(); i++)
+        {
+            if (object.symbols[i].name == Frame::MAIN_NAME && object.symbols[i].section == Encode::TEXT)
+            {
+                return tiger_run(reinterpret_cast<int64_t (*)(int64_t)>(addresses[i]), stackMaps);
+            }
+        }
+        Tiger::Error error(std::string("No function ") + Frame::MAIN_NAME + " to run");
+        return 1;
+    }
+}
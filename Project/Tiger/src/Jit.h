@@ -0,0 +1,22 @@
+//
+// Running compiled code in the compiler's own process
+//
+
+#ifndef SRC_JIT_H
+#define SRC_JIT_H
+
+#include "Assem.h"
+#include "Frame.h"
+
+namespace Jit
+{
+    // Encodes the functions and StringFrags into memory of this process,
+    // links them against the runtime the compiler carries and calls the
+    // main fragment, writing no files. With perfMap it writes
+    // /tmp/perf-<pid>.map, from which perf names the functions, and leaves
+    // it for perf to read. Returns the program's exit status, unless it
+    // calls exit.
+    int run(const Frame::FragList &fragList, const Assem::FunctionList &functions, bool perfMap);
+}
+
+#endif //SRC_JIT_H
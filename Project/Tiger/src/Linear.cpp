@@ -0,0 +1,607 @@
+//
+// Linear three-address form of canonicalized functions
+//
+
+#include "Linear.h"
+#include "Error.h"
+#include "ThreadPool.h"
+#include <unordered_map>
+
+namespace Linear
+{
+    int32_t Function::getTempCount() const
+    {
+        return (int32_t) tempNums.size();
+    }
+
+    namespace
+    {
+        // Root destination of an expression whose value is not used
+        const int32_t DISCARD = -2;
+
+        Instr makeInstr(Opcode opcode, int32_t dst = NONE, int32_t a = NONE, int32_t b = NONE, int32_t imm = 0)
+        {
+            Instr instr;
+            instr.opcode = (uint8_t) opcode;
+            instr.op = 0;
+            instr.useImm = 0;
+            instr.reserved = 0;
+            instr.dst = dst;
+            instr.a = a;
+            instr.b = b;
+            instr.imm = imm;
+            instr.first = NONE;
+            instr.second = NONE;
+            return instr;
+        }
+
+        bool isConst(const std::shared_ptr<IR::Exp> &exp)
+        {
+            return exp->getExpType() == IR::CONST;
+        }
+
+        int32_t constOf(const std::shared_ptr<IR::Exp> &exp)
+        {
+            return std::static_pointer_cast<IR::Const>(exp)->getConstt();
+        }
+
+        // Splits an address into a base expression and a constant offset
+        const IR::Exp *splitAddress(const IR::Exp *address, int32_t &offset)
+        {
+            offset = 0;
+            if (address->getExpType() == IR::BINOP)
+            {
+                auto binop = static_cast<const IR::Binop *>(address);
+                if ((binop->getOp() == IR::PLUS || binop->getOp() == IR::MINUS) && isConst(binop->getRight()))
+                {
+                    offset = constOf(binop->getRight());
+                    if (binop->getOp() == IR::MINUS)
+                    {
+                        offset = -offset;
+                    }
+                    return binop->getLeft().get();
+                }
+            }
+            return address;
+        }
+
+        // Lowers one statement list. Expressions are walked with an explicit
+        // stack, as Canon does, so deep trees cost no native stack.
+        class Lowerer
+        {
+            Function &function;
+            std::unordered_map<int, int32_t> temps;
+            std::unordered_map<std::string, int32_t> labelIndex;
+            // Block that starts at each label, NONE for labels of other code
+            std::vector<int32_t> labelBlock;
+            // Set while instructions go into the last block
+            bool open;
+
+            struct Work
+            {
+                const IR::Exp *exp;
+                int32_t dst;
+                bool done;
+            };
+            std::vector<Work> work;
+            std::vector<int32_t> values;
+
+            int32_t newTemp()
+            {
+                function.tempNums.push_back(NONE);
+                function.tempKinds.push_back(Temporary::UNKNOWN);
+                return function.getTempCount() - 1;
+            }
+
+            int32_t temp(const std::shared_ptr<Temporary::Temp> &temp)
+            {
+                auto found = temps.find(temp->getNum());
+                if (found != temps.end())
+                {
+                    return found->second;
+                }
+                function.tempNums.push_back(temp->getNum());
+                function.tempKinds.push_back((uint8_t) temp->getKind());
+                int32_t index = function.getTempCount() - 1;
+                temps.emplace(temp->getNum(), index);
+                return index;
+            }
+
+            int32_t label(const std::shared_ptr<Temporary::Label> &label)
+            {
+                auto name = label->getLabelName();
+                auto found = labelIndex.find(name);
+                if (found != labelIndex.end())
+                {
+                    return found->second;
+                }
+                auto index = (int32_t) function.labels.size();
+                function.labels.push_back(name);
+                labelBlock.push_back(NONE);
+                labelIndex.emplace(name, index);
+                return index;
+            }
+
+            int32_t target(int32_t dst)
+            {
+                return dst >= 0 ? dst : newTemp();
+            }
+
+            void startBlock(int32_t label)
+            {
+                closeBlock();
+                auto begin = (uint32_t) function.instrs.size();
+                function.blocks.push_back({label, begin, begin});
+                open = true;
+            }
+
+            void closeBlock()
+            {
+                if (open)
+                {
+                    function.blocks.back().end = (uint32_t) function.instrs.size();
+                    open = false;
+                }
+            }
+
+            void emit(const Instr &instr)
+            {
+                if (!open)
+                {
+                    startBlock(NONE);
+                }
+                function.instrs.push_back(instr);
+            }
+
+            // Evaluates root into dst, or into a new temp when dst is NONE,
+            // and returns the temp holding the value
+            int32_t exp(const IR::Exp *root, int32_t dst)
+            {
+                work.assign(1, {root, dst, false});
+                values.clear();
+                while (!work.empty())
+                {
+                    auto item = work.back();
+                    work.pop_back();
+                    auto node = item.exp;
+                    if (!item.done)
+                    {
+                        switch (node->getExpType())
+                        {
+                            case IR::TEMP:
+                            {
+                                int32_t value = temp(static_cast<const IR::Temp *>(node)->getTemp());
+                                if (item.dst >= 0 && item.dst != value)
+                                {
+                                    emit(makeInstr(MOVE, item.dst, value));
+                                    value = item.dst;
+                                }
+                                values.push_back(value);
+                                continue;
+                            }
+                            case IR::CONST:
+                                values.push_back(target(item.dst));
+                                emit(makeInstr(LOADI, values.back(), NONE, NONE,
+                                               static_cast<const IR::Const *>(node)->getConstt()));
+                                continue;
+                            case IR::NAME:
+                                values.push_back(target(item.dst));
+                                emit(makeInstr(LOADA, values.back(), NONE, NONE,
+                                               label(static_cast<const IR::Name *>(node)->getLabel())));
+                                continue;
+                            case IR::BINOP:
+                            {
+                                auto binop = static_cast<const IR::Binop *>(node);
+                                work.push_back({node, item.dst, true});
+                                if (!isConst(binop->getRight()))
+                                {
+                                    work.push_back({binop->getRight().get(), NONE, false});
+                                }
+                                work.push_back({binop->getLeft().get(), NONE, false});
+                                continue;
+                            }
+                            case IR::MEM:
+                            {
+                                int32_t offset;
+                                work.push_back({node, item.dst, true});
+                                work.push_back({splitAddress(static_cast<const IR::Mem *>(node)->getExp().get(),
+                                                             offset), NONE, false});
+                                continue;
+                            }
+                            case IR::CALL:
+                            {
+                                auto call = static_cast<const IR::Call *>(node);
+                                work.push_back({node, item.dst, true});
+                                auto &args = *call->getArgs();
+                                for (auto arg = args.rbegin(); arg != args.rend(); arg++)
+                                {
+                                    work.push_back({arg->get(), NONE, false});
+                                }
+                                if (call->getFun()->getExpType() != IR::NAME)
+                                {
+                                    work.push_back({call->getFun().get(), NONE, false});
+                                }
+                                continue;
+                            }
+                            default:
+                                Tiger::Error error("Expression is not canonical");
+                                values.push_back(target(item.dst));
+                                continue;
+                        }
+                    }
+                    switch (node->getExpType())
+                    {
+                        case IR::BINOP:
+                        {
+                            auto binop = static_cast<const IR::Binop *>(node);
+                            auto instr = makeInstr(BINOP);
+                            instr.op = (uint8_t) binop->getOp();
+                            if (isConst(binop->getRight()))
+                            {
+                                instr.useImm = 1;
+                                instr.imm = constOf(binop->getRight());
+                            }
+                            else
+                            {
+                                instr.b = values.back();
+                                values.pop_back();
+                            }
+                            instr.a = values.back();
+                            instr.dst = target(item.dst);
+                            values.back() = instr.dst;
+                            emit(instr);
+                            break;
+                        }
+                        case IR::MEM:
+                        {
+                            int32_t offset;
+                            splitAddress(static_cast<const IR::Mem *>(node)->getExp().get(), offset);
+                            auto instr = makeInstr(LOAD, target(item.dst), values.back(), NONE, offset);
+                            values.back() = instr.dst;
+                            emit(instr);
+                            break;
+                        }
+                        case IR::CALL:
+                        default:
+                        {
+                            auto call = static_cast<const IR::Call *>(node);
+                            auto instr = makeInstr(CALL);
+                            auto count = call->getArgs()->size();
+                            instr.first = (int32_t) function.args.size();
+                            instr.second = (int32_t) count;
+                            function.args.insert(function.args.end(), values.end() - count, values.end());
+                            values.resize(values.size() - count);
+                            if (call->getFun()->getExpType() == IR::NAME)
+                            {
+                                instr.imm = label(std::static_pointer_cast<IR::Name>(call->getFun())->getLabel());
+                            }
+                            else
+                            {
+                                instr.imm = NONE;
+                                instr.a = values.back();
+                                values.pop_back();
+                            }
+                            instr.dst = item.dst == DISCARD ? NONE : target(item.dst);
+                            values.push_back(instr.dst);
+                            emit(instr);
+                            break;
+                        }
+                    }
+                }
+                return values.back();
+            }
+
+            void stm(const IR::Stm *stm)
+            {
+                switch (stm->getStmType())
+                {
+                    case IR::LABEL:
+                    {
+                        int32_t index = label(static_cast<const IR::Label *>(stm)->getLabel());
+                        startBlock(index);
+                        labelBlock[index] = (int32_t) function.blocks.size() - 1;
+                        break;
+                    }
+                    case IR::JUMP:
+                    {
+                        auto jump = static_cast<const IR::Jump *>(stm);
+                        auto instr = makeInstr(JUMP);
+                        if (jump->getExp()->getExpType() == IR::NAME)
+                        {
+                            instr.first = label(std::static_pointer_cast<IR::Name>(jump->getExp())->getLabel());
+                        }
+                        else
+                        {
+                            instr.a = exp(jump->getExp().get(), NONE);
+                        }
+                        emit(instr);
+                        closeBlock();
+                        break;
+                    }
+                    case IR::CJUMP:
+                    {
+                        auto cjump = static_cast<const IR::CJump *>(stm);
+                        auto instr = makeInstr(CJUMP);
+                        instr.op = (uint8_t) cjump->getOp();
+                        instr.a = exp(cjump->getLeft().get(), NONE);
+                        if (isConst(cjump->getRight()))
+                        {
+                            instr.useImm = 1;
+                            instr.imm = constOf(cjump->getRight());
+                        }
+                        else
+                        {
+                            instr.b = exp(cjump->getRight().get(), NONE);
+                        }
+                        instr.first = label(cjump->getLabelTrue());
+                        instr.second = label(cjump->getLabelFalse());
+                        emit(instr);
+                        closeBlock();
+                        break;
+                    }
+                    case IR::MOVE:
+                    {
+                        auto move = static_cast<const IR::Move *>(stm);
+                        auto dst = move->getDst();
+                        if (dst->getExpType() == IR::TEMP)
+                        {
+                            exp(move->getSrc().get(), temp(std::static_pointer_cast<IR::Temp>(dst)->getTemp()));
+                        }
+                        else if (dst->getExpType() == IR::MEM)
+                        {
+                            int32_t offset;
+                            auto base = splitAddress(std::static_pointer_cast<IR::Mem>(dst)->getExp().get(), offset);
+                            int32_t a = exp(base, NONE);
+                            int32_t b = exp(move->getSrc().get(), NONE);
+                            emit(makeInstr(STORE, NONE, a, b, offset));
+                        }
+                        else
+                        {
+                            // Keep the side effects of src
+                            exp(move->getSrc().get(), DISCARD);
+                            Tiger::Error error("MOVE to an expression that is not TEMP or MEM in " + function.name);
+                        }
+                        break;
+                    }
+                    case IR::EXP:
+                        exp(static_cast<const IR::Exp *>(stm), DISCARD);
+                        break;
+                    case IR::SEQ:
+                    default:
+                        Tiger::Error error("Statement is not canonical");
+                        break;
+                }
+            }
+
+            // Turns the label indices of jumps into block indices
+            void resolve(int32_t &target)
+            {
+                if (target == NONE)
+                {
+                    return;
+                }
+                int32_t block = labelBlock[target];
+                if (block == NONE)
+                {
+                    Tiger::Error error("Jump to label " + function.labels[target] + " outside of " + function.name);
+                }
+                target = block;
+            }
+
+        public:
+            Lowerer(Function &function) : function(function), open(false)
+            {}
+
+            void run(const IR::StmList &stmList)
+            {
+                for (auto &s : stmList)
+                {
+                    stm(s.get());
+                }
+                closeBlock();
+                for (auto &instr : function.instrs)
+                {
+                    if (instr.opcode == JUMP || instr.opcode == CJUMP)
+                    {
+                        resolve(instr.first);
+                        resolve(instr.second);
+                    }
+                }
+            }
+        };
+
+        const char *const arithmeticOps[] = {"+", "-", "*", "/"};
+        const char *const comparisonOps[] = {"==", "!=", "<", ">", "<=", ">="};
+    }
+
+    std::shared_ptr<Function> lower(std::shared_ptr<Frame::ProcFrag> procFrag)
+    {
+        auto function = std::make_shared<Function>();
+        if (procFrag->getFrame() != nullptr)
+        {
+            function->name = procFrag->getFrame()->getName()->getLabelName();
+        }
+        if (procFrag->getStmList() == nullptr)
+        {
+            Tiger::Error error("Function " + function->name + " is not canonicalized");
+            return function;
+        }
+        Lowerer(*function).run(*procFrag->getStmList());
+        return function;
+    }
+
+    std::shared_ptr<FunctionList> lower(std::shared_ptr<Frame::FragList> fragList)
+    {
+        std::vector<std::shared_ptr<Frame::ProcFrag>> procFrags;
+        for (auto &frag : *fragList)
+        {
+            if (frag->getKind() == Frame::PROC_FRAG)
+            {
+                procFrags.push_back(std::static_pointer_cast<Frame::ProcFrag>(frag));
+            }
+        }
+        auto functions = std::make_shared<FunctionList>(procFrags.size());
+        parallelFor(procFrags.size(), [&procFrags, &functions](size_t i)
+        {
+            (*functions)[i] = lower(procFrags[i]);
+        });
+        return functions;
+    }
+
+    void print(const Function &function, OutBuffer &outFile)
+    {
+        auto temp = [&function, &outFile](int32_t index)
+        {
+            if (function.tempNums[index] == NONE)
+            {
+                outFile << 'n' << index;
+            }
+            else
+            {
+                outFile << 't' << function.tempNums[index];
+            }
+        };
+        auto address = [&temp, &outFile](const Instr &instr)
+        {
+            outFile << "M[";
+            temp(instr.a);
+            if (instr.imm != 0)
+            {
+                outFile << (instr.imm < 0 ? " - " : " + ") << (instr.imm < 0 ? -instr.imm : instr.imm);
+            }
+            outFile << ']';
+        };
+        auto block = [&outFile](int32_t index)
+        {
+            outFile << 'B' << index;
+        };
+
+        outFile << "function " << function.name << " (" << function.getTempCount() << " temps, "
+                << (int) function.blocks.size() << " blocks)" << '\n';
+        for (size_t b = 0; b < function.blocks.size(); b++)
+        {
+            auto &current = function.blocks[b];
+            block((int32_t) b);
+            if (current.label != NONE)
+            {
+                outFile << ' ' << function.labels[current.label];
+            }
+            outFile << ":\n";
+            for (uint32_t i = current.begin; i < current.end; i++)
+            {
+                auto &instr = function.instrs[i];
+                outFile << "    ";
+                switch (instr.opcode)
+                {
+                    case MOVE:
+                        temp(instr.dst);
+                        outFile << " = ";
+                        temp(instr.a);
+                        break;
+                    case LOADI:
+                        temp(instr.dst);
+                        outFile << " = " << instr.imm;
+                        break;
+                    case LOADA:
+                        temp(instr.dst);
+                        outFile << " = &" << function.labels[instr.imm];
+                        break;
+                    case BINOP:
+                        temp(instr.dst);
+                        outFile << " = ";
+                        temp(instr.a);
+                        outFile << ' ' << arithmeticOps[instr.op] << ' ';
+                        if (instr.useImm)
+                        {
+                            outFile << instr.imm;
+                        }
+                        else
+                        {
+                            temp(instr.b);
+                        }
+                        break;
+                    case LOAD:
+                        temp(instr.dst);
+                        outFile << " = ";
+                        address(instr);
+                        break;
+                    case STORE:
+                        address(instr);
+                        outFile << " = ";
+                        temp(instr.b);
+                        break;
+                    case CALL:
+                        if (instr.dst != NONE)
+                        {
+                            temp(instr.dst);
+                            outFile << " = ";
+                        }
+                        outFile << "call ";
+                        if (instr.imm != NONE)
+                        {
+                            outFile << function.labels[instr.imm];
+                        }
+                        else
+                        {
+                            outFile << '*';
+                            temp(instr.a);
+                        }
+                        outFile << '(';
+                        for (int32_t j = 0; j < instr.second; j++)
+                        {
+                            if (j > 0)
+                            {
+                                outFile << ", ";
+                            }
+                            temp(function.args[instr.first + j]);
+                        }
+                        outFile << ')';
+                        break;
+                    case JUMP:
+                        outFile << "goto ";
+                        if (instr.first != NONE)
+                        {
+                            block(instr.first);
+                        }
+                        else
+                        {
+                            outFile << '*';
+                            temp(instr.a);
+                        }
+                        break;
+                    case CJUMP:
+                    default:
+                        outFile << "if ";
+                        temp(instr.a);
+                        outFile << ' ' << comparisonOps[instr.op] << ' ';
+                        if (instr.useImm)
+                        {
+                            outFile << instr.imm;
+                        }
+                        else
+                        {
+                            temp(instr.b);
+                        }
+                        outFile << " goto ";
+                        block(instr.first);
+                        outFile << " else ";
+                        block(instr.second);
+                        break;
+                }
+                outFile << '\n';
+            }
+        }
+        outFile << '\n';
+    }
+
+    void print(const FunctionList &functions, std::ostream &outFile)
+    {
+        OutBuffer buffer(OutBuffer::FLUSH_CAPACITY);
+        for (auto &function : functions)
+        {
+            print(*function, buffer);
+            buffer.writeIfFull(outFile);
+        }
+        buffer.writeTo(outFile);
+    }
+}
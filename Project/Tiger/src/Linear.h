@@ -0,0 +1,95 @@
+//
+// Linear three-address form of canonicalized functions
+//
+
+#ifndef SRC_LINEAR_H
+#define SRC_LINEAR_H
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Frame.h"
+#include "OutBuffer.h"
+
+// A function is an array of fixed-size instructions split into basic
+// blocks. Temps are numbered densely from 0 per function, so passes can
+// keep per-temp data in plain arrays, and jumps name the index of the
+// block they go to.
+namespace Linear
+{
+    // Stands for a missing temp, block or label
+    const int32_t NONE = -1;
+
+    enum Opcode
+    {
+        MOVE, LOADI, LOADA, BINOP, LOAD, STORE, CALL, JUMP, CJUMP
+    };
+
+    //   MOVE   dst = a
+    //   LOADI  dst = imm
+    //   LOADA  dst = address of label imm
+    //   BINOP  dst = a op b, or a op imm when useImm is set
+    //   LOAD   dst = M[a + imm]
+    //   STORE  M[a + imm] = b
+    //   CALL   dst = call label imm, or the address in a when imm is NONE,
+    //          with the temps args[first .. first + second) as arguments;
+    //          dst is NONE when the result is unused
+    //   JUMP   goto block first, or the address in a when first is NONE
+    //   CJUMP  if a op b (or imm) goto block first else block second
+    struct Instr
+    {
+        uint8_t opcode;     // Opcode
+        uint8_t op;         // IR::ArithmeticOp or IR::ComparisonOp
+        uint8_t useImm;
+        uint8_t reserved;
+        int32_t dst;
+        int32_t a;
+        int32_t b;
+        int32_t imm;
+        int32_t first;
+        int32_t second;
+    };
+
+    // Instructions [begin, end) of a function. A block without a jump at
+    // its end falls through to the next one.
+    struct Block
+    {
+        int32_t label;      // index into labels, NONE for an unlabelled start
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    struct Function
+    {
+        std::string name;
+        std::vector<Instr> instrs;
+        std::vector<Block> blocks;
+        // Argument temps of the calls
+        std::vector<int32_t> args;
+        std::vector<std::string> labels;
+        // Temporary::Temp number of each temp, NONE for the temps made while
+        // lowering
+        std::vector<int> tempNums;
+        // Temporary::Kind of each temp
+        std::vector<uint8_t> tempKinds;
+
+        int32_t getTempCount() const;
+    };
+
+    using FunctionList = std::vector<std::shared_ptr<Function>>;
+
+    // Lowers the canonical statements of procFrag, which Canon::canonicalize
+    // must have made
+    std::shared_ptr<Function> lower(std::shared_ptr<Frame::ProcFrag> procFrag);
+
+    // Lowers every ProcFrag, one task per fragment, in fragment order
+    std::shared_ptr<FunctionList> lower(std::shared_ptr<Frame::FragList> fragList);
+
+    void print(const Function &function, OutBuffer &outFile);
+
+    void print(const FunctionList &functions, std::ostream &outFile);
+}
+
+#endif //SRC_LINEAR_H
@@ -0,0 +1,1058 @@
+//
+// Linear scan register allocation
+//
+
+#include "LinearScan.h"
+#include "Flow.h"
+#include <algorithm>
+#include <climits>
+#include <functional>
+#include <queue>
+
+namespace LinearScan
+{
+    namespace
+    {
+        using Assem::makeInstr;
+
+        const int32_t COLORS[] = {
+                Frame::RAX, Frame::RCX, Frame::RDX, Frame::RSI, Frame::RDI, Frame::R8, Frame::R9, Frame::RBX,
+                Frame::R12, Frame::R13, Frame::R14, Frame::R15
+        };
+        const int32_t SCRATCH[] = {Frame::R10, Frame::R11};
+
+        // A position after every instruction
+        const int32_t END = INT_MAX;
+
+        // Positions [from, to). Instruction i reads its operands at 2i and
+        // writes them at 2i + 1.
+        struct Range
+        {
+            int32_t from;
+            int32_t to;
+        };
+
+        // The part of a temp's lifetime from one split to the next, in one
+        // register or in the temp's stack slot. Its ranges and uses are
+        // slices of the allocator's pools.
+        struct Interval
+        {
+            int32_t temp;
+            // Where the split that made this part is, 0 for the first part
+            int32_t begin;
+            // Next part of the same temp, or NONE
+            int32_t next;
+            // Register, NONE while unassigned or on the stack
+            int32_t reg;
+            bool spilled;
+            // Sorted ranges, with holes between them
+            uint32_t rangeBegin;
+            uint32_t rangeEnd;
+            // Sorted positions that read or write the temp
+            uint32_t useBegin;
+            uint32_t useEnd;
+        };
+
+        // First range that ends after pos
+        const Range *firstEnding(const Range *first, const Range *last, int32_t pos)
+        {
+            return std::upper_bound(first, last, pos, [](int32_t p, const Range &r)
+            {
+                return p < r.to;
+            });
+        }
+
+        // First position from pos on that both cover, or END. The ranges
+        // before a and b end before pos.
+        int32_t nextIntersection(const Range *a, const Range *aEnd, const Range *b, const Range *bEnd, int32_t pos)
+        {
+            while (a != aEnd && b != bEnd)
+            {
+                int32_t from = std::max(pos, std::max(a->from, b->from));
+                if (from < a->to && from < b->to)
+                {
+                    return from;
+                }
+                if (a->to < b->to)
+                {
+                    ++a;
+                }
+                else
+                {
+                    ++b;
+                }
+            }
+            return END;
+        }
+
+        // Where a move goes, NONE for the temp's stack slot
+        struct Move
+        {
+            int32_t temp;
+            int32_t from;
+            int32_t to;
+        };
+
+        class Allocator
+        {
+            Assem::Function &function;
+            Flow::Graph graph;
+            std::vector<std::vector<int32_t>> liveOut;
+            // The first part of temp t is intervals[t]. Registers keep
+            // their ranges there and are never split.
+            std::vector<Interval> intervals;
+            std::vector<Range> rangePool;
+            std::vector<int32_t> usePool;
+            // Other side of a move with the temp, preferring a register
+            std::vector<int32_t> hint;
+            // Positions where a block starts, where intervals can be split
+            std::vector<int32_t> boundaries;
+            std::vector<int32_t> active;
+            std::vector<int32_t> inactive;
+            // First parts in order of their start, and the parts splits
+            // made, by start and index
+            std::vector<int32_t> unhandled;
+            size_t nextUnhandled;
+            std::priority_queue<std::pair<int32_t, int32_t>, std::vector<std::pair<int32_t, int32_t>>,
+                    std::greater<std::pair<int32_t, int32_t>>> splitParts;
+            std::vector<int32_t> stillActive;
+            std::vector<int32_t> stillInactive;
+            // First range of each register that ends after the current
+            // position, which only grows
+            uint32_t fixedCursor[Frame::REGISTER_COUNT];
+            std::vector<int32_t> slots;
+
+            const Range *rangesBegin(int32_t index) const
+            {
+                return rangePool.data() + intervals[index].rangeBegin;
+            }
+
+            const Range *rangesEnd(int32_t index) const
+            {
+                return rangePool.data() + intervals[index].rangeEnd;
+            }
+
+            int32_t start(int32_t index) const
+            {
+                return rangesBegin(index)->from;
+            }
+
+            int32_t end(int32_t index) const
+            {
+                return (rangesEnd(index) - 1)->to;
+            }
+
+            bool covers(int32_t index, int32_t pos) const
+            {
+                auto it = firstEnding(rangesBegin(index), rangesEnd(index), pos);
+                return it != rangesEnd(index) && it->from <= pos;
+            }
+
+            int32_t intersect(int32_t index, int32_t current, int32_t pos) const
+            {
+                return nextIntersection(firstEnding(rangesBegin(index), rangesEnd(index), pos), rangesEnd(index),
+                                        rangesBegin(current), rangesEnd(current), pos);
+            }
+
+            // Next position of the register's fixed ranges that the current
+            // part covers too
+            int32_t intersectFixed(int32_t reg, int32_t current, int32_t pos)
+            {
+                auto &cursor = fixedCursor[reg];
+                while (cursor < intervals[reg].rangeEnd && rangePool[cursor].to <= pos)
+                {
+                    cursor++;
+                }
+                return nextIntersection(rangePool.data() + cursor, rangesEnd(reg), rangesBegin(current),
+                                        rangesEnd(current), pos);
+            }
+
+            int32_t nextUse(int32_t index, int32_t pos) const
+            {
+                auto first = usePool.begin() + intervals[index].useBegin;
+                auto last = usePool.begin() + intervals[index].useEnd;
+                auto it = std::lower_bound(first, last, pos);
+                return it == last ? END : *it;
+            }
+
+            // Latest block start in (lo, hi], or NONE
+            int32_t lastBoundary(int32_t lo, int32_t hi) const
+            {
+                auto it = std::upper_bound(boundaries.begin(), boundaries.end(), hi);
+                if (it == boundaries.begin() || *(it - 1) <= lo)
+                {
+                    return Assem::NONE;
+                }
+                return *(it - 1);
+            }
+
+            int32_t nextBoundary(int32_t pos) const
+            {
+                auto it = std::upper_bound(boundaries.begin(), boundaries.end(), pos);
+                return it == boundaries.end() ? END : *it;
+            }
+
+            int32_t blockStart(int32_t pos) const
+            {
+                return *(std::upper_bound(boundaries.begin(), boundaries.end(), pos) - 1);
+            }
+
+            static bool isAllocated(int32_t temp)
+            {
+                return !Assem::isRegister(temp) || std::find(std::begin(COLORS), std::end(COLORS), temp) !=
+                                                   std::end(COLORS);
+            }
+
+            // Walks the blocks backwards, collecting the ranges and uses of
+            // every temp latest first, then sorts them into the pools by
+            // temp with a counting sort, so no temp needs lists of its own
+            void buildIntervals()
+            {
+                auto count = function.tempCount;
+                graph = Flow::makeGraph(function);
+                liveOut = Flow::liveOut(function, graph);
+                hint.assign((size_t) count, Assem::NONE);
+
+                std::vector<Range> ranges;
+                std::vector<int32_t> rangeTemps;
+                std::vector<std::pair<int32_t, int32_t>> uses;
+                // Last range added for each temp, which is its earliest
+                std::vector<int32_t> lastRange((size_t) count, Assem::NONE);
+                auto addRange = [&ranges, &rangeTemps, &lastRange](int32_t temp, int32_t from, int32_t to)
+                {
+                    int32_t last = lastRange[temp];
+                    if (last != Assem::NONE && ranges[last].from <= to)
+                    {
+                        ranges[last].from = std::min(ranges[last].from, from);
+                        ranges[last].to = std::max(ranges[last].to, to);
+                        return;
+                    }
+                    lastRange[temp] = (int32_t) ranges.size();
+                    ranges.push_back({from, to});
+                    rangeTemps.push_back(temp);
+                };
+                auto addUse = [&uses](int32_t temp, int32_t pos)
+                {
+                    if (uses.empty() || uses.back().first != temp || uses.back().second != pos)
+                    {
+                        uses.push_back({temp, pos});
+                    }
+                };
+
+                std::vector<char> live((size_t) count, 0);
+                // Temps live somewhere in the block, to clear after it
+                std::vector<int32_t> marked;
+                std::vector<int32_t> instrUses, instrDefs;
+                for (size_t b = function.blocks.size(); b-- > 0;)
+                {
+                    auto &block = function.blocks[b];
+                    int32_t from = 2 * (int32_t) block.begin;
+                    boundaries.push_back(from);
+                    for (auto temp : liveOut[b])
+                    {
+                        if (isAllocated(temp))
+                        {
+                            live[temp] = 1;
+                            marked.push_back(temp);
+                            addRange(temp, from, 2 * (int32_t) block.end);
+                        }
+                    }
+                    for (auto i = block.end; i > block.begin; i--)
+                    {
+                        auto &instr = function.instrs[i - 1];
+                        int32_t pos = 2 * (int32_t) (i - 1);
+                        instrUses.clear();
+                        instrDefs.clear();
+                        Assem::getUses(instr, instrUses);
+                        Assem::getDefs(instr, instrDefs);
+                        for (auto def : instrDefs)
+                        {
+                            if (!isAllocated(def))
+                            {
+                                continue;
+                            }
+                            if (live[def])
+                            {
+                                ranges[lastRange[def]].from = pos + 1;
+                                live[def] = 0;
+                            }
+                            else
+                            {
+                                addRange(def, pos + 1, pos + 2);
+                            }
+                            addUse(def, pos + 1);
+                        }
+                        for (auto use : instrUses)
+                        {
+                            if (!isAllocated(use))
+                            {
+                                continue;
+                            }
+                            addRange(use, from, pos + 1);
+                            live[use] = 1;
+                            marked.push_back(use);
+                            addUse(use, pos);
+                        }
+                        if (Assem::isMove(instr))
+                        {
+                            for (auto pair : {std::make_pair(instr.dst, instr.src),
+                                              std::make_pair(instr.src, instr.dst)})
+                            {
+                                if (!Assem::isRegister(pair.first) &&
+                                    (hint[pair.first] == Assem::NONE || Assem::isRegister(pair.second)))
+                                {
+                                    hint[pair.first] = pair.second;
+                                }
+                            }
+                        }
+                    }
+                    for (auto temp : marked)
+                    {
+                        live[temp] = 0;
+                    }
+                    marked.clear();
+                }
+                std::reverse(boundaries.begin(), boundaries.end());
+                boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
+
+                // Slices of the pools, filled from the back since the
+                // ranges and uses were found latest first
+                intervals.resize((size_t) count);
+                for (int32_t t = 0; t < count; t++)
+                {
+                    intervals[t] = {t, 0, Assem::NONE, Assem::isRegister(t) ? t : Assem::NONE, false, 0, 0, 0, 0};
+                }
+                for (auto temp : rangeTemps)
+                {
+                    intervals[temp].rangeEnd++;
+                }
+                for (auto &use : uses)
+                {
+                    intervals[use.first].useEnd++;
+                }
+                uint32_t rangeOffset = 0, useOffset = 0;
+                for (auto &interval : intervals)
+                {
+                    interval.rangeBegin = rangeOffset;
+                    rangeOffset += interval.rangeEnd;
+                    interval.rangeEnd = interval.rangeBegin;
+                    interval.useBegin = useOffset;
+                    useOffset += interval.useEnd;
+                    interval.useEnd = interval.useBegin;
+                }
+                rangePool.resize(ranges.size());
+                for (size_t i = ranges.size(); i-- > 0;)
+                {
+                    rangePool[intervals[rangeTemps[i]].rangeEnd++] = ranges[i];
+                }
+                usePool.resize(uses.size());
+                for (size_t i = uses.size(); i-- > 0;)
+                {
+                    usePool[intervals[uses[i].first].useEnd++] = uses[i].second;
+                }
+
+                std::vector<std::pair<int32_t, int32_t>> order;
+                for (int32_t t = Frame::REGISTER_COUNT; t < count; t++)
+                {
+                    if (intervals[t].rangeBegin != intervals[t].rangeEnd)
+                    {
+                        order.push_back({start(t), t});
+                    }
+                }
+                std::sort(order.begin(), order.end());
+                unhandled.clear();
+                for (auto &o : order)
+                {
+                    unhandled.push_back(o.second);
+                }
+                nextUnhandled = 0;
+                for (int32_t reg = 0; reg < Frame::REGISTER_COUNT && reg < count; reg++)
+                {
+                    fixedCursor[reg] = intervals[reg].rangeBegin;
+                }
+            }
+
+            // Cuts the interval at pos, which is after its start, and
+            // returns the part from pos on, or NONE if nothing is left there.
+            // The tail gets a copy of its ranges, as the range across pos
+            // becomes two.
+            int32_t split(int32_t index, int32_t pos)
+            {
+                if (pos >= end(index))
+                {
+                    return Assem::NONE;
+                }
+                auto k = (uint32_t) (firstEnding(rangesBegin(index), rangesEnd(index), pos) - rangePool.data());
+                Interval tail = intervals[index];
+                tail.begin = pos;
+                tail.reg = Assem::NONE;
+                tail.spilled = false;
+                tail.rangeBegin = (uint32_t) rangePool.size();
+                for (auto i = k; i < intervals[index].rangeEnd; i++)
+                {
+                    rangePool.push_back(rangePool[i]);
+                }
+                tail.rangeEnd = (uint32_t) rangePool.size();
+                if (rangePool[tail.rangeBegin].from < pos)
+                {
+                    rangePool[tail.rangeBegin].from = pos;
+                    rangePool[k].to = pos;
+                    k++;
+                }
+                intervals[index].rangeEnd = k;
+                auto uses = usePool.begin();
+                tail.useBegin = (uint32_t) (std::lower_bound(uses + tail.useBegin, uses + tail.useEnd, pos) - uses);
+                intervals[index].useEnd = tail.useBegin;
+                auto tailIndex = (int32_t) intervals.size();
+                intervals[index].next = tailIndex;
+                intervals.push_back(tail);
+                return tailIndex;
+            }
+
+            void addSplitPart(int32_t index)
+            {
+                if (index != Assem::NONE)
+                {
+                    splitParts.push({start(index), index});
+                }
+            }
+
+            // Puts the interval on the stack from its start to the block
+            // before its next use outside the block of position
+            void spill(int32_t index, int32_t position)
+            {
+                intervals[index].reg = Assem::NONE;
+                intervals[index].spilled = true;
+                int32_t use = nextUse(index, nextBoundary(position));
+                int32_t at = use == END ? Assem::NONE : lastBoundary(position, use);
+                if (at != Assem::NONE)
+                {
+                    addSplitPart(split(index, at));
+                }
+            }
+
+            // Gives the interval reg up to blockedAt, splitting off the rest
+            void assign(int32_t index, int32_t reg, int32_t blockedAt)
+            {
+                if (blockedAt < end(index))
+                {
+                    addSplitPart(split(index, lastBoundary(start(index), blockedAt)));
+                }
+                intervals[index].reg = reg;
+                active.push_back(index);
+            }
+
+            // Register of the hint's part just before the interval starts
+            int32_t hintRegister(int32_t index) const
+            {
+                int32_t other = hint[intervals[index].temp];
+                if (other == Assem::NONE || Assem::isRegister(other))
+                {
+                    return other;
+                }
+                return location(other, std::max(start(index) - 1, 0));
+            }
+
+            bool tryAllocateFree(int32_t current, int32_t position)
+            {
+                int32_t freeUntil[Frame::REGISTER_COUNT];
+                for (auto reg : COLORS)
+                {
+                    freeUntil[reg] = intersectFixed(reg, current, position);
+                }
+                for (auto index : active)
+                {
+                    freeUntil[intervals[index].reg] = 0;
+                }
+                for (auto index : inactive)
+                {
+                    auto &reg = freeUntil[intervals[index].reg];
+                    if (reg > position)
+                    {
+                        reg = std::min(reg, intersect(index, current, position));
+                    }
+                }
+                int32_t best = hintRegister(current);
+                if (best == Assem::NONE || !isAllocated(best) || freeUntil[best] < end(current))
+                {
+                    best = COLORS[0];
+                    for (auto reg : COLORS)
+                    {
+                        if (freeUntil[reg] > freeUntil[best])
+                        {
+                            best = reg;
+                        }
+                    }
+                }
+                if (freeUntil[best] <= position ||
+                    (freeUntil[best] < end(current) && lastBoundary(position, freeUntil[best]) == Assem::NONE))
+                {
+                    return false;
+                }
+                assign(current, best, freeUntil[best]);
+                return true;
+            }
+
+            // Takes the register whose holders are used last, moving them
+            // to the stack from the start of the current block, unless the
+            // current interval is used later still
+            void allocateBlocked(int32_t current, int32_t position)
+            {
+                int32_t use[Frame::REGISTER_COUNT];
+                int32_t blockedAt[Frame::REGISTER_COUNT];
+                for (auto reg : COLORS)
+                {
+                    use[reg] = END;
+                    blockedAt[reg] = intersectFixed(reg, current, position);
+                }
+                for (auto index : active)
+                {
+                    auto reg = intervals[index].reg;
+                    use[reg] = std::min(use[reg], nextUse(index, position));
+                }
+                for (auto index : inactive)
+                {
+                    auto reg = intervals[index].reg;
+                    if (intersect(index, current, position) != END)
+                    {
+                        use[reg] = std::min(use[reg], nextUse(index, position));
+                    }
+                }
+                int32_t best = Assem::NONE;
+                for (auto reg : COLORS)
+                {
+                    if (blockedAt[reg] <= position ||
+                        (blockedAt[reg] < end(current) && lastBoundary(position, blockedAt[reg]) == Assem::NONE))
+                    {
+                        continue;
+                    }
+                    if (best == Assem::NONE || use[reg] > use[best])
+                    {
+                        best = reg;
+                    }
+                }
+                int32_t firstUse = nextUse(current, position);
+                if (best == Assem::NONE || firstUse == END || use[best] < firstUse)
+                {
+                    spill(current, position);
+                    return;
+                }
+                int32_t from = blockStart(position);
+                auto evict = [this, best, current, position, from](std::vector<int32_t> &list, bool checkOverlap)
+                {
+                    for (size_t i = 0; i < list.size();)
+                    {
+                        int32_t index = list[i];
+                        if (intervals[index].reg != best ||
+                            (checkOverlap && intersect(index, current, position) == END))
+                        {
+                            i++;
+                            continue;
+                        }
+                        list[i] = list.back();
+                        list.pop_back();
+                        int32_t tail = start(index) < from ? split(index, from) : index;
+                        if (tail != Assem::NONE)
+                        {
+                            spill(tail, position);
+                        }
+                    }
+                };
+                evict(active, false);
+                evict(inactive, true);
+                assign(current, best, blockedAt[best]);
+            }
+
+            // The unhandled part that starts first, or NONE
+            int32_t nextPart()
+            {
+                bool first = nextUnhandled < unhandled.size();
+                if (!splitParts.empty() && (!first || splitParts.top().first < start(unhandled[nextUnhandled])))
+                {
+                    int32_t index = splitParts.top().second;
+                    splitParts.pop();
+                    return index;
+                }
+                return first ? unhandled[nextUnhandled++] : Assem::NONE;
+            }
+
+            void run()
+            {
+                for (int32_t current = nextPart(); current != Assem::NONE; current = nextPart())
+                {
+                    int32_t position = start(current);
+                    stillActive.clear();
+                    stillInactive.clear();
+                    for (auto list : {&active, &inactive})
+                    {
+                        for (auto index : *list)
+                        {
+                            if (end(index) > position)
+                            {
+                                (covers(index, position) ? stillActive : stillInactive).push_back(index);
+                            }
+                        }
+                    }
+                    active.swap(stillActive);
+                    inactive.swap(stillInactive);
+                    if (!tryAllocateFree(current, position))
+                    {
+                        allocateBlocked(current, position);
+                    }
+                }
+            }
+
+            // Register of the temp at pos, NONE for its stack slot
+            int32_t location(int32_t temp, int32_t pos) const
+            {
+                if (Assem::isRegister(temp))
+                {
+                    return temp;
+                }
+                int32_t index = temp;
+                while (intervals[index].next != Assem::NONE && intervals[intervals[index].next].begin <= pos)
+                {
+                    index = intervals[index].next;
+                }
+                return intervals[index].reg;
+            }
+
+            bool liveAt(int32_t temp, int32_t pos) const
+            {
+                int32_t index = temp;
+                while (intervals[index].next != Assem::NONE && intervals[intervals[index].next].begin <= pos)
+                {
+                    index = intervals[index].next;
+                }
+                return covers(index, pos);
+            }
+
+            Assem::Mem slot(int32_t temp)
+            {
+                return Assem::makeMem(Frame::RBP, -Frame::WORD_SIZE * (function.frameWords + slots[temp] + 1));
+            }
+
+            void load(int32_t reg, int32_t temp, std::vector<Assem::Instr> &out)
+            {
+                auto instr = makeInstr(Assem::MOV, Assem::RM);
+                instr.dst = reg;
+                instr.mem = slot(temp);
+                out.push_back(instr);
+            }
+
+            void store(int32_t temp, int32_t reg, std::vector<Assem::Instr> &out)
+            {
+                auto instr = makeInstr(Assem::MOV, Assem::MR);
+                instr.src = reg;
+                instr.mem = slot(temp);
+                out.push_back(instr);
+            }
+
+            void move(int32_t dst, int32_t src, std::vector<Assem::Instr> &out)
+            {
+                auto instr = makeInstr(Assem::MOV, Assem::RR);
+                instr.dst = dst;
+                instr.src = src;
+                out.push_back(instr);
+            }
+
+            // Moves on the edge from pred to succ. Stores go first, while
+            // every register still holds its temp, and loads last, after
+            // the registers they fill have been read. A cycle of register
+            // moves goes through a scratch register.
+            std::vector<Assem::Instr> resolve(size_t pred, size_t succ)
+            {
+                std::vector<Assem::Instr> out;
+                auto &from = function.blocks[pred];
+                auto &to = function.blocks[succ];
+                int32_t fromPos = std::max(2 * (int32_t) from.end - 1, 2 * (int32_t) from.begin);
+                int32_t toPos = 2 * (int32_t) to.begin;
+                std::vector<Move> moves;
+                for (auto temp : liveOut[pred])
+                {
+                    if (Assem::isRegister(temp))
+                    {
+                        continue;
+                    }
+                    bool live = to.begin == to.end
+                                ? std::binary_search(liveOut[succ].begin(), liveOut[succ].end(), temp)
+                                : liveAt(temp, toPos);
+                    int32_t src = location(temp, fromPos);
+                    int32_t dst = location(temp, toPos);
+                    if (live && src != dst)
+                    {
+                        moves.push_back({temp, src, dst});
+                    }
+                }
+                for (auto &m : moves)
+                {
+                    if (m.to == Assem::NONE)
+                    {
+                        store(m.temp, m.from, out);
+                    }
+                }
+                std::vector<Move> pending;
+                for (auto &m : moves)
+                {
+                    if (m.from != Assem::NONE && m.to != Assem::NONE)
+                    {
+                        pending.push_back(m);
+                    }
+                }
+                while (!pending.empty())
+                {
+                    bool progress = false;
+                    for (size_t i = 0; i < pending.size(); i++)
+                    {
+                        bool read = false;
+                        for (auto &other : pending)
+                        {
+                            read = read || other.from == pending[i].to;
+                        }
+                        if (!read)
+                        {
+                            move(pending[i].to, pending[i].from, out);
+                            pending[i] = pending.back();
+                            pending.pop_back();
+                            progress = true;
+                            break;
+                        }
+                    }
+                    if (!progress)
+                    {
+                        // Every destination is still read: save one
+                        auto saved = pending.back().to;
+                        move(SCRATCH[0], saved, out);
+                        for (auto &other : pending)
+                        {
+                            if (other.from == saved)
+                            {
+                                other.from = SCRATCH[0];
+                            }
+                        }
+                    }
+                }
+                for (auto &m : moves)
+                {
+                    if (m.from == Assem::NONE)
+                    {
+                        load(m.to, m.temp, out);
+                    }
+                }
+                return out;
+            }
+
+            // Rewrites the temps of instr to their registers. A temp on the
+            // stack is loaded into a scratch register before and stored
+            // after; when three operands are on the stack, the base and the
+            // index are folded into one address first.
+            void rewrite(const Assem::Instr &original, int32_t pos, std::vector<Assem::Instr> &out)
+            {
+                auto instr = original;
+                auto onStack = [this, pos](int32_t temp)
+                {
+                    return temp != Assem::NONE && !Assem::isRegister(temp) && location(temp, pos) == Assem::NONE;
+                };
+                auto place = [this, pos](int32_t &temp)
+                {
+                    if (temp != Assem::NONE)
+                    {
+                        temp = location(temp, pos);
+                    }
+                };
+                bool dst = onStack(instr.dst);
+                bool src = onStack(instr.src);
+                if (!dst && !src && !onStack(instr.mem.base) && !onStack(instr.mem.index))
+                {
+                    place(instr.dst);
+                    place(instr.src);
+                    place(instr.mem.base);
+                    place(instr.mem.index);
+                    if (Assem::isMove(instr) && instr.dst == instr.src)
+                    {
+                        function.eliminatedMoves++;
+                        return;
+                    }
+                    out.push_back(instr);
+                    return;
+                }
+                if (Assem::isMove(instr))
+                {
+                    if (instr.dst == instr.src)
+                    {
+                        function.eliminatedMoves++;
+                    }
+                    else if (dst && src)
+                    {
+                        load(SCRATCH[0], instr.src, out);
+                        store(instr.dst, SCRATCH[0], out);
+                        out.back().kind = instr.kind;
+                    }
+                    else if (dst)
+                    {
+                        store(instr.dst, location(instr.src, pos), out);
+                        out.back().kind = instr.kind;
+                    }
+                    else
+                    {
+                        load(location(instr.dst, pos), instr.src, out);
+                        out.back().kind = instr.kind;
+                    }
+                    return;
+                }
+                if (instr.opcode == Assem::MOV && instr.form == Assem::RI)
+                {
+                    auto direct = makeInstr(Assem::MOV, Assem::MI);
+                    direct.imm = instr.imm;
+                    direct.mem = slot(instr.dst);
+                    out.push_back(direct);
+                    return;
+                }
+
+                std::vector<int32_t> uses, defs;
+                Assem::getUses(original, uses);
+                Assem::getDefs(original, defs);
+                // Temps on the stack and their scratch registers
+                std::vector<std::pair<int32_t, int32_t>> scratch;
+                int32_t free = 0;
+                auto rename = [&scratch](int32_t &temp)
+                {
+                    for (auto &s : scratch)
+                    {
+                        if (s.first == temp)
+                        {
+                            temp = s.second;
+                            return true;
+                        }
+                    }
+                    return false;
+                };
+                int32_t distinct = 0;
+                std::vector<int32_t> seen;
+                for (auto temp : {instr.dst, instr.src, instr.mem.base, instr.mem.index})
+                {
+                    if (onStack(temp) && std::find(seen.begin(), seen.end(), temp) == seen.end())
+                    {
+                        seen.push_back(temp);
+                        distinct++;
+                    }
+                }
+                if (distinct > 2)
+                {
+                    load(SCRATCH[0], instr.mem.base, out);
+                    load(SCRATCH[1], instr.mem.index, out);
+                    auto lea = makeInstr(Assem::LEA, Assem::RM);
+                    lea.dst = SCRATCH[0];
+                    lea.mem = instr.mem;
+                    lea.mem.base = SCRATCH[0];
+                    lea.mem.index = SCRATCH[1];
+                    out.push_back(lea);
+                    instr.mem = Assem::makeMem(SCRATCH[0], 0);
+                    free = 1;
+                }
+                for (auto temp : {instr.dst, instr.src, instr.mem.base, instr.mem.index})
+                {
+                    int32_t copy = temp;
+                    if (onStack(temp) && !rename(copy))
+                    {
+                        scratch.push_back({temp, SCRATCH[free++]});
+                    }
+                }
+                for (auto &s : scratch)
+                {
+                    if (std::find(uses.begin(), uses.end(), s.first) != uses.end())
+                    {
+                        load(s.second, s.first, out);
+                    }
+                }
+                for (auto temp : {&instr.dst, &instr.src, &instr.mem.base, &instr.mem.index})
+                {
+                    if (!rename(*temp))
+                    {
+                        place(*temp);
+                    }
+                }
+                out.push_back(instr);
+                for (auto &s : scratch)
+                {
+                    if (std::find(defs.begin(), defs.end(), s.first) != defs.end())
+                    {
+                        store(s.first, s.second, out);
+                    }
+                }
+            }
+
+            static bool endsWithJump(const Assem::Function &function, const Assem::Block &block)
+            {
+                if (block.end == block.begin)
+                {
+                    return false;
+                }
+                auto opcode = function.instrs[block.end - 1].opcode;
+                return opcode == Assem::JMP || opcode == Assem::JCC;
+            }
+
+            // Replaces every temp and adds the moves of the edges: at the
+            // end of a block with one successor, else at the start of a
+            // block with one predecessor, else in a block of their own. A
+            // block of its own on a fall through edge goes right after the
+            // predecessor, one on a jump after the last block, which then
+            // jumps over them.
+            void rewriteProgram()
+            {
+                slots.assign((size_t) function.tempCount, Assem::NONE);
+                for (auto &interval : intervals)
+                {
+                    if (interval.spilled && slots[interval.temp] == Assem::NONE)
+                    {
+                        slots[interval.temp] = function.spillWords++;
+                        function.spilledTemps++;
+                    }
+                }
+
+                auto count = function.blocks.size();
+                std::vector<std::vector<Assem::Instr>> atStart(count), atEnd(count), fallEdge(count), jumpEdge(count);
+                std::vector<char> splitFall(count, 0), splitJump(count, 0);
+                for (size_t p = 0; p < count; p++)
+                {
+                    for (auto s : graph.succs[p])
+                    {
+                        auto moves = resolve(p, (size_t) s);
+                        if (moves.empty())
+                        {
+                            continue;
+                        }
+                        if (graph.succs[p].size() == 1)
+                        {
+                            atEnd[p].insert(atEnd[p].end(), moves.begin(), moves.end());
+                        }
+                        else if (graph.preds[s].size() == 1)
+                        {
+                            atStart[s].insert(atStart[s].end(), moves.begin(), moves.end());
+                        }
+                        else if ((size_t) s == p + 1)
+                        {
+                            fallEdge[p].swap(moves);
+                            splitFall[p] = 1;
+                        }
+                        else
+                        {
+                            jumpEdge[p].swap(moves);
+                            splitJump[p] = 1;
+                        }
+                    }
+                }
+
+                // New index of every old block, then of the blocks added
+                // for jump edges and of the block after them
+                std::vector<int32_t> remap(count);
+                int32_t next = 0;
+                for (size_t b = 0; b < count; b++)
+                {
+                    remap[b] = next++;
+                    next += splitFall[b];
+                }
+                bool jumpBlocks = std::find(splitJump.begin(), splitJump.end(), 1) != splitJump.end();
+                std::vector<int32_t> jumpBlock(count, Assem::NONE);
+                if (jumpBlocks)
+                {
+                    next++;
+                    for (size_t b = 0; b < count; b++)
+                    {
+                        if (splitJump[b])
+                        {
+                            jumpBlock[b] = next++;
+                        }
+                    }
+                }
+                int32_t exitBlock = next;
+
+                std::vector<Assem::Instr> instrs;
+                std::vector<Assem::Block> blocks;
+                instrs.reserve(function.instrs.size());
+                auto open = [&instrs, &blocks](int32_t label)
+                {
+                    blocks.push_back({label, (uint32_t) instrs.size(), (uint32_t) instrs.size()});
+                };
+                auto close = [&instrs, &blocks]()
+                {
+                    blocks.back().end = (uint32_t) instrs.size();
+                };
+                auto jump = [&instrs](int32_t target)
+                {
+                    auto instr = makeInstr(Assem::JMP, Assem::L);
+                    instr.target = target;
+                    instrs.push_back(instr);
+                };
+                for (size_t b = 0; b < count; b++)
+                {
+                    auto &block = function.blocks[b];
+                    open(block.label);
+                    instrs.insert(instrs.end(), atStart[b].begin(), atStart[b].end());
+                    auto last = endsWithJump(function, block) ? block.end - 1 : block.end;
+                    for (auto i = block.begin; i < last; i++)
+                    {
+                        rewrite(function.instrs[i], 2 * (int32_t) i, instrs);
+                    }
+                    instrs.insert(instrs.end(), atEnd[b].begin(), atEnd[b].end());
+                    if (last < block.end)
+                    {
+                        auto instr = function.instrs[last];
+                        if (instr.form == Assem::L)
+                        {
+                            instr.target = splitJump[b] ? jumpBlock[b] : remap[instr.target];
+                            instrs.push_back(instr);
+                        }
+                        else
+                        {
+                            rewrite(instr, 2 * (int32_t) last, instrs);
+                        }
+                    }
+                    close();
+                    if (splitFall[b])
+                    {
+                        open(Assem::NONE);
+                        instrs.insert(instrs.end(), fallEdge[b].begin(), fallEdge[b].end());
+                        close();
+                    }
+                }
+                if (jumpBlocks)
+                {
+                    open(Assem::NONE);
+                    jump(exitBlock);
+                    close();
+                    for (size_t b = 0; b < count; b++)
+                    {
+                        if (splitJump[b])
+                        {
+                            open(Assem::NONE);
+                            instrs.insert(instrs.end(), jumpEdge[b].begin(), jumpEdge[b].end());
+                            jump(remap[function.instrs[function.blocks[b].end - 1].target]);
+                            close();
+                        }
+                    }
+                    open(Assem::NONE);
+                    close();
+                }
+                function.instrs.swap(instrs);
+                function.blocks.swap(blocks);
+            }
+
+        public:
+            explicit Allocator(Assem::Function &function) : function(function)
+            {}
+
+            void allocate()
+            {
+                buildIntervals();
+                run();
+                rewriteProgram();
+            }
+        };
+    }
+
+    void allocate(Assem::Function &function)
+    {
+        Allocator(function).allocate();
+    }
+}
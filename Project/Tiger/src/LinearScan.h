@@ -0,0 +1,23 @@
+//
+// Linear scan register allocation
+//
+
+#ifndef SRC_LINEARSCAN_H
+#define SRC_LINEARSCAN_H
+
+#include "Assem.h"
+
+namespace LinearScan
+{
+    // Maps every virtual temp to a machine register or a stack slot in one
+    // pass over the live intervals of the instructions in block order
+    // (Wimmer and Mössenböck). An interval keeps its lifetime holes, so
+    // another one can use its register in between, and is split only where
+    // a block starts; moves on the edges then bring each temp to where the
+    // next block wants it. R10 and R11 are not allocated and carry the
+    // operands of temps on the stack. Faster than RegAlloc::color on large
+    // functions, but spills more and removes fewer moves.
+    void allocate(Assem::Function &function);
+}
+
+#endif //SRC_LINEARSCAN_H
@@ -0,0 +1,89 @@
+//
+// Growable text buffer the IR printers write into
+//
+
+#include "OutBuffer.h"
+
+namespace
+{
+    // Indentation is copied out of one run of spaces built at start-up
+    const std::string blanks(256, ' ');
+}
+
+OutBuffer::OutBuffer(size_t capacity)
+        : stream(nullptr)
+{
+    data.reserve(capacity);
+}
+
+OutBuffer &OutBuffer::operator<<(int value)
+{
+    char digits[12];
+    char *end = digits + sizeof(digits);
+    char *p = end;
+    // Work on the negative value so INT_MIN needs no special case
+    int rest = value < 0 ? value : -value;
+    do
+    {
+        *--p = (char) ('0' - rest % 10);
+        rest /= 10;
+    } while (rest != 0);
+    if (value < 0)
+    {
+        *--p = '-';
+    }
+    data.append(p, end - p);
+    return *this;
+}
+
+void OutBuffer::blank(int n)
+{
+    while (n > 0)
+    {
+        int chunk = n < (int) blanks.size() ? n : (int) blanks.size();
+        data.append(blanks, 0, chunk);
+        n -= chunk;
+    }
+}
+
+size_t OutBuffer::size() const
+{
+    return data.size();
+}
+
+const std::string &OutBuffer::str() const
+{
+    return data;
+}
+
+void OutBuffer::clear()
+{
+    data.clear();
+}
+
+void OutBuffer::writeTo(std::ostream &out)
+{
+    out.write(data.data(), data.size());
+    data.clear();
+}
+
+void OutBuffer::writeIfFull(std::ostream &out)
+{
+    if (data.size() >= FLUSH_SIZE)
+    {
+        writeTo(out);
+    }
+}
+
+void OutBuffer::streamTo(std::ostream *out)
+{
+    stream = out;
+}
+
+void OutBuffer::writeIfFull()
+{
+    if (stream != nullptr)
+    {
+        writeIfFull(*stream);
+    }
+}
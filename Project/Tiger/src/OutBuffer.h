@@ -0,0 +1,72 @@
+//
+// Growable text buffer the IR printers write into
+//
+
+#ifndef SRC_OUTBUFFER_H
+#define SRC_OUTBUFFER_H
+
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// Text is collected in memory and handed to the stream in large chunks,
+// so printing a tree costs no flush and no allocation per line.
+class OutBuffer
+{
+    std::string data;
+    std::ostream *stream;
+
+public:
+    // Bytes collected before the text is handed to the output stream
+    static const size_t FLUSH_SIZE = 1 << 20;
+
+    // Room for a full buffer and whatever the last piece put past it
+    static const size_t FLUSH_CAPACITY = FLUSH_SIZE + FLUSH_SIZE / 4;
+
+    explicit OutBuffer(size_t capacity = 0);
+
+    OutBuffer &operator<<(const std::string &text)
+    {
+        data.append(text);
+        return *this;
+    }
+
+    OutBuffer &operator<<(const char *text)
+    {
+        data.append(text, std::strlen(text));
+        return *this;
+    }
+
+    OutBuffer &operator<<(char c)
+    {
+        data.push_back(c);
+        return *this;
+    }
+
+    OutBuffer &operator<<(int value);
+
+    // Appends n spaces
+    void blank(int n);
+
+    size_t size() const;
+
+    const std::string &str() const;
+
+    // Empties the buffer but keeps its storage for reuse
+    void clear();
+
+    // Writes the buffered text to out and empties the buffer
+    void writeTo(std::ostream &out);
+
+    // Writes the buffered text to out once it reaches FLUSH_SIZE
+    void writeIfFull(std::ostream &out);
+
+    // Sets the stream a printer that only sees the buffer writes to, or
+    // none when the text has to stay in the buffer
+    void streamTo(std::ostream *out);
+
+    // writeIfFull to the stream set with streamTo, if there is one
+    void writeIfFull();
+};
+
+#endif //SRC_OUTBUFFER_H
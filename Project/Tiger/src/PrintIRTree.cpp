@@ -3,8 +3,14 @@
 //
 
 #include "PrintIRTree.h"
-
-PrintIRTree::PrintIRTree(const std::shared_ptr<Frame::FragList> &fragList) : fragList(fragList)
+#include "ThreadPool.h"
+#include <vector>
+#include <mutex>
+#include <cerrno>
+#include <sys/stat.h>
+
+PrintIRTree::PrintIRTree(const std::shared_ptr<Frame::FragList> &fragList)
+        : fragList(fragList), collapseSeq(false)
 {}
 
 static char bin_oper[][12] = {
@@ -13,416 +19,801 @@ static char bin_oper[][12] = {
 static char rel_oper[][12] = {
         "EQ", "NE", "LT", "GT", "LE", "GE"};
 
-void printBlank(int i, std::ostream &out)
+namespace
 {
-    out << std::string(i, ' ');
+    // One step of printing a tree in text form. Children are printed by
+    // pushing steps instead of recursing, so deep trees do not overflow the
+    // stack.
+    struct TextStep
+    {
+        enum Kind
+        {
+            STM, EXP, TEXT, CJUMP_LABELS
+        } kind;
+        const IR::Stm *node;
+        int indent;
+        // TEXT: written after indent blanks
+        const char *text;
+    };
+
+    std::string labelName(const std::shared_ptr<Temporary::Label> &label)
+    {
+        return label ? label->getLabelName() : "NULL";
+    }
+
+    void printTree(const TextStep &root, OutBuffer &outFile);
 }
 
-void PrintIRTree::printStm(std::shared_ptr<IR::Stm> stm, std::ostream &outFile, int i)
+void PrintIRTree::printStm(std::shared_ptr<IR::Stm> stm, OutBuffer &outFile, int i)
 {
-    switch (stm->getStmType())
+    printTree({TextStep::STM, stm.get(), i, nullptr}, outFile);
+}
+
+void PrintIRTree::printExp(std::shared_ptr<IR::Exp> exp, OutBuffer &outFile, int i)
+{
+    printTree({TextStep::EXP, exp.get(), i, nullptr}, outFile);
+}
+
+namespace
+{
+    void printTree(const TextStep &root, OutBuffer &outFile)
     {
-        case IR::SEQ:
+        std::vector<TextStep> todo{root};
+        // Steps of the current node in printing order, pushed onto todo reversed
+        std::vector<TextStep> steps;
+        while (!todo.empty())
         {
-            auto seq = std::dynamic_pointer_cast<IR::Seq>(stm);
-            /*   这是用来占位的   */outFile << "| — SEQ" << std::endl;
-            printBlank(i, outFile);
-            outFile << "      ";
-            printStm(seq->getLeft(), outFile, i + 5);
-            printBlank(i, outFile);
-            outFile << "      ";
-            printStm(seq->getRight(), outFile, i + 5);
-            outFile << std::endl;
-            break;
-        }
+            // A single tree can print to gigabytes, so it goes out as it is printed
+            outFile.writeIfFull();
+            TextStep step = todo.back();
+            todo.pop_back();
+            int i = step.indent;
+            steps.clear();
+            auto text = [&steps, i](const char *chars)
+            {
+                steps.push_back({TextStep::TEXT, nullptr, i, chars});
+            };
+            auto stm = [&steps](const IR::Stm *node, int indent)
+            {
+                steps.push_back({TextStep::STM, node, indent, nullptr});
+            };
+            auto exp = [&steps](const IR::Exp *node, int indent)
+            {
+                steps.push_back({TextStep::EXP, node, indent, nullptr});
+            };
 
-        case IR::LABEL:
-        {
-            auto label = std::dynamic_pointer_cast<IR::Label>(stm);
-            /*   这是用来占位的   */outFile << "| — LABEL" << std::endl;
-            printBlank(i, outFile);
-            outFile << "       | — " << label->getLabel()->getLabelName();
-            outFile << std::endl;
-            break;
+            if (step.kind == TextStep::TEXT)
+            {
+                outFile.blank(i);
+                outFile << step.text;
+                continue;
+            }
+            if (step.kind == TextStep::CJUMP_LABELS)
+            {
+                auto cjump = static_cast<const IR::CJump *>(step.node);
+                outFile.blank(i);
+                outFile << "       | — " << labelName(cjump->getLabelTrue()) << '\n';
+                outFile.blank(i);
+                outFile << "       | — " << labelName(cjump->getLabelFalse()) << '\n';
+                continue;
+            }
+            if (step.kind == TextStep::STM)
+            {
+                switch (step.node->getStmType())
+                {
+                    case IR::SEQ:
+                    {
+                        auto seq = static_cast<const IR::Seq *>(step.node);
+                        outFile << "| — SEQ" << '\n';
+                        for (auto &child : seq->getStms())
+                        {
+                            text("      ");
+                            stm(child.get(), i + 5);
+                        }
+                        steps.push_back({TextStep::TEXT, nullptr, 0, "\n"});
+                        break;
+                    }
+
+                    case IR::LABEL:
+                    {
+                        auto label = static_cast<const IR::Label *>(step.node);
+                        outFile << "| — LABEL" << '\n';
+                        outFile.blank(i);
+                        outFile << "       | — " << label->getLabel()->getLabelName();
+                        outFile << '\n';
+                        break;
+                    }
+
+                    case IR::JUMP:
+                    {
+                        auto jump = static_cast<const IR::Jump *>(step.node);
+                        outFile << "| — JUMP" << '\n';
+                        text("      ");
+                        exp(jump->getExp().get(), i + 6);
+                        steps.push_back({TextStep::TEXT, nullptr, 0, "\n"});
+                        break;
+                    }
+
+                    case IR::CJUMP:
+                    {
+                        auto cjump = static_cast<const IR::CJump *>(step.node);
+                        outFile << "| — CJUMP" << '\n';
+                        outFile.blank(i);
+                        outFile << "       | — " << rel_oper[cjump->getOp()] << '\n';
+                        text("       ");
+                        stm(cjump->getLeft().get(), i + 7);
+                        text("       ");
+                        stm(cjump->getRight().get(), i + 7);
+                        steps.push_back({TextStep::CJUMP_LABELS, cjump, i, nullptr});
+                        break;
+                    }
+
+                    case IR::MOVE:
+                    {
+                        auto move = static_cast<const IR::Move *>(step.node);
+                        outFile << "| — MOVE" << '\n';
+                        text("      ");
+                        stm(move->getDst().get(), i + 5);
+                        text("      ");
+                        stm(move->getSrc().get(), i + 5);
+                        steps.push_back({TextStep::TEXT, nullptr, 0, "\n"});
+                        break;
+                    }
+
+                    case IR::EXP:
+                    {
+                        outFile << "| — EXP" << '\n';
+                        text("      ");
+                        exp(static_cast<const IR::Exp *>(step.node), i + 6);
+                        steps.push_back({TextStep::TEXT, nullptr, 0, "\n"});
+                        break;
+                    }
+                }
+            }
+            else
+            {
+                auto node = static_cast<const IR::Exp *>(step.node);
+                switch (node->getExpType())
+                {
+                    case IR::BINOP:
+                    {
+                        auto binop = static_cast<const IR::Binop *>(node);
+                        outFile << "| — BINOP" << '\n';
+                        outFile.blank(i);
+                        outFile << "       | — " << bin_oper[binop->getOp()] << '\n';
+                        text("       ");
+                        stm(binop->getLeft().get(), i + 6);
+                        text("       ");
+                        stm(binop->getRight().get(), i + 6);
+                        steps.push_back({TextStep::TEXT, nullptr, 0, "\n"});
+                        break;
+                    }
+
+                    case IR::MEM:
+                    {
+                        auto mem = static_cast<const IR::Mem *>(node);
+                        outFile << "| — MEM" << '\n';
+                        text("      ");
+                        exp(mem->getExp().get(), i + 6);
+                        steps.push_back({TextStep::TEXT, nullptr, 0, "\n"});
+                        break;
+                    }
+
+                    case IR::TEMP:
+                    {
+                        auto temp = static_cast<const IR::Temp *>(node);
+                        outFile << "| — TEMP " << temp->getTemp()->getTempName() << '\n';
+                        break;
+                    }
+
+                    case IR::ESEQ:
+                    {
+                        auto eseq = static_cast<const IR::Eseq *>(node);
+                        outFile << "| — ESEQ" << '\n';
+                        for (auto &child : eseq->getStms())
+                        {
+                            text("      ");
+                            stm(child.get(), i + 5);
+                        }
+                        text("      ");
+                        exp(eseq->getExp().get(), i + 5);
+                        steps.push_back({TextStep::TEXT, nullptr, 0, "\n"});
+                        break;
+                    }
+
+                    case IR::NAME:
+                    {
+                        auto name = static_cast<const IR::Name *>(node);
+                        outFile << "| — NAME " << name->getLabel()->getLabelName() << '\n';
+                        break;
+                    }
+
+                    case IR::CONST:
+                    {
+                        auto constt = static_cast<const IR::Const *>(node);
+                        outFile << "| — CONST " << constt->getConstt() << '\n';
+                        break;
+                    }
+
+                    case IR::CALL:
+                    {
+                        auto call = static_cast<const IR::Call *>(node);
+                        outFile << "| — CALL" << '\n';
+                        text("      ");
+                        exp(call->getFun().get(), i + 6);
+                        for (auto &arg : *call->getArgs())
+                        {
+                            text("      ");
+                            exp(arg.get(), i + 6);
+                        }
+                        steps.push_back({TextStep::TEXT, nullptr, 0, "\n"});
+                        break;
+                    }
+                }
+            }
+            todo.insert(todo.end(), steps.rbegin(), steps.rend());
         }
+    }
+}
 
-        case IR::JUMP:
-        {
-            auto jump = std::dynamic_pointer_cast<IR::Jump>(stm);
-            /*   这是用来占位的   */outFile << "| — JUMP" << std::endl;
-            printBlank(i, outFile);
-            outFile << "      ";
-            printExp(jump->getExp(), outFile, i + 6);
-            outFile << std::endl;
-            break;
-        }
 
-        case IR::CJUMP:
+void PrintIRTree::printFrag(std::shared_ptr<Frame::Frag> frag, OutBuffer &outFile)
+{
+    switch (frag->getKind())
+    {
+        case Frame::STRING_FRAG:
         {
-            auto cjump = std::dynamic_pointer_cast<IR::CJump>(stm);
-            /*   这是用来占位的   */outFile << "| — CJUMP" << std::endl;
-            printBlank(i, outFile);
-            outFile << "       | — " << rel_oper[cjump->getOp()] << std::endl;
-            printBlank(i, outFile);
-            outFile << "       ";
-            printStm(cjump->getLeft(), outFile, i + 7);
-            printBlank(i, outFile);
-            outFile << "       ";
-            printStm(cjump->getRight(), outFile, i + 7);
-            printBlank(i, outFile);
-            outFile << "       | — " << (cjump->getLabelTrue() ? cjump->getLabelTrue()->getLabelName() : "NULL");
-            outFile << std::endl;
-            printBlank(i, outFile);
-            outFile << "       | — " << (cjump->getLabelTrue() ? cjump->getLabelFalse()->getLabelName() : "NULL");
-            outFile << std::endl;
+            auto stringFrag = std::dynamic_pointer_cast<Frame::StringFrag>(frag);
+            printExp(IR::makeName(stringFrag->getLabel()), outFile, 0);
+            outFile << '\n';
             break;
         }
-
-        case IR::MOVE:
+        case Frame::PROC_FRAG:
         {
-            auto move = std::dynamic_pointer_cast<IR::Move>(stm);
-            /*   这是用来占位的   */outFile << "| — MOVE" << std::endl;
-            printBlank(i, outFile);
-            outFile << "      ";
-            printStm(move->getDst(), outFile, i + 5);
-            printBlank(i, outFile);
-            outFile << "      ";
-            printStm(move->getSrc(), outFile, i + 5);
-            outFile << std::endl;
+            auto procFrag = std::dynamic_pointer_cast<Frame::ProcFrag>(frag);
+            if (procFrag->getStmList() != nullptr)
+            {
+                for (auto &stm : *procFrag->getStmList())
+                {
+                    printStm(stm, outFile, 0);
+                }
+            }
+            else
+            {
+                printStm(procFrag->getBody(), outFile, 0);
+            }
+            outFile << '\n';
             break;
         }
-
-        case IR::EXP:
+        default:
         {
-            auto exp = std::dynamic_pointer_cast<IR::Exp>(stm);
-            /*   这是用来占位的   */outFile << "| — EXP" << std::endl;
-            printBlank(i, outFile);
-            outFile << "      ";
-            printExp(exp, outFile, i + 6);
-            outFile << std::endl;
-            break;
+            Tiger::Error error("frag-kind is error");
         }
     }
 }
 
-void PrintIRTree::printExp(std::shared_ptr<IR::Exp> exp, std::ostream &outFile, int i)
+void PrintIRTree::printFrags(std::ostream &outFile,
+                             const std::function<void(std::shared_ptr<Frame::Frag>, OutBuffer &, int)> &print)
 {
-    switch (exp->getExpType())
+    std::vector<std::shared_ptr<Frame::Frag>> frags(fragList->begin(), fragList->end());
+    if (ThreadPool::getThreadNum() <= 1)
     {
-        case IR::BINOP:
+        // One buffer for the whole list, written out whenever it fills up
+        OutBuffer buffer(OutBuffer::FLUSH_CAPACITY);
+        buffer.streamTo(&outFile);
+        for (size_t i = 0; i < frags.size(); i++)
         {
-            auto binop = std::dynamic_pointer_cast<IR::Binop>(exp);
-            /*   这是用来占位的   */outFile << "| — BINOP" << std::endl;
-            printBlank(i, outFile);
-            outFile << "       | — " << bin_oper[binop->getOp()] << std::endl;
-            printBlank(i, outFile);
-            outFile << "       ";
-            printStm(binop->getLeft(), outFile, i + 6);
-            printBlank(i, outFile);
-            outFile << "       ";
-            printStm(binop->getRight(), outFile, i + 6);
-            outFile << std::endl;
-            break;
+            print(frags[i], buffer, (int) i);
         }
-
-        case IR::MEM:
+        buffer.writeTo(outFile);
+        return;
+    }
+    // Text of the fragments finished ahead of their turn
+    std::vector<std::string> texts(frags.size());
+    std::vector<bool> done(frags.size(), false);
+    // First fragment not written yet, and the lock on it, done and outFile
+    size_t next = 0;
+    std::mutex lock;
+    parallelFor(frags.size(), [&frags, &texts, &done, &next, &lock, &outFile, &print](size_t i)
+    {
+        // Each worker keeps its buffer, so only the finished text is allocated
+        thread_local OutBuffer buffer(OutBuffer::FLUSH_SIZE);
+        buffer.clear();
+        bool first;
         {
-            auto mem = std::dynamic_pointer_cast<IR::Mem>(exp);
-            /*   这是用来占位的   */outFile << "| — MEM" << std::endl;
-            printBlank(i, outFile);
-            outFile << "      ";
-            printExp(mem->getExp(), outFile, i + 6);
-            outFile << std::endl;
-            break;
+            std::lock_guard<std::mutex> guard(lock);
+            first = i == next;
         }
-
-        case IR::TEMP:
+        // Nothing else writes until the first fragment is done, so it goes
+        // straight to outFile
+        buffer.streamTo(first ? &outFile : nullptr);
+        print(frags[i], buffer, (int) i);
+        buffer.streamTo(nullptr);
+        if (!first)
         {
-            auto temp = std::dynamic_pointer_cast<IR::Temp>(exp);
-            /*   这是用来占位的   */outFile << "| — TEMP " << temp->getTemp()->getTempName() << std::endl;
-            break;
+            texts[i] = buffer.str();
         }
-
-        case IR::ESEQ:
+        std::lock_guard<std::mutex> guard(lock);
+        if (first)
         {
-            auto eseq = std::dynamic_pointer_cast<IR::Eseq>(exp);
-            /*   这是用来占位的   */outFile << "| — ESEQ" << std::endl;
-            printBlank(i, outFile);
-            outFile << "      ";
-            printStm(eseq->getStm(), outFile, i + 5);
-            printBlank(i, outFile);
-            outFile << "      ";
-            printExp(eseq->getExp(), outFile, i + 5);
-            outFile << std::endl;
-            break;
+            buffer.writeTo(outFile);
+            next++;
         }
-
-        case IR::NAME:
+        else
         {
-            auto name = std::dynamic_pointer_cast<IR::Name>(exp);
-            /*   这是用来占位的   */outFile << "| — NAME " << name->getLabel()->getLabelName() << std::endl;
-            break;
+            done[i] = true;
         }
-
-        case IR::CONST:
+        // Writes the texts that are now first in order and frees them
+        while (next < frags.size() && done[next])
         {
-            auto constt = std::dynamic_pointer_cast<IR::Const>(exp);
-            /*   这是用来占位的   */outFile << "| — CONST " << constt->getConstt() << std::endl;
-            break;
+            outFile.write(texts[next].data(), texts[next].size());
+            std::string().swap(texts[next]);
+            next++;
         }
-
-        case IR::CALL:
-        {
-            auto call = std::dynamic_pointer_cast<IR::Call>(exp);
-            /*   这是用来占位的   */outFile << "| — CALL" << std::endl;
-            printBlank(i, outFile);
-            outFile << "      ";
-            printExp(call->getFun(), outFile, i + 6);
-            for (auto args = call->getArgs()->begin(); args != call->getArgs()->end(); args++)
-            {
-                printBlank(i, outFile);
-                outFile << "      ";
-                printExp((*args), outFile, i + 6);
-            }
-            outFile << std::endl;
-            break;
-        }
-    }
+    });
 }
 
-
 void PrintIRTree::printIRTreeInFile(std::ostream &outFile)
 {
     if (fragList == nullptr)
     {
-        outFile << "FragList is empty" << std::endl;
+        outFile << "FragList is empty" << '\n';
     }
     else
     {
-        for (auto iter = fragList->begin(); iter != fragList->end(); iter++)
+        printFrags(outFile, [this](std::shared_ptr<Frame::Frag> frag, OutBuffer &out, int)
+        {
+            printFrag(frag, out);
+        });
+    }
+}
+
+namespace
+{
+    // One step of printing a tree in dot form. A node is numbered when it
+    // is visited and its edges are written once all its children have
+    // been, so the output matches a recursive preorder walk.
+    struct DotStep
+    {
+        enum Kind
         {
-            switch ((*iter)->getKind())
+            STM, EXP, EDGE
+        } kind;
+        const IR::Stm *node;
+        // STM, EXP: slot that receives the node number
+        // EDGE: slot of the child the edge points to
+        size_t slot;
+        // EDGE: source node and port, the port is s<portIndex> when
+        // portIndex is not negative
+        int from;
+        const char *port;
+        int portIndex;
+    };
+
+    int printTreeDot(const IR::Stm *root, bool isExp, OutBuffer &outFile, int &nodeNum, bool collapseSeq)
+    {
+        std::vector<int> slots{0};
+        std::vector<DotStep> todo{{isExp ? DotStep::EXP : DotStep::STM, root, 0, 0, nullptr, -1}};
+        std::vector<DotStep> steps;
+        std::vector<const IR::Stm *> pending;
+        while (!todo.empty())
+        {
+            outFile.writeIfFull();
+            DotStep step = todo.back();
+            todo.pop_back();
+            if (step.kind == DotStep::EDGE)
             {
-                case Frame::STRING_FRAG:
+                outFile << "\"node" << step.from << "\":";
+                if (step.portIndex >= 0)
                 {
-                    auto stringFrag = std::dynamic_pointer_cast<Frame::StringFrag>((*iter));
-                    printExp(IR::makeName(stringFrag->getLabel()), outFile, 0);
-                    outFile << std::endl;
-                    break;
+                    outFile << "s" << step.portIndex;
                 }
-                case Frame::PROC_FRAG:
+                else
                 {
-                    auto procFrag = std::dynamic_pointer_cast<Frame::ProcFrag>((*iter));
-                    printStm(procFrag->getBody(), outFile, 0);
-                    outFile << std::endl;
-                    break;
+                    outFile << step.port;
                 }
-                default:
+                outFile << " -> \"node" << slots[step.slot] << "\":f1" << '\n';
+                continue;
+            }
+            steps.clear();
+            int mynode = 0;
+            // Visits child and then draws the edge from port to it
+            auto child = [&steps, &slots, &mynode](const IR::Stm *node, bool isExp, const char *port, int portIndex)
+            {
+                size_t slot = slots.size();
+                slots.push_back(0);
+                steps.push_back({isExp ? DotStep::EXP : DotStep::STM, node, slot, 0, nullptr, -1});
+                steps.push_back({DotStep::EDGE, nullptr, slot, mynode, port, portIndex});
+            };
+            // Visits both children before drawing their edges
+            auto children = [&steps, &slots, &mynode](const IR::Stm *left, bool leftIsExp,
+                                                      const IR::Stm *right, bool rightIsExp)
+            {
+                size_t slot = slots.size();
+                slots.push_back(0);
+                slots.push_back(0);
+                steps.push_back({leftIsExp ? DotStep::EXP : DotStep::STM, left, slot, 0, nullptr, -1});
+                steps.push_back({rightIsExp ? DotStep::EXP : DotStep::STM, right, slot + 1, 0, nullptr, -1});
+                steps.push_back({DotStep::EDGE, nullptr, slot, mynode, "f0", -1});
+                steps.push_back({DotStep::EDGE, nullptr, slot + 1, mynode, "f2", -1});
+            };
+
+            if (step.kind == DotStep::STM)
+            {
+                switch (step.node->getStmType())
                 {
-                    Tiger::Error error("frag-kind is error");
+                    case IR::SEQ:
+                    {
+                        auto seq = static_cast<const IR::Seq *>(step.node);
+                        mynode = ++nodeNum;
+                        // A port per statement, with the statements of nested
+                        // SEQs pulled up when collapsing
+                        std::vector<const IR::Stm *> stms;
+                        pending.assign(1, seq);
+                        while (!pending.empty())
+                        {
+                            auto stm = pending.back();
+                            pending.pop_back();
+                            if (stm->getStmType() == IR::SEQ && (stm == seq || collapseSeq))
+                            {
+                                auto &inner = static_cast<const IR::Seq *>(stm)->getStms();
+                                for (auto child = inner.rbegin(); child != inner.rend(); child++)
+                                {
+                                    pending.push_back(child->get());
+                                }
+                            }
+                            else
+                            {
+                                stms.push_back(stm);
+                            }
+                        }
+                        outFile << "node" << mynode << "[label = \"<f1> SEQ";
+                        for (size_t i = 0; i < stms.size(); i++)
+                        {
+                            outFile << "|<s" << (int) i << ">";
+                        }
+                        outFile << "\"]" << '\n';
+                        for (size_t i = 0; i < stms.size(); i++)
+                        {
+                            child(stms[i], false, nullptr, (int) i);
+                        }
+                        break;
+                    }
+
+                    case IR::LABEL:
+                    {
+                        auto label = static_cast<const IR::Label *>(step.node);
+                        mynode = ++nodeNum;
+                        int childnode = ++nodeNum;
+                        outFile << "node" << mynode << "[label = \"<f0>|<f1> LABEL |<f2>\"]" << '\n';
+                        outFile << "node" << childnode << "[label = \"<f0>|<f1> " << label->getLabel()->getLabelName()
+                                << "|<f2>\"]" << '\n';
+                        outFile << "\"node" << mynode << "\":f1 -> \"node" << childnode << "\":f1" << '\n';
+                        break;
+                    }
+
+                    case IR::JUMP:
+                    {
+                        auto jump = static_cast<const IR::Jump *>(step.node);
+                        mynode = ++nodeNum;
+                        outFile << "node" << mynode << "[label = \"<f0>|<f1> JUMP |<f2>\"]" << '\n';
+                        child(jump->getExp().get(), true, "f1", -1);
+                        break;
+                    }
+
+                    case IR::CJUMP:
+                    {
+                        auto cjump = static_cast<const IR::CJump *>(step.node);
+                        mynode = ++nodeNum;
+                        outFile << "node" << mynode << "[label = \"<f0>" << labelName(cjump->getLabelTrue())
+                                << "|<f1> CJUMP: " << rel_oper[cjump->getOp()] << " |<f2>"
+                                << labelName(cjump->getLabelFalse()) << "\"]" << '\n';
+                        children(cjump->getLeft().get(), false, cjump->getRight().get(), false);
+                        break;
+                    }
+
+                    case IR::MOVE:
+                    {
+                        auto move = static_cast<const IR::Move *>(step.node);
+                        mynode = ++nodeNum;
+                        outFile << "node" << mynode << "[label = \"<f0>|<f1> MOVE |<f2>\"]" << '\n';
+                        children(move->getDst().get(), false, move->getSrc().get(), false);
+                        break;
+                    }
+
+                    case IR::EXP:
+                    {
+                        // An expression statement is drawn as the expression
+                        todo.push_back({DotStep::EXP, step.node, step.slot, 0, nullptr, -1});
+                        continue;
+                    }
                 }
             }
+            else
+            {
+                auto node = static_cast<const IR::Exp *>(step.node);
+                mynode = ++nodeNum;
+                switch (node->getExpType())
+                {
+                    case IR::BINOP:
+                    {
+                        auto binop = static_cast<const IR::Binop *>(node);
+                        outFile << "node" << mynode << "[label = \"<f0>|<f1> BINOP: " << bin_oper[binop->getOp()]
+                                << " |<f2>\"]" << '\n';
+                        children(binop->getLeft().get(), false, binop->getRight().get(), false);
+                        break;
+                    }
+
+                    case IR::MEM:
+                    {
+                        auto mem = static_cast<const IR::Mem *>(node);
+                        outFile << "node" << mynode << "[label = \"<f0>|<f1> MEM |<f2>\"]" << '\n';
+                        child(mem->getExp().get(), true, "f1", -1);
+                        break;
+                    }
+
+                    case IR::TEMP:
+                    {
+                        auto temp = static_cast<const IR::Temp *>(node);
+                        outFile << "node" << mynode << "[label = \"<f0>|<f1> TEMP: " << temp->getTemp()->getTempName()
+                                << "|<f2>\"]" << '\n';
+                        break;
+                    }
+
+                    case IR::ESEQ:
+                    {
+                        auto eseq = static_cast<const IR::Eseq *>(node);
+                        auto &stms = eseq->getStms();
+                        outFile << "node" << mynode << "[label = \"<f1> ESEQ";
+                        for (size_t i = 0; i < stms.size(); i++)
+                        {
+                            outFile << "|<s" << (int) i << ">";
+                        }
+                        outFile << "|<f2>\"]" << '\n';
+                        for (size_t i = 0; i < stms.size(); i++)
+                        {
+                            child(stms[i].get(), false, nullptr, (int) i);
+                        }
+                        child(eseq->getExp().get(), true, "f2", -1);
+                        break;
+                    }
+
+                    case IR::NAME:
+                    {
+                        auto name = static_cast<const IR::Name *>(node);
+                        outFile << "node" << mynode << "[label = \"<f0>|<f1> NAME: " << name->getLabel()->getLabelName()
+                                << "|<f2>\"]" << '\n';
+                        break;
+                    }
+
+                    case IR::CONST:
+                    {
+                        auto constt = static_cast<const IR::Const *>(node);
+                        outFile << "node" << mynode << "[label = \"<f0>|<f1> CONST: " << constt->getConstt()
+                                << "|<f2>\"]" << '\n';
+                        break;
+                    }
+
+                    case IR::CALL:
+                    {
+                        auto call = static_cast<const IR::Call *>(node);
+                        outFile << "node" << mynode << "[label = \"<f0>|<f1> CALL |<f2>\"]" << '\n';
+                        child(call->getFun().get(), true, "f0", -1);
+                        for (auto &arg : *call->getArgs())
+                        {
+                            child(arg.get(), true, "f2", -1);
+                        }
+                        break;
+                    }
+                }
+            }
+            slots[step.slot] = mynode;
+            todo.insert(todo.end(), steps.rbegin(), steps.rend());
         }
+        return slots[0];
     }
 }
 
-static int nodeNum = 0;
-
-int PrintIRTree::printStmDot(std::shared_ptr<IR::Stm> stm, std::ostream &outFile)
+int PrintIRTree::printStmDot(std::shared_ptr<IR::Stm> stm, OutBuffer &outFile, int &nodeNum)
 {
-    switch (stm->getStmType())
-    {
-        case IR::SEQ:
-        {
-            auto seq = std::dynamic_pointer_cast<IR::Seq>(stm);
-            int mynode = ++nodeNum;
-            outFile << "node" << mynode << "[label = \"<f0>|<f1> SEQ |<f2>\"]" << std::endl;
-            int leftNum = printStmDot(seq->getLeft(), outFile);
-            int rightNum = printStmDot(seq->getRight(), outFile);
-            outFile << "\"node" << mynode << "\":f0 -> \"node" << leftNum << "\":f1" << std::endl;
-            outFile << "\"node" << mynode << "\":f2 -> \"node" << rightNum << "\":f1" << std::endl;
-            return mynode;
-        }
-
-        case IR::LABEL:
-        {
-            auto label = std::dynamic_pointer_cast<IR::Label>(stm);
-            int mynode = ++nodeNum;
-            int childnode = ++nodeNum;
-            outFile << "node" << mynode << "[label = \"<f0>|<f1> LABEL |<f2>\"]" << std::endl;
-            outFile << "node" << childnode << "[label = \"<f0>|<f1> " << label->getLabel()->getLabelName() << "|<f2>\"]"
-                    << std::endl;
-            outFile << "\"node" << mynode << "\":f1 -> \"node" << childnode << "\":f1" << std::endl;
-            return mynode;
-        }
+    return printTreeDot(stm.get(), false, outFile, nodeNum, collapseSeq);
+}
 
-        case IR::JUMP:
-        {
-            auto jump = std::dynamic_pointer_cast<IR::Jump>(stm);
-            int mynode = ++nodeNum;
-            outFile << "node" << mynode << "[label = \"<f0>|<f1> JUMP |<f2>\"]" << std::endl;
-            int childnode = printExpDot(jump->getExp(), outFile);
-            outFile << "\"node" << mynode << "\":f1 -> \"node" << childnode << "\":f1" << std::endl;
-            return mynode;
-        }
+int PrintIRTree::printExpDot(std::shared_ptr<IR::Exp> exp, OutBuffer &outFile, int &nodeNum)
+{
+    return printTreeDot(exp.get(), true, outFile, nodeNum, collapseSeq);
+}
 
-        case IR::CJUMP:
+void PrintIRTree::printFragDot(std::shared_ptr<Frame::Frag> frag, OutBuffer &outFile, int gNum)
+{
+    int nodeNum = 0;
+    outFile << "digraph G" << gNum << "{" << '\n';
+    outFile << "node [shape = record, height = .1]" << '\n';
+    switch (frag->getKind())
+    {
+        case Frame::STRING_FRAG:
         {
-            auto cjump = std::dynamic_pointer_cast<IR::CJump>(stm);
-            int mynode = ++nodeNum;
-            outFile << "node" << mynode << "[label = \"<f0>"
-                    << (cjump->getLabelTrue() ? cjump->getLabelTrue()->getLabelName() : "NULL")
-                    << "|<f1> CJUMP: " << rel_oper[cjump->getOp()] << " |<f2>"
-                    << (cjump->getLabelTrue() ? cjump->getLabelFalse()->getLabelName() : "NULL")
-                    << "\"]" << std::endl;
-            int leftNum = printStmDot(cjump->getLeft(), outFile);
-            int rightNum = printStmDot(cjump->getRight(), outFile);
-            outFile << "\"node" << mynode << "\":f0 -> \"node" << leftNum << "\":f1" << std::endl;
-            outFile << "\"node" << mynode << "\":f2 -> \"node" << rightNum << "\":f1" << std::endl;
-            return mynode;
+            auto stringFrag = std::dynamic_pointer_cast<Frame::StringFrag>(frag);
+            printExpDot(IR::makeName(stringFrag->getLabel()), outFile, nodeNum);
+            break;
         }
-
-        case IR::MOVE:
+        case Frame::PROC_FRAG:
         {
-            auto move = std::dynamic_pointer_cast<IR::Move>(stm);
-            int mynode = ++nodeNum;
-            outFile << "node" << mynode << "[label = \"<f0>|<f1> MOVE |<f2>\"]" << std::endl;
-            int leftNum = printStmDot(move->getDst(), outFile);
-            int rightNum = printStmDot(move->getSrc(), outFile);
-            outFile << "\"node" << mynode << "\":f0 -> \"node" << leftNum << "\":f1" << std::endl;
-            outFile << "\"node" << mynode << "\":f2 -> \"node" << rightNum << "\":f1" << std::endl;
-            return mynode;
+            auto procFrag = std::dynamic_pointer_cast<Frame::ProcFrag>(frag);
+            if (procFrag->getStmList() != nullptr)
+            {
+                for (auto &stm : *procFrag->getStmList())
+                {
+                    printStmDot(stm, outFile, nodeNum);
+                }
+            }
+            else
+            {
+                printStmDot(procFrag->getBody(), outFile, nodeNum);
+            }
+            break;
         }
-
-        case IR::EXP:
+        default:
         {
-            auto exp = std::dynamic_pointer_cast<IR::Exp>(stm);
-            return printExpDot(exp, outFile);
-            break;
+            Tiger::Error error("frag-kind is error");
         }
     }
+    outFile << "}" << '\n';
 }
 
-int PrintIRTree::printExpDot(std::shared_ptr<IR::Exp> exp, std::ostream &outFile)
+void PrintIRTree::makeDotFile(std::ostream &outFile)
 {
-    switch (exp->getExpType())
+    if (fragList == nullptr)
     {
-        case IR::BINOP:
-        {
-            auto binop = std::dynamic_pointer_cast<IR::Binop>(exp);
-            int mynode = ++nodeNum;
-            outFile << "node" << mynode << "[label = \"<f0>|<f1> BINOP: " << bin_oper[binop->getOp()] << " |<f2>\"]"
-                    << std::endl;
-            int leftNum = printStmDot(binop->getLeft(), outFile);
-            int rightNum = printStmDot(binop->getRight(), outFile);
-            outFile << "\"node" << mynode << "\":f0 -> \"node" << leftNum << "\":f1" << std::endl;
-            outFile << "\"node" << mynode << "\":f2 -> \"node" << rightNum << "\":f1" << std::endl;
-            return mynode;
-        }
-
-        case IR::MEM:
-        {
-            auto mem = std::dynamic_pointer_cast<IR::Mem>(exp);
-            int mynode = ++nodeNum;
-            outFile << "node" << mynode << "[label = \"<f0>|<f1> MEM |<f2>\"]" << std::endl;
-            int childnode = printExpDot(mem->getExp(), outFile);
-            outFile << "\"node" << mynode << "\":f1 -> \"node" << childnode << "\":f1" << std::endl;
-            return mynode;
-        }
-
-        case IR::TEMP:
-        {
-            auto temp = std::dynamic_pointer_cast<IR::Temp>(exp);
-            int mynode = ++nodeNum;
-            outFile << "node" << mynode << "[label = \"<f0>|<f1> TEMP: " << temp->getTemp()->getTempName() << "|<f2>\"]"
-                    << std::endl;
-            return mynode;
-        }
-
-        case IR::ESEQ:
+        outFile << "FragList is empty" << '\n';
+    }
+    else
+    {
+        printFrags(outFile, [this](std::shared_ptr<Frame::Frag> frag, OutBuffer &out, int gNum)
         {
-            auto eseq = std::dynamic_pointer_cast<IR::Eseq>(exp);
-            int mynode = ++nodeNum;
-            outFile << "node" << mynode << "[label = \"<f0>|<f1> ESEQ |<f2>\"]" << std::endl;
-            int leftNum = printStmDot(eseq->getStm(), outFile);
-            int rightNum = printExpDot(eseq->getExp(), outFile);
-            outFile << "\"node" << mynode << "\":f0 -> \"node" << leftNum << "\":f1" << std::endl;
-            outFile << "\"node" << mynode << "\":f2 -> \"node" << rightNum << "\":f1" << std::endl;
-            return mynode;
-        }
+            printFragDot(frag, out, gNum);
+            out << "---" << '\n';
+        });
+    }
+}
 
-        case IR::NAME:
+bool PrintIRTree::fitsIn(std::shared_ptr<IR::Stm> stm, int &budget)
+{
+    std::vector<const IR::Stm *> todo{stm.get()};
+    while (!todo.empty())
+    {
+        auto node = todo.back();
+        todo.pop_back();
+        if (--budget < 0)
         {
-            auto name = std::dynamic_pointer_cast<IR::Name>(exp);
-            int mynode = ++nodeNum;
-            outFile << "node" << mynode << "[label = \"<f0>|<f1> NAME: " << name->getLabel()->getLabelName()
-                    << "|<f2>\"]" << std::endl;
-            return mynode;
+            return false;
         }
-
-        case IR::CONST:
+        switch (node->getStmType())
         {
-            auto constt = std::dynamic_pointer_cast<IR::Const>(exp);
-            int mynode = ++nodeNum;
-            outFile << "node" << mynode << "[label = \"<f0>|<f1> CONST: " << constt->getConstt() << "|<f2>\"]"
-                    << std::endl;
-            return mynode;
+            case IR::SEQ:
+            {
+                for (auto &stm : static_cast<const IR::Seq *>(node)->getStms())
+                {
+                    todo.push_back(stm.get());
+                }
+                continue;
+            }
+            case IR::JUMP:
+                todo.push_back(static_cast<const IR::Jump *>(node)->getExp().get());
+                continue;
+            case IR::CJUMP:
+            {
+                auto cjump = static_cast<const IR::CJump *>(node);
+                todo.push_back(cjump->getLeft().get());
+                todo.push_back(cjump->getRight().get());
+                continue;
+            }
+            case IR::MOVE:
+            {
+                auto move = static_cast<const IR::Move *>(node);
+                todo.push_back(move->getDst().get());
+                todo.push_back(move->getSrc().get());
+                continue;
+            }
+            case IR::EXP:
+                break;
+            default:
+                continue;
         }
-
-        case IR::CALL:
+        auto exp = static_cast<const IR::Exp *>(node);
+        switch (exp->getExpType())
         {
-            auto call = std::dynamic_pointer_cast<IR::Call>(exp);
-            int mynode = ++nodeNum;
-            outFile << "node" << mynode << "[label = \"<f0>|<f1> CALL |<f2>\"]" << std::endl;
-            int leftNum = printExpDot(call->getFun(), outFile);
-            int rightNum = mynode;
-            outFile << "\"node" << mynode << "\":f0 -> \"node" << leftNum << "\":f1" << std::endl;
-
-            for (auto args = call->getArgs()->begin(); args != call->getArgs()->end(); args++)
+            case IR::BINOP:
             {
-                int childnode = printExpDot((*args), outFile);
-                outFile << "\"node" << mynode << "\":f2 -> \"node" << childnode << "\":f1" << std::endl;
-
+                auto binop = static_cast<const IR::Binop *>(exp);
+                todo.push_back(binop->getLeft().get());
+                todo.push_back(binop->getRight().get());
+                break;
+            }
+            case IR::MEM:
+                todo.push_back(static_cast<const IR::Mem *>(exp)->getExp().get());
+                break;
+            case IR::ESEQ:
+            {
+                auto eseq = static_cast<const IR::Eseq *>(exp);
+                for (auto &stm : eseq->getStms())
+                {
+                    todo.push_back(stm.get());
+                }
+                todo.push_back(eseq->getExp().get());
+                break;
             }
-            return mynode;
+            case IR::CALL:
+            {
+                auto call = static_cast<const IR::Call *>(exp);
+                todo.push_back(call->getFun().get());
+                for (auto &arg : *call->getArgs())
+                {
+                    todo.push_back(arg.get());
+                }
+                break;
+            }
+            default:
+                break;
         }
     }
+    return true;
 }
 
-void PrintIRTree::makeDotFile(std::ostream &outFile)
+void PrintIRTree::makeDotFiles(const std::string &dirName, int maxNodes, bool collapseSeq)
 {
-    if (fragList == nullptr)
+    if (mkdir(dirName.c_str(), 0777) != 0 && errno != EEXIST)
     {
-        outFile << "FragList is empty" << std::endl;
+        Tiger::Error error("Cannot create directory " + dirName);
+        return;
     }
-    else
+    PrintIRTree::collapseSeq = collapseSeq;
+    std::vector<std::shared_ptr<Frame::Frag>> frags(fragList->begin(), fragList->end());
+    std::vector<std::string> skipped(frags.size());
+    parallelFor(frags.size(), [this, &frags, &skipped, &dirName, maxNodes](size_t i)
     {
-        int gNum = 0;
-        for (auto iter = fragList->begin(); iter != fragList->end(); iter++)
+        if (frags[i]->getKind() != Frame::PROC_FRAG)
         {
-            outFile << "digraph G" << gNum++ << "{" << std::endl;
-            outFile << "node [shape = record, height = .1]" << std::endl;
-            switch ((*iter)->getKind())
+            return;
+        }
+        // Named like the files bin/graphviz.py splits a single dot file into
+        std::string name = "graph" + std::to_string(i + 1);
+        auto procFrag = std::dynamic_pointer_cast<Frame::ProcFrag>(frags[i]);
+        if (maxNodes > 0)
+        {
+            int budget = maxNodes;
+            bool fits = true;
+            if (procFrag->getStmList() != nullptr)
             {
-                case Frame::STRING_FRAG:
-                {
-                    auto stringFrag = std::dynamic_pointer_cast<Frame::StringFrag>((*iter));
-                    printExpDot(IR::makeName(stringFrag->getLabel()), outFile);
-                    break;
-                }
-                case Frame::PROC_FRAG:
-                {
-                    auto procFrag = std::dynamic_pointer_cast<Frame::ProcFrag>((*iter));
-                    printStmDot(procFrag->getBody(), outFile);
-                    break;
-                }
-                default:
+                for (auto &stm : *procFrag->getStmList())
                 {
-                    Tiger::Error error("frag-kind is error");
+                    fits = fits && fitsIn(stm, budget);
                 }
             }
-            outFile << "}" << std::endl;
-            outFile << "---" << std::endl;
+            else
+            {
+                fits = fitsIn(procFrag->getBody(), budget);
+            }
+            if (!fits)
+            {
+                skipped[i] = name;
+                return;
+            }
+        }
+        std::ofstream out(dirName + "/" + name + ".txt", std::ios::out | std::ios::binary);
+        thread_local OutBuffer buffer(OutBuffer::FLUSH_SIZE);
+        buffer.clear();
+        buffer.streamTo(&out);
+        printFragDot(frags[i], buffer, (int) i);
+        buffer.writeTo(out);
+        buffer.streamTo(nullptr);
+    });
+    PrintIRTree::collapseSeq = false;
+    for (auto &name : skipped)
+    {
+        if (!name.empty())
+        {
+            std::cerr << "Skipped " << name << ": more than " << maxNodes << " nodes" << std::endl;
         }
     }
 }
@@ -11,20 +11,38 @@
 #include "Frame.h"
 #include "Translate.h"
 #include "Error.h"
+#include "OutBuffer.h"
 #include <string>
 #include <iostream>
+#include <functional>
 
 class PrintIRTree
 {
     std::shared_ptr<Frame::FragList> fragList;
+    // Draw the statements of SEQs nested in a SEQ on the outer node
+    bool collapseSeq;
 
-    void printStm(std::shared_ptr<IR::Stm> exp, std::ostream &outFile, int i);
+    void printStm(std::shared_ptr<IR::Stm> exp, OutBuffer &outFile, int i);
 
-    void printExp(std::shared_ptr<IR::Exp> exp, std::ostream &outFile, int i);
+    void printExp(std::shared_ptr<IR::Exp> exp, OutBuffer &outFile, int i);
 
-    int printStmDot(std::shared_ptr<IR::Stm> stm, std::ostream &outFile);
+    // nodeNum numbers the nodes of the fragment being printed
+    int printStmDot(std::shared_ptr<IR::Stm> stm, OutBuffer &outFile, int &nodeNum);
 
-    int printExpDot(std::shared_ptr<IR::Exp> exp, std::ostream &outFile);
+    int printExpDot(std::shared_ptr<IR::Exp> exp, OutBuffer &outFile, int &nodeNum);
+
+    // Counts the nodes of stm against budget, stopping once it runs out
+    bool fitsIn(std::shared_ptr<IR::Stm> stm, int &budget);
+
+    void printFrag(std::shared_ptr<Frame::Frag> frag, OutBuffer &outFile);
+
+    void printFragDot(std::shared_ptr<Frame::Frag> frag, OutBuffer &outFile, int gNum);
+
+    // Prints every fragment, one task per fragment when running on several
+    // threads, and writes each fragment out as soon as the ones before it
+    // are
+    void printFrags(std::ostream &outFile,
+                    const std::function<void(std::shared_ptr<Frame::Frag>, OutBuffer &, int)> &print);
 
 public:
     PrintIRTree(const std::shared_ptr<Frame::FragList> &fragList);
@@ -33,6 +51,11 @@ public:
 
     void makeDotFile(std::ostream &outFile);
 
+    // Writes every ProcFrag to its own dot file in dirName, in parallel.
+    // Fragments of more than maxNodes IR nodes are skipped unless maxNodes
+    // is 0.
+    void makeDotFiles(const std::string &dirName, int maxNodes, bool collapseSeq);
+
 };
 
 #endif //SRC_PRINTIRTREE_H
\ No newline at end of file
@@ -0,0 +1,865 @@
+//
+// Register allocation
+//
+
+#include "RegAlloc.h"
+#include "Flow.h"
+#include "Error.h"
+#include "OutBuffer.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+namespace RegAlloc
+{
+    namespace
+    {
+        using Assem::makeInstr;
+
+        // Registers a temp can get, the caller saved ones first so that a
+        // function only saves the callee saved registers it needs
+        const int32_t COLORS[] = {
+                Frame::RAX, Frame::RCX, Frame::RDX, Frame::RSI, Frame::RDI, Frame::R8, Frame::R9, Frame::R10,
+                Frame::R11, Frame::RBX, Frame::R12, Frame::R13, Frame::R14, Frame::R15
+        };
+        const int32_t K = sizeof(COLORS) / sizeof(COLORS[0]);
+
+        // Graphs of up to this many temps keep their edges in a bit matrix
+        const int32_t MATRIX_LIMIT = 4096;
+
+        // Degree of a machine register, which never runs out of colors
+        const int32_t REGISTER_DEGREE = INT_MAX / 2;
+
+        // Loop depth past which a use weighs no more
+        const int32_t MAX_WEIGHT_DEPTH = 8;
+
+        const int32_t MAX_ROUNDS = 32;
+
+        int32_t colorIndex(int32_t reg)
+        {
+            for (int32_t i = 0; i < K; i++)
+            {
+                if (COLORS[i] == reg)
+                {
+                    return i;
+                }
+            }
+            return Assem::NONE;
+        }
+
+        // Edges between temps. Small graphs answer whether two temps
+        // interfere from a bit matrix over the lower triangle, large ones
+        // from the adjacency list of the end of lower degree. Machine
+        // registers interfere with each other and keep no list.
+        class Interference
+        {
+            std::vector<uint64_t> matrix;
+
+            static size_t bit(int32_t u, int32_t v)
+            {
+                if (u < v)
+                {
+                    std::swap(u, v);
+                }
+                return (size_t) u * (size_t) (u - 1) / 2 + (size_t) v;
+            }
+
+        public:
+            std::vector<std::vector<int32_t>> adjList;
+            std::vector<int32_t> degree;
+
+            explicit Interference(int32_t count)
+                    : adjList((size_t) count), degree((size_t) count, 0)
+            {
+                if (count <= MATRIX_LIMIT)
+                {
+                    matrix.assign((bit(count, 0) + 63) / 64, 0);
+                }
+                for (int32_t reg = 0; reg < Frame::REGISTER_COUNT && reg < count; reg++)
+                {
+                    degree[reg] = REGISTER_DEGREE;
+                }
+            }
+
+            bool contains(int32_t u, int32_t v) const
+            {
+                if (Assem::isRegister(u) && Assem::isRegister(v))
+                {
+                    return u != v;
+                }
+                if (!matrix.empty())
+                {
+                    auto index = bit(u, v);
+                    return (matrix[index / 64] >> (index % 64) & 1) != 0;
+                }
+                if (Assem::isRegister(u) || (!Assem::isRegister(v) && adjList[v].size() < adjList[u].size()))
+                {
+                    std::swap(u, v);
+                }
+                auto &list = adjList[u];
+                return std::find(list.begin(), list.end(), v) != list.end();
+            }
+
+            void add(int32_t u, int32_t v)
+            {
+                if (u == v || contains(u, v))
+                {
+                    return;
+                }
+                if (!matrix.empty())
+                {
+                    auto index = bit(u, v);
+                    matrix[index / 64] |= (uint64_t) 1 << (index % 64);
+                }
+                if (!Assem::isRegister(u))
+                {
+                    adjList[u].push_back(v);
+                    degree[u]++;
+                }
+                if (!Assem::isRegister(v))
+                {
+                    adjList[v].push_back(u);
+                    degree[v]++;
+                }
+            }
+        };
+
+        // Temps live at one point, with constant time insertion, removal
+        // and iteration
+        class LiveSet
+        {
+            std::vector<int32_t> position;
+        public:
+            std::vector<int32_t> members;
+
+            explicit LiveSet(int32_t count) : position((size_t) count, 0)
+            {}
+
+            bool contains(int32_t temp) const
+            {
+                auto at = (size_t) position[temp];
+                return at < members.size() && members[at] == temp;
+            }
+
+            void insert(int32_t temp)
+            {
+                if (!contains(temp))
+                {
+                    position[temp] = (int32_t) members.size();
+                    members.push_back(temp);
+                }
+            }
+
+            void erase(int32_t temp)
+            {
+                if (contains(temp))
+                {
+                    int32_t last = members.back();
+                    position[last] = position[temp];
+                    members[position[temp]] = last;
+                    members.pop_back();
+                }
+            }
+        };
+
+        enum NodeState : uint8_t
+        {
+            PRECOLORED, INITIAL, SIMPLIFY, FREEZE, SPILL, SPILLED, COALESCED, COLORED, SELECTED
+        };
+
+        enum MoveState : uint8_t
+        {
+            MOVE_COALESCED, MOVE_CONSTRAINED, MOVE_FROZEN, MOVE_WORKLIST, MOVE_ACTIVE
+        };
+
+        // The worklists hold a node or move for as long as its state says
+        // so; entries left behind by a state change are skipped when popped.
+        class Colorer
+        {
+            Assem::Function &function;
+            // Temps made by rewriting spills, which have the shortest live
+            // ranges there are and are not spilled again
+            std::vector<char> unspillable;
+
+            int32_t count;
+            std::unique_ptr<Interference> graph;
+            std::vector<NodeState> state;
+            std::vector<int32_t> alias;
+            std::vector<int32_t> color;
+            std::vector<double> spillCost;
+            std::vector<std::vector<int32_t>> moveList;
+            // Destination and source of each move
+            std::vector<std::pair<int32_t, int32_t>> moves;
+            std::vector<MoveState> moveState;
+
+            std::vector<int32_t> simplifyWorklist;
+            std::vector<int32_t> freezeWorklist;
+            std::vector<int32_t> spillWorklist;
+            std::vector<int32_t> worklistMoves;
+            std::vector<int32_t> selectStack;
+            std::vector<int32_t> spilledNodes;
+
+            std::vector<int32_t> uses;
+            std::vector<int32_t> defs;
+            std::vector<int32_t> marks;
+            int32_t mark;
+
+            // Moves from or to the stack and frame pointers are left alone,
+            // as those registers are live everywhere
+            static bool isCoalescable(const Assem::Instr &instr)
+            {
+                return Assem::isMove(instr) &&
+                       (!Assem::isRegister(instr.src) || colorIndex(instr.src) != Assem::NONE) &&
+                       (!Assem::isRegister(instr.dst) || colorIndex(instr.dst) != Assem::NONE);
+            }
+
+            void build()
+            {
+                count = function.tempCount;
+                graph.reset(new Interference(count));
+                state.assign((size_t) count, INITIAL);
+                alias.resize((size_t) count);
+                color.assign((size_t) count, Assem::NONE);
+                spillCost.assign((size_t) count, 0);
+                moveList.assign((size_t) count, std::vector<int32_t>());
+                moves.clear();
+                moveState.clear();
+                simplifyWorklist.clear();
+                freezeWorklist.clear();
+                spillWorklist.clear();
+                worklistMoves.clear();
+                selectStack.clear();
+                spilledNodes.clear();
+                marks.assign((size_t) count, 0);
+                mark = 0;
+                for (int32_t n = 0; n < count; n++)
+                {
+                    alias[n] = n;
+                    if (Assem::isRegister(n))
+                    {
+                        state[n] = PRECOLORED;
+                        color[n] = n;
+                    }
+                }
+
+                auto flow = Flow::makeGraph(function);
+                auto liveOut = Flow::liveOut(function, flow);
+                LiveSet live(count);
+                for (size_t b = 0; b < function.blocks.size(); b++)
+                {
+                    auto &block = function.blocks[b];
+                    double weight = std::pow(10.0, std::min(flow.loopDepth[b], MAX_WEIGHT_DEPTH));
+                    live.members.clear();
+                    for (auto temp : liveOut[b])
+                    {
+                        live.insert(temp);
+                    }
+                    for (auto i = block.end; i > block.begin; i--)
+                    {
+                        auto &instr = function.instrs[i - 1];
+                        uses.clear();
+                        defs.clear();
+                        Assem::getUses(instr, uses);
+                        Assem::getDefs(instr, defs);
+                        for (auto temp : {instr.dst, instr.src, instr.mem.base, instr.mem.index})
+                        {
+                            if (temp != Assem::NONE && !Assem::isRegister(temp))
+                            {
+                                spillCost[temp] += weight;
+                            }
+                        }
+                        if (isCoalescable(instr))
+                        {
+                            live.erase(instr.src);
+                            auto index = (int32_t) moves.size();
+                            moves.push_back({instr.dst, instr.src});
+                            moveState.push_back(MOVE_WORKLIST);
+                            moveList[instr.dst].push_back(index);
+                            if (instr.src != instr.dst)
+                            {
+                                moveList[instr.src].push_back(index);
+                            }
+                            worklistMoves.push_back(index);
+                        }
+                        for (auto def : defs)
+                        {
+                            live.insert(def);
+                        }
+                        for (auto def : defs)
+                        {
+                            for (auto temp : live.members)
+                            {
+                                graph->add(temp, def);
+                            }
+                        }
+                        for (auto def : defs)
+                        {
+                            live.erase(def);
+                        }
+                        for (auto use : uses)
+                        {
+                            live.insert(use);
+                        }
+                    }
+                }
+            }
+
+            template<typename F>
+            void forAdjacent(int32_t n, F f)
+            {
+                // Edges can be added to the list while it is walked
+                auto &list = graph->adjList[n];
+                for (size_t i = 0; i < list.size(); i++)
+                {
+                    int32_t m = list[i];
+                    if (state[m] != SELECTED && state[m] != COALESCED)
+                    {
+                        f(m);
+                    }
+                }
+            }
+
+            template<typename F>
+            void forNodeMoves(int32_t n, F f)
+            {
+                for (auto m : moveList[n])
+                {
+                    if (moveState[m] == MOVE_ACTIVE || moveState[m] == MOVE_WORKLIST)
+                    {
+                        f(m);
+                    }
+                }
+            }
+
+            bool moveRelated(int32_t n) const
+            {
+                for (auto m : moveList[n])
+                {
+                    if (moveState[m] == MOVE_ACTIVE || moveState[m] == MOVE_WORKLIST)
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            void setState(int32_t n, NodeState next)
+            {
+                state[n] = next;
+                switch (next)
+                {
+                    case SIMPLIFY:
+                        simplifyWorklist.push_back(n);
+                        break;
+                    case FREEZE:
+                        freezeWorklist.push_back(n);
+                        break;
+                    case SPILL:
+                        spillWorklist.push_back(n);
+                        break;
+                    default:
+                        break;
+                }
+            }
+
+            void makeWorklist()
+            {
+                for (int32_t n = Frame::REGISTER_COUNT; n < count; n++)
+                {
+                    setState(n, graph->degree[n] >= K ? SPILL : moveRelated(n) ? FREEZE : SIMPLIFY);
+                }
+            }
+
+            bool pop(std::vector<int32_t> &worklist, NodeState listState, int32_t &n)
+            {
+                while (!worklist.empty())
+                {
+                    n = worklist.back();
+                    worklist.pop_back();
+                    if (state[n] == listState)
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            void enableMoves(int32_t n)
+            {
+                forNodeMoves(n, [this](int32_t m)
+                {
+                    if (moveState[m] == MOVE_ACTIVE)
+                    {
+                        moveState[m] = MOVE_WORKLIST;
+                        worklistMoves.push_back(m);
+                    }
+                });
+            }
+
+            void decrementDegree(int32_t m)
+            {
+                if (Assem::isRegister(m))
+                {
+                    return;
+                }
+                int32_t degree = graph->degree[m]--;
+                if (degree == K)
+                {
+                    enableMoves(m);
+                    forAdjacent(m, [this](int32_t n)
+                    {
+                        enableMoves(n);
+                    });
+                    if (state[m] == SPILL)
+                    {
+                        setState(m, moveRelated(m) ? FREEZE : SIMPLIFY);
+                    }
+                }
+            }
+
+            void simplify(int32_t n)
+            {
+                state[n] = SELECTED;
+                selectStack.push_back(n);
+                forAdjacent(n, [this](int32_t m)
+                {
+                    decrementDegree(m);
+                });
+            }
+
+            int32_t getAlias(int32_t n) const
+            {
+                while (state[n] == COALESCED)
+                {
+                    n = alias[n];
+                }
+                return n;
+            }
+
+            void addWorkList(int32_t u)
+            {
+                if (state[u] == FREEZE && !moveRelated(u) && graph->degree[u] < K)
+                {
+                    setState(u, SIMPLIFY);
+                }
+            }
+
+            // George: every neighbour of a temp merged into register r is
+            // insignificant or already interferes with r
+            bool ok(int32_t t, int32_t r) const
+            {
+                return graph->degree[t] < K || Assem::isRegister(t) || graph->contains(t, r);
+            }
+
+            // Briggs: the merged node has fewer than K significant neighbours
+            bool conservative(int32_t u, int32_t v)
+            {
+                mark++;
+                int32_t significant = 0;
+                for (auto n : {u, v})
+                {
+                    forAdjacent(n, [this, &significant](int32_t t)
+                    {
+                        if (marks[t] != mark)
+                        {
+                            marks[t] = mark;
+                            significant += graph->degree[t] >= K ? 1 : 0;
+                        }
+                    });
+                }
+                return significant < K;
+            }
+
+            void combine(int32_t u, int32_t v)
+            {
+                state[v] = COALESCED;
+                alias[v] = u;
+                moveList[u].insert(moveList[u].end(), moveList[v].begin(), moveList[v].end());
+                enableMoves(v);
+                forAdjacent(v, [this, u](int32_t t)
+                {
+                    graph->add(t, u);
+                    decrementDegree(t);
+                });
+                if (graph->degree[u] >= K && state[u] == FREEZE)
+                {
+                    setState(u, SPILL);
+                }
+            }
+
+            void coalesce(int32_t m)
+            {
+                int32_t x = getAlias(moves[m].first);
+                int32_t y = getAlias(moves[m].second);
+                int32_t u = Assem::isRegister(y) ? y : x;
+                int32_t v = Assem::isRegister(y) ? x : y;
+                if (u == v)
+                {
+                    moveState[m] = MOVE_COALESCED;
+                    addWorkList(u);
+                    return;
+                }
+                if (Assem::isRegister(v) || graph->contains(u, v))
+                {
+                    moveState[m] = MOVE_CONSTRAINED;
+                    addWorkList(u);
+                    addWorkList(v);
+                    return;
+                }
+                bool merge;
+                if (Assem::isRegister(u))
+                {
+                    merge = true;
+                    forAdjacent(v, [this, u, &merge](int32_t t)
+                    {
+                        merge = merge && ok(t, u);
+                    });
+                }
+                else
+                {
+                    merge = conservative(u, v);
+                }
+                if (merge)
+                {
+                    moveState[m] = MOVE_COALESCED;
+                    combine(u, v);
+                    addWorkList(u);
+                    return;
+                }
+                moveState[m] = MOVE_ACTIVE;
+            }
+
+            void freezeMoves(int32_t u)
+            {
+                forNodeMoves(u, [this, u](int32_t m)
+                {
+                    int32_t x = getAlias(moves[m].first);
+                    int32_t y = getAlias(moves[m].second);
+                    int32_t v = y == getAlias(u) ? x : y;
+                    moveState[m] = MOVE_FROZEN;
+                    if (state[v] == FREEZE && !moveRelated(v) && graph->degree[v] < K)
+                    {
+                        setState(v, SIMPLIFY);
+                    }
+                });
+            }
+
+            void freeze(int32_t u)
+            {
+                setState(u, SIMPLIFY);
+                freezeMoves(u);
+            }
+
+            // Takes the temp of lowest spill cost per neighbour, and temps
+            // made by an earlier spill only when nothing else is left
+            bool selectSpill()
+            {
+                int32_t best = Assem::NONE;
+                double bestPriority = 0;
+                for (auto n : spillWorklist)
+                {
+                    if (state[n] != SPILL)
+                    {
+                        continue;
+                    }
+                    double priority = spillCost[n] / graph->degree[n] + (unspillable[n] ? 1e30 : 0);
+                    if (best == Assem::NONE || priority < bestPriority)
+                    {
+                        best = n;
+                        bestPriority = priority;
+                    }
+                }
+                spillWorklist.clear();
+                if (best == Assem::NONE)
+                {
+                    return false;
+                }
+                // The others stay potential spills
+                for (int32_t n = Frame::REGISTER_COUNT; n < count; n++)
+                {
+                    if (state[n] == SPILL && n != best)
+                    {
+                        spillWorklist.push_back(n);
+                    }
+                }
+                setState(best, SIMPLIFY);
+                freezeMoves(best);
+                return true;
+            }
+
+            void assignColors()
+            {
+                while (!selectStack.empty())
+                {
+                    int32_t n = selectStack.back();
+                    selectStack.pop_back();
+                    uint32_t taken = 0;
+                    for (auto w : graph->adjList[n])
+                    {
+                        int32_t a = getAlias(w);
+                        int32_t index = colorIndex(color[a]);
+                        if ((state[a] == COLORED || state[a] == PRECOLORED) && index != Assem::NONE)
+                        {
+                            taken |= 1u << index;
+                        }
+                    }
+                    int32_t chosen = Assem::NONE;
+                    // The color of a move partner lets the move go
+                    for (auto m : moveList[n])
+                    {
+                        int32_t partner = getAlias(moves[m].first == n ? moves[m].second : moves[m].first);
+                        int32_t index = colorIndex(color[partner]);
+                        if ((state[partner] == COLORED || state[partner] == PRECOLORED) && index != Assem::NONE &&
+                            !(taken >> index & 1))
+                        {
+                            chosen = COLORS[index];
+                            break;
+                        }
+                    }
+                    for (int32_t i = 0; i < K && chosen == Assem::NONE; i++)
+                    {
+                        if (!(taken >> i & 1))
+                        {
+                            chosen = COLORS[i];
+                        }
+                    }
+                    if (chosen == Assem::NONE)
+                    {
+                        state[n] = SPILLED;
+                        spilledNodes.push_back(n);
+                        continue;
+                    }
+                    state[n] = COLORED;
+                    color[n] = chosen;
+                }
+                for (int32_t n = 0; n < count; n++)
+                {
+                    if (state[n] == COALESCED)
+                    {
+                        color[n] = color[getAlias(n)];
+                    }
+                }
+            }
+
+            int32_t newTemp()
+            {
+                unspillable.push_back(1);
+                return function.tempCount++;
+            }
+
+            // Gives each spilled temp a stack slot. An instruction that reads
+            // one loads it into a new temp first, and one that writes it
+            // stores the new temp afterwards.
+            void rewriteProgram()
+            {
+                std::vector<int32_t> slots((size_t) count, Assem::NONE);
+                for (auto n : spilledNodes)
+                {
+                    slots[n] = function.spillWords++;
+                }
+                function.spilledTemps += (int32_t) spilledNodes.size();
+                auto slot = [this, &slots](int32_t temp)
+                {
+                    return Assem::makeMem(Frame::RBP, -Frame::WORD_SIZE * (function.frameWords + slots[temp] + 1));
+                };
+                auto isSpilled = [&slots](int32_t temp)
+                {
+                    return temp != Assem::NONE && !Assem::isRegister(temp) && slots[temp] != Assem::NONE;
+                };
+
+                std::vector<Assem::Instr> instrs;
+                instrs.reserve(function.instrs.size() + spilledNodes.size() * 4);
+                // Spilled temps of one instruction and their new temps
+                std::vector<std::pair<int32_t, int32_t>> renamed;
+                auto rename = [&renamed](int32_t &temp)
+                {
+                    for (auto &r : renamed)
+                    {
+                        if (r.first == temp)
+                        {
+                            temp = r.second;
+                            return true;
+                        }
+                    }
+                    return false;
+                };
+                for (auto &block : function.blocks)
+                {
+                    auto begin = (uint32_t) instrs.size();
+                    for (auto i = block.begin; i < block.end; i++)
+                    {
+                        auto instr = function.instrs[i];
+                        bool dst = isSpilled(instr.dst);
+                        bool src = isSpilled(instr.src);
+                        if (!dst && !src && !isSpilled(instr.mem.base) && !isSpilled(instr.mem.index))
+                        {
+                            instrs.push_back(instr);
+                            continue;
+                        }
+                        // A move with one spilled side reads or writes the
+                        // slot directly
+                        if (Assem::isMove(instr) && dst != src)
+                        {
+                            auto direct = makeInstr(Assem::MOV, dst ? Assem::MR : Assem::RM);
+                            direct.dst = dst ? Assem::NONE : instr.dst;
+                            direct.src = dst ? instr.src : Assem::NONE;
+                            direct.mem = slot(dst ? instr.dst : instr.src);
+                            direct.kind = instr.kind;
+                            instrs.push_back(direct);
+                            continue;
+                        }
+                        if (instr.opcode == Assem::MOV && instr.form == Assem::RI)
+                        {
+                            auto direct = makeInstr(Assem::MOV, Assem::MI);
+                            direct.imm = instr.imm;
+                            direct.mem = slot(instr.dst);
+                            instrs.push_back(direct);
+                            continue;
+                        }
+                        renamed.clear();
+                        for (auto temp : {instr.dst, instr.src, instr.mem.base, instr.mem.index})
+                        {
+                            int32_t copy = temp;
+                            if (isSpilled(temp) && !rename(copy))
+                            {
+                                renamed.push_back({temp, newTemp()});
+                            }
+                        }
+                        uses.clear();
+                        defs.clear();
+                        Assem::getUses(instr, uses);
+                        Assem::getDefs(instr, defs);
+                        for (auto &r : renamed)
+                        {
+                            if (std::find(uses.begin(), uses.end(), r.first) != uses.end())
+                            {
+                                auto load = makeInstr(Assem::MOV, Assem::RM);
+                                load.dst = r.second;
+                                load.mem = slot(r.first);
+                                instrs.push_back(load);
+                            }
+                        }
+                        rename(instr.dst);
+                        rename(instr.src);
+                        rename(instr.mem.base);
+                        rename(instr.mem.index);
+                        instrs.push_back(instr);
+                        for (auto &r : renamed)
+                        {
+                            if (std::find(defs.begin(), defs.end(), r.first) != defs.end())
+                            {
+                                auto store = makeInstr(Assem::MOV, Assem::MR);
+                                store.src = r.second;
+                                store.mem = slot(r.first);
+                                instrs.push_back(store);
+                            }
+                        }
+                    }
+                    block.begin = begin;
+                    block.end = (uint32_t) instrs.size();
+                }
+                function.instrs.swap(instrs);
+            }
+
+            // Puts the colors in, dropping the moves that became no-ops
+            void applyColors()
+            {
+                auto colorOf = [this](int32_t temp)
+                {
+                    return temp == Assem::NONE || Assem::isRegister(temp) ? temp : color[temp];
+                };
+                std::vector<Assem::Instr> instrs;
+                instrs.reserve(function.instrs.size());
+                for (auto &block : function.blocks)
+                {
+                    auto begin = (uint32_t) instrs.size();
+                    for (auto i = block.begin; i < block.end; i++)
+                    {
+                        auto instr = function.instrs[i];
+                        instr.dst = colorOf(instr.dst);
+                        instr.src = colorOf(instr.src);
+                        instr.mem.base = colorOf(instr.mem.base);
+                        instr.mem.index = colorOf(instr.mem.index);
+                        if (Assem::isMove(instr) && instr.dst == instr.src)
+                        {
+                            function.eliminatedMoves++;
+                            continue;
+                        }
+                        instrs.push_back(instr);
+                    }
+                    block.begin = begin;
+                    block.end = (uint32_t) instrs.size();
+                }
+                function.instrs.swap(instrs);
+            }
+
+        public:
+            Colorer(Assem::Function &function)
+                    : function(function), unspillable((size_t) function.tempCount, 0), count(0), mark(0)
+            {}
+
+            void run()
+            {
+                for (int32_t round = 0; round < MAX_ROUNDS; round++)
+                {
+                    build();
+                    makeWorklist();
+                    int32_t n;
+                    while (true)
+                    {
+                        if (pop(simplifyWorklist, SIMPLIFY, n))
+                        {
+                            simplify(n);
+                        }
+                        else if (!worklistMoves.empty())
+                        {
+                            int32_t m = worklistMoves.back();
+                            worklistMoves.pop_back();
+                            if (moveState[m] == MOVE_WORKLIST)
+                            {
+                                coalesce(m);
+                            }
+                        }
+                        else if (pop(freezeWorklist, FREEZE, n))
+                        {
+                            freeze(n);
+                        }
+                        else if (!selectSpill())
+                        {
+                            break;
+                        }
+                    }
+                    assignColors();
+                    if (spilledNodes.empty())
+                    {
+                        applyColors();
+                        return;
+                    }
+                    rewriteProgram();
+                }
+                Tiger::Error error("Register allocation of " + function.name + " does not converge");
+            }
+        };
+    }
+
+    void color(Assem::Function &function)
+    {
+        Colorer(function).run();
+    }
+
+    void printStats(const Assem::FunctionList &functions, std::ostream &outFile)
+    {
+        OutBuffer buffer(1 << 16);
+        int spilled = 0;
+        int eliminated = 0;
+        for (auto &function : functions)
+        {
+            buffer << function->name << ": " << function->spilledTemps << " spilled, "
+                   << function->eliminatedMoves << " moves eliminated\n";
+            spilled += function->spilledTemps;
+            eliminated += function->eliminatedMoves;
+        }
+        buffer << "total: " << spilled << " spilled, " << eliminated << " moves eliminated\n";
+        buffer.writeTo(outFile);
+    }
+}
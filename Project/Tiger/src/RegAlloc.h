@@ -0,0 +1,24 @@
+//
+// Register allocation
+//
+
+#ifndef SRC_REGALLOC_H
+#define SRC_REGALLOC_H
+
+#include <ostream>
+#include "Assem.h"
+
+namespace RegAlloc
+{
+    // Maps every virtual temp to a machine register by iterated register
+    // coalescing (George and Appel): build, simplify, coalesce, freeze,
+    // potential spill and select, rewriting spilled temps into stack slots
+    // below the Frame's locals until everything gets a register. Moves
+    // whose sides end up in one register are removed.
+    void color(Assem::Function &function);
+
+    // One line per function with its spilled temps and eliminated moves
+    void printStats(const Assem::FunctionList &functions, std::ostream &outFile);
+}
+
+#endif //SRC_REGALLOC_H
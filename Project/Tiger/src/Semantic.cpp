@@ -4,14 +4,136 @@
 
 #include "Semantic.h"
 #include "Debug.h"
+#include "ThreadPool.h"
+#include <vector>
 
 namespace Semantic
 {
 
+    namespace
+    {
+        // The type behind the names type was declared with. A name still
+        // unresolved in a type of its own group is looked up, and one that
+        // cannot be is left as it is.
+        shared_ptr<Type::Type> actualType(Env::TypeEnv &typeEnv, shared_ptr<Type::Type> type)
+        {
+            for (int depth = 0; type && Type::isName(type) && depth < 16; depth++)
+            {
+                auto name = dynamic_pointer_cast<Type::Name>(type);
+                if (name->type)
+                {
+                    type = name->type;
+                    continue;
+                }
+                try
+                {
+                    type = typeEnv.find(name->name)->getType();
+                }
+                catch (Env::EntryNotFound &e)
+                {
+                    break;
+                }
+            }
+            return type;
+        }
+
+        // Whether values of type are records, arrays or strings, which the
+        // garbage collector must find. A type that cannot be told is taken
+        // for a pointer, the safe guess.
+        bool holdsPointer(Env::TypeEnv &typeEnv, shared_ptr<Type::Type> type)
+        {
+            type = actualType(typeEnv, type);
+            return !type || (!Type::isInt(type) && !Type::isVoid(type));
+        }
+
+        // One body of a function declaration group. It is translated against
+        // views of the environments holding the group's headers, and keeps its
+        // names, fragments and diagnostics to itself until commit().
+        class FunctionBody
+        {
+            Env::TypeEnv typeEnv;
+            Env::VarEnv varEnv;
+            Temporary::NameScope names;
+            Translate::FragScope frags;
+            Tiger::ErrorBuffer errors;
+            shared_ptr<AST::FunDec> func;
+        public:
+            FunctionBody(Env::TypeEnv &typeEnv, Env::VarEnv &varEnv, const shared_ptr<AST::FunDec> &func)
+                    : typeEnv(&typeEnv), varEnv(&varEnv), func(func)
+            {
+            }
+
+            void translate()
+            {
+                Temporary::NameScope::Activation nameActivation(&names);
+                Translate::FragScope::Activation fragActivation(&frags);
+                // A serial run reports right away, in source order anyway
+                Tiger::ErrorBuffer::Activation errorActivation(
+                        ThreadPool::getThreadNum() > 1 ? &errors : Tiger::ErrorBuffer::current());
+                varEnv.beginScope();
+                std::shared_ptr<Env::FuncEntry> funcEntry;
+                try
+                {
+                    auto funcName = func->getName();
+                    funcEntry = varEnv.findFunc(funcName);
+                }
+                catch (Env::EntryNotFound &e)
+                {
+                    Tiger::Error err(e.what());
+                }
+                // Add args into var environment
+                auto args = func->getParams();
+                auto accessList = funcEntry->getLevel()->getFormals();
+                auto access = accessList->begin();
+                auto argType = funcEntry->args->begin();
+                if (args != nullptr)
+                {
+                    for (auto arg = args->begin();
+                         (arg != args->end()) && (access != accessList->end()) &&
+                         (argType != funcEntry->args->end()); arg++, access++, argType++)
+                    {
+                        auto argName = (*arg)->getName();
+                        Env::VarEntry argEntry(argName, *argType, (*access));
+                        varEnv.enterVar(argEntry);
+                    }
+                }
+                // Traverse func body, a break in it cannot leave the function
+                auto funcExp = transExp(funcEntry->getLevel(), nullptr, typeEnv, varEnv, func->getBody());
+                try
+                {
+                    auto returnType = varEnv.findFunc(func->getName())->getResultType();
+                    assertTypeMatch(funcExp.type, returnType, func->getLoc());
+                }
+                catch (Env::EntryNotFound &e)
+                {
+                    Tiger::Error err(func->getLoc(), e.what());
+                }
+                catch (TypeNotMatchError &e)
+                {
+                    string msg = "Incorrect return type\n";
+                    msg += e.what();
+                    Tiger::Error err(func->getLoc(), msg);
+                }
+                Translate::procEntryExit(funcEntry->getLevel(), funcExp.exp);
+                varEnv.endScope();
+            }
+
+            void commit()
+            {
+                names.commit();
+                frags.commit();
+                errors.commit();
+            }
+        };
+    }
+
     shared_ptr<Frame::FragList> transProg(std::shared_ptr<AST::Exp> exp)
     {
         Debugger d("Trans prog");
         ExpTy expType;
+        // The frame pointer is shared by every function, create it before any
+        // function body can ask for it from a worker thread
+        Frame::getFP();
         // create default environments
         Env::TypeEnv typeEnv;
         typeEnv.setDefaultEnv();
@@ -19,6 +141,7 @@ namespace Semantic
         varEnv.setDefaultEnv();
         // traverse program's root exp
         expType = transExp(Translate::getGlobalLevel(), nullptr, typeEnv, varEnv, exp);
+        Translate::procEntryExit(Translate::getGlobalLevel(), expType.exp);
         auto resultList = Translate::getResult();
         return resultList;
     }
@@ -66,21 +189,22 @@ namespace Semantic
                 auto nonValue = Translate::makeNonValueExp();
                 auto fieldVar = dynamic_pointer_cast<AST::FieldVar>(var);
                 ExpTy resultTransField = transVar(level, breakExp, typeEnv, varEnv, fieldVar->getVar());
-                // TODO: if not record, then error?
-                if (!Type::isRecord(resultTransField.type))
+                // The record, through the name a field of a recursive type has
+                auto recordType = actualType(typeEnv, resultTransField.type);
+                if (recordType == nullptr || !Type::isRecord(recordType))
                 {
-                    //Tiger::Error err(var->getLoc(), "Not a record variable: "+fieldVar->getSym());
-                    return ExpTy(nonValue, resultTransField.type);
+                    Tiger::Error err(var->getLoc(), "Not a record variable: " + fieldVar->getSym());
+                    return ExpTy(nonValue, Type::RECORD);
                 }
                 else
                 {
-                    auto recordVar = dynamic_pointer_cast<Type::Record>(resultTransField.type);
+                    auto recordVar = dynamic_pointer_cast<Type::Record>(recordType);
                     try
                     {
                         int offset = 0;
                         auto field = recordVar->find(fieldVar->getSym(), offset);
                         auto newFieldVar = Translate::makeFieldVar(resultTransField.exp, offset);
-                        return ExpTy(newFieldVar, field->type);
+                        return ExpTy(newFieldVar, actualType(typeEnv, field->type));
                     }
                     catch (Type::EntryNotFound &e)
                     {
@@ -96,6 +220,7 @@ namespace Semantic
                 auto subscriptVar = dynamic_pointer_cast<AST::SubscriptVar>(var);
                 ExpTy resultTransSubscript = transVar(level, breakExp, typeEnv, varEnv,
                                                       subscriptVar->getVar());
+                resultTransSubscript.type = actualType(typeEnv, resultTransSubscript.type);
                 if (!Type::isArray(resultTransSubscript.type))
                 {
                     Tiger::Error err(var->getLoc(), "Not an array variable");
@@ -111,10 +236,11 @@ namespace Semantic
                     }
                     else
                     {
-                        // TODO: actual type?
                         auto newSubscriptVar = Translate::makeSubscriptVar(resultTransSubscript.exp,
                                                                            resultTransExp.exp);
-                        return ExpTy(newSubscriptVar, resultTransExp.type);
+                        // The element type, through the name it was declared with
+                        auto element = dynamic_pointer_cast<Type::Array>(resultTransSubscript.type)->array;
+                        return ExpTy(newSubscriptVar, actualType(typeEnv, element));
                     }
                 }
             }
@@ -128,6 +254,161 @@ namespace Semantic
         }
     }
 
+    namespace
+    {
+        // A sequence, operator chain, if or let that transExp is part way
+        // through
+        struct PendingExp
+        {
+            shared_ptr<AST::Exp> exp;
+            // Operands asked for so far
+            int asked = 0;
+            // What a sequence or let translates to so far
+            shared_ptr<Translate::ExpList> exps;
+            AST::ExpList::const_iterator next;
+            // The operators of a chain like a + b + ... + z still to apply,
+            // the innermost last
+            std::vector<shared_ptr<AST::OpExp>> chain;
+            // The chain so far, or the test of an if, and its then branch
+            ExpTy left, then;
+        };
+
+        // Takes result, the operand of task translated last, and puts the
+        // next operand to translate in exp. Once there are none left, returns
+        // false with the translation of task in result.
+        bool continueExp(PendingExp &task,
+                         ExpTy &result,
+                         shared_ptr<AST::Exp> &exp,
+                         shared_ptr<Translate::Level> level,
+                         shared_ptr<Translate::Exp> breakExp,
+                         Env::TypeEnv &typeEnv,
+                         Env::VarEnv &varEnv)
+        {
+            switch (task.exp->getClassType())
+            {
+                case AST::SEQ_EXP:
+                {
+                    auto expList = dynamic_pointer_cast<AST::SeqExp>(task.exp)->getSeq();
+                    if (task.asked == 0)
+                    {
+                        if ((expList == nullptr) || (expList->size() == 0))
+                        {
+                            result = ExpTy(Translate::makeNonValueExp(), Type::VOID);
+                            return false;
+                        }
+                        task.exps = Translate::makeExpList();
+                        task.next = expList->begin();
+                    }
+                    else
+                    {
+                        task.exps->push_front(result.exp);
+                    }
+                    if (task.next != expList->end())
+                    {
+                        exp = *task.next++;
+                        task.asked++;
+                        return true;
+                    }
+                    // The value of a sequence is that of its last exp
+                    result = ExpTy(Translate::makeSeqExp(task.exps), result.type);
+                    return false;
+                }
+                case AST::OP_EXP:
+                {
+                    if (task.asked++ == 0)
+                    {
+                        auto left = task.exp;
+                        while (left != nullptr && left->getClassType() == AST::OP_EXP)
+                        {
+                            task.chain.push_back(dynamic_pointer_cast<AST::OpExp>(left));
+                            left = task.chain.back()->getLeft();
+                        }
+                        exp = left;
+                        return true;
+                    }
+                    if (task.asked > 2)
+                    {
+                        result = transOpExp(task.chain.back(), task.left, result);
+                        task.chain.pop_back();
+                    }
+                    if (task.chain.empty())
+                    {
+                        return false;
+                    }
+                    task.left = result;
+                    exp = task.chain.back()->getRight();
+                    return true;
+                }
+                case AST::IF_EXP:
+                {
+                    auto ifUsage = dynamic_pointer_cast<AST::IfExp>(task.exp);
+                    try
+                    {
+                        switch (task.asked++)
+                        {
+                            case 0:
+                                exp = ifUsage->getTest();
+                                return true;
+                            case 1:
+                                // Check if's test condition
+                                assertTypeMatch(result.type, Type::INT, ifUsage->getTest()->getLoc());
+                                task.left = result;
+                                exp = ifUsage->getThen();
+                                return true;
+                            case 2:
+                                task.then = result;
+                                if (ifUsage->getElsee() != nullptr)
+                                {
+                                    exp = ifUsage->getElsee();
+                                    return true;
+                                }
+                                result = ExpTy(Translate::makeIfExp(task.left.exp, task.then.exp, nullptr),
+                                               task.then.type);
+                                return false;
+                            default:
+                                assertTypeMatch(task.then.type, result.type, ifUsage->getThen()->getLoc());
+                                result = ExpTy(Translate::makeIfExp(task.left.exp, task.then.exp, result.exp),
+                                               task.then.type);
+                                return false;
+                        }
+                    }
+                    catch (TypeNotMatchError &e)
+                    {
+                        Tiger::Error err(e.loc, e.what());
+                    }
+                    result = ExpTy(Translate::makeNonValueExp(), Type::VOID);
+                    return false;
+                }
+                default:
+                {
+                    auto letUsage = dynamic_pointer_cast<AST::LetExp>(task.exp);
+                    if (task.asked++ == 0)
+                    {
+                        // Begin scope
+                        varEnv.beginScope();
+                        typeEnv.beginScope();
+                        // Check each exp decs
+                        auto letDecs = letUsage->getDecs();
+                        task.exps = Translate::makeExpList();
+                        for (auto dec = letDecs->begin(); dec != letDecs->end(); dec++)
+                        {
+                            task.exps->push_front(transDec(level, breakExp, typeEnv, varEnv, *dec));
+                        }
+                        // Check let exp body
+                        exp = letUsage->getBody();
+                        return true;
+                    }
+                    task.exps->push_front(result.exp);
+                    // End scope
+                    typeEnv.endScope();
+                    varEnv.endScope();
+                    result = ExpTy(Translate::makeSeqExp(task.exps), result.type);
+                    return false;
+                }
+            }
+        }
+    }
+
     ExpTy transExp(shared_ptr<Translate::Level> level,
                    shared_ptr<Translate::Exp> breakExp,
                    Env::TypeEnv &typeEnv,
@@ -136,11 +417,54 @@ namespace Semantic
     {
         // DEBUG
         Debugger d("Trans exp");
-        auto defaultLoc = exp->getLoc();
+        // Sequences, operator chains, ifs and lets are walked from a work
+        // stack, so how deep they nest is bounded by memory rather than by
+        // the native stack. Their operands share level and breakExp.
+        std::vector<PendingExp> pending;
+        ExpTy result;
+        for (;;)
+        {
+            switch (exp == nullptr ? AST::NIL_EXP : exp->getClassType())
+            {
+                case AST::SEQ_EXP:
+                case AST::OP_EXP:
+                case AST::IF_EXP:
+                case AST::LET_EXP:
+                    pending.emplace_back();
+                    pending.back().exp = std::move(exp);
+                    break;
+                default:
+                    result = transOtherExp(level, breakExp, typeEnv, varEnv, std::move(exp));
+                    break;
+            }
+            // Hand result up until an expression asks for another operand
+            exp = nullptr;
+            for (;;)
+            {
+                if (pending.empty())
+                {
+                    return result;
+                }
+                if (continueExp(pending.back(), result, exp, level, breakExp, typeEnv, varEnv))
+                {
+                    break;
+                }
+                pending.pop_back();
+            }
+        }
+    }
+
+    ExpTy transOtherExp(shared_ptr<Translate::Level> level,
+                        shared_ptr<Translate::Exp> breakExp,
+                        Env::TypeEnv &typeEnv,
+                        Env::VarEnv &varEnv,
+                        shared_ptr<AST::Exp> exp) noexcept(true)
+    {
         if (nullptr == exp)
         {
             return ExpTy(Translate::makeNonValueExp(), Type::VOID);
         }
+        auto defaultLoc = exp->getLoc();
         switch (exp->getClassType())
         {
             case AST::VAR_EXP:
@@ -212,7 +536,20 @@ namespace Semantic
                         auto f = transExp(level, breakExp, typeEnv, varEnv, (*field)->getExp());
                         fieldList->push_front(f.exp);
                     }
-                    auto record = Translate::makeRecordExp(n, fieldList);
+                    std::string layout;
+                    auto recordType = dynamic_pointer_cast<Type::Record>(recordDefine->getType());
+                    if (recordType)
+                    {
+                        for (auto &field : *recordType->getFields())
+                        {
+                            layout += holdsPointer(typeEnv, field->type) ? '1' : '0';
+                        }
+                    }
+                    else
+                    {
+                        layout.assign((size_t) n, '1');
+                    }
+                    auto record = Translate::makeRecordExp(n, fieldList, layout);
                     return ExpTy(record, recordDefine->getType());
                 }
                 catch (Env::EntryNotFound &e)
@@ -248,7 +585,9 @@ namespace Semantic
                     auto arrayInit = transExp(level, breakExp, typeEnv, varEnv, arrayUsage->getInit());
                     assertTypeMatch(arrayInit.type, Type::ARRAY, defaultLoc);
                     // Check pass
-                    auto array = Translate::makeArrayExp(arraySize.exp, arrayInit.exp);
+                    auto arrayType = dynamic_pointer_cast<Type::Array>(arrayDefine->getType());
+                    bool pointers = !arrayType || holdsPointer(typeEnv, arrayType->array);
+                    auto array = Translate::makeArrayExp(arraySize.exp, arrayInit.exp, pointers);
                     return ExpTy(array, arrayDefine->getType());
                 }
                 catch (Env::EntryNotFound &e)
@@ -264,29 +603,6 @@ namespace Semantic
                 return ExpTy(nonValue, Type::ARRAY);
             }
                 break;
-            case AST::SEQ_EXP:
-            {
-                auto exps = dynamic_pointer_cast<AST::SeqExp>(exp);
-                // TODO: why need a * ?
-                auto expList = exps->getSeq();
-                // Check num of exps
-                if ((expList == nullptr) || (expList->size() == 0))
-                {
-                    auto nonValue = Translate::makeNonValueExp();
-                    return ExpTy(nonValue, Type::VOID);
-                }
-                // Check each exp and return last exp's return value
-                auto trExpList = Translate::makeExpList();
-                ExpTy result;
-                for (auto iter = expList->begin(); iter != expList->end(); iter++)
-                {
-                    result = transExp(level, breakExp, typeEnv, varEnv, (*iter));
-                    trExpList->push_front(result.exp);
-                }
-                auto seq = Translate::makeSeqExp(trExpList);
-                return ExpTy(seq, result.type);
-                break;
-            }
             case AST::WHILE_EXP:
             {
                 auto whileUsage = dynamic_pointer_cast<AST::WhileExp>(exp);
@@ -295,9 +611,9 @@ namespace Semantic
                     // Check while's test condition
                     auto whileTest = transExp(level, breakExp, typeEnv, varEnv, whileUsage->getTest());
                     assertTypeMatch(whileTest.type, Type::INT, defaultLoc);
-                    // Check while's body
-                    auto whileBody = transExp(level, breakExp, typeEnv, varEnv, whileUsage->getBody());
+                    // Check while's body, a break in it goes to done
                     auto done = Translate::makeDoneExp();
+                    auto whileBody = transExp(level, done, typeEnv, varEnv, whileUsage->getBody());
                     auto whileExp = Translate::makeWhileExp(whileTest.exp, whileBody.exp, done);
                     return ExpTy(whileExp, Type::VOID);
                 }
@@ -327,20 +643,23 @@ namespace Semantic
                 {
                     Tiger::Error err(e.loc, e.what());
                 }
-                auto assign = Translate::makeAssignExp(assignVarResult.exp, assignExpResult.exp);
+                // Pointers stored into the heap take the write barrier
+                bool heap = assignVar->getClassType() == AST::FIELD_VAR ||
+                            assignVar->getClassType() == AST::SUBSCRIPT_VAR;
+                auto assign = heap && holdsPointer(typeEnv, assignVarResult.type)
+                              ? Translate::makeHeapAssignExp(assignVarResult.exp, assignExpResult.exp)
+                              : Translate::makeAssignExp(assignVarResult.exp, assignExpResult.exp);
                 return ExpTy(assign, Type::VOID);
                 break;
             }
             case AST::BREAK_EXP:
             {
                 if (breakExp != nullptr)
-                {
-                    return ExpTy(Translate::makeNonValueExp(), Type::VOID);
-                }
-                else
                 {
                     return ExpTy(Translate::makeBreakExp(breakExp), Type::VOID);
                 }
+                Tiger::Error err(defaultLoc, "break is not inside a loop");
+                return ExpTy(Translate::makeNonValueExp(), Type::VOID);
                 break;
             }
             case AST::FOR_EXP:
@@ -388,213 +707,6 @@ namespace Semantic
                 return expTy;
                 break;
             }
-            case AST::LET_EXP:
-            {
-                // Begin scope
-                varEnv.beginScope();
-                typeEnv.beginScope();
-                // Check each exp decs
-                auto letUsage = dynamic_pointer_cast<AST::LetExp>(exp);
-                auto letDecs = letUsage->getDecs();
-                auto expList = Translate::makeExpList();
-                for (auto dec = letDecs->begin(); dec != letDecs->end(); dec++)
-                {
-                    auto result = transDec(level, breakExp, typeEnv, varEnv, *dec);
-                    expList->push_front(result);
-                }
-                // Check let exp body
-                auto letBody = letUsage->getBody();
-                auto result = transExp(level, breakExp, typeEnv, varEnv, letBody);
-                expList->push_front(result.exp);
-                // End scope
-                typeEnv.endScope();
-                varEnv.endScope();
-                return ExpTy(Translate::makeSeqExp(expList), result.type);
-                break;
-            }
-            case AST::OP_EXP:
-            {
-                auto opUsage = dynamic_pointer_cast<AST::OpExp>(exp);
-                // Check both side of op exp
-                auto opLeft = transExp(level, breakExp, typeEnv, varEnv, opUsage->getLeft());
-                auto opRight = transExp(level, breakExp, typeEnv, varEnv, opUsage->getRight());
-                // Check type
-                try
-                {
-                    assertTypeMatch(opLeft.type, opRight.type, opUsage->getLeft()->getLoc());
-                    IR::ArithmeticOp arithOP;
-                    IR::ComparisonOp compOP;
-                    auto opLeftExp = opLeft.exp;
-                    auto opRightExp = opRight.exp;
-                    if (Type::isInt(opLeft.type))
-                    {
-                        /*
-                                 * Op exp type
-                                 * 0 : Arithmetic exp
-                                 * 1 : Comparison exp
-                                 */
-                        int expType = 0;
-                        switch (opUsage->getOp())
-                        {
-                            case AST::PLUS:
-                                arithOP = IR::PLUS;
-                                break;
-                            case AST::MINUS:
-                                arithOP = IR::MINUS;
-                                break;
-                            case AST::TIMES:
-                                arithOP = IR::MUL;
-                                break;
-                            case AST::DIVIDE:
-                                arithOP = IR::DIV;
-                                break;
-                            case AST::EQ:
-                                expType = 1;
-                                compOP = IR::EQ;
-                                break;
-                            case AST::NEQ:
-                                expType = 1;
-                                compOP = IR::NE;
-                                break;
-                            case AST::LT:
-                                expType = 1;
-                                compOP = IR::LT;
-                                break;
-                            case AST::LE:
-                                expType = 1;
-                                compOP = IR::LE;
-                                break;
-                            case AST::GT:
-                                expType = 1;
-                                compOP = IR::GT;
-                                break;
-                            case AST::GE:
-                                expType = 1;
-                                compOP = IR::GE;
-                                break;
-                            default:
-                                expType = 2;
-                                break;
-                        }
-                        if (expType == 0)
-                        {
-                            auto arithExp = Translate::makeArithmeticExp(arithOP, opLeftExp, opRightExp);
-                            return ExpTy(arithExp, Type::INT);
-                        }
-                        else if (expType == 1)
-                        {
-                            auto compExp = Translate::makeIntComparisonExp(compOP, opLeftExp, opRightExp);
-                            return ExpTy(compExp, Type::INT);
-                        }
-                        else
-                        {
-                            Tiger::Error err(opUsage->getLoc(), "Invalid binary operation for int");
-                        }
-                    }
-                    else if (Type::isString(opLeft.type))
-                    {
-                        bool validOP = true;
-                        switch (opUsage->getOp())
-                        {
-                            case AST::EQ:
-                                compOP = IR::EQ;
-                                break;
-                            case AST::NEQ:
-                                compOP = IR::NE;
-                                break;
-                            case AST::LT:
-                                compOP = IR::LT;
-                                break;
-                            case AST::LE:
-                                compOP = IR::LE;
-                                break;
-                            case AST::GT:
-                                compOP = IR::GT;
-                                break;
-                            case AST::GE:
-                                compOP = IR::GE;
-                                break;
-                            default:
-                                validOP = false;
-                                break;
-                        }
-                        if (validOP)
-                        {
-                            auto compExp = Translate::makeStringComparisonExp(compOP, opLeftExp, opRightExp);
-                            return ExpTy(compExp, Type::INT);
-                        }
-                        else
-                        {
-                            Tiger::Error err(opUsage->getLoc(), "Invalid binary operation for string");
-                        }
-                    }
-                    else if (Type::isRecord(opLeft.type) || Type::isArray(opLeft.type))
-                    {
-                        bool validOP = true;
-                        switch (opUsage->getOp())
-                        {
-                            case AST::EQ:
-                                compOP = IR::EQ;
-                                break;
-                            case AST::NEQ:
-                                compOP = IR::NE;
-                                break;
-                            default:
-                                validOP = false;
-                                break;
-                        }
-                        if (validOP)
-                        {
-                            auto compExp = Translate::makeReferenceComparisonExp(compOP, opLeftExp, opRightExp);
-                            return ExpTy(compExp, Type::INT);
-                        }
-                        else
-                        {
-                            Tiger::Error err(opUsage->getLoc(), "Invalid binary operation for reference");
-                        }
-                    }
-                }
-                catch (TypeNotMatchError &e)
-                {
-                    Tiger::Error err(e.loc, e.what());
-                }
-                return ExpTy(Translate::makeNonValueExp(), Type::INT);
-                break;
-            }
-            case AST::IF_EXP:
-            {
-                auto ifUsage = dynamic_pointer_cast<AST::IfExp>(exp);
-                auto ifTestPtr = ifUsage->getTest();
-                auto ifThenPtr = ifUsage->getThen();
-                auto ifElsePtr = ifUsage->getElsee();
-                try
-                {
-                    // Check if's test condition
-                    auto ifTest = transExp(level, breakExp, typeEnv, varEnv, ifTestPtr);
-                    assertTypeMatch(ifTest.type, Type::INT, ifTestPtr->getLoc());
-                    // Check if's then body
-                    auto ifThen = transExp(level, breakExp, typeEnv, varEnv, ifThenPtr);
-                    // Check if's else body
-                    shared_ptr<Translate::Exp> ifExp;
-                    if (ifElsePtr != nullptr)
-                    {
-                        auto ifElse = transExp(level, breakExp, typeEnv, varEnv, ifElsePtr);
-                        assertTypeMatch(ifThen.type, ifElse.type, ifThenPtr->getLoc());
-                        ifExp = Translate::makeIfExp(ifTest.exp, ifThen.exp, ifElse.exp);
-                    }
-                    else
-                    {
-                        ifExp = Translate::makeIfExp(ifTest.exp, ifThen.exp, nullptr);
-                    }
-                    return ExpTy(ifExp, ifThen.type);
-                }
-                catch (TypeNotMatchError &e)
-                {
-                    Tiger::Error err(e.loc, e.what());
-                }
-                return ExpTy(Translate::makeNonValueExp(), Type::VOID);
-            }
-                break;
             case AST::STRING_EXP:
             {
                 auto stringUsage = dynamic_pointer_cast<AST::StringExp>(exp);
@@ -617,6 +729,151 @@ namespace Semantic
         return ExpTy(nullptr, Type::VOID);
     }
 
+    ExpTy transOpExp(const shared_ptr<AST::OpExp> &opUsage, const ExpTy &opLeft, const ExpTy &opRight)
+    {
+        // Check type
+        try
+        {
+            assertTypeMatch(opLeft.type, opRight.type, opUsage->getLeft()->getLoc());
+            IR::ArithmeticOp arithOP;
+            IR::ComparisonOp compOP;
+            auto opLeftExp = opLeft.exp;
+            auto opRightExp = opRight.exp;
+            if (Type::isInt(opLeft.type))
+            {
+                /*
+                         * Op exp type
+                         * 0 : Arithmetic exp
+                         * 1 : Comparison exp
+                         */
+                int expType = 0;
+                switch (opUsage->getOp())
+                {
+                    case AST::PLUS:
+                        arithOP = IR::PLUS;
+                        break;
+                    case AST::MINUS:
+                        arithOP = IR::MINUS;
+                        break;
+                    case AST::TIMES:
+                        arithOP = IR::MUL;
+                        break;
+                    case AST::DIVIDE:
+                        arithOP = IR::DIV;
+                        break;
+                    case AST::EQ:
+                        expType = 1;
+                        compOP = IR::EQ;
+                        break;
+                    case AST::NEQ:
+                        expType = 1;
+                        compOP = IR::NE;
+                        break;
+                    case AST::LT:
+                        expType = 1;
+                        compOP = IR::LT;
+                        break;
+                    case AST::LE:
+                        expType = 1;
+                        compOP = IR::LE;
+                        break;
+                    case AST::GT:
+                        expType = 1;
+                        compOP = IR::GT;
+                        break;
+                    case AST::GE:
+                        expType = 1;
+                        compOP = IR::GE;
+                        break;
+                    default:
+                        expType = 2;
+                        break;
+                }
+                if (expType == 0)
+                {
+                    auto arithExp = Translate::makeArithmeticExp(arithOP, opLeftExp, opRightExp);
+                    return ExpTy(arithExp, Type::INT);
+                }
+                else if (expType == 1)
+                {
+                    auto compExp = Translate::makeIntComparisonExp(compOP, opLeftExp, opRightExp);
+                    return ExpTy(compExp, Type::INT);
+                }
+                else
+                {
+                    Tiger::Error err(opUsage->getLoc(), "Invalid binary operation for int");
+                }
+            }
+            else if (Type::isString(opLeft.type))
+            {
+                bool validOP = true;
+                switch (opUsage->getOp())
+                {
+                    case AST::EQ:
+                        compOP = IR::EQ;
+                        break;
+                    case AST::NEQ:
+                        compOP = IR::NE;
+                        break;
+                    case AST::LT:
+                        compOP = IR::LT;
+                        break;
+                    case AST::LE:
+                        compOP = IR::LE;
+                        break;
+                    case AST::GT:
+                        compOP = IR::GT;
+                        break;
+                    case AST::GE:
+                        compOP = IR::GE;
+                        break;
+                    default:
+                        validOP = false;
+                        break;
+                }
+                if (validOP)
+                {
+                    auto compExp = Translate::makeStringComparisonExp(compOP, opLeftExp, opRightExp);
+                    return ExpTy(compExp, Type::INT);
+                }
+                else
+                {
+                    Tiger::Error err(opUsage->getLoc(), "Invalid binary operation for string");
+                }
+            }
+            else if (Type::isRecord(opLeft.type) || Type::isArray(opLeft.type))
+            {
+                bool validOP = true;
+                switch (opUsage->getOp())
+                {
+                    case AST::EQ:
+                        compOP = IR::EQ;
+                        break;
+                    case AST::NEQ:
+                        compOP = IR::NE;
+                        break;
+                    default:
+                        validOP = false;
+                        break;
+                }
+                if (validOP)
+                {
+                    auto compExp = Translate::makeReferenceComparisonExp(compOP, opLeftExp, opRightExp);
+                    return ExpTy(compExp, Type::INT);
+                }
+                else
+                {
+                    Tiger::Error err(opUsage->getLoc(), "Invalid binary operation for reference");
+                }
+            }
+        }
+        catch (TypeNotMatchError &e)
+        {
+            Tiger::Error err(e.loc, e.what());
+        }
+        return ExpTy(Translate::makeNonValueExp(), Type::INT);
+    }
+
     shared_ptr<Translate::Exp> transDec(const shared_ptr<Translate::Level> level,
                                         const shared_ptr<Translate::Exp> breakExp,
                                         Env::TypeEnv &typeEnv,
@@ -666,7 +923,7 @@ namespace Semantic
                         Tiger::Error err(e.loc, e.what());
                     }
                 }
-                auto varAlloc = Translate::allocLocal(level, varUsage->isEscape());
+                auto varAlloc = Translate::allocLocal(level, varUsage->isEscape(), holdsPointer(typeEnv, varType));
                 auto simpleVar = Translate::makeSimpleVar(varAlloc, level);
                 Env::VarEntry ve(varName, varType, varAlloc);
                 varEnv.enterVar(ve);
@@ -706,6 +963,7 @@ namespace Semantic
                     // Check and add args to new function entry
                     auto args = (*func)->getParams();
                     auto formals = make_shared<BoolList>();
+                    auto pointers = make_shared<BoolList>();
                     auto argTypeList = Env::makeArgList();
                     if (args != nullptr)
                     {
@@ -724,63 +982,37 @@ namespace Semantic
                             }
                             argTypeList->push_back(argType);
                             formals->push_back(true);
+                            pointers->push_back(holdsPointer(typeEnv, argType));
                         }
                     }
                     // Add func into func environment
                     auto funcLabel = Temporary::makeLabel();
-                    auto funcLevel = Translate::makeNewLevel(level, funcLabel, formals);
+                    auto funcLevel = Translate::makeNewLevel(level, funcLabel, formals, pointers);
                     Env::FuncEntry funcEntry(funcLevel, funcLabel, (*func)->getName(), argTypeList, returnType);
                     varEnv.enterFunc(funcEntry);
                 }
                 // Traverse all functions' body to check `return type`
-                // Need to form function environment first, then traverse their body
+                // Need to form function environment first, then traverse their body.
+                // The bodies are independent from here on, so they run as tasks
+                // and are merged back in source order.
+                std::vector<std::unique_ptr<FunctionBody>> bodies;
                 for (auto func = funcList->begin(); func != funcList->end(); func++)
                 {
-                    varEnv.beginScope();
-                    std::shared_ptr<Env::FuncEntry> funcEntry;
-                    try
-                    {
-                        auto funcName = (*func)->getName();
-                        funcEntry = varEnv.findFunc(funcName);
-                    }
-                    catch (Env::EntryNotFound &e)
-                    {
-                        Tiger::Error err(e.what());
-                    }
-                    // Add args into var environment
-                    auto args = (*func)->getParams();
-                    auto accessList = funcEntry->getLevel()->getFormals();
-                    auto access = accessList->begin();
-                    if (args != nullptr)
-                    {
-                        for (auto arg = args->begin();
-                             (arg != args->end()) && (access != accessList->end()); arg++, access++)
-                        {
-                            auto argName = (*arg)->getName();
-                            auto argType = typeEnv.find((*arg)->getTyp())->getType();
-                            Env::VarEntry argEntry(argName, Type::INT, (*access));
-                            varEnv.enterVar(argEntry);
-                        }
-                    }
-                    // Traverse func body
-                    auto funcExp = transExp(funcEntry->getLevel(), breakExp, typeEnv, varEnv, (*func)->getBody());
-                    try
-                    {
-                        auto returnType = varEnv.findFunc((*func)->getName())->getResultType();
-                        assertTypeMatch(funcExp.type, returnType, (*func)->getLoc());
-                    }
-                    catch (Env::EntryNotFound &e)
-                    {
-                        Tiger::Error err((*func)->getLoc(), e.what());
-                    }
-                    catch (TypeNotMatchError &e)
-                    {
-                        string msg = "Incorrect return type\n";
-                        msg += e.what();
-                        Tiger::Error err((*func)->getLoc(), msg);
-                    }
-                    Translate::procEntryExit(funcEntry->getLevel(), funcExp.exp);
-                    varEnv.endScope();
+                    bodies.emplace_back(new FunctionBody(typeEnv, varEnv, *func));
+                }
+                TaskGroup group;
+                for (auto &body : bodies)
+                {
+                    auto task = body.get();
+                    group.run([task]()
+                              {
+                                  task->translate();
+                              });
+                }
+                group.wait();
+                for (auto &body : bodies)
+                {
+                    body->commit();
                 }
                 return Translate::makeNonValueExp();
                 break;
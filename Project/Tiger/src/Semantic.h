@@ -126,9 +126,17 @@ namespace Semantic
     ExpTy transExp(shared_ptr<Translate::Level> level, shared_ptr<Translate::Exp> breakExp, Env::TypeEnv &typeEnv,
                    Env::VarEnv &varEnv, shared_ptr<AST::Exp> exp) noexcept(true);
 
+    // Translates an expression that transExp does not walk itself, one that
+    // is not a sequence, operator chain, if or let
+    ExpTy transOtherExp(shared_ptr<Translate::Level> level, shared_ptr<Translate::Exp> breakExp,
+                        Env::TypeEnv &typeEnv, Env::VarEnv &varEnv, shared_ptr<AST::Exp> exp) noexcept(true);
+
     ExpTy transVar(shared_ptr<Translate::Level> level, shared_ptr<Translate::Exp> breakExp, Env::TypeEnv &typeEnv,
                    Env::VarEnv &varEnv, const shared_ptr<AST::Var> &var) noexcept(true);
 
+    // Checks and translates an operator applied to already translated operands
+    ExpTy transOpExp(const shared_ptr<AST::OpExp> &opUsage, const ExpTy &opLeft, const ExpTy &opRight);
+
 
     void checkCallArgs(shared_ptr<Translate::Level> level,
                        shared_ptr<Translate::Exp> breakExp,
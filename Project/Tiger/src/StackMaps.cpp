@@ -0,0 +1,424 @@
+//
+// Stack maps for the garbage collector
+//
+
+#include "StackMaps.h"
+#include "Emit.h"
+#include "Flow.h"
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <unordered_map>
+
+namespace StackMaps
+{
+    namespace
+    {
+        // What a location holds on a path that has not written it
+        const uint8_t UNWRITTEN = 3;
+
+        uint8_t join(uint8_t left, uint8_t right)
+        {
+            if (left == UNWRITTEN)
+            {
+                return right;
+            }
+            if (right == UNWRITTEN || left == right)
+            {
+                return left;
+            }
+            return Temporary::UNKNOWN;
+        }
+
+        int32_t calleeSaveIndex(int32_t reg)
+        {
+            auto found = std::find(std::begin(Frame::CALLEE_SAVES), std::end(Frame::CALLEE_SAVES), reg);
+            return found == std::end(Frame::CALLEE_SAVES) ? Assem::NONE
+                                                           : (int32_t) (found - std::begin(Frame::CALLEE_SAVES));
+        }
+
+        // The locations are the registers, then the spill slots. A
+        // location's kind comes from the last instruction that wrote it:
+        // its mark, or for a move without one what it copied.
+        class Builder
+        {
+            Assem::Function &function;
+            size_t count;
+            Flow::Graph graph;
+            std::unordered_map<int32_t, uint8_t> frameKinds;
+            std::vector<int32_t> reads;
+            std::vector<int32_t> writes;
+
+            int32_t slotOffset(int32_t slot) const
+            {
+                return -Frame::WORD_SIZE * (function.frameWords + slot - Frame::REGISTER_COUNT + 1);
+            }
+
+            // Location of the spill slot mem addresses, NONE for any other
+            // memory
+            int32_t spillSlot(const Assem::Mem &mem) const
+            {
+                if (mem.base != Frame::RBP || mem.index != Assem::NONE || mem.label != Assem::NONE ||
+                    mem.disp >= 0 || mem.disp % Frame::WORD_SIZE != 0)
+                {
+                    return Assem::NONE;
+                }
+                int32_t slot = -mem.disp / Frame::WORD_SIZE - 1 - function.frameWords;
+                return slot >= 0 && slot < function.spillWords ? Frame::REGISTER_COUNT + slot : Assem::NONE;
+            }
+
+            static bool hasMem(const Assem::Instr &instr)
+            {
+                return instr.form == Assem::RM || instr.form == Assem::MR || instr.form == Assem::MI;
+            }
+
+            void access(const Assem::Instr &instr)
+            {
+                reads.clear();
+                writes.clear();
+                Assem::getUses(instr, reads);
+                Assem::getDefs(instr, writes);
+                auto slot = hasMem(instr) ? spillSlot(instr.mem) : Assem::NONE;
+                if (slot == Assem::NONE)
+                {
+                    return;
+                }
+                if (instr.form != Assem::RM)
+                {
+                    writes.push_back(slot);
+                }
+                if ((instr.form == Assem::RM && instr.opcode != Assem::LEA) ||
+                    (instr.form != Assem::RM && instr.opcode != Assem::MOV))
+                {
+                    reads.push_back(slot);
+                }
+            }
+
+            void transfer(const Assem::Instr &instr, std::vector<uint8_t> &state)
+            {
+                auto kind = instr.kind;
+                auto copied = [kind](uint8_t source)
+                {
+                    return kind != Temporary::UNKNOWN ? kind : source;
+                };
+                // Where the value goes and what it is
+                int32_t target = Assem::NONE;
+                uint8_t value = kind;
+                if (instr.opcode == Assem::MOV && instr.form == Assem::RR)
+                {
+                    target = instr.dst;
+                    value = copied(state[instr.src]);
+                }
+                else if (instr.opcode == Assem::MOV && instr.form == Assem::RI)
+                {
+                    target = instr.dst;
+                    value = Temporary::SCALAR;
+                }
+                else if (instr.opcode == Assem::MOV && instr.form == Assem::RM)
+                {
+                    target = instr.dst;
+                    auto slot = spillSlot(instr.mem);
+                    if (slot != Assem::NONE)
+                    {
+                        value = copied(state[slot]);
+                    }
+                    else if (instr.mem.base == Frame::RBP && instr.mem.index == Assem::NONE &&
+                             instr.mem.label == Assem::NONE)
+                    {
+                        auto found = frameKinds.find(instr.mem.disp);
+                        value = copied(found == frameKinds.end() ? (uint8_t) Temporary::UNKNOWN : found->second);
+                    }
+                }
+                else if (instr.opcode == Assem::MOV && (instr.form == Assem::MR || instr.form == Assem::MI))
+                {
+                    target = spillSlot(instr.mem);
+                    value = instr.form == Assem::MI ? (uint8_t) Temporary::SCALAR : copied(state[instr.src]);
+                }
+                else if ((instr.form == Assem::RR || instr.form == Assem::RI || instr.form == Assem::RM ||
+                          instr.form == Assem::RRI) && instr.opcode != Assem::CMP)
+                {
+                    target = instr.dst;
+                }
+                writes.clear();
+                Assem::getDefs(instr, writes);
+                for (auto write : writes)
+                {
+                    state[write] = Temporary::UNKNOWN;
+                }
+                if (target != Assem::NONE)
+                {
+                    state[target] = value;
+                }
+            }
+
+            // Live locations when each block ends
+            std::vector<std::vector<char>> liveness()
+            {
+                auto blocks = function.blocks.size();
+                std::vector<std::vector<char>> gen(blocks, std::vector<char>(count, 0));
+                std::vector<std::vector<char>> kill(blocks, std::vector<char>(count, 0));
+                for (size_t b = 0; b < blocks; b++)
+                {
+                    auto &block = function.blocks[b];
+                    for (auto i = block.end; i-- > block.begin;)
+                    {
+                        access(function.instrs[i]);
+                        for (auto write : writes)
+                        {
+                            kill[b][write] = 1;
+                            gen[b][write] = 0;
+                        }
+                        for (auto read : reads)
+                        {
+                            gen[b][read] = 1;
+                        }
+                    }
+                }
+                std::vector<std::vector<char>> liveIn(blocks, std::vector<char>(count, 0));
+                std::vector<std::vector<char>> liveOut(blocks, std::vector<char>(count, 0));
+                for (bool changed = true; changed;)
+                {
+                    changed = false;
+                    for (size_t b = blocks; b-- > 0;)
+                    {
+                        auto &out = liveOut[b];
+                        for (auto succ : graph.succs[b])
+                        {
+                            for (size_t l = 0; l < count; l++)
+                            {
+                                out[l] |= liveIn[succ][l];
+                            }
+                        }
+                        for (size_t l = 0; l < count; l++)
+                        {
+                            char in = gen[b][l] || (out[l] && !kill[b][l]);
+                            if (in != liveIn[b][l])
+                            {
+                                liveIn[b][l] = in;
+                                changed = true;
+                            }
+                        }
+                    }
+                }
+                return liveOut;
+            }
+
+            // What the locations hold when each block begins
+            std::vector<std::vector<uint8_t>> kinds()
+            {
+                auto blocks = function.blocks.size();
+                std::vector<std::vector<uint8_t>> in(blocks, std::vector<uint8_t>(count, UNWRITTEN));
+                if (blocks == 0)
+                {
+                    return in;
+                }
+                std::fill(in[0].begin(), in[0].begin() + Frame::REGISTER_COUNT, (uint8_t) Temporary::UNKNOWN);
+                std::vector<uint8_t> state;
+                for (bool changed = true; changed;)
+                {
+                    changed = false;
+                    for (size_t b = 0; b < blocks; b++)
+                    {
+                        state = in[b];
+                        auto &block = function.blocks[b];
+                        for (auto i = block.begin; i < block.end; i++)
+                        {
+                            transfer(function.instrs[i], state);
+                        }
+                        for (auto succ : graph.succs[b])
+                        {
+                            for (size_t l = 0; l < count; l++)
+                            {
+                                auto joined = join(in[succ][l], state[l]);
+                                if (joined != in[succ][l])
+                                {
+                                    in[succ][l] = joined;
+                                    changed = true;
+                                }
+                            }
+                        }
+                    }
+                }
+                return in;
+            }
+
+        public:
+            explicit Builder(Assem::Function &function)
+                    : function(function), count((size_t) (Frame::REGISTER_COUNT + function.spillWords)),
+                      graph(Flow::makeGraph(function))
+            {
+                for (auto &kind : function.frameKinds)
+                {
+                    frameKinds.emplace(kind.first, kind.second);
+                }
+            }
+
+            void run()
+            {
+                function.stackMaps.clear();
+                auto liveOut = liveness();
+                auto in = kinds();
+                // Every map has the frame's variables that may hold pointers
+                Assem::StackMap frame;
+                frame.pointerRegisters = frame.otherRegisters = 0;
+                for (auto &kind : function.frameKinds)
+                {
+                    if (kind.second == Temporary::POINTER)
+                    {
+                        frame.pointerSlots.push_back(kind.first);
+                    }
+                    else if (kind.second == Temporary::UNKNOWN)
+                    {
+                        frame.otherSlots.push_back(kind.first);
+                    }
+                }
+
+                std::vector<uint8_t> state;
+                std::vector<char> live;
+                // Calls of the block and what the locations hold at each
+                std::vector<std::pair<uint32_t, std::vector<uint8_t>>> calls;
+                for (size_t b = 0; b < function.blocks.size(); b++)
+                {
+                    auto &block = function.blocks[b];
+                    calls.clear();
+                    state = in[b];
+                    for (auto i = block.begin; i < block.end; i++)
+                    {
+                        if (function.instrs[i].opcode == Assem::CALL)
+                        {
+                            calls.push_back({i, state});
+                        }
+                        transfer(function.instrs[i], state);
+                    }
+                    auto first = function.stackMaps.size();
+                    function.stackMaps.resize(first + calls.size(), frame);
+                    live = liveOut[b];
+                    auto call = calls.size();
+                    for (auto i = block.end; i-- > block.begin;)
+                    {
+                        if (call > 0 && calls[call - 1].first == i)
+                        {
+                            call--;
+                            auto &at = calls[call].second;
+                            auto &map = function.stackMaps[first + call];
+                            map.call = i;
+                            for (size_t l = 0; l < count; l++)
+                            {
+                                int32_t index = l < Frame::REGISTER_COUNT ? calleeSaveIndex((int32_t) l) : 0;
+                                if (!live[l] || at[l] == Temporary::SCALAR || index == Assem::NONE)
+                                {
+                                    continue;
+                                }
+                                bool pointer = at[l] == Temporary::POINTER;
+                                if (l < Frame::REGISTER_COUNT)
+                                {
+                                    (pointer ? map.pointerRegisters : map.otherRegisters) |= (uint8_t) (1 << index);
+                                }
+                                else
+                                {
+                                    (pointer ? map.pointerSlots : map.otherSlots).push_back(slotOffset((int32_t) l));
+                                }
+                            }
+                        }
+                        access(function.instrs[i]);
+                        for (auto write : writes)
+                        {
+                            live[write] = 0;
+                        }
+                        for (auto read : reads)
+                        {
+                            live[read] = 1;
+                        }
+                    }
+                }
+            }
+        };
+    }
+
+    void prepare(Assem::Function &function, const Frame::Frame *frame)
+    {
+        for (auto &instr : function.instrs)
+        {
+            if (instr.dst != Assem::NONE && !Assem::isRegister(instr.dst) &&
+                (size_t) instr.dst < function.tempKinds.size())
+            {
+                instr.kind = function.tempKinds[instr.dst];
+            }
+        }
+        function.frameKinds.clear();
+        if (frame == nullptr)
+        {
+            return;
+        }
+        auto &slotKinds = frame->getSlotKinds();
+        auto kindAt = [&slotKinds](int32_t offset)
+        {
+            auto found = slotKinds.find(offset);
+            return (uint8_t) (found == slotKinds.end() ? Temporary::UNKNOWN : found->second);
+        };
+        for (int32_t word = 1; word <= frame->getLocal_count(); word++)
+        {
+            function.frameKinds.push_back({-Frame::WORD_SIZE * word, kindAt(-Frame::WORD_SIZE * word)});
+        }
+        for (auto &formal : *frame->getFormals())
+        {
+            if (formal->getAccessType() != Frame::IN_FRAME)
+            {
+                continue;
+            }
+            auto offset = std::static_pointer_cast<Frame::AccessFrame>(formal)->getOffset();
+            if (offset > 0)
+            {
+                function.frameKinds.push_back({offset, kindAt(offset)});
+            }
+        }
+    }
+
+    void build(Assem::Function &function)
+    {
+        Builder(function).run();
+    }
+
+    Table makeTable(const Assem::FunctionList &functions)
+    {
+        Table table;
+        size_t calls = 0;
+        for (auto &function : functions)
+        {
+            calls += function->stackMaps.size();
+        }
+        auto base = (uint32_t) (sizeof(int32_t) * (1 + 2 * calls));
+        std::map<std::vector<int32_t>, uint32_t> written;
+        std::vector<int32_t> words;
+        for (auto &function : functions)
+        {
+            auto frame = Emit::layout(*function);
+            int32_t codes = 0;
+            for (size_t i = 0; i < frame.saved.size(); i++)
+            {
+                codes |= (calleeSaveIndex(frame.saved[i]) + 1) << (4 * i);
+            }
+            for (auto &map : function->stackMaps)
+            {
+                words.clear();
+                words.push_back(map.pointerRegisters | map.otherRegisters << 8);
+                words.push_back((int32_t) (map.pointerSlots.size() + map.otherSlots.size()));
+                words.push_back(frame.saveSlots.empty() ? 0 : frame.saveSlots[0]);
+                words.push_back(codes);
+                words.insert(words.end(), map.pointerSlots.begin(), map.pointerSlots.end());
+                for (auto slot : map.otherSlots)
+                {
+                    words.push_back(slot + 1);
+                }
+                auto found = written.find(words);
+                if (found == written.end())
+                {
+                    found = written.emplace(words, base + (uint32_t) (sizeof(int32_t) * table.maps.size())).first;
+                    table.maps.insert(table.maps.end(), words.begin(), words.end());
+                }
+                table.mapOffsets.push_back(found->second);
+            }
+        }
+        return table;
+    }
+}
@@ -0,0 +1,59 @@
+//
+// Stack maps for the garbage collector
+//
+
+#ifndef SRC_STACKMAPS_H
+#define SRC_STACKMAPS_H
+
+#include <cstdint>
+#include <vector>
+#include "Assem.h"
+#include "Frame.h"
+
+// The collector walks the frames of compiled code by their frame pointers
+// and finds in each, at the call the frame waits on, the words and callee
+// saved registers that may hold heap pointers. The compiler writes the map
+// of every call into a table after the code, where the runtime looks the
+// return addresses up.
+namespace StackMaps
+{
+    // Global symbol of the table, which the runtime's main hands the
+    // collector
+    const char *const TABLE_NAME = "tiger_stackMaps";
+
+    // Before allocation: takes what the variables of frame hold, and marks
+    // every instruction with the kind of the temp it writes
+    void prepare(Assem::Function &function, const Frame::Frame *frame);
+
+    // After allocation: the map of every call, from what the registers and
+    // spill slots hold where the call is and whether they are live after it
+    void build(Assem::Function &function);
+
+    // The table in 32-bit words: the number of calls, then for each the
+    // offset from the table of its return address and of its map, in the
+    // order of the code, then the maps. A map is a word with the register
+    // bits of its pointer roots and of its other roots at bit 8, its count
+    // of slots, which a frame of many variables can take past 16 bits, the
+    // slot of the first callee saved register
+    // the function saves, a word with those registers, one more than their
+    // index in Frame::CALLEE_SAVES in each 4 bits, and the slots: offsets
+    // from the frame pointer, plus 1 for a root that is not a pointer root.
+    // Equal maps are written once.
+    struct Table
+    {
+        // Offset from the table of the map of each call
+        std::vector<uint32_t> mapOffsets;
+        // What follows the offsets
+        std::vector<int32_t> maps;
+    };
+
+    Table makeTable(const Assem::FunctionList &functions);
+
+    // Bytes of the table before its maps
+    inline uint32_t headerSize(const Table &table)
+    {
+        return (uint32_t) (sizeof(int32_t) * (1 + 2 * table.mapOffsets.size()));
+    }
+}
+
+#endif //SRC_STACKMAPS_H
@@ -9,30 +9,52 @@ namespace Temporary
 {
     int Temp::tempNum = 0;
 
-    Temp::Temp()
+    Temp::Temp() : kind(UNKNOWN)
     {
+        setNum(tempNum);
+        tempNum += 1;
+    }
+
+    Temp::Temp(int num) : kind(UNKNOWN)
+    {
+        setNum(num);
+    }
+
+    const std::string Temp::getTempName() const
+    {
+        return tempName;
+    }
+
+    int Temp::getNum() const
+    {
+        return num;
+    }
+
+    void Temp::setNum(int num)
+    {
+        Temp::num = num;
         std::stringstream ss;
-        ss << tempNum;
+        ss << num;
         std::string tNum;
         ss >> tNum;
         tempName = "t" + tNum;
-        tempNum += 1;
     }
 
-    const std::string Temp::getTempName() const
+    Kind Temp::getKind() const
     {
-        return tempName;
+        return kind;
+    }
+
+    void Temp::setKind(Kind kind)
+    {
+        Temp::kind = kind;
     }
 
     int Label::labelNum = 0;
 
     Label::Label()
     {
-        std::stringstream ss;
-        ss << labelNum;
-        std::string lNum;
-        ss >> lNum;
-        labelName = "L" + lNum;
+        setNum(labelNum);
         labelNum += 1;
     }
 
@@ -50,13 +72,88 @@ namespace Temporary
         Label::labelName = labelName;
     }
 
-    std::shared_ptr<Temp> makeTemp()
+    void Label::setNum(int num)
+    {
+        std::stringstream ss;
+        ss << num;
+        std::string lNum;
+        ss >> lNum;
+        labelName = "L" + lNum;
+    }
+
+    namespace
+    {
+        thread_local NameScope *activeScope = nullptr;
+    }
+
+    NameScope::NameScope() : parent(activeScope)
+    {
+    }
+
+    std::shared_ptr<Temp> NameScope::makeTemp()
+    {
+        auto temp = std::make_shared<Temp>(-1);
+        temps.push_back(temp);
+        return temp;
+    }
+
+    std::shared_ptr<Label> NameScope::makeLabel()
+    {
+        auto label = std::make_shared<Label>(std::string());
+        labels.push_back(label);
+        return label;
+    }
+
+    void NameScope::commit()
+    {
+        if (parent != nullptr)
+        {
+            parent->temps.insert(parent->temps.end(), temps.begin(), temps.end());
+            parent->labels.insert(parent->labels.end(), labels.begin(), labels.end());
+        }
+        else
+        {
+            for (auto &temp : temps)
+            {
+                temp->setNum(Temp::tempNum++);
+            }
+            for (auto &label : labels)
+            {
+                label->setNum(Label::labelNum++);
+            }
+        }
+        temps.clear();
+        labels.clear();
+    }
+
+    NameScope *NameScope::current()
+    {
+        return activeScope;
+    }
+
+    NameScope::Activation::Activation(NameScope *scope) : saved(activeScope)
+    {
+        activeScope = scope;
+    }
+
+    NameScope::Activation::~Activation()
+    {
+        activeScope = saved;
+    }
+
+    std::shared_ptr<Temp> makeTemp(Kind kind)
     {
-        return std::make_shared<Temp>();
+        auto temp = activeScope != nullptr ? activeScope->makeTemp() : std::make_shared<Temp>();
+        temp->setKind(kind);
+        return temp;
     }
 
     std::shared_ptr<Label> makeLabel()
     {
+        if (activeScope != nullptr)
+        {
+            return activeScope->makeLabel();
+        }
         return std::make_shared<Label>();
     }
 
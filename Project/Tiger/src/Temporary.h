@@ -6,15 +6,35 @@
 #define SRC_TEMPLATE_H
 #include <string>
 #include <memory>
+#include <vector>
 
 namespace Temporary{
+    // What a temp or a variable holds, for the collector's stack maps. A
+    // pointer is nil, a string literal or the start of a heap object, never
+    // an address into one; a temp of unknown kind may hold anything.
+    enum Kind
+    {
+        UNKNOWN, SCALAR, POINTER
+    };
+
     class Temp{
         std::string tempName;
+        int num;
+        Kind kind;
     public:
         static int tempNum;
         Temp();
+        Temp(int num);
 
         const std::string getTempName() const;
+
+        int getNum() const;
+
+        void setNum(int num);
+
+        Kind getKind() const;
+
+        void setKind(Kind kind);
     };
 
     class Label{
@@ -27,9 +47,42 @@ namespace Temporary{
         const std::string getLabelName() const;
 
         void setLabelName(const std::string &labelName);
+
+        void setNum(int num);
+    };
+
+    // Temps and labels made while a NameScope is active on the current thread
+    // get their numbers only when the scope is committed. Committing scopes
+    // in source order hands out the same names a serial run would.
+    class NameScope
+    {
+        NameScope *parent;
+        std::vector<std::shared_ptr<Temp>> temps;
+        std::vector<std::shared_ptr<Label>> labels;
+    public:
+        // The scope active on the constructing thread becomes the parent
+        NameScope();
+
+        std::shared_ptr<Temp> makeTemp();
+
+        std::shared_ptr<Label> makeLabel();
+
+        // Number everything into the parent scope, or globally if there is none
+        void commit();
+
+        static NameScope *current();
+
+        class Activation
+        {
+            NameScope *saved;
+        public:
+            Activation(NameScope *scope);
+
+            ~Activation();
+        };
     };
 
-    std::shared_ptr<Temp> makeTemp();
+    std::shared_ptr<Temp> makeTemp(Kind kind = UNKNOWN);
     std::shared_ptr<Label> makeLabel();
     std::shared_ptr<Label> makeLabel(std::string &labelName);
 }
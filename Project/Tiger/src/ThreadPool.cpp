@@ -0,0 +1,209 @@
+//
+// Work-stealing thread pool shared by the compiler passes
+//
+
+#include "ThreadPool.h"
+
+namespace
+{
+    int configuredThreadNum = 1;
+    // Index of the queue owned by the current thread, -1 outside the pool
+    thread_local int workerIndex = -1;
+}
+
+ThreadPool::ThreadPool(int threadNum)
+        : queued(0), stopping(false)
+{
+    int workerNum = threadNum > 1 ? threadNum - 1 : 0;
+    for (int i = 0; i <= workerNum; i++)
+    {
+        queues.emplace_back(new Queue());
+    }
+    for (int i = 0; i < workerNum; i++)
+    {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::setThreadNum(int threadNum)
+{
+    configuredThreadNum = threadNum < 1 ? 1 : threadNum;
+}
+
+int ThreadPool::getThreadNum()
+{
+    return configuredThreadNum;
+}
+
+ThreadPool &ThreadPool::instance()
+{
+    static ThreadPool pool(configuredThreadNum);
+    return pool;
+}
+
+void ThreadPool::workerLoop(int index)
+{
+    workerIndex = index;
+    std::function<void()> task;
+    while (true)
+    {
+        if (popTask(task))
+        {
+            task();
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepLock);
+        wakeUp.wait(lock, [this] { return stopping || queued > 0; });
+        if (stopping && queued == 0)
+        {
+            return;
+        }
+    }
+}
+
+bool ThreadPool::popTask(std::function<void()> &task)
+{
+    int own = workerIndex >= 0 ? workerIndex : (int) queues.size() - 1;
+    // Newest own task first, it is the one most likely to be warm in cache
+    {
+        auto &queue = *queues[own];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            queued--;
+            return true;
+        }
+    }
+    // Otherwise steal the oldest task of another queue
+    for (size_t i = 1; i < queues.size(); i++)
+    {
+        auto &queue = *queues[(own + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::push(std::function<void()> task)
+{
+    int own = workerIndex >= 0 ? workerIndex : (int) queues.size() - 1;
+    {
+        auto &queue = *queues[own];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.tasks.push_back(std::move(task));
+        queued++;
+    }
+    // Taking the lock orders this wake-up after a sleeper's check of `queued`
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+    }
+    wakeUp.notify_one();
+}
+
+bool ThreadPool::runOne()
+{
+    std::function<void()> task;
+    if (!popTask(task))
+    {
+        return false;
+    }
+    task();
+    return true;
+}
+
+TaskGroup::TaskGroup() : pending(0)
+{
+}
+
+TaskGroup::~TaskGroup()
+{
+    while (pending > 0)
+    {
+        if (!ThreadPool::instance().runOne())
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void TaskGroup::run(std::function<void()> task)
+{
+    auto guarded = [this, task]()
+    {
+        try
+        {
+            task();
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> guard(errorLock);
+            if (!error)
+            {
+                error = std::current_exception();
+            }
+        }
+    };
+    if (ThreadPool::getThreadNum() <= 1)
+    {
+        guarded();
+        return;
+    }
+    pending++;
+    ThreadPool::instance().push([this, guarded]()
+                                {
+                                    guarded();
+                                    pending--;
+                                });
+}
+
+void TaskGroup::wait()
+{
+    while (pending > 0)
+    {
+        if (!ThreadPool::instance().runOne())
+        {
+            std::this_thread::yield();
+        }
+    }
+    if (error)
+    {
+        auto first = error;
+        error = nullptr;
+        std::rethrow_exception(first);
+    }
+}
+
+void parallelFor(size_t n, const std::function<void(size_t)> &task)
+{
+    TaskGroup group;
+    for (size_t i = 0; i < n; i++)
+    {
+        group.run([&task, i]()
+                  {
+                      task(i);
+                  });
+    }
+    group.wait();
+}
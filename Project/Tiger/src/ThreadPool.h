@@ -0,0 +1,80 @@
+//
+// Work-stealing thread pool shared by the compiler passes
+//
+
+#ifndef SRC_THREADPOOL_H
+#define SRC_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+    struct Queue
+    {
+        std::mutex lock;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    // One queue per worker thread, plus a last one for outside threads
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<int> queued;
+    std::mutex sleepLock;
+    std::condition_variable wakeUp;
+    bool stopping;
+
+    explicit ThreadPool(int threadNum);
+
+    void workerLoop(int index);
+
+    bool popTask(std::function<void()> &task);
+
+public:
+    ~ThreadPool();
+
+    // Number of threads work runs on, counting the thread that waits
+    static void setThreadNum(int threadNum);
+
+    static int getThreadNum();
+
+    // The pool is started on first use with the configured thread count
+    static ThreadPool &instance();
+
+    void push(std::function<void()> task);
+
+    // Run one queued task on the calling thread, false if none was found
+    bool runOne();
+};
+
+// A set of tasks that is waited for as a whole. Tasks run inline when the
+// pool has a single thread, so a serial run takes exactly the same path.
+class TaskGroup
+{
+    std::atomic<int> pending;
+    std::mutex errorLock;
+    std::exception_ptr error;
+
+public:
+    TaskGroup();
+
+    ~TaskGroup();
+
+    void run(std::function<void()> task);
+
+    // Helps with queued work until every task of the group has finished,
+    // then rethrows the first exception a task threw
+    void wait();
+};
+
+// Runs task(0) .. task(n - 1) as one task group and waits for all of them
+void parallelFor(size_t n, const std::function<void(size_t)> &task);
+
+#endif //SRC_THREADPOOL_H
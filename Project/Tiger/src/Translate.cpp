@@ -3,6 +3,7 @@
 //
 
 #include "Translate.h"
+#include <iterator>
 
 namespace Translate
 {
@@ -114,7 +115,9 @@ namespace Translate
 
 
 
-    static std::shared_ptr<Level> globalLevel = makeNewLevel(nullptr, Temporary::makeLabel(),
+    static std::shared_ptr<Level> globalLevel = makeNewLevel(nullptr,
+                                                             std::make_shared<Temporary::Label>(Frame::MAIN_NAME),
+                                                             std::make_shared<BoolList>(),
                                                              std::make_shared<BoolList>());
 
     std::shared_ptr<Level> getGlobalLevel(void)
@@ -124,18 +127,20 @@ namespace Translate
 
 
     std::shared_ptr<Level> makeNewLevel(std::shared_ptr<Level> parent, std::shared_ptr<Temporary::Label> name,
-                                        std::shared_ptr<BoolList> formals)
+                                        std::shared_ptr<BoolList> formals, std::shared_ptr<BoolList> pointers)
     {
+        // The static link, which points at a frame
         formals->push_front(true);
-        auto l = std::make_shared<Level>(parent, name, Frame::makeFrame(name, formals), nullptr);
+        pointers->push_front(false);
+        auto l = std::make_shared<Level>(parent, name, Frame::makeFrame(name, formals, pointers), nullptr);
         l->setFormals(makeFormalAccessList(l));
         return l;
     }
 
 
-    std::shared_ptr<Access> allocLocal(std::shared_ptr<Level> level, bool escape)
+    std::shared_ptr<Access> allocLocal(std::shared_ptr<Level> level, bool escape, bool pointer)
     {
-        return std::make_shared<Access>(level, Frame::allocLocalVariable(level->getFrame(), escape));
+        return std::make_shared<Access>(level, Frame::allocLocalVariable(level->getFrame(), escape, pointer));
     }
 
 
@@ -188,21 +193,17 @@ namespace Translate
                 return IR::makeEseq(std::dynamic_pointer_cast<Nx>(exp)->getNx(), IR::makeConst(0));
             case CX:
             {
-                auto r = Temporary::makeTemp();
+                auto r = Temporary::makeTemp(Temporary::SCALAR);
                 auto t = Temporary::makeLabel();
                 auto f = Temporary::makeLabel();
                 auto cx = std::dynamic_pointer_cast<Cx>(exp);
                 doPatch(cx->getPatchList(), t, f);
-                return IR::makeEseq(IR::makeMove(IR::makeTemp(r), IR::makeConst(1)),
-                                    IR::makeEseq(cx->getStm(),
-                                                 IR::makeEseq(IR::makeLabel(f),
-                                                              IR::makeEseq(IR::makeMove(
-                                                                      IR::makeTemp(r),
-                                                                      IR::makeConst(0)),
-                                                                           IR::makeEseq(
-                                                                                   IR::makeLabel(t),
-                                                                                   IR::makeTemp(
-                                                                                           r))))));
+                return IR::makeEseq({IR::makeMove(IR::makeTemp(r), IR::makeConst(1)),
+                                     cx->getStm(),
+                                     IR::makeLabel(f),
+                                     IR::makeMove(IR::makeTemp(r), IR::makeConst(0)),
+                                     IR::makeLabel(t)},
+                                    IR::makeTemp(r));
             }
             default:
                 Tiger::Error error("something wrong in Translate::unEx");
@@ -232,7 +233,7 @@ namespace Translate
             {
                 auto patchList = std::make_shared<PatchList>();
                 auto ex = std::dynamic_pointer_cast<Ex>(exp);
-                auto stm = IR::makeCJump(IR::EQ, ex->getEx(), IR::makeConst(1), nullptr, nullptr);
+                auto stm = IR::makeCJump(IR::NE, ex->getEx(), IR::makeConst(0), nullptr, nullptr);
                 patchList->push_front(std::dynamic_pointer_cast<IR::CJump>(stm));
                 return std::make_shared<Cx>(patchList, stm);
             }
@@ -263,7 +264,7 @@ namespace Translate
     {
         auto temp = Frame::getFP();
         auto addr = IR::makeTemp(temp);
-        while (level != access->getLevel()->getParent())
+        while (level != access->getLevel())
         {
             auto frame = level->getFrame();
             auto formals = frame->getFormals();
@@ -287,7 +288,7 @@ namespace Translate
     {
         auto right = IR::makeConst(Frame::WORD_SIZE);
         auto left = unEx(index);
-        auto right2 = IR::makeBinop(IR::PLUS, left, right);
+        auto right2 = IR::makeBinop(IR::MUL, left, right);
         auto left2 = unEx(base);
         auto binop = IR::makeBinop(IR::PLUS, left2, right2);
         auto mem = IR::makeMem(binop);
@@ -298,22 +299,74 @@ namespace Translate
     {
         std::shared_ptr<Frame::FragList> stringFragList = std::make_shared<Frame::FragList>();
         std::shared_ptr<Frame::FragList> procFragList = std::make_shared<Frame::FragList>();
-        std::shared_ptr<Temporary::Temp> nilTemp;
+        // The literals made outside any FragScope
+        std::unordered_map<std::string, std::shared_ptr<Temporary::Label>> literalPool;
+        thread_local FragScope *activeScope = nullptr;
+    }
+
+    FragScope::FragScope() : parent(activeScope)
+    {
+    }
+
+    void FragScope::commit()
+    {
+        auto &stringTarget = parent ? parent->stringFrags : *stringFragList;
+        auto &procTarget = parent ? parent->procFrags : *procFragList;
+        // Both lists are built with push_front, so the newest fragment leads
+        stringTarget.splice(stringTarget.begin(), stringFrags);
+        procTarget.splice(procTarget.begin(), procFrags);
+        // A literal a sibling made first stays, getResult merges the two
+        auto &literalTarget = parent ? parent->literals : literalPool;
+        literalTarget.insert(literals.begin(), literals.end());
+        literals.clear();
+    }
+
+    FragScope *FragScope::current()
+    {
+        return activeScope;
+    }
+
+    FragScope::Activation::Activation(FragScope *scope) : saved(activeScope)
+    {
+        activeScope = scope;
+    }
+
+    FragScope::Activation::~Activation()
+    {
+        activeScope = saved;
     }
 
     void procEntryExit(std::shared_ptr<Level> level, std::shared_ptr<Exp> body)
     {
-        auto procBody = unNx(body);
         auto procFrame = level->getFrame();
+        auto procBody = Frame::procEntryExit1(procFrame, IR::makeMove(IR::makeTemp(Frame::getRV()), unEx(body)));
         auto procFrag = Frame::makeProcFrag(procBody, procFrame);
-        procFragList->push_front(procFrag);
+        auto &fragList = activeScope ? activeScope->procFrags : *procFragList;
+        fragList.push_front(procFrag);
     }
 
     std::shared_ptr<Exp> makeStringExp(const std::string &s)
     {
+        // The enclosing scopes wait while this one is translated, so their
+        // literals can be read
+        for (auto scope = activeScope;; scope = scope->parent)
+        {
+            auto &literals = scope ? scope->literals : literalPool;
+            auto found = literals.find(s);
+            if (found != literals.end())
+            {
+                return makeEx(IR::makeName(found->second));
+            }
+            if (scope == nullptr)
+            {
+                break;
+            }
+        }
         auto label = Temporary::makeLabel();
         auto frag = Frame::makeStringFrag(label, s);
-        stringFragList->push_front(frag);
+        auto &fragList = activeScope ? activeScope->stringFrags : *stringFragList;
+        fragList.push_front(frag);
+        (activeScope ? activeScope->literals : literalPool).emplace(s, label);
         auto name = IR::makeName(label);
         return makeEx(name);
     }
@@ -326,16 +379,7 @@ namespace Translate
 
     std::shared_ptr<Exp> makeNilExp()
     {
-        if (nullptr == nilTemp)
-        {
-            nilTemp = Temporary::makeTemp();
-            auto dst = IR::makeTemp(nilTemp);
-            auto src = Frame::makeExternalCall("initRecord", IR::makeExpList(IR::makeConst(0), nullptr));
-            auto alloc = IR::makeMove(dst, src);
-            auto eseq = IR::makeEseq(alloc, IR::makeTemp(nilTemp));
-            return makeEx(eseq);
-        }
-        return makeEx(IR::makeTemp(nilTemp));
+        return makeEx(IR::makeConst(0));
     }
 
     std::shared_ptr<Exp>
@@ -343,10 +387,20 @@ namespace Translate
                 std::shared_ptr<Level> defLevel,
                 std::shared_ptr<ExpList> l)
     {
-        auto entry = getStaticLink(usageLevel, defLevel);
-        l->push_front(entry);
+        // size reads the length before the characters, with no call
+        if (defLevel == nullptr && l->size() == 1 &&
+            label->getLabelName() == Frame::makeRuntimeLabel("size")->getLabelName())
+        {
+            return makeEx(IR::makeMem(unEx(l->front())));
+        }
         IR::ExpList arglist;
-        for (auto exp = l->begin(); exp != l->end(); exp++)
+        // Library functions have no level and take no static link
+        if (defLevel != nullptr)
+        {
+            arglist.push_back(unEx(getStaticLink(usageLevel, defLevel)));
+        }
+        // The arguments are listed last one first
+        for (auto exp = l->rbegin(); exp != l->rend(); exp++)
         {
             arglist.push_back(unEx(*exp));
         }
@@ -356,46 +410,67 @@ namespace Translate
         return makeEx(call2);
     }
 
-    std::shared_ptr<Exp> makeRecordExp(int n, std::shared_ptr<ExpList> l)
+    std::shared_ptr<Exp> makeRecordExp(int n, std::shared_ptr<ExpList> l, const std::string &layout)
     {
-        auto r = Temporary::makeTemp();
+        auto r = Temporary::makeTemp(Temporary::POINTER);
+        auto layoutExp = layout.find('1') != std::string::npos ? unEx(makeStringExp(layout)) : IR::makeConst(0);
         auto alloc = IR::makeMove(IR::makeTemp(r),
                                   Frame::makeExternalCall("initRecord", IR::makeExpList(
-                                          IR::makeConst(n * Frame::WORD_SIZE), nullptr)));
-        int i = n - 1;
-        auto seq = IR::makeMove(
-                IR::makeMem(IR::makeBinop(IR::PLUS, IR::makeTemp(r),
-                                          IR::makeConst(i * Frame::WORD_SIZE))),
-                unEx(l->front()));
-        i--;
-        for (auto exp = l->begin(); exp != l->end(); exp++, i--)
+                                          IR::makeConst(n * Frame::WORD_SIZE),
+                                          IR::makeExpList(layoutExp, nullptr))));
+        IR::StmVector stms;
+        stms.reserve(2 * n + 1);
+        // The fields are listed last one first. They are evaluated before
+        // the record is allocated, so no call comes between the allocation
+        // and the stores and the native code need not clear the record.
+        std::vector<std::shared_ptr<IR::Exp>> values;
+        int i = 0;
+        for (auto exp = l->rbegin(); exp != l->rend(); exp++, i++)
+        {
+            auto value = unEx(*exp);
+            if (value->getExpType() != IR::CONST && value->getExpType() != IR::NAME)
+            {
+                auto t = Temporary::makeTemp((size_t) i < layout.size() && layout[i] == '1' ? Temporary::POINTER
+                                                                                            : Temporary::SCALAR);
+                stms.push_back(IR::makeMove(IR::makeTemp(t), value));
+                value = IR::makeTemp(t);
+            }
+            values.push_back(value);
+        }
+        stms.push_back(alloc);
+        for (i = 0; i < (int) values.size(); i++)
         {
-            auto move = IR::makeMove(IR::makeMem(IR::makeBinop(IR::PLUS, IR::makeTemp(r),
-                                                               IR::makeConst(i * Frame::WORD_SIZE))),
-                                     unEx(*exp));
-            seq = IR::makeSeq(move, seq);
+            stms.push_back(IR::makeMove(IR::makeMem(IR::makeBinop(IR::PLUS, IR::makeTemp(r),
+                                                                  IR::makeConst(i * Frame::WORD_SIZE))),
+                                        values[i]));
         }
-        auto eseq = IR::makeEseq(IR::makeSeq(alloc, seq), IR::makeTemp(r));
+        auto eseq = IR::makeEseq(std::move(stms), IR::makeTemp(r));
         return makeEx(eseq);
     }
 
-    std::shared_ptr<Exp> makeArrayExp(std::shared_ptr<Exp> size, std::shared_ptr<Exp> init)
+    std::shared_ptr<Exp> makeArrayExp(std::shared_ptr<Exp> size, std::shared_ptr<Exp> init, bool pointers)
     {
         auto call = Frame::makeExternalCall("initArray",
-                                            IR::makeExpList(unEx(size), IR::makeExpList(unEx(init), NULL)));
+                                            IR::makeExpList(unEx(size), IR::makeExpList(unEx(init), IR::makeExpList(
+                                                    IR::makeConst(pointers ? 1 : 0), NULL))));
         return makeEx(call);
     }
 
     std::shared_ptr<Exp> makeSeqExp(std::shared_ptr<ExpList> l)
     {
-        auto resl = unEx(l->front());
-        auto exp = l->begin();
-        exp++;
-        for (; exp != l->end(); exp++)
+        // The expressions are listed last one first, and the last one gives
+        // the value
+        if (l->size() == 1)
+        {
+            return makeEx(unEx(l->front()));
+        }
+        IR::StmVector stms;
+        stms.reserve(l->size() - 1);
+        for (auto exp = l->rbegin(); exp != std::prev(l->rend()); exp++)
         {
-            resl = IR::makeEseq(IR::makeExp(unEx(*exp)), resl);
+            stms.push_back(IR::makeExp(unEx(*exp)));
         }
-        return makeEx(resl);
+        return makeEx(IR::makeEseq(std::move(stms), unEx(l->front())));
     }
 
     std::shared_ptr<Exp> makeDoneExp()
@@ -416,22 +491,13 @@ namespace Translate
         auto labelList = std::make_shared<IR::LabelList>();
         labelList->push_front(testLabel);
         auto doneLabel = std::dynamic_pointer_cast<IR::Name>(unEx(done))->getLabel();
-        return makeEx(IR::makeEseq(IR::makeJump(IR::makeName(testLabel), labelList),
-                                   IR::makeEseq(IR::makeLabel(bodyLabel),
-                                                IR::makeEseq(unNx(body),
-                                                             IR::makeEseq(IR::makeLabel(testLabel),
-                                                                          IR::makeEseq(
-                                                                                  IR::makeCJump(
-                                                                                          IR::EQ,
-                                                                                          unEx(test),
-                                                                                          IR::makeConst(0),
-                                                                                          doneLabel,
-                                                                                          bodyLabel),
-                                                                                  IR::makeEseq(
-                                                                                          IR::makeLabel(
-                                                                                                  bodyLabel),
-                                                                                          IR::makeConst(
-                                                                                                  0))))))));
+        return makeEx(IR::makeEseq({IR::makeJump(IR::makeName(testLabel), labelList),
+                                    IR::makeLabel(bodyLabel),
+                                    unNx(body),
+                                    IR::makeLabel(testLabel),
+                                    IR::makeCJump(IR::EQ, unEx(test), IR::makeConst(0), doneLabel, bodyLabel),
+                                    IR::makeLabel(doneLabel)},
+                                   IR::makeConst(0)));
     }
 
 
@@ -440,6 +506,22 @@ namespace Translate
         return makeNx(IR::makeMove(unEx(lval), unEx(exp)));
     }
 
+    std::shared_ptr<Exp> makeHeapAssignExp(std::shared_ptr<Exp> lval, std::shared_ptr<Exp> exp)
+    {
+        auto mem = std::dynamic_pointer_cast<IR::Mem>(unEx(lval));
+        if (mem == nullptr)
+        {
+            return makeAssignExp(lval, exp);
+        }
+        // The address is worked out once, before the value as the plain
+        // store would
+        auto address = Temporary::makeTemp();
+        return makeNx(IR::makeSeq({IR::makeMove(IR::makeTemp(address), mem->getExp()),
+                                   IR::makeMove(IR::makeMem(IR::makeTemp(address)), unEx(exp)),
+                                   IR::makeExp(Frame::makeExternalCall("markCard", IR::makeExpList(
+                                           IR::makeTemp(address), nullptr)))}));
+    }
+
     std::shared_ptr<Exp> makeBreakExp(std::shared_ptr<Exp> b)
     {
         auto breakLabel = std::dynamic_pointer_cast<IR::Name>(unEx(b))->getLabel();
@@ -465,11 +547,52 @@ namespace Translate
     std::shared_ptr<Exp>
     makeStringComparisonExp(IR::ComparisonOp op, std::shared_ptr<Exp> left, std::shared_ptr<Exp> right)
     {
-        auto resl = Frame::makeExternalCall(std::string("strcmp"),
-                                            IR::makeExpList(unEx(left),
-                                                            IR::makeExpList(unEx(right), nullptr)));
-        auto zero = IR::makeConst(0);
-        auto cond = IR::makeCJump(op, resl, zero, nullptr, nullptr);
+        auto leftExp = unEx(left);
+        auto rightExp = unEx(right);
+        std::shared_ptr<IR::Stm> cond;
+        if (op != IR::EQ && op != IR::NE)
+        {
+            auto resl = Frame::makeExternalCall(std::string("strcmp"),
+                                                IR::makeExpList(leftExp, IR::makeExpList(rightExp, nullptr)));
+            cond = IR::makeCJump(op, resl, IR::makeConst(0), nullptr, nullptr);
+        }
+        else if (leftExp->getExpType() == IR::NAME && rightExp->getExpType() == IR::NAME)
+        {
+            // Literals of the same content share a label
+            cond = IR::makeCJump(op, leftExp, rightExp, nullptr, nullptr);
+        }
+        else
+        {
+            // r is zero when the strings are equal: the same string, or of
+            // the same length and content
+            auto r = Temporary::makeTemp(Temporary::SCALAR);
+            auto a = Temporary::makeTemp(Temporary::POINTER);
+            auto b = Temporary::makeTemp(Temporary::POINTER);
+            auto same = Temporary::makeLabel();
+            auto lengths = Temporary::makeLabel();
+            auto differ = Temporary::makeLabel();
+            auto content = Temporary::makeLabel();
+            auto done = Temporary::makeLabel();
+            auto toDone = std::make_shared<IR::LabelList>(1, done);
+            auto compare = IR::makeSeq(
+                    {IR::makeMove(IR::makeTemp(a), leftExp),
+                     IR::makeMove(IR::makeTemp(b), rightExp),
+                     IR::makeCJump(IR::EQ, IR::makeTemp(a), IR::makeTemp(b), same, lengths),
+                     IR::makeLabel(lengths),
+                     IR::makeCJump(IR::NE, IR::makeMem(IR::makeTemp(a)), IR::makeMem(IR::makeTemp(b)), differ,
+                                   content),
+                     IR::makeLabel(content),
+                     IR::makeMove(IR::makeTemp(r), Frame::makeExternalCall(
+                             "strcmp", IR::makeExpList(IR::makeTemp(a), IR::makeExpList(IR::makeTemp(b), nullptr)))),
+                     IR::makeJump(IR::makeName(done), toDone),
+                     IR::makeLabel(same),
+                     IR::makeMove(IR::makeTemp(r), IR::makeConst(0)),
+                     IR::makeJump(IR::makeName(done), toDone),
+                     IR::makeLabel(differ),
+                     IR::makeMove(IR::makeTemp(r), IR::makeConst(1)),
+                     IR::makeLabel(done)});
+            cond = IR::makeCJump(op, IR::makeEseq(compare, IR::makeTemp(r)), IR::makeConst(0), nullptr, nullptr);
+        }
         auto patchList = std::make_shared<PatchList>();
         patchList->push_front(std::dynamic_pointer_cast<IR::CJump>(cond));
         return makeCx(patchList, cond);
@@ -497,24 +620,14 @@ namespace Translate
             switch (then->getKind())
             {
                 case NX:
-                    result = makeNx(IR::makeSeq(cond->getStm(),
-                                                IR::makeSeq(IR::makeLabel(t),
-                                                            IR::makeSeq(std::dynamic_pointer_cast<Nx>(
-                                                                    then)->getNx(),
-                                                                        IR::makeLabel(f)))));
+                    result = makeNx(IR::makeSeq({cond->getStm(), IR::makeLabel(t),
+                                                 std::dynamic_pointer_cast<Nx>(then)->getNx(), IR::makeLabel(f)}));
                     break;
                 case CX:
-                    result = makeNx(IR::makeSeq(cond->getStm(),
-                                                IR::makeSeq(IR::makeLabel(t),
-                                                            IR::makeSeq(std::dynamic_pointer_cast<Cx>(
-                                                                    then)->getStm(),
-                                                                        IR::makeLabel(f)))));
+                    result = makeNx(IR::makeSeq({cond->getStm(), IR::makeLabel(t), unNx(then), IR::makeLabel(f)}));
                     break;
                 case EX:
-                    result = makeNx(IR::makeSeq(cond->getStm(),
-                                                IR::makeSeq(IR::makeLabel(t),
-                                                            IR::makeSeq(unEx(then),
-                                                                        IR::makeLabel(f)))));
+                    result = makeNx(IR::makeSeq({cond->getStm(), IR::makeLabel(t), unEx(then), IR::makeLabel(f)}));
                     break;
                 default:
                     Tiger::Error error("something wrong in [Translate::IfExp no else], type of [then] exp error");
@@ -522,55 +635,32 @@ namespace Translate
         }
         else
         {
-            auto r = Temporary::makeTemp();
             auto join = Temporary::makeLabel();
-            auto labelList = std::make_shared<IR::LabelList>();
-            labelList->push_front(join);
-            auto joinJump = IR::makeJump(IR::makeName(join), labelList);
-            std::shared_ptr<IR::Stm> thenStm;
-            switch (then->getKind())
+            auto joinJump = [&join]()
             {
-                case EX:
-                    thenStm = IR::makeExp(std::dynamic_pointer_cast<Ex>(then)->getEx());
-                    break;
-                case NX:
-                    thenStm = std::dynamic_pointer_cast<Nx>(then)->getNx();
-                    break;
-                case CX:
-                    thenStm = std::dynamic_pointer_cast<Cx>(then)->getStm();
-                    break;
-                default:
-                    Tiger::Error error("something wrong in Translate::IfExp in else in then");
+                auto labelList = std::make_shared<IR::LabelList>();
+                labelList->push_front(join);
+                return IR::makeJump(IR::makeName(join), labelList);
+            };
+            if (then->getKind() == NX || elsee->getKind() == NX)
+            {
+                result = makeNx(IR::makeSeq({cond->getStm(), IR::makeLabel(t), unNx(then), joinJump(),
+                                             IR::makeLabel(f), unNx(elsee), joinJump(), IR::makeLabel(join)}));
             }
-
-            std::shared_ptr<IR::Stm> elseeStm;
-            switch (elsee->getKind())
+            else
             {
-                case EX:
-                    elseeStm = IR::makeExp(std::dynamic_pointer_cast<Ex>(elsee)->getEx());
-                    break;
-                case NX:
-                    elseeStm = std::dynamic_pointer_cast<Nx>(elsee)->getNx();
-                    break;
-                case CX:
-                    elseeStm = std::dynamic_pointer_cast<Cx>(elsee)->getStm();
-                    break;
-                default:
-                    Tiger::Error error("something wrong in Translate::IfExp in else in elsee");
+                // Both branches give a value, which ends up in r
+                auto r = Temporary::makeTemp();
+                result = makeEx(IR::makeEseq({cond->getStm(),
+                                              IR::makeLabel(t),
+                                              IR::makeMove(IR::makeTemp(r), unEx(then)),
+                                              joinJump(),
+                                              IR::makeLabel(f),
+                                              IR::makeMove(IR::makeTemp(r), unEx(elsee)),
+                                              joinJump(),
+                                              IR::makeLabel(join)},
+                                             IR::makeTemp(r)));
             }
-            result = makeNx(IR::makeSeq(cond->getStm(),
-                                        IR::makeSeq(IR::makeLabel(t),
-                                                    IR::makeSeq(thenStm,
-                                                                IR::makeSeq(joinJump,
-                                                                            IR::makeSeq(
-                                                                                    IR::makeLabel(
-                                                                                            f),
-                                                                                    IR::makeSeq(
-                                                                                            elseeStm,
-                                                                                            IR::makeSeq(
-                                                                                                    joinJump,
-                                                                                                    IR::makeLabel(
-                                                                                                            join)))))))));
         }
         return result;
     }
@@ -578,6 +668,19 @@ namespace Translate
 
     std::shared_ptr<Frame::FragList> getResult()
     {
+        std::unordered_map<std::string, std::string> literalNames;
+        for (auto frag = stringFragList->begin(); frag != stringFragList->end();)
+        {
+            auto string = std::static_pointer_cast<Frame::StringFrag>(*frag);
+            auto first = literalNames.emplace(string->getStr(), string->getLabel()->getLabelName());
+            if (first.second)
+            {
+                frag++;
+                continue;
+            }
+            string->getLabel()->setLabelName(first.first->second);
+            frag = stringFragList->erase(frag);
+        }
         auto iter = procFragList->begin();
         for (; iter != procFragList->end(); iter++)
         {
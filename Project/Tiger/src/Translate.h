@@ -7,6 +7,7 @@
 
 #include <memory>
 #include <list>
+#include <unordered_map>
 #include "IR.h"
 #include "Temporary.h"
 #include "Frame.h"
@@ -56,10 +57,11 @@ namespace Translate
 
     std::shared_ptr<Level> getGlobalLevel(void);
 
+    // pointers tells for each formal whether it holds a pointer
     std::shared_ptr<Level> makeNewLevel(std::shared_ptr<Level> parent, std::shared_ptr<Temporary::Label> name,
-                                        std::shared_ptr<BoolList> formals);
+                                        std::shared_ptr<BoolList> formals, std::shared_ptr<BoolList> pointers);
 
-    std::shared_ptr<Access> allocLocal(std::shared_ptr<Level> level, bool escape);
+    std::shared_ptr<Access> allocLocal(std::shared_ptr<Level> level, bool escape, bool pointer);
 
     /* ----------------IR------------------ */
 
@@ -122,6 +124,8 @@ namespace Translate
 
     std::shared_ptr<Exp> makeSubscriptVar(std::shared_ptr<Exp> base, std::shared_ptr<Exp> index);
 
+    // The label of a literal with the content s, made once for each
+    // content, so equal literals are the same string
     std::shared_ptr<Exp> makeStringExp(const std::string &s);
 
     std::shared_ptr<Exp> makeIntExp(int i);
@@ -135,9 +139,11 @@ namespace Translate
 
     std::shared_ptr<Exp> makeNilExp();
 
-    std::shared_ptr<Exp> makeRecordExp(int n, std::shared_ptr<ExpList> l);
+    // layout has a '1' for each field that holds a pointer and a '0' for
+    // each int, for the garbage collector
+    std::shared_ptr<Exp> makeRecordExp(int n, std::shared_ptr<ExpList> l, const std::string &layout);
 
-    std::shared_ptr<Exp> makeArrayExp(std::shared_ptr<Exp> size, std::shared_ptr<Exp> init);
+    std::shared_ptr<Exp> makeArrayExp(std::shared_ptr<Exp> size, std::shared_ptr<Exp> init, bool pointers);
 
     std::shared_ptr<Exp> makeSeqExp(std::shared_ptr<ExpList> l);
 
@@ -149,6 +155,10 @@ namespace Translate
 
     std::shared_ptr<Exp> makeAssignExp(std::shared_ptr<Exp> lval, std::shared_ptr<Exp> exp);
 
+    // A pointer stored into a field or an element, which marks the card of
+    // the address for the garbage collector
+    std::shared_ptr<Exp> makeHeapAssignExp(std::shared_ptr<Exp> lval, std::shared_ptr<Exp> exp);
+
     std::shared_ptr<Exp> makeBreakExp(std::shared_ptr<Exp> b);
 
     std::shared_ptr<Exp>
@@ -157,6 +167,8 @@ namespace Translate
     std::shared_ptr<Exp>
     makeIntComparisonExp(IR::ComparisonOp op, std::shared_ptr<Exp> left, std::shared_ptr<Exp> right);
 
+    // = and <> compare two literals by address, and other strings by
+    // address, then length and only then content
     std::shared_ptr<Exp>
     makeStringComparisonExp(IR::ComparisonOp op, std::shared_ptr<Exp> left, std::shared_ptr<Exp> right);
 
@@ -170,8 +182,45 @@ namespace Translate
 
     void procEntryExit(std::shared_ptr<Level>, std::shared_ptr<Exp>);
 
+    // The fragments, with a literal that bodies translated concurrently
+    // both made kept once
     std::shared_ptr<Frame::FragList> getResult();
 
+    // Fragments translated while a FragScope is active on the current thread
+    // are kept in the scope until it is committed, so function bodies can be
+    // translated concurrently and still be merged in source order.
+    class FragScope
+    {
+        FragScope *parent;
+        Frame::FragList stringFrags;
+        Frame::FragList procFrags;
+        // Label of each string literal the scope made, by its content
+        std::unordered_map<std::string, std::shared_ptr<Temporary::Label>> literals;
+    public:
+        // The scope active on the constructing thread becomes the parent
+        FragScope();
+
+        // Move the fragments into the parent scope, or into the result list
+        void commit();
+
+        static FragScope *current();
+
+        class Activation
+        {
+            FragScope *saved;
+        public:
+            Activation(FragScope *scope);
+
+            ~Activation();
+        };
+
+        friend void procEntryExit(std::shared_ptr<Level>, std::shared_ptr<Exp>);
+
+        friend std::shared_ptr<Exp> makeStringExp(const std::string &s);
+
+        friend std::shared_ptr<Exp> makeNilExp();
+    };
+
     std::shared_ptr<Exp> makeEx(const std::shared_ptr<IR::Exp> &ex);
 }
 
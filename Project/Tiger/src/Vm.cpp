@@ -0,0 +1,285 @@
+//
+// Interpreter of the register bytecode
+//
+
+#include "Vm.h"
+#include "../runtime/runtime.h"
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+namespace Vm
+{
+    namespace
+    {
+        // Words of the VM stack. The memory is not touched before a frame
+        // needs it, so the system commits only what deep recursion uses.
+        const size_t STACK_WORDS = (size_t) 1 << 24;
+        // The words between an argument past the sixth and fp, where the
+        // native frame keeps the return address and the caller's fp
+        const int64_t LINK_WORDS = 2;
+
+        // Where to go on when a call returns
+        struct Return
+        {
+            const Bytecode::Function *function;
+            const int32_t *pc;
+            int64_t *regs;
+            char *fp;
+            int32_t dst;
+        };
+
+        template<typename T>
+        T *pointer(int64_t value)
+        {
+            return reinterpret_cast<T *>(value);
+        }
+
+        int64_t word(const void *value)
+        {
+            return reinterpret_cast<int64_t>(value);
+        }
+
+        int64_t callNative(int32_t native, const int64_t *args)
+        {
+            switch ((Bytecode::Native) native)
+            {
+                case Bytecode::INIT_ARRAY:
+                    return word(tiger_initArray(args[0], args[1], args[2]));
+                case Bytecode::INIT_RECORD:
+                    return word(tiger_initRecord(args[0], pointer<TigerString>(args[1])));
+                case Bytecode::STRCMP:
+                    return tiger_strcmp(pointer<TigerString>(args[0]), pointer<TigerString>(args[1]));
+                case Bytecode::PRINT:
+                    tiger_print(pointer<TigerString>(args[0]));
+                    return 0;
+                case Bytecode::FLUSH:
+                    tiger_flush();
+                    return 0;
+                case Bytecode::GETCHAR:
+                    return word(tiger_getchar());
+                case Bytecode::ORD:
+                    return tiger_ord(pointer<TigerString>(args[0]));
+                case Bytecode::CHR:
+                    return word(tiger_chr(args[0]));
+                case Bytecode::SIZE:
+                    return tiger_size(pointer<TigerString>(args[0]));
+                case Bytecode::SUBSTRING:
+                    return word(tiger_substring(pointer<TigerString>(args[0]), args[1], args[2]));
+                case Bytecode::CONCAT:
+                    return word(tiger_concat(pointer<TigerString>(args[0]), pointer<TigerString>(args[1])));
+                case Bytecode::NOT:
+                    return tiger_not(args[0]);
+                case Bytecode::MARK_CARD:
+                    tiger_markCard(pointer<int64_t>(args[0]));
+                    return 0;
+                case Bytecode::EXIT:
+                default:
+                    tiger_exit(args[0]);
+                    return 0;
+            }
+        }
+
+        void overflow()
+        {
+            std::fflush(stdout);
+            std::fputs("Stack overflow\n", stderr);
+            std::exit(1);
+        }
+    }
+
+    int run(const Bytecode::Program &program)
+    {
+        static void *const dispatch[Bytecode::OPCODE_COUNT] = {
+                &&MOVE, &&LOADI, &&LOADK,
+                &&ADD, &&SUB, &&MUL, &&DIV,
+                &&ADDI, &&SUBI, &&MULI, &&DIVI,
+                &&LOAD, &&STORE, &&LOADF, &&STOREF,
+                &&JUMP,
+                &&JEQ, &&JNE, &&JLT, &&JGT, &&JLE, &&JGE,
+                &&JEQI, &&JNEI, &&JLTI, &&JGTI, &&JLEI, &&JGEI,
+                &&CALL, &&NATIVE, &&RET
+        };
+
+        tiger_init();
+        std::unique_ptr<int64_t[]> stack(new int64_t[STACK_WORDS]);
+        std::vector<Return> returns;
+        returns.reserve(1024);
+        int64_t nativeArgs[Frame::MAX_REG];
+
+        // main runs with a null static link, like tiger_run calls it
+        auto function = &program.functions[program.main];
+        auto fp = reinterpret_cast<char *>(stack.get() + STACK_WORDS - LINK_WORDS);
+        auto regs = reinterpret_cast<int64_t *>(fp) - function->frameWords - function->registerCount;
+        if (regs < stack.get())
+        {
+            overflow();
+        }
+        if (function->fp != Bytecode::NONE)
+        {
+            regs[function->fp] = word(fp);
+        }
+        if (function->args[0] != Bytecode::NONE)
+        {
+            regs[function->args[0]] = 0;
+        }
+        auto code = function->code.data();
+        auto pc = code;
+
+#define REG(i) regs[pc[i]]
+#define NEXT(n) pc += (n); goto *dispatch[*pc]
+#define BRANCH(condition) pc = (condition) ? code + pc[3] : pc + 4; goto *dispatch[*pc]
+        goto *dispatch[*pc];
+
+    MOVE:
+        REG(1) = REG(2);
+        NEXT(3);
+    LOADI:
+        REG(1) = pc[2];
+        NEXT(3);
+    LOADK:
+        REG(1) = word(program.strings[pc[2]].data());
+        NEXT(3);
+    // Overflow wraps as it does in the native code
+    ADD:
+        REG(1) = (int64_t) ((uint64_t) REG(2) + (uint64_t) REG(3));
+        NEXT(4);
+    SUB:
+        REG(1) = (int64_t) ((uint64_t) REG(2) - (uint64_t) REG(3));
+        NEXT(4);
+    MUL:
+        REG(1) = (int64_t) ((uint64_t) REG(2) * (uint64_t) REG(3));
+        NEXT(4);
+    DIV:
+        REG(1) = REG(2) / REG(3);
+        NEXT(4);
+    ADDI:
+        REG(1) = (int64_t) ((uint64_t) REG(2) + (uint64_t) (int64_t) pc[3]);
+        NEXT(4);
+    SUBI:
+        REG(1) = (int64_t) ((uint64_t) REG(2) - (uint64_t) (int64_t) pc[3]);
+        NEXT(4);
+    MULI:
+        REG(1) = (int64_t) ((uint64_t) REG(2) * (uint64_t) (int64_t) pc[3]);
+        NEXT(4);
+    DIVI:
+        REG(1) = REG(2) / pc[3];
+        NEXT(4);
+    LOAD:
+        REG(1) = *pointer<int64_t>(REG(2) + pc[3]);
+        NEXT(4);
+    STORE:
+        *pointer<int64_t>(REG(1) + pc[2]) = REG(3);
+        NEXT(4);
+    LOADF:
+        REG(1) = *reinterpret_cast<int64_t *>(fp + pc[2]);
+        NEXT(3);
+    STOREF:
+        *reinterpret_cast<int64_t *>(fp + pc[1]) = REG(2);
+        NEXT(3);
+    JUMP:
+        pc = code + pc[1];
+        goto *dispatch[*pc];
+    JEQ:
+        BRANCH(REG(1) == REG(2));
+    JNE:
+        BRANCH(REG(1) != REG(2));
+    JLT:
+        BRANCH(REG(1) < REG(2));
+    JGT:
+        BRANCH(REG(1) > REG(2));
+    JLE:
+        BRANCH(REG(1) <= REG(2));
+    JGE:
+        BRANCH(REG(1) >= REG(2));
+    JEQI:
+        BRANCH(REG(1) == pc[2]);
+    JNEI:
+        BRANCH(REG(1) != pc[2]);
+    JLTI:
+        BRANCH(REG(1) < pc[2]);
+    JGTI:
+        BRANCH(REG(1) > pc[2]);
+    JLEI:
+        BRANCH(REG(1) <= pc[2]);
+    JGEI:
+        BRANCH(REG(1) >= pc[2]);
+    CALL:
+    {
+        auto callee = &program.functions[pc[2]];
+        int32_t argc = pc[3];
+        int32_t extra = argc > Frame::MAX_REG ? argc - Frame::MAX_REG : 0;
+        auto calleeFp = reinterpret_cast<char *>(regs - extra - LINK_WORDS);
+        auto calleeRegs = reinterpret_cast<int64_t *>(calleeFp) - callee->frameWords - callee->registerCount;
+        if (calleeRegs < stack.get())
+        {
+            overflow();
+        }
+        auto args = pc + 4;
+        for (int32_t i = 0; i < argc - extra; i++)
+        {
+            if (callee->args[i] != Bytecode::NONE)
+            {
+                calleeRegs[callee->args[i]] = regs[args[i]];
+            }
+        }
+        auto stackArgs = reinterpret_cast<int64_t *>(calleeFp) + LINK_WORDS;
+        for (int32_t i = 0; i < extra; i++)
+        {
+            stackArgs[i] = regs[args[Frame::MAX_REG + i]];
+        }
+        if (callee->fp != Bytecode::NONE)
+        {
+            calleeRegs[callee->fp] = word(calleeFp);
+        }
+        returns.push_back({function, args + argc, regs, fp, pc[1]});
+        function = callee;
+        regs = calleeRegs;
+        fp = calleeFp;
+        code = callee->code.data();
+        pc = code;
+        goto *dispatch[*pc];
+    }
+    NATIVE:
+    {
+        int32_t argc = pc[3];
+        for (int32_t i = 0; i < argc; i++)
+        {
+            nativeArgs[i] = regs[pc[4 + i]];
+        }
+        // The collector sees the registers of every frame
+        tiger_setRoots(regs, stack.get() + STACK_WORDS);
+        int64_t result = callNative(pc[2], nativeArgs);
+        if (pc[1] != Bytecode::NONE)
+        {
+            REG(1) = result;
+        }
+        NEXT(4 + argc);
+    }
+    RET:
+    {
+        int64_t result = function->rv != Bytecode::NONE ? regs[function->rv] : 0;
+        if (returns.empty())
+        {
+            std::fflush(stdout);
+            return 0;
+        }
+        auto &back = returns.back();
+        function = back.function;
+        regs = back.regs;
+        fp = back.fp;
+        code = function->code.data();
+        pc = back.pc;
+        if (back.dst != Bytecode::NONE)
+        {
+            regs[back.dst] = result;
+        }
+        returns.pop_back();
+        goto *dispatch[*pc];
+    }
+#undef REG
+#undef NEXT
+#undef BRANCH
+    }
+}
@@ -0,0 +1,21 @@
+//
+// Interpreter of the register bytecode
+//
+
+#ifndef SRC_VM_H
+#define SRC_VM_H
+
+#include "Bytecode.h"
+
+namespace Vm
+{
+    // Runs the main function of program on a stack of its own, calling the
+    // runtime the compiler carries for the builtins. Frames lay out like
+    // the native ones, the arguments past the sixth at fp + 16 and the
+    // locals below fp, so static links are the addresses of real slots;
+    // the registers of a frame sit below its locals. Returns the
+    // program's exit status, unless it calls exit.
+    int run(const Bytecode::Program &program);
+}
+
+#endif //SRC_VM_H
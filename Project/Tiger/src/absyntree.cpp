@@ -3,6 +3,7 @@
 //
 
 #include "absyntree.h"
+#include <vector>
 
 namespace AST
 {
@@ -27,6 +28,37 @@ namespace AST
         return classType;
     }
 
+    namespace
+    {
+        // Expressions waiting to be freed by the release running on this
+        // thread
+        thread_local std::vector<shared_ptr<Exp>> *graveyard = nullptr;
+    }
+
+    void Exp::release(shared_ptr<Exp> child)
+    {
+        if (child == nullptr || child.use_count() > 1)
+        {
+            return;
+        }
+        if (graveyard != nullptr)
+        {
+            graveyard->push_back(std::move(child));
+            return;
+        }
+        std::vector<shared_ptr<Exp>> pending;
+        graveyard = &pending;
+        pending.push_back(std::move(child));
+        while (!pending.empty())
+        {
+            auto next = std::move(pending.back());
+            pending.pop_back();
+            // The destructor queues the children of next in pending
+            next.reset();
+        }
+        graveyard = nullptr;
+    }
+
 // Dec---------------------------------------
     Dec::Dec(Tiger::location loc, DeclarationType classType) : ASTNode(loc), classType(classType)
     {}
@@ -233,6 +265,12 @@ namespace AST
                  const shared_ptr<Exp> &right) : Exp(loc, OP_EXP), op(op), left(left), right(right)
     {}
 
+    OpExp::~OpExp()
+    {
+        release(std::move(left));
+        release(std::move(right));
+    }
+
     Operator OpExp::getOp() const
     {
         return op;
@@ -269,6 +307,17 @@ namespace AST
     SeqExp::SeqExp(Tiger::location loc, const shared_ptr<ExpList> &seq) : Exp(loc, SEQ_EXP), seq(seq)
     {}
 
+    SeqExp::~SeqExp()
+    {
+        if (seq != nullptr && seq.use_count() == 1)
+        {
+            for (auto &exp : *seq)
+            {
+                release(std::move(exp));
+            }
+        }
+    }
+
     const shared_ptr<ExpList> &SeqExp::getSeq() const
     {
         return seq;
@@ -296,6 +345,13 @@ namespace AST
                  const shared_ptr<Exp> &elsee) : Exp(loc, IF_EXP), test(test), then(then), elsee(elsee)
     {}
 
+    IfExp::~IfExp()
+    {
+        release(std::move(test));
+        release(std::move(then));
+        release(std::move(elsee));
+    }
+
     const shared_ptr<Exp> &IfExp::getTest() const
     {
         return test;
@@ -383,6 +439,11 @@ namespace AST
         }
     }
 
+    LetExp::~LetExp()
+    {
+        release(std::move(body));
+    }
+
     const shared_ptr<DecList> &LetExp::getDecs() const
     {
         return decs;
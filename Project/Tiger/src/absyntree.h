@@ -100,6 +100,11 @@ namespace AST
 
 
         ExpressionType getClassType();
+
+    protected:
+        // Destroys child without recursing once per tree level: children
+        // released while a release is running are queued and freed by it
+        static void release(shared_ptr<Exp> child);
     };
 
 
@@ -327,6 +332,8 @@ namespace AST
         OpExp(Tiger::location loc, Operator op, const shared_ptr<Exp> &left,
               const shared_ptr<Exp> &right);
 
+        ~OpExp();
+
         Operator getOp() const;
 
         const shared_ptr<Exp> &getLeft() const;
@@ -355,6 +362,8 @@ namespace AST
     public:
         SeqExp(Tiger::location loc, const shared_ptr<ExpList> &seq);
 
+        ~SeqExp();
+
         const shared_ptr<ExpList> &getSeq() const;
     };
 
@@ -379,6 +388,8 @@ namespace AST
         IfExp(Tiger::location loc, const shared_ptr<Exp> &test, const shared_ptr<Exp> &then,
               const shared_ptr<Exp> &elsee);
 
+        ~IfExp();
+
         const shared_ptr<Exp> &getTest() const;
 
         const shared_ptr<Exp> &getThen() const;
@@ -436,6 +447,8 @@ namespace AST
     public:
         LetExp(Tiger::location loc, const shared_ptr<DecList> &decs, const shared_ptr<Exp> &body);
 
+        ~LetExp();
+
         const shared_ptr<DecList> &getDecs() const;
 
         const shared_ptr<Exp> &getBody() const;
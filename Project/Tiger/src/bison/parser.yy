@@ -37,12 +37,14 @@
 %token <string> STRING
 %token <int> INT
 
+%nonassoc DO OF
+%nonassoc THEN
+%nonassoc ELSE
 %right ASSIGN
 %left AND OR
 %nonassoc EQ NEQ LT LE GT GE
 %left PLUS MINUS
 %left TIMES DIVIDE
-%right DO OF ELSE
 %left UMINUS
 
 %token 
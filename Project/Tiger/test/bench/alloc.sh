@@ -0,0 +1,64 @@
+#!/bin/bash
+# Time the allocation of small objects in tight loops, in executables the
+# native backend builds at -O2, the best of some rounds. points makes
+# records of two fields, pairs records of a field each holding the last,
+# and vectors arrays of four elements and of a length only known at run
+# time. Given the directory of another build of the compiler, say of an
+# older commit, its executables are timed next to these.
+#
+#   ./alloc.sh [iterations] [rounds] [other build's directory]
+
+COUNT=${1:-20000000}
+ROUNDS=${2:-3}
+OTHER=$3
+source "$(dirname "$0")/common.sh"
+
+cat >"$WORK/points.tig" <<TIGER
+let
+  type point = {x: int, y: int}
+  var p := point{x=0, y=0}
+  var sum := 0
+in
+  for i := 1 to $COUNT do (p := point{x=i, y=p.x}; sum := sum + p.y);
+  if sum = 0 then print("none\n")
+end
+TIGER
+
+cat >"$WORK/pairs.tig" <<TIGER
+let
+  type pair = {first: pair, last: int}
+  var p : pair := nil
+in
+  for i := 1 to $COUNT do
+    (p := pair{first=p, last=i};
+     if i - i / 64 * 64 = 0 then p := nil);
+  if p = nil then print("none\n")
+end
+TIGER
+
+cat >"$WORK/vectors.tig" <<TIGER
+let
+  type vector = array of int
+  var n := 3
+  var v := vector[1] of 0
+  var w := vector[1] of 0
+  var sum := 0
+in
+  for i := 1 to $COUNT / 2 do
+    (v := vector[4] of i; w := vector[n] of i; sum := sum + v[3] + w[2]);
+  if sum = 0 then print("none\n")
+end
+TIGER
+
+# The seconds the executable takes
+function times(){
+    column "$(best "$1")"
+}
+
+printf "%-10s" ""
+heading
+for name in points pairs vectors
+do
+    printf "%-10s" "$name"
+    row "$name" times
+done
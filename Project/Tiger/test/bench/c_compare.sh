@@ -0,0 +1,46 @@
+#!/bin/bash
+# Compare the executables of the native backend, at -O0 and -O2, with the
+# ones cc -O2 builds from the C output, on queens.tig, on a larger board,
+# and merge.tig, on two long sorted lists: seconds to build and to run,
+# the best of some rounds. The C frames are larger, so deep recursion
+# overflows the stack sooner than in the native executables.
+#
+#   ./c_compare.sh [queens board size] [merge list length] [rounds]
+
+BOARD=${1:-12}
+LENGTH=${2:-20000}
+ROUNDS=${3:-3}
+source "$(dirname "$0")/common.sh"
+
+# queens.tig indexes the second diagonals for N = 8
+sed -e "s/var N := 8/var N := $BOARD/" -e "s/+7-c/+N-1-c/g" "$BENCH_PATH/../testcase/queens.tig" >"$WORK/queens.tig"
+cp "$BENCH_PATH/../testcase/merge.tig" "$WORK/merge.tig"
+python3 - "$LENGTH" >"$WORK/merge.in" <<'PYTHON'
+import sys
+n = int(sys.argv[1])
+print(" ".join(str(2 * i + 1) for i in range(n)) + " ;")
+print(" ".join(str(2 * i) for i in range(n)) + " .")
+PYTHON
+: >"$WORK/queens.in"
+
+printf "%-10s %19s %19s %19s\n" "" "native -O0" "native -O2" "C, cc -O2"
+printf "%-10s %9s %9s %9s %9s %9s %9s\n" program build run build run build run
+for name in queens merge
+do
+    src=$WORK/$name.tig
+    row=()
+    for level in 0 2
+    do
+        row+=($(best sh -c "'$TIGER' -c '$src' -x -O$level -o '$WORK/$name$level.o' &&
+                '$CC' -o '$WORK/$name$level' '$WORK/$name$level.o' '$RUNTIME' -lstdc++"))
+        row+=($(bestFrom "$WORK/$name.in" "$WORK/$name$level"))
+    done
+    row+=($(best sh -c "'$TIGER' -c '$src' -e -o '$WORK/$name.c' && '$CC' -O2 -o '$WORK/$name.c.bin' '$WORK/$name.c'"))
+    if ! cmp -s <("$WORK/${name}2" <"$WORK/$name.in") <("$WORK/$name.c.bin" <"$WORK/$name.in")
+    then
+        echo "$name: the output built from C differs from the native one"
+        continue
+    fi
+    row+=($(bestFrom "$WORK/$name.in" "$WORK/$name.c.bin"))
+    printf "%-10s %9s %9s %9s %9s %9s %9s\n" "$name" "${row[@]}"
+done
@@ -0,0 +1,82 @@
+# What the benchmarks share: a work directory, removed on exit, the time
+# format, timing the best of ROUNDS, and building a program with this build
+# of the compiler or with OTHER, the directory of another build, say of an
+# older commit, to time their executables side by side. A benchmark sets
+# ROUNDS, and OTHER if it takes one, then sources this.
+#
+#   source "$(dirname "$0")/common.sh"
+
+BENCH_PATH=$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)
+THIS=$(cd "$BENCH_PATH/../.." && pwd)
+TIGER=$THIS/bin/tiger
+RUNTIME=$THIS/bin/libtigerrt.a
+CC=${CC:-cc}
+WORK=$(mktemp -d)
+TIMEFORMAT=%R
+trap 'rm -rf "$WORK"' EXIT
+
+# Seconds the command takes reading input, the best of ROUNDS
+function bestFrom(){
+    local input=$1 result="" seconds
+    shift
+    for ((round = 0; round < ROUNDS; round++))
+    do
+        seconds=$( { time "$@" <"$input" >/dev/null 2>&1 ; } 2>&1 )
+        result=$(awk -v a="$result" -v b="$seconds" 'BEGIN {print (a == "" || b < a) ? b : a}')
+    done
+    echo "$result"
+}
+
+# Seconds the command takes, the best of ROUNDS
+function best(){
+    bestFrom /dev/null "$@"
+}
+
+# Builds WORK/name.tig with the compiler and runtime of build into out. A
+# benchmark that needs the program built some other way defines its own.
+function build(){
+    "$1/bin/tiger" -c "$WORK/$2.tig" -x -O2 -o "$3.o" >/dev/null &&
+        "$CC" -o "$3" "$3.o" "$1/bin/libtigerrt.a" -lstdc++
+}
+
+# Prints each argument as a column of the table
+function column(){
+    printf " %9s" "$@"
+}
+
+# Ends the heading of the table with the columns of this build, then of the
+# other if there is one: the name of the build and the rest of the headings
+function heading(){
+    local name
+    PER_BUILD=$(($# + 1))
+    for name in this ${OTHER:+other}
+    do
+        column "$name" "$@"
+    done
+    printf "\n"
+}
+
+# Ends the row of name with the columns that columns prints of the
+# executable of WORK/name.tig each build makes, or a - for each column when
+# the build fails
+function row(){
+    local name=$1 columns=$2 dirs=("$THIS") outs=("$WORK/$1") i j
+    if [ -n "$OTHER" ]
+    then
+        dirs+=("$OTHER")
+        outs+=("$WORK/$1.other")
+    fi
+    for ((i = 0; i < ${#dirs[@]}; i++))
+    do
+        if build "${dirs[i]}" "$name" "${outs[i]}"
+        then
+            "$columns" "${outs[i]}"
+        else
+            for ((j = 0; j < PER_BUILD; j++))
+            do
+                column "-"
+            done
+        fi
+    done
+    printf "\n"
+}
@@ -0,0 +1,61 @@
+#!/bin/bash
+# Time building a string by appending, s := concat(s, x), a character at
+# a time and ten at a time, in executables the native backend builds at
+# -O2, the best of some rounds, for counts doubling up to the largest. Each
+# program prints the last characters at the end, which flattens the string.
+# Time that grows as the count does is linear; copying the whole string an
+# append grows four times as the count doubles. Given the directory of
+# another build of the compiler, say of an older commit, its executables
+# are timed next to these, up to the count it takes other seconds for.
+#
+#   ./concat.sh [largest count] [rounds] [other build's directory] [other seconds]
+
+LARGEST=${1:-1000000}
+ROUNDS=${2:-3}
+OTHER=$3
+OTHER_LIMIT=${4:-10}
+source "$(dirname "$0")/common.sh"
+
+# Writes name.tig, count appends of step characters
+function program(){
+    cat >"$WORK/$1.tig" <<TIGER
+let
+  var piece := if $3 = 1 then "x" else "0123456789"
+  var s := ""
+in
+  for i := 1 to $2 do s := concat(s, piece);
+  print(substring(s, size(s) - 5, 5)); print("\n")
+end
+TIGER
+}
+
+# The seconds the executable takes, or a - for the other build's once
+# they take longer than OTHER_LIMIT
+function times(){
+    local seconds
+    if [[ $1 == *.other ]] && [ -n "$slow" ]
+    then
+        column "-"
+        return
+    fi
+    seconds=$(best "$1")
+    column "$seconds"
+    if [[ $1 == *.other ]]
+    then
+        slow=$(awk -v s="$seconds" -v l="$OTHER_LIMIT" 'BEGIN {if (s > l) print 1}')
+    fi
+}
+
+printf "%-10s %-6s" "appends" "piece"
+heading
+for step in 1 10
+do
+    slow=""
+    for ((count = LARGEST / 16; count <= LARGEST; count *= 2))
+    do
+        name="append$step.$count"
+        program "$name" "$count" "$step"
+        printf "%-10s %-6s" "$count" "$step"
+        row "$name" times
+    done
+done
@@ -0,0 +1,51 @@
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include "../../src/driver.h"
+#include "../../src/Semantic.h"
+#include "../../src/PrintIRTree.h"
+
+// Measures how fast the IR text emitter writes a translated program.
+//
+//   emit_bench <file.tig> <output file> [rounds]
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        std::cerr << "usage: " << argv[0] << " <file.tig> <output file> [rounds]" << std::endl;
+        return 1;
+    }
+    int rounds = argc > 3 ? std::atoi(argv[3]) : 5;
+
+    Tiger::Driver driver;
+    driver.parse(argv[1]);
+    if (driver.syntaxError)
+    {
+        std::cerr << "Tiger compiler exit with syntax error." << std::endl;
+        return 1;
+    }
+    auto fragList = Semantic::transProg(driver.result);
+    PrintIRTree printer(fragList);
+
+    double best = 0;
+    long bytes = 0;
+    for (int round = 0; round < rounds; round++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        {
+            std::ofstream fo(argv[2], std::ios::out);
+            printer.printIRTreeInFile(fo);
+            bytes = (long) fo.tellp();
+        }
+        std::chrono::duration<double> spent = std::chrono::steady_clock::now() - start;
+        if (round == 0 || spent.count() < best)
+        {
+            best = spent.count();
+        }
+    }
+    std::cout << bytes / 1e6 << " MB in " << best << " s, "
+              << bytes / 1e6 / best << " MB/s" << std::endl;
+    return 0;
+}
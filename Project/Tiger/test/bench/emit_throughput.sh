@@ -0,0 +1,18 @@
+#!/bin/bash
+# Build the emitter benchmark against the compiler objects and report the
+# MB/s the IR text dump reaches on a generated program.
+#
+#   ./emit_throughput.sh [functions] [statements per body]
+
+BENCH_PATH=$(cd "$(dirname "$0")" && pwd)
+OBJ_PATH=$BENCH_PATH/../../obj
+FUNCS=${1:-4000}
+STMTS=${2:-8}
+WORK=$(mktemp -d)
+
+g++ -std=c++14 -O2 -pthread -o "$WORK/emit_bench" "$BENCH_PATH/emit_bench.cpp" \
+    $(ls "$OBJ_PATH"/*.o | grep -v runtime_main.o) || exit 1
+python3 "$BENCH_PATH/gen_funcs.py" "$FUNCS" "$STMTS" >"$WORK/big.tig"
+echo "---- $FUNCS functions, $STMTS statements each ----"
+"$WORK/emit_bench" "$WORK/big.tig" "$WORK/big.ir"
+rm -rf "$WORK"
@@ -0,0 +1,101 @@
+#!/bin/bash
+# Run allocation heavy programs, built by the native backend at -O2, and
+# report for each the seconds it takes, its peak resident size and what
+# TIGER_GC_STATS prints: the collections, the bytes allocated and
+# promoted, the pause percentiles and the share of the run the collector
+# took. trees builds and walks binary trees next to a long lived one,
+# lists stores fresh lists into an old array, which takes the write
+# barrier, strings concatenates short lived strings and merge is
+# merge.tig on two long sorted lists.
+#
+#   ./gc.sh [tree depth] [merge list length] [nursery KiB]
+
+BENCH_PATH=$(cd "$(dirname "$0")" && pwd)
+TIGER=$BENCH_PATH/../../bin/tiger
+RUNTIME=$BENCH_PATH/../../bin/libtigerrt.a
+DEPTH=${1:-18}
+LENGTH=${2:-200000}
+if [ -n "$3" ]
+then
+    export TIGER_NURSERY=$3
+fi
+WORK=$(mktemp -d)
+
+cat >"$WORK/trees.tig" <<TIGER
+let
+  type tree = {left: tree, right: tree}
+  function make(depth: int) : tree =
+    if depth = 0 then tree{left=nil, right=nil}
+    else tree{left=make(depth - 1), right=make(depth - 1)}
+  function check(t: tree, depth: int) : int =
+    if depth = 0 then 1 else 1 + check(t.left, depth - 1) + check(t.right, depth - 1)
+  var long := make($DEPTH)
+  var total := 0
+in
+  for depth := 4 to $DEPTH do
+    for i := 1 to 16 do total := total + check(make(depth), depth);
+  if check(long, $DEPTH) + total = 0 then print("none\n")
+end
+TIGER
+
+cat >"$WORK/lists.tig" <<'TIGER'
+let
+  type list = {head: int, tail: list}
+  type lists = array of list
+  var slots := lists[4096] of nil
+  function build(n: int) : list =
+    let var l : list := nil in for i := 1 to n do l := list{head=i, tail=l}; l end
+  var sum := 0
+in
+  for i := 0 to 1000000 do slots[i - i / 4096 * 4096] := build(16);
+  for i := 0 to 4095 do sum := sum + slots[i].head;
+  if sum = 0 then print("none\n")
+end
+TIGER
+
+cat >"$WORK/strings.tig" <<'TIGER'
+let
+  var s := ""
+in
+  for i := 0 to 2000000 do
+    (s := concat(s, chr(ord("a") + i - i / 26 * 26));
+     if size(s) = 256 then s := "");
+  print(s)
+end
+TIGER
+
+cp "$BENCH_PATH/../testcase/merge.tig" "$WORK/merge.tig"
+python3 - "$LENGTH" >"$WORK/merge.in" <<'PYTHON'
+import sys
+n = int(sys.argv[1])
+print(" ".join(str(2 * i + 1) for i in range(n)) + " ;")
+print(" ".join(str(2 * i) for i in range(n)) + " .")
+PYTHON
+# merge recurses once an element
+ulimit -s unlimited 2>/dev/null
+
+for name in trees lists strings merge
+do
+    input=$WORK/$name.in
+    [ -f "$input" ] || input=/dev/null
+    if ! "$TIGER" -c "$WORK/$name.tig" -x -O2 -o "$WORK/$name.o" >/dev/null ||
+       ! cc -o "$WORK/$name" "$WORK/$name.o" "$RUNTIME" -lstdc++
+    then
+        echo "$name: does not build"
+        continue
+    fi
+    echo "$name"
+    # Seconds and peak resident MiB of the child, then its statistics
+    TIGER_GC_STATS=1 python3 - "$WORK/$name" "$input" <<'PYTHON'
+import resource, subprocess, sys, time
+with open(sys.argv[2]) as stdin:
+    start = time.monotonic()
+    run = subprocess.run([sys.argv[1]], stdin=stdin, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+    seconds = time.monotonic() - start
+peak = resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss / 1024
+print("  %.2f s, %.1f MiB peak, exit %d" % (seconds, peak, run.returncode))
+for line in run.stderr.decode().splitlines():
+    print("  " + line)
+PYTHON
+done
+rm -rf "$WORK"
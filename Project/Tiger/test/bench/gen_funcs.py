@@ -0,0 +1,39 @@
+# Generate a Tiger program with one large group of mutually recursive
+# functions, used to benchmark and cross-check the parallel front end.
+#
+#   python gen_funcs.py <functions> [statements per body] > big.tig
+import sys
+
+
+def body(i, n, stmts):
+    lines = []
+    for k in range(stmts):
+        callee = (i * 7 + k) % n
+        lines.append('      r := r + f%d(x - 1, "s%d")' % (callee, k))
+        lines.append('      if r > %d then p := node{value=r, next=p} else p := nil' % (k * 13))
+    return ';\n'.join(lines)
+
+
+def main():
+    n = int(sys.argv[1])
+    stmts = int(sys.argv[2]) if len(sys.argv) > 2 else 4
+    print('let')
+    print('  type node = {value: int, next: node}')
+    for i in range(n):
+        print('  function f%d(x: int, s: string) : int =' % i)
+        print('    if x < 1 then size(s) else')
+        print('    let var r := x * %d' % (i + 1))
+        print('        var p : node := nil')
+        print('        function g%d(y: int) : int = y + r' % i)
+        print('     in (')
+        print(body(i, n, stmts) + ';')
+        print('      g%d(r)' % i)
+        print('     )')
+        print('    end')
+    print('in')
+    print('  print(chr(f0(3, "start")))')
+    print('end')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,33 @@
+#!/bin/bash
+# Build the liveness benchmark against the compiler objects and report the
+# passes, blocks visited and time Flow::liveOut needs on generated
+# functions with many branches and nested loops.
+#
+#   ./liveness.sh [statements per function]
+
+BENCH_PATH=$(cd "$(dirname "$0")" && pwd)
+OBJ_PATH=$BENCH_PATH/../../obj
+COUNT=${1:-20000}
+WORK=$(mktemp -d)
+
+g++ -std=c++14 -O2 -pthread -o "$WORK/liveness_bench" "$BENCH_PATH/liveness_bench.cpp" \
+    $(ls "$OBJ_PATH"/*.o | grep -v runtime_main.o) || exit 1
+# Branches whose values meet after them, inside loops nested four deep,
+# and the same number of branches on their own
+awk -v n="$COUNT" 'BEGIN {
+    print "let var x := 0"
+    print "    var y := 0"
+    print "    function loops() ="
+    print "        for a := 0 to 2 do for b := 0 to 2 do for c := 0 to 2 do"
+    printf "        for d := 0 to 2 do ("
+    for (i = 1; i < n; i++) printf "y := y + (if x > %d then %d else y - %d);\n", i, i, i
+    print "y := 0)"
+    print "    function branches() ="
+    printf "        ("
+    for (i = 1; i < n; i++) printf "if y > %d then x := x + (if x < %d then 1 else 2) else y := y - 1;\n", i, i
+    print "x := 0)"
+    print "in loops(); branches() end"
+}' >"$WORK/branches.tig"
+echo "---- $COUNT statements per function ----"
+"$WORK/liveness_bench" "$WORK/branches.tig"
+rm -rf "$WORK"
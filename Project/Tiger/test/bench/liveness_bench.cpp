@@ -0,0 +1,73 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include "../../src/driver.h"
+#include "../../src/Semantic.h"
+#include "../../src/Canon.h"
+#include "../../src/Burs.h"
+#include "../../src/Flow.h"
+
+// Measures the passes and time Flow::liveOut takes to converge on the
+// functions of a program with the most blocks.
+//
+//   liveness_bench <file.tig> [functions] [rounds]
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: " << argv[0] << " <file.tig> [functions] [rounds]" << std::endl;
+        return 1;
+    }
+    size_t shown = argc > 2 ? (size_t) std::atoi(argv[2]) : 5;
+    int rounds = argc > 3 ? std::atoi(argv[3]) : 5;
+
+    Tiger::Driver driver;
+    driver.parse(argv[1]);
+    if (driver.syntaxError)
+    {
+        std::cerr << "Tiger compiler exit with syntax error." << std::endl;
+        return 1;
+    }
+    auto fragList = Semantic::transProg(driver.result);
+    Canon::canonicalize(fragList);
+    std::vector<std::shared_ptr<Assem::Function>> functions;
+    for (auto &frag : *fragList)
+    {
+        if (frag->getKind() == Frame::PROC_FRAG)
+        {
+            auto procFrag = std::static_pointer_cast<Frame::ProcFrag>(frag);
+            auto frame = procFrag->getFrame();
+            functions.push_back(Burs::select(procFrag, frame ? frame->getLocal_count() : 0));
+        }
+    }
+    std::sort(functions.begin(), functions.end(), [](const std::shared_ptr<Assem::Function> &a,
+                                                     const std::shared_ptr<Assem::Function> &b)
+    {
+        return a->blocks.size() > b->blocks.size();
+    });
+    functions.resize(std::min(shown, functions.size()));
+
+    std::cout << "function          blocks   instrs    temps  globals  dense  passes   visits       ms" << std::endl;
+    for (auto &function : functions)
+    {
+        auto graph = Flow::makeGraph(*function);
+        Flow::LivenessStats stats = {};
+        double best = 0;
+        for (int round = 0; round < rounds; round++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            Flow::liveOut(*function, graph, &stats);
+            std::chrono::duration<double> spent = std::chrono::steady_clock::now() - start;
+            if (round == 0 || spent.count() < best)
+            {
+                best = spent.count();
+            }
+        }
+        std::printf("%-16s %7zu %8zu %8d %8d %6s %7d %8d %8.2f\n", function->name.c_str(), function->blocks.size(),
+                    function->instrs.size(), function->tempCount, stats.globals, stats.dense ? "yes" : "no",
+                    stats.passes, stats.visits, best * 1e3);
+    }
+    return 0;
+}
@@ -0,0 +1,34 @@
+#!/bin/bash
+# Time a compile of a generated program to an object file both ways: the
+# assembly written with --asm and put through as, and the object the
+# compiler writes itself with --object. The object written through as is
+# the reference the direct one is checked against.
+#
+#   ./object_latency.sh [functions] [statements per body]
+
+BENCH_PATH=$(cd "$(dirname "$0")" && pwd)
+TIGER=$BENCH_PATH/../../bin/tiger
+FUNCS=${1:-4000}
+STMTS=${2:-8}
+WORK=$(mktemp -d)
+TIMEFORMAT=%R
+
+python3 "$BENCH_PATH/gen_funcs.py" "$FUNCS" "$STMTS" >"$WORK/big.tig"
+assembly=$( { time "$TIGER" -c "$WORK/big.tig" -a -o "$WORK/big.s" >/dev/null ; } 2>&1 )
+assembler=$( { time as "$WORK/big.s" -o "$WORK/big.as.o" ; } 2>&1 )
+direct=$( { time "$TIGER" -c "$WORK/big.tig" -x -o "$WORK/big.o" >/dev/null ; } 2>&1 )
+
+echo "---- $FUNCS functions, $STMTS statements each ----"
+printf "%-28s %8s\n" "--asm" "$assembly"
+printf "%-28s %8s\n" "as" "$assembler"
+printf "%-28s %8s\n" "--asm, then as" "$(awk -v a="$assembly" -v b="$assembler" 'BEGIN {print a + b}')"
+printf "%-28s %8s\n" "--object" "$direct"
+objcopy -O binary -j .text "$WORK/big.o" "$WORK/direct.text"
+objcopy -O binary -j .text "$WORK/big.as.o" "$WORK/as.text"
+if cmp -s "$WORK/direct.text" "$WORK/as.text"
+then
+    echo "text identical to as"
+else
+    echo "text differs from as"
+fi
+rm -rf "$WORK"
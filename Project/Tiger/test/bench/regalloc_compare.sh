@@ -0,0 +1,48 @@
+#!/bin/bash
+# Compare the linear scan allocator (-O0) with graph coloring (-O2) on the
+# test programs and a generated declaration group: compile time, emitted
+# instructions and spilled temps of each.
+#
+#   ./regalloc_compare.sh [functions] [statements per body]
+
+BENCH_PATH=$(cd "$(dirname "$0")" && pwd)
+TIGER=$BENCH_PATH/../../bin/tiger
+FUNCS=${1:-4000}
+STMTS=${2:-8}
+WORK=$(mktemp -d)
+TIMEFORMAT=%R
+
+python3 "$BENCH_PATH/gen_funcs.py" "$FUNCS" "$STMTS" >"$WORK/generated.tig"
+
+# Prints seconds, instructions and spilled temps of one compile
+function measure(){
+    local seconds
+    seconds=$( { time "$TIGER" -c "$1" -a -R "$2" -o "$WORK/out.s" >"$WORK/stats" 2>&1 ; } 2>&1 )
+    if ! grep -q '^total:' "$WORK/stats"
+    then
+        echo "-"
+        return
+    fi
+    echo "$seconds $(grep -c $'^\t[a-z]' "$WORK/out.s") $(awk '/^total:/ {print $2}' "$WORK/stats")"
+}
+
+printf "%-16s %24s %24s\n" "" "linear scan (-O0)" "coloring (-O2)"
+printf "%-16s %8s %8s %7s %8s %8s %7s\n" program seconds instrs spilled seconds instrs spilled
+total=(0 0 0 0 0 0)
+for src in "$BENCH_PATH"/../testcase/*.tig "$BENCH_PATH"/../native/*.tig "$WORK/generated.tig"
+do
+    linear=($(measure "$src" -O0))
+    coloring=($(measure "$src" -O2))
+    if [ ${#linear[@]} -lt 3 ] || [ ${#coloring[@]} -lt 3 ]
+    then
+        continue
+    fi
+    printf "%-16s %8s %8s %7s %8s %8s %7s\n" "$(basename "$src" .tig)" "${linear[@]}" "${coloring[@]}"
+    values=("${linear[@]}" "${coloring[@]}")
+    for i in 0 1 2 3 4 5
+    do
+        total[$i]=$(awk -v a="${total[$i]}" -v b="${values[$i]}" 'BEGIN {print a + b}')
+    done
+done
+printf "%-16s %8s %8s %7s %8s %8s %7s\n" total "${total[@]}"
+rm -rf "$WORK"
@@ -0,0 +1,47 @@
+#!/bin/bash
+# Time from start to the first line of output, or to the exit of a program
+# that prints none, of programs run with --run, against writing an object,
+# linking it and running the executable.
+#
+#   ./run_latency.sh [rounds]
+
+BENCH_PATH=$(cd "$(dirname "$0")" && pwd)
+TIGER=$BENCH_PATH/../../bin/tiger
+RUNTIME=$BENCH_PATH/../../bin/libtigerrt.a
+CC=${CC:-cc}
+ROUNDS=${1:-5}
+WORK=$(mktemp -d)
+
+python3 "$BENCH_PATH/gen_funcs.py" 400 8 >"$WORK/generated.tig"
+
+# Seconds until the command prints its first line, the best of ROUNDS
+function firstLine(){
+    python3 - "$ROUNDS" "$@" <<'PYTHON'
+import subprocess, sys, time
+best = None
+for _ in range(int(sys.argv[1])):
+    start = time.perf_counter()
+    process = subprocess.Popen(sys.argv[2:], stdin=subprocess.DEVNULL, stdout=subprocess.PIPE,
+                               stderr=subprocess.DEVNULL)
+    process.stdout.readline()
+    spent = time.perf_counter() - start
+    process.communicate()
+    best = spent if best is None else min(best, spent)
+print("%.4f" % best)
+PYTHON
+}
+
+cat >"$WORK/build.sh" <<SCRIPT
+#!/bin/bash
+"$TIGER" -c "\$1" -x -o "$WORK/prog.o" >/dev/null && "$CC" -o "$WORK/prog" "$WORK/prog.o" "$RUNTIME" -lstdc++ &&
+exec "$WORK/prog"
+SCRIPT
+chmod +x "$WORK/build.sh"
+
+printf "%-16s %14s %14s\n" program "--object, cc" "--run"
+for src in "$BENCH_PATH"/../native/*.tig "$BENCH_PATH/../testcase/queens.tig" "$WORK/generated.tig"
+do
+    printf "%-16s %14s %14s\n" "$(basename "$src" .tig)" "$(firstLine "$WORK/build.sh" "$src")" \
+        "$(firstLine "$TIGER" --run "$src")"
+done
+rm -rf "$WORK"
@@ -0,0 +1,18 @@
+#!/bin/bash
+# Build the runtime microbenchmarks against obj/runtime.o, obj/gc.o and
+# obj/kernels.o and report the nanoseconds each entry point takes a call.
+#
+#   ./runtime.sh [calls] [rounds]
+
+BENCH_PATH=$(cd "$(dirname "$0")" && pwd)
+OBJ_PATH=$BENCH_PATH/../../obj
+CALLS=${1:-500000}
+ROUNDS=${2:-5}
+WORK=$(mktemp -d)
+
+g++ -std=c++14 -O2 -o "$WORK/runtime_bench" "$BENCH_PATH/runtime_bench.cpp" "$OBJ_PATH/runtime.o" "$OBJ_PATH/gc.o" \
+    "$OBJ_PATH/kernels.o" || exit 1
+# Characters for the getchar calls
+head -c "$CALLS" /dev/zero | tr '\0' 'z' >"$WORK/input"
+"$WORK/runtime_bench" "$CALLS" "$ROUNDS" <"$WORK/input"
+rm -rf "$WORK"
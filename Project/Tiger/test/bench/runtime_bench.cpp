@@ -0,0 +1,174 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../../runtime/runtime.h"
+
+// Times every entry point of the runtime, in nanoseconds a call, the best
+// of some rounds. Nothing stays alive past a call, so the calls that
+// allocate include the minor collections that sweep them up. print writes to
+// /dev/null and getchar reads stdin, which should hold at least as many
+// characters as there are calls.
+//
+//   runtime_bench [calls] [rounds] < input
+
+namespace
+{
+    int64_t calls;
+    int rounds;
+    // Keeps the results alive
+    volatile int64_t sink;
+
+    TigerString *makeString(const std::string &text)
+    {
+        auto s = static_cast<TigerString *>(std::malloc(sizeof(int64_t) + text.size() + 1));
+        s->length = (int64_t) text.size();
+        std::memcpy(s->chars, text.data(), text.size());
+        return s;
+    }
+
+    void measure(const char *name, int64_t count, const std::function<void(int64_t)> &body)
+    {
+        double best = 0;
+        for (int round = 0; round < rounds; round++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            body(count);
+            std::chrono::duration<double, std::nano> spent = std::chrono::steady_clock::now() - start;
+            if (round == 0 || spent.count() < best)
+            {
+                best = spent.count();
+            }
+        }
+        std::fprintf(stderr, "%-28s %12.2f\n", name, best / (double) count);
+    }
+
+    // The loop initArray replaces
+    int64_t *mallocArray(int64_t size, int64_t init)
+    {
+        auto array = static_cast<int64_t *>(std::malloc((size_t) size * sizeof(int64_t)));
+        for (int64_t i = 0; i < size; i++)
+        {
+            array[i] = init;
+        }
+        return array;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    calls = argc > 1 ? std::atoll(argv[1]) : 500000;
+    rounds = argc > 2 ? std::atoi(argv[2]) : 5;
+    if (!std::freopen("/dev/null", "w", stdout))
+    {
+        return 1;
+    }
+    tiger_init();
+
+    auto word = makeString("tiger");
+    auto other = makeString("tigers");
+    auto line = makeString(std::string(80, 'x'));
+    auto text = makeString(std::string(4096, 'y'));
+
+    std::fprintf(stderr, "%-28s %12s\n", "entry point", "ns/call");
+    // A process a call, so mostly what fork and wait cost, measured while
+    // the process is small
+    measure("exit, forked", 100, [](int64_t n)
+    {
+        for (int64_t i = 0; i < n; i++)
+        {
+            auto child = fork();
+            if (child == 0)
+            {
+                tiger_exit(0);
+            }
+            int status;
+            waitpid(child, &status, 0);
+        }
+    });
+    measure("initArray(8, 0)", calls, [](int64_t n)
+    {
+        for (int64_t i = 0; i < n; i++) sink = (int64_t) tiger_initArray(8, 0, 0);
+    });
+    measure("initArray(8, 7)", calls, [](int64_t n)
+    {
+        for (int64_t i = 0; i < n; i++) sink = (int64_t) tiger_initArray(8, 7, 0);
+    });
+    measure("initArray(1024, 0)", calls / 256, [](int64_t n)
+    {
+        for (int64_t i = 0; i < n; i++) sink = (int64_t) tiger_initArray(1024, 0, 0);
+    });
+    measure("initArray(1024, 7)", calls / 256, [](int64_t n)
+    {
+        for (int64_t i = 0; i < n; i++) sink = (int64_t) tiger_initArray(1024, 7, 0);
+    });
+    measure("malloc + loop (1024, 7)", calls / 256, [](int64_t n)
+    {
+        for (int64_t i = 0; i < n; i++) sink = (int64_t) mallocArray(1024, 7);
+    });
+    measure("initArray(1 << 20, 0)", 64, [](int64_t n)
+    {
+        for (int64_t i = 0; i < n; i++) sink = (int64_t) tiger_initArray(1 << 20, 0, 0);
+    });
+    measure("initRecord(32)", calls, [](int64_t n)
+    {
+        for (int64_t i = 0; i < n; i++) sink = (int64_t) tiger_initRecord(32, nullptr);
+    });
+    measure("strcmp, equal", calls, [word](int64_t n)
+    {
+        for (int64_t i = 0; i < n; i++) sink = tiger_strcmp(word, word);
+    });
+    measure("strcmp, prefix", calls, [word, other](int64_t n)
+    {
+        for (int64_t i = 0; i < n; i++) sink = tiger_strcmp(word, other);
+    });
+    measure("print, 1 char", calls, [](int64_t n)
+    {
+        for (int64_t i = 0; i < n; i++) tiger_print(tiger_chr('a' + i % 26));
+    });
+    measure("print, 80 chars", calls, [line](int64_t n)
+    {
+        for (int64_t i = 0; i < n; i++) tiger_print(line);
+    });
+    measure("flush", calls / 16, [](int64_t n)
+    {
+        for (int64_t i = 0; i < n; i++) tiger_flush();
+    });
+    measure("getchar", calls / rounds, [](int64_t n)
+    {
+        for (int64_t i = 0; i < n; i++) sink = (int64_t) tiger_getchar();
+    });
+    measure("ord", calls, [word](int64_t n)
+    {
+        for (int64_t i = 0; i < n; i++) sink = tiger_ord(word);
+    });
+    measure("chr", calls, [](int64_t n)
+    {
+        for (int64_t i = 0; i < n; i++) sink = (int64_t) tiger_chr(i & 255);
+    });
+    measure("size", calls, [text](int64_t n)
+    {
+        for (int64_t i = 0; i < n; i++) sink = tiger_size(text);
+    });
+    measure("substring, 1 char", calls, [text](int64_t n)
+    {
+        for (int64_t i = 0; i < n; i++) sink = (int64_t) tiger_substring(text, i & 1023, 1);
+    });
+    measure("substring, 64 chars", calls, [text](int64_t n)
+    {
+        for (int64_t i = 0; i < n; i++) sink = (int64_t) tiger_substring(text, i & 1023, 64);
+    });
+    measure("concat, 5 + 6 chars", calls, [word, other](int64_t n)
+    {
+        for (int64_t i = 0; i < n; i++) sink = (int64_t) tiger_concat(word, other);
+    });
+    measure("not", calls, [](int64_t n)
+    {
+        for (int64_t i = 0; i < n; i++) sink = tiger_not(i & 1);
+    });
+    return 0;
+}
@@ -0,0 +1,27 @@
+#!/bin/bash
+# Time the front end on a generated declaration group at several thread
+# counts, and check every run produces the same IR as the serial one.
+#
+#   ./semantic_scaling.sh [functions] [statements per body]
+
+BENCH_PATH=$(cd "$(dirname "$0")" && pwd)
+TIGER=$BENCH_PATH/../../bin/tiger
+FUNCS=${1:-4000}
+STMTS=${2:-8}
+WORK=$(mktemp -d)
+TIMEFORMAT=%R
+
+python3 "$BENCH_PATH/gen_funcs.py" "$FUNCS" "$STMTS" >"$WORK/big.tig"
+echo "---- $FUNCS functions, $STMTS statements each ----"
+for jobs in 1 2 4 8 16
+do
+    seconds=$( { time "$TIGER" -c "$WORK/big.tig" -o "$WORK/j$jobs.ir" -j $jobs >/dev/null 2>&1 ; } 2>&1 )
+    if cmp -s "$WORK/j1.ir" "$WORK/j$jobs.ir"
+    then
+        same="same IR"
+    else
+        same="IR DIFFERS"
+    fi
+    printf "jobs %-3s %8s s  %s\n" $jobs "$seconds" "$same"
+done
+rm -rf "$WORK"
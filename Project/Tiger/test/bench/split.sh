@@ -0,0 +1,88 @@
+#!/bin/bash
+# Time splitting a text into lines, in executables the native backend
+# builds at -O2, the best of some rounds, and report the megabytes of text
+# split a second. The text is a line doubled some times, which costs the
+# same with or without ropes. rest takes each line off the front and goes
+# on with the substring after it, as a tokenizer that consumes its input
+# would, and index takes each line by where it begins. Both read the text
+# a character at a time to find the ends of the lines, and sum the first
+# character of each line. Given the directory of another build of the
+# compiler, say of an older commit, its executables are timed next to
+# these.
+#
+#   ./split.sh [doublings] [rounds] [other build's directory]
+
+DOUBLINGS=${1:-14}
+ROUNDS=${2:-3}
+OTHER=$3
+source "$(dirname "$0")/common.sh"
+LINE="field one, field two; and some more words"
+BYTES=$(( (${#LINE} + 1) << DOUBLINGS ))
+
+function text(){
+    cat <<TIGER
+  var text := "$LINE\n"
+  var sum := 0
+  var lines := 0
+  function lineEnd(s: string, from: int) : int =
+    let var n := from in (while substring(s, n, 1) <> "\n" do n := n + 1; n) end
+TIGER
+}
+
+cat >"$WORK/rest.tig" <<TIGER
+let
+$(text)
+  var rest := ""
+in
+  for i := 1 to $DOUBLINGS do text := concat(text, text);
+  rest := text;
+  while size(rest) > 0 do
+    let var n := lineEnd(rest, 0)
+        var line := substring(rest, 0, n)
+    in
+      sum := sum + ord(line);
+      lines := lines + 1;
+      rest := substring(rest, n + 1, size(rest) - n - 1)
+    end;
+  if sum = 0 | lines = 0 then print("none\n")
+end
+TIGER
+
+cat >"$WORK/index.tig" <<TIGER
+let
+$(text)
+  var start := 0
+in
+  for i := 1 to $DOUBLINGS do text := concat(text, text);
+  while start < size(text) do
+    let var n := lineEnd(text, start)
+        var line := substring(text, start, n - start)
+    in
+      sum := sum + ord(line);
+      lines := lines + 1;
+      start := n + 1
+    end;
+  if sum = 0 | lines = 0 then print("none\n")
+end
+TIGER
+
+# Megabytes a second, of the text split in seconds
+function rate(){
+    awk -v b="$BYTES" -v s="$1" 'BEGIN {printf "%.1f", (s > 0 ? b / s / 1e6 : 0)}'
+}
+
+# The seconds the executable takes, and the megabytes it splits a second
+function times(){
+    local seconds
+    seconds=$(best "$1")
+    column "$seconds" "$(rate "$seconds")"
+}
+
+echo "$BYTES bytes, $((1 << DOUBLINGS)) lines"
+printf "%-10s" ""
+heading "MB/s"
+for name in rest index
+do
+    printf "%-10s" "$name"
+    row "$name" times
+done
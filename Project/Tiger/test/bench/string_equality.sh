@@ -0,0 +1,69 @@
+#!/bin/bash
+# Time string = and <> in tight loops, in executables the native backend
+# builds at -O2, the best of some rounds, and count the literals the
+# assembly holds. words tests words built at run time against literals,
+# most of another length, and tokens compares a literal a variable holds
+# with literals, as a scanner's state machine would. Given the directory
+# of another build of the compiler, say of an older commit, its
+# executables are timed next to these.
+#
+#   ./string_equality.sh [iterations] [rounds] [other build's directory]
+
+COUNT=${1:-10000000}
+ROUNDS=${2:-3}
+OTHER=$3
+source "$(dirname "$0")/common.sh"
+
+cat >"$WORK/words.tig" <<TIGER
+let
+  type words = array of string
+  var list := words[4] of ""
+  var hits := 0
+in
+  list[0] := concat("whi", "le");
+  list[1] := concat("fun", "ction");
+  list[2] := concat("i", "f");
+  list[3] := concat("th", "en");
+  for i := 1 to $COUNT do
+    let var w := list[i - i / 4 * 4] in
+      if w = "if" then hits := hits + 1
+      else if w = "then" then hits := hits + 2
+      else if w <> "else" then hits := hits + 3
+    end;
+  if hits = 0 then print("none\n")
+end
+TIGER
+
+cat >"$WORK/tokens.tig" <<TIGER
+let
+  var state := "start"
+  var count := 0
+in
+  for i := 1 to $COUNT do
+    (if state = "start" then state := "name"
+     else if state = "name" then state := "number"
+     else if state = "number" then state := "start";
+     if state <> "name" then count := count + 1);
+  if count = 0 then print("none\n")
+end
+TIGER
+
+# Builds name.tig with the compiler and runtime of build into out, through
+# assembly to count the literals of
+function build(){
+    "$1/bin/tiger" -c "$WORK/$2.tig" -a -O2 -o "$3.s" >/dev/null &&
+        "$CC" -o "$3" "$3.s" "$1/bin/libtigerrt.a" -lstdc++
+}
+
+# The seconds the executable takes, and the literals of its assembly
+function times(){
+    column "$(best "$1")" "$(grep -c '^	\.ascii' "$1.s")"
+}
+
+printf "%-10s" ""
+heading literals
+for name in words tokens
+do
+    printf "%-10s" "$name"
+    row "$name" times
+done
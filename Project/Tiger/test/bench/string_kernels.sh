@@ -0,0 +1,18 @@
+#!/bin/bash
+# Build the string kernel benchmarks against obj/runtime.o, obj/gc.o and
+# obj/kernels.o and report, for each set of kernels the processor runs and
+# strings from 1 byte to 1 MiB, the nanoseconds strcmp, concat and
+# substring take a call.
+#
+#   ./string_kernels.sh [bytes a round] [rounds]
+
+BENCH_PATH=$(cd "$(dirname "$0")" && pwd)
+OBJ_PATH=$BENCH_PATH/../../obj
+BYTES=${1:-67108864}
+ROUNDS=${2:-5}
+WORK=$(mktemp -d)
+
+g++ -std=c++14 -O2 -o "$WORK/string_kernels_bench" "$BENCH_PATH/string_kernels_bench.cpp" "$OBJ_PATH/runtime.o" \
+    "$OBJ_PATH/gc.o" "$OBJ_PATH/kernels.o" || exit 1
+"$WORK/string_kernels_bench" "$BYTES" "$ROUNDS"
+rm -rf "$WORK"
@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+#include "../../runtime/kernels.h"
+#include "../../runtime/runtime.h"
+
+// Times the string entry points with each set of kernels the processor
+// runs, on strings from 1 byte to 1 MiB: strcmp of two equal strings in
+// different places, which reads both to the end, concat of two halves,
+// flattened by taking its first character when it makes a rope, and
+// substring of about half a string twice as long, which copies only below
+// 32 characters and makes a slice from there. Nanoseconds a call, the
+// best of some rounds, with about bytes characters handled in a round.
+// Strings from 64 KiB on are allocated in the old generation, which the
+// times of concat and substring show.
+//
+//   string_kernels_bench [bytes] [rounds]
+
+namespace
+{
+    int64_t bytes;
+    int rounds;
+    // Keeps the results alive
+    volatile int64_t sink;
+
+    TigerString *makeString(size_t length, char c)
+    {
+        auto s = static_cast<TigerString *>(std::malloc(sizeof(int64_t) + length + 1));
+        s->length = (int64_t) length;
+        for (size_t i = 0; i < length; i++)
+        {
+            s->chars[i] = (char) (c + i % 23);
+        }
+        return s;
+    }
+
+    double measure(int64_t count, const std::function<void(int64_t)> &body)
+    {
+        double best = 0;
+        for (int round = 0; round < rounds; round++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            body(count);
+            std::chrono::duration<double, std::nano> spent = std::chrono::steady_clock::now() - start;
+            if (round == 0 || spent.count() < best)
+            {
+                best = spent.count();
+            }
+        }
+        return best / (double) count;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    bytes = argc > 1 ? std::atoll(argv[1]) : (int64_t) 64 << 20;
+    rounds = argc > 2 ? std::atoi(argv[2]) : 5;
+    tiger_init();
+
+    std::vector<const char *> kernels;
+    for (auto name : {"scalar", "sse2", "avx2"})
+    {
+        if (Kernels::use(name))
+        {
+            kernels.push_back(name);
+        }
+    }
+
+    std::printf("%-10s %-8s %12s %12s %12s\n", "bytes", "kernels", "strcmp", "concat", "substring");
+    for (size_t length = 1; length <= ((size_t) 1 << 20); length *= length < 16 ? 2 : 4)
+    {
+        auto left = makeString(length, 'a');
+        auto right = makeString(length, 'a');
+        auto half = makeString(length / 2, 'a');
+        auto other = makeString(length - length / 2, 'b');
+        auto twice = makeString(2 * length + 8, 'a');
+        int64_t count = std::max((int64_t) 64, bytes / (int64_t) length);
+        for (auto name : kernels)
+        {
+            Kernels::use(name);
+            auto compare = measure(count, [left, right](int64_t n)
+            {
+                for (int64_t i = 0; i < n; i++) sink = tiger_strcmp(left, right);
+            });
+            // Strings of no more than a character are shared, not copied
+            auto concat = measure(count, [half, other](int64_t n)
+            {
+                for (int64_t i = 0; i < n; i++) sink = (int64_t) tiger_substring(tiger_concat(half, other), 0, 1);
+            });
+            auto substring = measure(count, [twice, length](int64_t n)
+            {
+                for (int64_t i = 0; i < n; i++)
+                {
+                    sink = (int64_t) tiger_substring(twice, (int64_t) (i & 7), (int64_t) length);
+                }
+            });
+            std::printf("%-10zu %-8s %12.2f %12.2f %12.2f\n", length, name, compare, concat, substring);
+        }
+        std::free(left);
+        std::free(right);
+        std::free(half);
+        std::free(other);
+        std::free(twice);
+    }
+    return 0;
+}
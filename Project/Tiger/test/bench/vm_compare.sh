@@ -0,0 +1,38 @@
+#!/bin/bash
+# Compare the bytecode interpreter (--vm) with the native backend on
+# queens.tig, on a larger board, and merge.tig, on two long sorted
+# lists: seconds to compile, and to run the executable or to compile to
+# bytecode and interpret it, the best of some rounds.
+#
+#   ./vm_compare.sh [queens board size] [merge list length] [rounds]
+
+BOARD=${1:-12}
+LENGTH=${2:-50000}
+ROUNDS=${3:-3}
+source "$(dirname "$0")/common.sh"
+
+# queens.tig indexes the second diagonals for N = 8
+sed -e "s/var N := 8/var N := $BOARD/" -e "s/+7-c/+N-1-c/g" "$BENCH_PATH/../testcase/queens.tig" >"$WORK/queens.tig"
+cp "$BENCH_PATH/../testcase/merge.tig" "$WORK/merge.tig"
+python3 - "$LENGTH" >"$WORK/merge.in" <<'PYTHON'
+import sys
+n = int(sys.argv[1])
+print(" ".join(str(2 * i + 1) for i in range(n)) + " ;")
+print(" ".join(str(2 * i) for i in range(n)) + " .")
+PYTHON
+: >"$WORK/queens.in"
+
+printf "%-10s %10s %10s %10s\n" program "compile" "native" "--vm"
+for name in queens merge
+do
+    src=$WORK/$name.tig
+    compile=$(best sh -c "'$TIGER' -c '$src' -x -o '$WORK/$name.o' && '$CC' -o '$WORK/$name' '$WORK/$name.o' '$RUNTIME' -lstdc++")
+    if [ ! -x "$WORK/$name" ] ||
+       ! cmp -s <("$WORK/$name" <"$WORK/$name.in") <("$TIGER" --vm "$src" <"$WORK/$name.in")
+    then
+        echo "$name: the interpreter's output differs from the native one"
+        continue
+    fi
+    printf "%-10s %10s %10s %10s\n" "$name" "$compile" "$(bestFrom "$WORK/$name.in" "$WORK/$name")" \
+        "$(bestFrom "$WORK/$name.in" "$TIGER" --vm "$src")"
+done
@@ -0,0 +1,116 @@
+#!/bin/bash
+# Compile functions with a very long sequence, a very long sum and a sum
+# nested as deep, so any pass that recurses once per element runs out of
+# stack, and run one with more frame variables than 16 bits count.
+# Usage: deep_test.sh [element count]
+
+TEST_PATH=$(cd "$(dirname "$0")" && pwd)
+TIGER=$TEST_PATH/../bin/tiger
+RUNTIME=$TEST_PATH/../bin/libtigerrt.a
+CC=${CC:-cc}
+COUNT=${1:-1000000}
+WIDTH=66000
+WORK=$(mktemp -d)
+FAILED=0
+
+echo "---- DEEP TREE TEST ($COUNT elements) ----"
+# A sequence of assignments and a sum of as many terms, each in a function
+# so they get a fragment
+awk -v n="$COUNT" 'BEGIN {
+    print "let var x := 0"
+    print "    function seq() ="
+    printf "        ("
+    for (i = 1; i < n; i++) printf "x := %d;\n", i
+    printf "x := %d)\n", n
+    print "in seq() end"
+}' >"$WORK/seq.tig"
+awk -v n="$COUNT" 'BEGIN {
+    print "let var x := 0"
+    print "    function sum() : int ="
+    printf "        x"
+    for (i = 1; i < n; i++) printf " + %d\n", i
+    print "in x := sum() end"
+}' >"$WORK/sum.tig"
+# The same sum nested the other way, 1 + (1 + (... + (1))), each level an
+# operator whose right operand is a parenthesized sequence
+awk -v n="$COUNT" 'BEGIN {
+    print "let var x := 0"
+    print "    function nest() : int ="
+    printf "        "
+    for (i = 1; i < n; i++) printf "1 + (\n"
+    printf "1"
+    for (i = 1; i < n; i++) printf ")"
+    print ""
+    print "in x := nest() end"
+}' >"$WORK/nest.tig"
+# As many variables holding a record, every one in the frame, which the
+# stack map lists while the loop collects and which are read after it. Each
+# shadows the one before, so looking a name up, which starts from the
+# latest, takes one step and the front end stays linear.
+awk -v n="$WIDTH" 'BEGIN {
+    print "let type cell = {value : int}"
+    print "    function wide(c : cell) : int ="
+    for (i = 0; i < n; i++) printf "        let var c := c in (\n"
+    print "        let var junk : cell := nil"
+    print "        in for i := 1 to 100000 do junk := cell {value = i}; 0"
+    print "        end"
+    for (i = 0; i < n; i++) printf ") + c.value end\n"
+    printf "in if wide(cell {value = 1}) = %d then print(\"ok\\n\") end\n", n
+}' >"$WORK/wide.tig"
+
+function check(){
+    local name=$1
+    shift
+    if ! "$TIGER" "$@" >/dev/null 2>"$WORK/err.log" || [ -s "$WORK/err.log" ]
+    then
+        echo -e "== Deep tree failed for [" $name "]\tFAILED =="
+        head -5 "$WORK/err.log"
+        FAILED=1
+    fi
+}
+
+function same(){
+    if ! cmp -s "$2" "$3"
+    then
+        echo -e "== Deep tree failed for [" $1 "]\tFAILED =="
+        FAILED=1
+    fi
+}
+
+# The text form indents every level of a tree, so a deep expression prints
+# quadratic text and only the flat canonical sequence is dumped as text
+check "seq text" -c "$WORK/seq.tig" -C -o "$WORK/seq.ir"
+check "seq binary" -c "$WORK/seq.tig" -b -o "$WORK/seq.tir"
+check "seq load" -l "$WORK/seq.tir" -C -o "$WORK/seq.loaded.ir"
+same "seq round trip" "$WORK/seq.ir" "$WORK/seq.loaded.ir"
+check "seq dot" -c "$WORK/seq.tig" -g -o "$WORK/seq.dot"
+check "seq linear" -c "$WORK/seq.tig" -L -o "$WORK/seq.lin"
+check "seq asm" -c "$WORK/seq.tig" -a -o "$WORK/seq.s"
+
+check "sum dot" -c "$WORK/sum.tig" -g -o "$WORK/sum.dot"
+check "sum canonical dot" -c "$WORK/sum.tig" -C -g -o "$WORK/sum.canon.dot"
+check "sum linear" -c "$WORK/sum.tig" -L -o "$WORK/sum.lin"
+check "sum asm" -c "$WORK/sum.tig" -a -o "$WORK/sum.s"
+check "sum binary" -c "$WORK/sum.tig" -b -o "$WORK/sum.tir"
+check "sum load" -l "$WORK/sum.tir" -g -o "$WORK/sum.loaded.dot"
+same "sum round trip" "$WORK/sum.dot" "$WORK/sum.loaded.dot"
+
+check "nest dot" -c "$WORK/nest.tig" -g -o "$WORK/nest.dot"
+check "nest canonical dot" -c "$WORK/nest.tig" -C -g -o "$WORK/nest.canon.dot"
+check "nest linear" -c "$WORK/nest.tig" -L -o "$WORK/nest.lin"
+check "nest asm" -c "$WORK/nest.tig" -a -o "$WORK/nest.s"
+check "nest binary" -c "$WORK/nest.tig" -b -o "$WORK/nest.tir"
+check "nest load" -l "$WORK/nest.tir" -g -o "$WORK/nest.loaded.dot"
+same "nest round trip" "$WORK/nest.dot" "$WORK/nest.loaded.dot"
+
+# A small nursery, so the loop collects many times
+check "wide asm" -c "$WORK/wide.tig" -a -O0 -o "$WORK/wide.s"
+if ! "$CC" -o "$WORK/wide" "$WORK/wide.s" "$RUNTIME" -lstdc++ 2>/dev/null ||
+   [ "$(TIGER_NURSERY=64 "$WORK/wide" </dev/null)" != "ok" ]
+then
+    echo -e "== Deep tree failed for [ wide run ]\tFAILED =="
+    FAILED=1
+fi
+rm -rf "$WORK"
+echo "---- DEEP TREE TEST COMPLETE ----"
+exit $FAILED
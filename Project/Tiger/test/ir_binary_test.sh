@@ -0,0 +1,28 @@
+#!/bin/bash
+# Write every test case as binary IR, read it back and check the text dump
+# matches the one printed straight from the source.
+
+TEST_PATH=$(cd "$(dirname "$0")" && pwd)
+TIGER=$TEST_PATH/../bin/tiger
+WORK=$(mktemp -d)
+FAILED=0
+
+echo "---- BINARY IR ROUND TRIP ----"
+for test_case in $(ls "$TEST_PATH/testcase")
+do
+    for canon in "" "-C"
+    do
+        src=$TEST_PATH/testcase/$test_case
+        "$TIGER" -c "$src" -o "$WORK/direct.ir" $canon >/dev/null 2>&1 || continue
+        "$TIGER" -c "$src" -o "$WORK/out.tir" -b $canon >/dev/null 2>&1
+        "$TIGER" -l "$WORK/out.tir" -o "$WORK/loaded.ir" >/dev/null 2>&1
+        if ! cmp -s "$WORK/direct.ir" "$WORK/loaded.ir"
+        then
+            echo -e "== Round trip failed for [" $test_case $canon "]\tFAILED =="
+            FAILED=1
+        fi
+    done
+done
+rm -rf "$WORK"
+echo "---- BINARY IR ROUND TRIP COMPLETE ----"
+exit $FAILED
@@ -0,0 +1,64 @@
+#!/bin/bash
+# Compile programs to assembly and to objects, link them against the
+# runtime library and check what they print, and what they print when
+# run in memory, when interpreted as bytecode and when built from C.
+
+TEST_PATH=$(cd "$(dirname "$0")" && pwd)
+TIGER=$TEST_PATH/../bin/tiger
+RUNTIME=$TEST_PATH/../bin/libtigerrt.a
+CC=${CC:-cc}
+WORK=$(mktemp -d)
+FAILED=0
+
+echo "---- NATIVE TEST ----"
+for src in "$TEST_PATH"/native/*.tig "$TEST_PATH/testcase/queens.tig"
+do
+    name=$(basename "$src" .tig)
+    if ! "$TIGER" -c "$src" -a -o "$WORK/$name.s" >/dev/null 2>"$WORK/err.log" || [ -s "$WORK/err.log" ] ||
+       ! "$CC" -o "$WORK/$name" "$WORK/$name.s" "$RUNTIME" -lstdc++ 2>>"$WORK/err.log"
+    then
+        echo -e "== Native build failed for [" $name "]\tFAILED =="
+        head -5 "$WORK/err.log"
+        FAILED=1
+        continue
+    fi
+    if ! "$WORK/$name" </dev/null | cmp -s - "$TEST_PATH/native/$name.out"
+    then
+        echo -e "== Native output differs for [" $name "]\tFAILED =="
+        FAILED=1
+    fi
+    # The object written without as must hold the same code
+    if ! "$TIGER" -c "$src" -x -o "$WORK/$name.o" >/dev/null 2>"$WORK/err.log" || [ -s "$WORK/err.log" ] ||
+       ! "$CC" -o "$WORK/$name.elf" "$WORK/$name.o" "$RUNTIME" -lstdc++ 2>>"$WORK/err.log" ||
+       ! "$WORK/$name.elf" </dev/null | cmp -s - "$TEST_PATH/native/$name.out"
+    then
+        echo -e "== Native object failed for [" $name "]\tFAILED =="
+        head -5 "$WORK/err.log"
+        FAILED=1
+    fi
+    if ! "$TIGER" --run "$src" </dev/null 2>"$WORK/err.log" | cmp -s - "$TEST_PATH/native/$name.out" ||
+       [ -s "$WORK/err.log" ]
+    then
+        echo -e "== Native run failed for [" $name "]\tFAILED =="
+        head -5 "$WORK/err.log"
+        FAILED=1
+    fi
+    if ! "$TIGER" --vm "$src" </dev/null 2>"$WORK/err.log" | cmp -s - "$TEST_PATH/native/$name.out" ||
+       [ -s "$WORK/err.log" ]
+    then
+        echo -e "== Bytecode run failed for [" $name "]\tFAILED =="
+        head -5 "$WORK/err.log"
+        FAILED=1
+    fi
+    if ! "$TIGER" -c "$src" -e -o "$WORK/$name.c" >/dev/null 2>"$WORK/err.log" || [ -s "$WORK/err.log" ] ||
+       ! "$CC" -O2 -o "$WORK/$name.cbin" "$WORK/$name.c" 2>>"$WORK/err.log" ||
+       ! "$WORK/$name.cbin" </dev/null | cmp -s - "$TEST_PATH/native/$name.out"
+    then
+        echo -e "== C source failed for [" $name "]\tFAILED =="
+        head -5 "$WORK/err.log"
+        FAILED=1
+    fi
+done
+rm -rf "$WORK"
+echo "---- NATIVE TEST COMPLETE ----"
+exit $FAILED